@@ -24,12 +24,14 @@ file(GLOB donut_core_src
     include/donut/core/chunk/*.h
     include/donut/core/math/*.h
     include/donut/core/vfs/Compression.h
+    include/donut/core/vfs/PackageFile.h
     include/donut/core/vfs/TarFile.h
     include/donut/core/vfs/VFS.h
     include/donut/core/*.h
     src/core/chunk/*.cpp
     src/core/math/*.cpp
     src/core/vfs/Compression.cpp
+    src/core/vfs/PackageFile.cpp
     src/core/vfs/TarFile.cpp
     src/core/vfs/VFS.cpp
     src/core/*.cpp
@@ -51,11 +53,29 @@ if(WIN32)
     target_compile_definitions(donut_core PUBLIC NOMINMAX _CRT_SECURE_NO_WARNINGS)
 endif()
 
+if(DONUT_WITH_IO_URING)
+    target_sources(donut_core PRIVATE
+        src/core/vfs/IoUringReader.h
+        src/core/vfs/IoUringReader.cpp
+    )
+    target_compile_definitions(donut_core PUBLIC DONUT_WITH_IO_URING)
+endif()
+
 if(DONUT_WITH_LZ4)
     target_link_libraries(donut_core lz4)
     target_compile_definitions(donut_core PUBLIC DONUT_WITH_LZ4)
 endif()
 
+if(DONUT_WITH_ZSTD)
+    target_link_libraries(donut_core zstd)
+    target_compile_definitions(donut_core PUBLIC DONUT_WITH_ZSTD)
+endif()
+
+if(DONUT_WITH_TASKFLOW)
+    target_link_libraries(donut_core taskflow)
+    target_compile_definitions(donut_core PUBLIC DONUT_WITH_TASKFLOW)
+endif()
+
 if(DONUT_WITH_MINIZ)
     target_link_libraries(donut_core miniz)
     target_sources(donut_core PRIVATE
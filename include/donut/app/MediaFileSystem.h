@@ -26,6 +26,7 @@
 
 #include <filesystem>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace donut::app
@@ -51,6 +52,10 @@ namespace donut::app
 	//        2. search package files in descending lexical order
 	//           (ex. zap.db => pack2.db => pack1.db => abc.db)
 	//
+	//   * the file lists of all packages are merged into a single hash index on
+	//     creation, so that finding a file in the packages is one lookup instead
+	//     of a search through every package
+	//
 	// note: MediaFileSystem can be mounted under a RootFileSytem
 	//
 	class MediaFileSystem : public vfs::IFileSystem
@@ -69,11 +74,21 @@ namespace donut::app
 		bool folderExists(const std::filesystem::path& name) override;
 		bool fileExists(const std::filesystem::path& name) override;
 		std::shared_ptr<vfs::IBlob> readFile(const std::filesystem::path& name) override;
+		std::shared_ptr<vfs::IBlob> readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size) override;
 		bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
 		int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, vfs::enumerate_callback_t callback, bool allowDuplicates = false) override;
 		int enumerateDirectories(const std::filesystem::path& path, vfs::enumerate_callback_t callback, bool allowDuplicates = false) override;
+		void readFileAsync(const std::filesystem::path& name, vfs::read_callback_t callback) override;
+		void readFilesAsync(std::vector<vfs::ReadRequest> requests) override;
 
 	private:
+		// the media folder at index 0, followed by the packages in search order
 		std::vector<std::shared_ptr<vfs::IFileSystem>> m_FileSystems;
+
+		// normalized file name => index of the first package in m_FileSystems containing it
+		std::unordered_map<std::string, size_t> m_PackageIndex;
+
+		void AddPackage(std::shared_ptr<vfs::IFileSystem> fs, const std::vector<std::string>& files, bool compressed);
+		vfs::IFileSystem* FindPackage(const std::filesystem::path& name) const;
 	};
 } // end namespace donut::app
\ No newline at end of file
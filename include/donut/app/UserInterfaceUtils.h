@@ -32,6 +32,7 @@ namespace donut::engine
     class DirectionalLight;
     class PointLight;
     class SpotLight;
+    class Profiler;
 }
 
 namespace donut::app
@@ -47,4 +48,8 @@ namespace donut::app
     bool LightEditor(engine::Light& light);
 
     bool AzimuthElevationSliders(math::double3& direction, bool negative = false);
+
+    // Draws the profiler controls and statistics into the current window:
+    // the frame time graph and a table of the CPU and GPU zones.
+    void ProfilerOverlay(engine::Profiler& profiler);
 }
@@ -0,0 +1,169 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace donut::core
+{
+
+	// Hash map for concurrent access, split into independently locked shards
+	//
+	// Each key maps to one shard by its hash, so threads working on different
+	// keys rarely contend on the same lock. Lookups take a shared lock on one
+	// shard, insertions an exclusive lock on one shard.
+	//
+	// Iteration goes through snapshot(), which copies the entries shard by shard
+	// and never holds more than one lock: writers are only blocked for the time
+	// it takes to copy one shard, and the snapshot is not a consistent view of
+	// concurrent modifications.
+
+	template<typename Key, typename Value, size_t ShardCount = 32, typename Hash = std::hash<Key>> class sharded_map
+	{
+	public:
+
+		typedef std::pair<Key, Value> value_type;
+
+		// returns the value for the key, or a default-constructed value if not found
+		Value find(Key const& key) const
+		{
+			shard const& s = get_shard(key);
+			std::shared_lock<std::shared_mutex> lock(s.mutex);
+			auto it = s.map.find(key);
+			return it != s.map.end() ? it->second : Value();
+		}
+
+		bool contains(Key const& key) const
+		{
+			shard const& s = get_shard(key);
+			std::shared_lock<std::shared_mutex> lock(s.mutex);
+			return s.map.find(key) != s.map.end();
+		}
+
+		// returns the existing value for the key and false, or inserts the value returned
+		// by 'create' and returns it and true; 'create' is called under the shard lock
+		template<typename Create> std::pair<Value, bool> find_or_insert(Key const& key, Create&& create)
+		{
+			shard& s = get_shard(key);
+
+			{
+				std::shared_lock<std::shared_mutex> lock(s.mutex);
+				auto it = s.map.find(key);
+				if (it != s.map.end())
+					return { it->second, false };
+			}
+
+			std::unique_lock<std::shared_mutex> lock(s.mutex);
+			auto [it, inserted] = s.map.try_emplace(key);
+			if (inserted)
+				it->second = create();
+			return { it->second, inserted };
+		}
+
+		void insert_or_assign(Key const& key, Value const& value)
+		{
+			shard& s = get_shard(key);
+			std::unique_lock<std::shared_mutex> lock(s.mutex);
+			s.map.insert_or_assign(key, value);
+		}
+
+		// returns true and the removed value if the key was present
+		bool erase(Key const& key, Value* erased = nullptr)
+		{
+			shard& s = get_shard(key);
+			std::unique_lock<std::shared_mutex> lock(s.mutex);
+			auto it = s.map.find(key);
+			if (it == s.map.end())
+				return false;
+			if (erased)
+				*erased = std::move(it->second);
+			s.map.erase(it);
+			return true;
+		}
+
+		void clear()
+		{
+			for (shard& s : _shards)
+			{
+				std::unique_lock<std::shared_mutex> lock(s.mutex);
+				s.map.clear();
+			}
+		}
+
+		std::size_t size() const
+		{
+			std::size_t count = 0;
+			for (shard const& s : _shards)
+			{
+				std::shared_lock<std::shared_mutex> lock(s.mutex);
+				count += s.map.size();
+			}
+			return count;
+		}
+
+		bool empty() const { return size() == 0; }
+
+		std::vector<value_type> snapshot() const
+		{
+			std::vector<value_type> entries;
+			for (shard const& s : _shards)
+			{
+				std::shared_lock<std::shared_mutex> lock(s.mutex);
+				entries.insert(entries.end(), s.map.begin(), s.map.end());
+			}
+			return entries;
+		}
+
+		static constexpr std::size_t shard_count() { return ShardCount; }
+
+	private:
+
+		// padded to a cache line to avoid false sharing between the locks of neighboring shards
+		struct alignas(64) shard
+		{
+			mutable std::shared_mutex mutex;
+			std::unordered_map<Key, Value, Hash> map;
+		};
+
+		shard& get_shard(Key const& key) { return _shards[shard_index(key)]; }
+		shard const& get_shard(Key const& key) const { return _shards[shard_index(key)]; }
+
+		static std::size_t shard_index(Key const& key)
+		{
+			// mix the upper bits in, std::hash of integers is often the identity
+			std::size_t h = Hash()(key);
+			h ^= h >> 17;
+			h *= 0xed5ad4bbu;
+			h ^= h >> 11;
+			return h % ShardCount;
+		}
+
+		std::array<shard, ShardCount> _shards;
+	};
+}
@@ -23,27 +23,69 @@
 #pragma once
 
 #include <donut/core/vfs/VFS.h>
+#include <shared_mutex>
+#include <unordered_map>
 #include <utility>
 
+#ifdef DONUT_WITH_TASKFLOW
+namespace tf
+{
+    class Executor;
+}
+#endif
+
+#ifdef DONUT_WITH_ZSTD
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+#endif
+
 namespace donut::vfs
 {
+    enum class CompressionFormat : uint8_t
+    {
+        None = 0,
+        LZ4 = 1,
+        Zstd = 2
+    };
+
     /* 
     Transparent compression and decompression layer for the virtual file system.
-    Currently, it only supports LZ4 frame compression.
+    Supports LZ4 frame compression (.lz4 files, DONUT_WITH_LZ4) and
+    Zstandard compression (.zst files, DONUT_WITH_ZSTD).
 
     Behavior:
     
-    The readFile function tries to read the file with an extra '.lz4' extension
-    appended first. If such file exists, it will be decompressed and returned.
-    If no .lz4 file exists, the compression layer will read and return the file
-    with the exact name requested.
+    The readFile function tries to read the file with an extra '.zst' or '.lz4' extension
+    appended first, in that order. If such file exists, it will be decompressed and returned.
+    If no compressed file exists, the compression layer will read and return the file
+    with the exact name requested. The format found for each name is remembered in a lookup
+    cache, so that subsequent reads of the same file do not probe for the other versions again.
+    Writing a file through the layer, compressed or not, updates the cache entry so that
+    subsequent reads return the version that was written last; external modifications of the underlying file system require a call to clearLookupCache().
+    Asynchronous reads pick the version to read with fileExists queries, pass the reads on to
+    the underlying file system as one batch, and decompress the results when they arrive.
+    The readFileRange function passes range reads of uncompressed files on to the underlying
+    file system and fails with an error for compressed files, which would have to be
+    decompressed entirely to extract the range.
 
     The writeFile function will compress the input data if the provided file name
-    has an '.lz4' extension. If no such extension is present, the file will be 
-    written uncompressed.
+    has an '.lz4' or '.zst' extension. If no such extension is present, the file will be 
+    written uncompressed. When independent blocks are enabled with setIndependentBlocks,
+    the LZ4 frames are written with LZ4F_blockIndependent mode and the content size stored.
+
+    Zstandard dictionaries improve the compression ratio of many small, similar files,
+    such as shaders or materials. Dictionaries are registered with addZstdDictionary, and
+    compressed frames refer to their dictionary by ID. A dictionary can be trained with
+    'zstd --train' or with the '--dictionary' option of 'scripts/lz4_tar.py'.
+
+    Frames with independent blocks and a known content size can be decompressed
+    block-parallel. When an executor is provided with setParallelDecompression, files
+    whose decompressed size is at least 'minParallelSize' bytes are split into blocks
+    and decoded by the executor's worker threads, with the calling thread participating.
+    All other frames are decompressed sequentially on the calling thread.
 
     The enumerateFiles function will search for files with the requested extensions
-    and with extra '.lz4' extensions. The .lz4 extensions will be removed from 
+    and with extra '.lz4' and '.zst' extensions. These extensions will be removed from 
     the returned file names and de-duplicated in case the same file exists in both
     compressed and uncompressed forms.
 
@@ -62,19 +104,80 @@ namespace donut::vfs
     private:
         std::shared_ptr<IFileSystem> m_fs;
         int m_CompressionLevel = 5;
+        bool m_IndependentBlocks = false;
+
+        std::unordered_map<std::string, CompressionFormat> m_KnownFormats;
+        std::shared_mutex m_KnownFormatsMutex;
+
+#ifdef DONUT_WITH_TASKFLOW
+        tf::Executor* m_Executor = nullptr;
+#endif
+        size_t m_MinParallelSize = 0;
+
+#ifdef DONUT_WITH_ZSTD
+        int m_ZstdCompressionLevel = 19;
+        ZSTD_CDict_s* m_ZstdCompressionDictionary = nullptr;
+        std::unordered_map<uint32_t, ZSTD_DDict_s*> m_ZstdDecompressionDictionaries;
+        std::shared_mutex m_ZstdDictionariesMutex;
+#endif
+
+        bool findKnownFormat(const std::string& name, CompressionFormat& format);
+        void setKnownFormat(const std::string& name, CompressionFormat format);
+        void forgetKnownFormat(const std::string& name);
+        CompressionFormat probeFormat(const std::filesystem::path& name);
+
+        std::shared_ptr<IBlob> decompressLZ4(const std::filesystem::path& name, const std::shared_ptr<IBlob>& compressedBlob);
+        std::shared_ptr<IBlob> decompressZstd(const std::filesystem::path& name, const std::shared_ptr<IBlob>& compressedBlob);
+        bool compressLZ4(const std::filesystem::path& name, const void* data, size_t size);
+        bool compressZstd(const std::filesystem::path& name, const void* data, size_t size);
 
     public:
         explicit CompressionLayer(std::shared_ptr<IFileSystem> fs)
             : m_fs(std::move(fs))
         { }
 
+        ~CompressionLayer() override;
+
+        // Sets the LZ4 compression level used when writing .lz4 files.
         void setCompressionLevel(int level) { m_CompressionLevel = level; }
+
+        // Enables writing frames with independent blocks, which can be decompressed in parallel.
+        void setIndependentBlocks(bool enable) { m_IndependentBlocks = enable; }
+
+#ifdef DONUT_WITH_TASKFLOW
+        // Enables block-parallel decompression of frames with independent blocks
+        // whose decompressed size is at least 'minParallelSize' bytes.
+        // Files read with readFileAsync are also decompressed on this executor.
+        // Pass a null executor to disable parallel decompression.
+        void setParallelDecompression(tf::Executor* executor, size_t minParallelSize = 1024 * 1024)
+        {
+            m_Executor = executor;
+            m_MinParallelSize = minParallelSize;
+        }
+#endif
+
+#ifdef DONUT_WITH_ZSTD
+        // Sets the Zstandard compression level used when writing .zst files, 1-22.
+        // The compression dictionary, if any, keeps the level that was current when it was added.
+        void setZstdCompressionLevel(int level) { m_ZstdCompressionLevel = level; }
+
+        // Registers a Zstandard dictionary. Frames that reference the dictionary's ID are decompressed with it.
+        // If 'useForCompression' is true, subsequently written .zst files are compressed with this dictionary.
+        // Returns false if the data is not a valid dictionary with a nonzero ID.
+        bool addZstdDictionary(const void* data, size_t size, bool useForCompression = false);
+#endif
+
+        // Forgets which format was found for each file name.
+        void clearLookupCache();
         
         bool folderExists(const std::filesystem::path& name) override;
         bool fileExists(const std::filesystem::path& name) override;
         std::shared_ptr<IBlob> readFile(const std::filesystem::path& name) override;
+        std::shared_ptr<IBlob> readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size) override;
         bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
         int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates = false) override;
         int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) override;
+        void readFileAsync(const std::filesystem::path& name, read_callback_t callback) override;
+        void readFilesAsync(std::vector<ReadRequest> requests) override;
     };
 }
@@ -0,0 +1,174 @@
+/*
+* Copyright (c) 2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/vfs/Compression.h>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+
+namespace donut::vfs
+{
+    /*
+    Donut package (.dpk) file layout. All values are little-endian.
+
+        PackageHeader
+        PackageEntry[entryCount]
+        uint32_t[hashTableSize]     - entry indices, open addressing with linear probing
+        char[stringsSize]           - entry names, not null-terminated
+        padding to PackageAlignment
+        payloads, each starting at a multiple of PackageAlignment
+
+    Everything before 'dataOffset' is the table of contents, which is loaded with a single
+    read when the package is opened. Names are stored normalized, i.e. relative, with forward
+    slashes, and without the compression extension; the compression format of each payload
+    is stored in the entry instead.
+    */
+    constexpr uint32_t PackageMagic = 0x474b5044; // 'DPKG'
+    constexpr uint32_t PackageVersion = 1;
+    constexpr uint64_t PackageAlignment = 4096;
+    constexpr uint32_t PackageEmptySlot = ~0u;
+
+    struct PackageHeader
+    {
+        uint32_t magic = PackageMagic;
+        uint32_t version = PackageVersion;
+        uint32_t entryCount = 0;
+        uint32_t hashTableSize = 0; // power of 2, or 0 for an empty package
+        uint64_t entriesOffset = 0;
+        uint64_t hashTableOffset = 0;
+        uint64_t stringsOffset = 0;
+        uint64_t stringsSize = 0;
+        uint64_t dataOffset = 0;
+        uint64_t reserved = 0;
+    };
+
+    struct PackageEntry
+    {
+        uint64_t nameHash = 0;
+        uint64_t offset = 0;            // multiple of PackageAlignment
+        uint64_t storedSize = 0;        // size of the payload in the package
+        uint64_t size = 0;              // size of the decompressed data, 0 if unknown
+        uint32_t nameOffset = 0;        // in the string table
+        uint16_t nameLength = 0;
+        CompressionFormat compression = CompressionFormat::None;
+        uint8_t reserved = 0;
+    };
+
+    static_assert(sizeof(PackageHeader) == 64);
+    static_assert(sizeof(PackageEntry) == 40);
+
+    // 64-bit FNV-1a hash of a normalized entry name.
+    [[nodiscard]] uint64_t getPackageNameHash(std::string_view name);
+
+    /*
+    A read-only file system that provides access to files in a Donut package.
+    Lookups go through the hash table stored in the package and do not touch the disk;
+    reading a file, or a range of it, is a single seek and read of its payload.
+
+    Compressed entries are exposed with their compression extension appended, i.e. an
+    LZ4-compressed entry 'textures/a.png' is visible as 'textures/a.png.lz4', the same way
+    as in a tar archive made by 'scripts/lz4_tar.py'. Mount the package under a
+    CompressionLayer to access the decompressed data by the original name.
+
+    Packages are made with PackageWriter, or converted from tar and zip archives with
+    'scripts/make_package.py'.
+    */
+    class PackageFile : public IFileSystem
+    {
+    private:
+        std::string m_PackagePath;
+        std::mutex m_Mutex;
+        FILE* m_PackageFile = nullptr;
+
+        std::vector<uint8_t> m_TableOfContents;
+        const PackageEntry* m_Entries = nullptr;
+        const uint32_t* m_HashTable = nullptr;
+        const char* m_Strings = nullptr;
+        uint32_t m_EntryCount = 0;
+        uint32_t m_HashTableSize = 0;
+
+        // directories are only needed for enumeration, so they are collected on first use
+        std::once_flag m_DirectoriesFlag;
+        std::unordered_set<std::string> m_Directories;
+
+        bool loadTableOfContents();
+        const std::unordered_set<std::string>& getDirectories();
+        [[nodiscard]] std::string_view getEntryName(const PackageEntry& entry) const;
+        [[nodiscard]] std::string getVisibleName(const PackageEntry& entry) const;
+        [[nodiscard]] const PackageEntry* findVisibleEntry(const std::filesystem::path& name) const;
+
+    public:
+        PackageFile(const std::filesystem::path& packagePath);
+        ~PackageFile() override;
+
+        [[nodiscard]] bool isOpen() const;
+
+        // Returns the entry with the given normalized name, without the compression extension,
+        // or nullptr if there is no such entry.
+        [[nodiscard]] const PackageEntry* findEntry(std::string_view normalizedName) const;
+
+        // Calls the callback with the full path of every file, as visible through readFile.
+        void enumerateAllFiles(enumerate_callback_t callback) const;
+
+        bool folderExists(const std::filesystem::path& name) override;
+        bool fileExists(const std::filesystem::path& name) override;
+        std::shared_ptr<IBlob> readFile(const std::filesystem::path& name) override;
+        std::shared_ptr<IBlob> readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size) override;
+        bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
+        int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates = false) override;
+        int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) override;
+    };
+
+    /*
+    Builds a Donut package from a set of files.
+    Files with an '.lz4' or '.zst' extension are stored as compressed entries under the name
+    without the extension, with their payloads kept as-is. The payload data is retained in
+    memory until write is called.
+    */
+    class PackageWriter
+    {
+    private:
+        struct PendingFile
+        {
+            std::string name;
+            std::shared_ptr<IBlob> data;
+            CompressionFormat compression = CompressionFormat::None;
+        };
+
+        std::vector<PendingFile> m_Files;
+        std::unordered_set<std::string> m_Names;
+
+    public:
+        // Adds one file to the package. Returns false if the name is empty or already used.
+        bool addFile(const std::filesystem::path& name, std::shared_ptr<IBlob> data);
+
+        // Adds all files from 'fs' that are listed in 'names', such as the output of
+        // enumerateAllFiles of a TarFile. Returns the number of files added.
+        int addFiles(IFileSystem& fs, const std::vector<std::string>& names);
+
+        // Writes the package into a native file.
+        bool write(const std::filesystem::path& packagePath) const;
+    };
+}
@@ -24,8 +24,11 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <filesystem>
 #include <functional>
+#include <future>
+#include <mutex>
 #include <vector>
 
 /* 
@@ -52,6 +55,18 @@ namespace donut::vfs
         return [&v](std::string_view s) { v.push_back(std::string(s)); };
     }
 
+    class IBlob;
+
+    // Receives the result of an asynchronous read: the file contents, or nullptr if the file cannot be read.
+    typedef std::function<void(std::shared_ptr<IBlob>)> read_callback_t;
+
+    // One request in a batch of asynchronous reads.
+    struct ReadRequest
+    {
+        std::filesystem::path name;
+        read_callback_t callback;
+    };
+
     // A blob is a package for untyped data, typically read from a file.
     class IBlob
     {
@@ -99,6 +114,11 @@ namespace donut::vfs
         // Returns nullptr if the file cannot be read.
         virtual std::shared_ptr<IBlob> readFile(const std::filesystem::path& name) = 0;
 
+        // Read 'size' bytes of the file starting at 'offset'.
+        // Returns nullptr if the file cannot be read or the range extends past the end of the file.
+        // The default implementation reads the entire file and copies the range.
+        virtual std::shared_ptr<IBlob> readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size);
+
         // Write the entire file.
         // Returns false if the file cannot be written.
         virtual bool writeFile(const std::filesystem::path& name, const void* data, size_t size) = 0;
@@ -113,18 +133,56 @@ namespace donut::vfs
         // Returns the number of directories found, or a negative number on errors - see donut::vfs::status.
         // The directory names, relative to the 'path', are passed to 'callback' in no particular order.
         virtual int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) = 0;
+
+        // Start reading the entire file asynchronously.
+        // The callback is called exactly once with the result of readFile, either before this function
+        // returns or later from another thread. Callbacks may run on a thread that completes other reads,
+        // so any expensive processing such as decoding should be handed off to a worker thread.
+        // The default implementation calls readFile and then the callback on the calling thread.
+        virtual void readFileAsync(const std::filesystem::path& name, read_callback_t callback);
+
+        // Start reading a batch of files asynchronously, see readFileAsync.
+        // Implementations may submit the whole batch to the OS at once.
+        // The default implementation calls readFileAsync for each request.
+        virtual void readFilesAsync(std::vector<ReadRequest> requests);
+
+        // Start reading the entire file asynchronously and return a future for the result.
+        std::future<std::shared_ptr<IBlob>> readFileFuture(const std::filesystem::path& name);
     };
 
+#ifdef DONUT_WITH_IO_URING
+    class IoUringReader;
+#endif
+
     // An implementation of virtual file system that directly maps to the OS files.
+    // With DONUT_WITH_IO_URING, asynchronous reads are submitted through an io_uring instance
+    // that is created on first use, and fall back to synchronous reads if io_uring is unavailable.
     class NativeFileSystem : public IFileSystem
     {
+#ifdef DONUT_WITH_IO_URING
+    private:
+        std::once_flag m_AsyncReaderFlag;
+        std::unique_ptr<IoUringReader> m_AsyncReader;
+
+        IoUringReader* getAsyncReader();
+#endif
     public:
+        NativeFileSystem();
+        ~NativeFileSystem() override;
+
 		bool folderExists(const std::filesystem::path& name) override;
         bool fileExists(const std::filesystem::path& name) override;
         std::shared_ptr<IBlob> readFile(const std::filesystem::path& name) override;
+        std::shared_ptr<IBlob> readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size) override;
         bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
         int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates = false) override;
         int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) override;
+        void readFileAsync(const std::filesystem::path& name, read_callback_t callback) override;
+        void readFilesAsync(std::vector<ReadRequest> requests) override;
+
+        // Map the entire file into memory, read-only. The mapping lives as long as the returned blob.
+        // Returns nullptr if the file cannot be mapped, which includes empty files.
+        std::shared_ptr<IBlob> mapFile(const std::filesystem::path& name);
     };
 
     // A layer that represents some path in the underlying file system as an entire FS.
@@ -135,6 +193,9 @@ namespace donut::vfs
     private:
         std::shared_ptr<IFileSystem> m_UnderlyingFS;
         std::filesystem::path m_BasePath;
+        std::filesystem::path::string_type m_BasePrefix; // m_BasePath with a trailing separator
+
+        [[nodiscard]] std::filesystem::path getUnderlyingPath(const std::filesystem::path& name) const;
     public:
         RelativeFileSystem(std::shared_ptr<IFileSystem> fs, const std::filesystem::path& basePath);
 
@@ -143,20 +204,40 @@ namespace donut::vfs
         bool folderExists(const std::filesystem::path& name) override;
         bool fileExists(const std::filesystem::path& name) override;
         std::shared_ptr<IBlob> readFile(const std::filesystem::path& name) override;
+        std::shared_ptr<IBlob> readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size) override;
         bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
         int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates = false) override;
         int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) override;
+        void readFileAsync(const std::filesystem::path& name, read_callback_t callback) override;
+        void readFilesAsync(std::vector<ReadRequest> requests) override;
     };
 
     // A virtual file system that allows mounting, or attaching, other VFS objects to paths.
     // Does not have any file systems by default, all of them must be mounted first.
+    // Mount points are stored in a trie of normalized path components. The results of recent
+    // lookups are kept in a small per-thread cache keyed by the path as passed by the caller,
+    // which avoids normalizing the paths of frequently used files on every request.
+    // Mounting and unmounting invalidate the caches, and must not run concurrently with other calls.
     class RootFileSystem : public IFileSystem
     {
     private:
-        std::vector<std::pair<std::string, std::shared_ptr<IFileSystem>>> m_MountPoints;
+        struct MountNode
+        {
+            std::string name;
+            std::shared_ptr<IFileSystem> fs;
+            std::vector<std::unique_ptr<MountNode>> children;
+
+            [[nodiscard]] MountNode* findChild(std::string_view childName) const;
+        };
 
+        MountNode m_MountRoot;
+        uint64_t m_MountGeneration = 0;
+
+        MountNode* findMountNode(const std::string& normalizedPath, size_t* pRelativePathStart);
         bool findMountPoint(const std::filesystem::path& path, std::filesystem::path* pRelativePath, IFileSystem** ppFS);
     public:
+        RootFileSystem();
+
         void mount(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs);
         void mount(const std::filesystem::path& path, const std::filesystem::path& nativePath);
         bool unmount(const std::filesystem::path& path);
@@ -164,9 +245,12 @@ namespace donut::vfs
 		bool folderExists(const std::filesystem::path& name) override;
         bool fileExists(const std::filesystem::path& name) override;
         std::shared_ptr<IBlob> readFile(const std::filesystem::path& name) override;
+        std::shared_ptr<IBlob> readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size) override;
         bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
         int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates = false) override;
         int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) override;
+        void readFileAsync(const std::filesystem::path& name, read_callback_t callback) override;
+        void readFilesAsync(std::vector<ReadRequest> requests) override;
     };
 
     std::string getFileSearchRegex(const std::filesystem::path& path, const std::vector<std::string>& extensions);
@@ -58,6 +58,9 @@ namespace donut::vfs
         ~ZipFile() override;
 
         [[nodiscard]] bool isOpen() const;
+
+        // Calls the callback with the full path of every file in the archive.
+        void enumerateAllFiles(enumerate_callback_t callback) const;
         
         bool folderExists(const std::filesystem::path& name) override;
         bool fileExists(const std::filesystem::path& name) override;
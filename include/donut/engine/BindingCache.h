@@ -23,8 +23,11 @@
 #pragma once
 
 #include <nvrhi/nvrhi.h>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 #include <shared_mutex>
+#include <vector>
 
 namespace donut::engine
 {
@@ -32,26 +35,80 @@ namespace donut::engine
     BindingCache maintains a dictionary that maps binding set descriptors
     into actual binding set objects. The binding sets are created on demand when 
     GetOrCreateBindingSet(...) is called and the requested binding set does not exist.
-    Created binding sets are stored for the lifetime of BindingCache, or until
-    Clear() is called.
+
+    Entries are matched by the full descriptor and layout, the hash is only used
+    to find the bucket. Each entry is stamped with the frame it was last used in.
+    By default, the cache is unbounded and keeps every binding set until Clear()
+    is called. Owners that call AdvanceFrame() once per frame can limit it:
+    with a maximum age, entries that were not used for that many frames are dropped,
+    which releases the render targets of previous resolutions after a resize;
+    with a capacity, the least recently used entries are evicted when the number
+    of entries exceeds it. Binding sets hold references to their resources, so
+    Invalidate(...) drops the sets that keep a released texture or buffer alive.
     
     All BindingCache methods are thread-safe.
     */
     class BindingCache
     {
+    public:
+        struct Statistics
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            size_t size = 0;
+        };
+
     private:
+        struct Entry
+        {
+            nvrhi::BindingSetDesc desc;
+            nvrhi::IBindingLayout* layout = nullptr;
+            nvrhi::BindingSetHandle bindingSet;
+            std::atomic<uint64_t> lastUsedFrame = 0;
+        };
+
         nvrhi::DeviceHandle m_Device;
-        std::unordered_map<size_t, nvrhi::BindingSetHandle> m_BindingSets;
+        std::unordered_map<size_t, std::vector<std::unique_ptr<Entry>>> m_BindingSets;
         std::shared_mutex m_Mutex;
+        size_t m_Capacity;
+        uint64_t m_MaxAge;
+        size_t m_NumEntries = 0;
+        std::atomic<uint64_t> m_CurrentFrame = 0;
+
+        std::atomic<uint64_t> m_Hits = 0;
+        std::atomic<uint64_t> m_Misses = 0;
+        std::atomic<uint64_t> m_Evictions = 0;
+
+        static size_t ComputeHash(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout);
+        Entry* FindEntry(size_t hash, const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout);
+        void EvictLeastRecentlyUsed();
+        void EvictUnusedSince(uint64_t frame);
 
     public:
-        BindingCache(nvrhi::IDevice* device)
+        // capacity = 0 means the number of entries is unbounded,
+        // maxAge = 0 means entries are kept regardless of when they were last used
+        BindingCache(nvrhi::IDevice* device, size_t capacity = 0, uint64_t maxAge = 0)
             : m_Device(device)
+            , m_Capacity(capacity)
+            , m_MaxAge(maxAge)
         { }
 
         nvrhi::BindingSetHandle GetCachedBindingSet(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout);
         nvrhi::BindingSetHandle GetOrCreateBindingSet(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout);
+
+        // Removes all binding sets that reference the given resource or use it as their layout.
+        void Invalidate(nvrhi::IResource* resource);
         void Clear();
+
+        // Starts a new frame for the last-used stamps and drops the entries older than the maximum age.
+        void AdvanceFrame();
+
+        void SetCapacity(size_t capacity);
+        size_t GetCapacity() const { return m_Capacity; }
+
+        Statistics GetStatistics();
+        void ResetStatistics();
     };
 
 }
@@ -86,6 +86,9 @@ namespace donut::engine
         };
 
         std::unordered_map<PsoCacheKey, nvrhi::GraphicsPipelineHandle, PsoCacheKey::Hash> m_BlitPsoCache;
+
+        nvrhi::ComputePipelineHandle m_GenerateMipsPso;
+        nvrhi::BufferHandle m_GenerateMipsCounters;
         
     public:
         nvrhi::ShaderHandle m_FullscreenVS;
@@ -108,7 +111,10 @@ namespace donut::engine
         nvrhi::SamplerHandle m_LinearWrapSampler;
         nvrhi::SamplerHandle m_AnisotropicWrapSampler;
 
+        nvrhi::ShaderHandle m_GenerateMipsCS;
+
         nvrhi::BindingLayoutHandle m_BlitBindingLayout;
+        nvrhi::BindingLayoutHandle m_GenerateMipsBindingLayout;
         
         CommonRenderPasses(nvrhi::IDevice* device, std::shared_ptr<ShaderFactory> shaderFactory);
         
@@ -116,6 +122,14 @@ namespace donut::engine
 
         // Simplified form of BlitTexture that blits the entire source texture, mip 0 slice 0, into the entire target framebuffer using a linear sampler.
         void BlitTexture(nvrhi::ICommandList* commandList, nvrhi::IFramebuffer* targetFramebuffer, nvrhi::ITexture* sourceTexture, BindingCache* bindingCache = nullptr);
+
+        // Tests if GenerateMips can write mip levels of the given format, i.e. if its UAV format supports typed stores.
+        bool SupportsGenerateMips(nvrhi::Format format) const;
+
+        // Fills mip levels (sourceMip + 1) to the last one of every array slice of a 2D, 2D array or cube texture
+        // with a single-pass compute downsampler that handles 12 levels per dispatch. sRGB textures are filtered in linear space.
+        // The texture must have been created with isUAV, and also with isTypeless if its format is sRGB.
+        void GenerateMips(nvrhi::ICommandList* commandList, nvrhi::ITexture* texture, uint32_t sourceMip = 0, BindingCache* bindingCache = nullptr);
     };
 
 }
\ No newline at end of file
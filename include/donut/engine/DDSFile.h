@@ -38,8 +38,24 @@ namespace donut::engine
     // Initialized the TextureInfo from the 'data' array, which must be populated with DDS data
     bool LoadDDSTextureFromMemory(TextureData& textureInfo);
 
+    // Parses and validates only the DDS headers in 'data', which may be just the beginning of the file,
+    // and fills the dimensions, format and subresource layout of 'textureInfo' without touching the payload.
+    // Returns the size of the complete DDS file, or 0 if the headers are invalid.
+    size_t ReadDDSHeader(const void* data, size_t size, TextureData& textureInfo);
+
+    // Uploads the subresources of a loaded DDS texture into 'texture'. Small textures are written through the
+    // command list, large ones outside of D3D11 are filled into a single staging texture and copied from it.
+    // Mip 'firstMipLevel' of the data becomes mip 0 of the texture, and at most 'mipCount' mips are written.
+    // Returns the number of bytes uploaded.
+    uint64_t UploadDDSTextureData(nvrhi::IDevice* device, nvrhi::ICommandList* commandList, nvrhi::ITexture* texture,
+        const TextureData& textureInfo, uint32_t firstMipLevel = 0, uint32_t mipCount = ~0u);
+
     // Creates a texture based on DDS data in memory
     nvrhi::TextureHandle CreateDDSTextureFromMemory(nvrhi::IDevice* device, nvrhi::ICommandList* commandList, std::shared_ptr<vfs::IBlob> data, const char* debugName = nullptr, bool forceSRGB = false);
 
     std::shared_ptr<vfs::IBlob> SaveStagingTextureAsDDS(nvrhi::IDevice* device, nvrhi::IStagingTexture* stagingTexture);
+
+    // Creates a DDS file from texture data that is laid out like in DDS: array slices one after another,
+    // each with tightly packed mip levels. Returns nullptr if 'dataSize' doesn't match the description.
+    std::shared_ptr<vfs::IBlob> SaveTextureDataAsDDS(const nvrhi::TextureDesc& textureDesc, const void* data, size_t dataSize);
 }
\ No newline at end of file
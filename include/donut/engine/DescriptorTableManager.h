@@ -23,8 +23,10 @@
 #pragma once
 
 #include <nvrhi/nvrhi.h>
+#include <deque>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 
 namespace donut::engine
 {
@@ -54,6 +56,13 @@ namespace donut::engine
         DescriptorHandle& operator=(DescriptorHandle&&) = default;
     };
 
+    // Allocates descriptors in a bindless descriptor table.
+    // Allocation and release are O(1) through a free list, and all methods are thread-safe.
+    // By default, released slots are reused and updated slots are rewritten immediately. Command lists still
+    // executing on the GPU must never see a slot rewritten with a different resource, so with framesInFlight > 0,
+    // slots that are released or updated while frame F is recorded keep their resource until frame
+    // F + framesInFlight begins, see BeginFrame. Scene enables this for its table and begins its frames in
+    // Scene::Refresh; applications that enable it for a table without a scene call BeginFrame or AdvanceFrame.
     class DescriptorTableManager : public std::enable_shared_from_this<DescriptorTableManager>
     {
     protected:
@@ -92,10 +101,29 @@ namespace donut::engine
         std::vector<nvrhi::BindingSetItem> m_Descriptors;
         std::unordered_map<nvrhi::BindingSetItem, DescriptorIndex, BindingSetItemHasher, BindingSetItemsEqual> m_DescriptorIndexMap;
         std::vector<bool> m_AllocatedDescriptors;
-        int m_SearchStart = 0;
+        std::vector<DescriptorIndex> m_FreeDescriptors;
+
+        // A slot release or update waiting for the frames that may use the slot to finish
+        struct PendingWrite
+        {
+            DescriptorIndex index;
+            uint64_t frame;
+            bool release;               // free the slot, otherwise write 'item' into it
+            nvrhi::BindingSetItem item; // referenced until written
+        };
+        std::deque<PendingWrite> m_PendingWrites;
+        uint32_t m_FramesInFlight;
+        uint64_t m_CurrentFrame = 0;
+
+        std::mutex m_Mutex;
+
+        void GrowDescriptorTable();
+        void FreeDescriptorSlot(DescriptorIndex index);
+        void WriteDescriptorSlot(DescriptorIndex index, const nvrhi::BindingSetItem& item);
+        void ApplyPendingWrites();
         
     public:
-        DescriptorTableManager(nvrhi::IDevice* device, nvrhi::IBindingLayout* layout);
+        DescriptorTableManager(nvrhi::IDevice* device, nvrhi::IBindingLayout* layout, uint32_t framesInFlight = 0);
         ~DescriptorTableManager();
         
         nvrhi::IDescriptorTable* GetDescriptorTable() const { return m_DescriptorTable; }
@@ -104,5 +132,21 @@ namespace donut::engine
         DescriptorHandle CreateDescriptorHandle(nvrhi::BindingSetItem item);
         nvrhi::BindingSetItem GetDescriptor(DescriptorIndex index);
         void ReleaseDescriptor(DescriptorIndex index);
+
+        // Replaces the resource of an allocated descriptor, keeping its index.
+        // The slot shows the previous resource until the frames that may use it have finished.
+        void UpdateDescriptor(DescriptorIndex index, nvrhi::BindingSetItem item);
+
+        // Call when recording of the frame with the given index starts, with indices that never decrease.
+        // Calls with the current index are ignored, so several owners of the table can begin the same frame.
+        void BeginFrame(uint64_t frameIndex);
+
+        // Begins the frame after the current one.
+        void AdvanceFrame();
+
+        // Changes the number of frames that released and updated slots wait for, never lowering it below
+        // the current value, so that several owners can each request what they need. See the class comment.
+        void SetFramesInFlight(uint32_t framesInFlight);
+        uint32_t GetFramesInFlight() const { return m_FramesInFlight; }
     };
 }
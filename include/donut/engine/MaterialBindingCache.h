@@ -60,6 +60,8 @@ namespace donut::engine
         bool m_TrackLiveness;
 
         nvrhi::BindingSetHandle CreateMaterialBindingSet(const Material* material);
+        bool IsMaterialBindingSetCurrent(const Material* material, nvrhi::IBindingSet* bindingSet) const;
+        static const std::shared_ptr<LoadedTexture>* GetMaterialTexture(const Material* material, MaterialResource resource);
         nvrhi::BindingSetItem GetTextureBindingSetItem(uint32_t slot, const std::shared_ptr<LoadedTexture>& texture) const;
 
     public:
@@ -0,0 +1,248 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/circular_buffer.h>
+#include <nvrhi/nvrhi.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace donut::vfs
+{
+    class IFileSystem;
+}
+
+namespace donut::engine
+{
+    /*
+    Profiler collects named CPU and GPU timing zones per frame. CPU zones are measured
+    with the high-resolution clock on any thread; GPU zones are bracketed by nvrhi timer
+    queries on a command list and resolved a few frames later, when the queries are ready,
+    without waiting for the GPU. A frame whose queries are still not ready after
+    c_MaxPendingGpuFrames frames, e.g. because a command list was never executed, is dropped.
+
+    The zone macros below record into the active profiler, see SetActive(...). Call
+    BeginFrame() and EndFrame() around the frame. Enabling or disabling the profiler takes
+    effect at the next BeginFrame(); while it is disabled, a zone only loads a pointer and a flag.
+    Zones must end in the frame where they began, GPU zones in the same command list.
+
+    The per-frame time of every zone, summed over its instances, is kept in a ring buffer of
+    c_HistoryLength frames. The events of the last c_TraceFrames frames are kept for
+    WriteChromeTrace(...). nvrhi timer queries only measure durations, so GPU events are placed
+    in the trace at the time when they were recorded on the CPU, on a separate track.
+
+    All Profiler methods are thread-safe.
+    */
+    class Profiler
+    {
+    public:
+        static constexpr size_t c_HistoryLength = 128;
+        static constexpr size_t c_TraceFrames = 16;
+        static constexpr size_t c_MaxPendingGpuFrames = 8;
+
+        struct ZoneStatistics
+        {
+            std::string name;
+            bool gpu = false;
+            uint32_t depth = 0;
+            float lastMs = 0.f;
+            float averageMs = 0.f;
+            float maxMs = 0.f;
+        };
+
+    private:
+        struct Zone
+        {
+            std::string name;
+            bool gpu = false;
+            uint32_t depth = 0;
+            uint64_t lastFrame = 0;
+            double frameMs = 0.0;
+            core::circular_buffer<float, c_HistoryLength> history;
+        };
+
+        struct TraceEvent
+        {
+            uint32_t zone;
+            uint32_t thread;
+            double beginUs;
+            double durationUs;
+        };
+
+        struct TraceFrame
+        {
+            uint64_t frameIndex = 0;
+            std::vector<TraceEvent> events;
+        };
+
+        struct GpuEvent
+        {
+            uint32_t zone;
+            nvrhi::TimerQueryHandle query;
+            double beginUs;
+        };
+
+        struct GpuFrame
+        {
+            uint64_t frameIndex = 0;
+            std::vector<GpuEvent> events;
+        };
+
+        static std::atomic<Profiler*> s_Active;
+
+        nvrhi::DeviceHandle m_Device;
+        std::atomic<bool> m_Enabled = false;
+        std::atomic<bool> m_FrameActive = false;
+        std::mutex m_Mutex;
+
+        std::chrono::high_resolution_clock::time_point m_StartTime;
+        double m_FrameBeginUs = 0.0;
+        uint64_t m_FrameIndex = 0;
+
+        std::vector<Zone> m_Zones;
+        std::unordered_map<std::string, uint32_t> m_CpuZoneIndices;
+        std::unordered_map<std::string, uint32_t> m_GpuZoneIndices;
+
+        std::vector<TraceEvent> m_CpuEvents;
+        GpuFrame m_CurrentGpuFrame;
+        std::deque<GpuFrame> m_PendingGpuFrames;
+        std::vector<nvrhi::TimerQueryHandle> m_FreeQueries;
+
+        core::circular_buffer<float, c_HistoryLength> m_FrameTimes;
+        core::circular_buffer<TraceFrame, c_TraceFrames> m_TraceFrames;
+
+        double GetTimeUs() const;
+        uint32_t GetZoneIndex(const char* name, bool gpu);
+        void AddZoneTime(Zone& zone, double ms, uint64_t frameIndex);
+        void FlushZoneTimes(uint64_t frameIndex);
+        void ResolveGpuFrames();
+
+    public:
+        // The device is used to create timer queries; without a device, GPU zones are ignored.
+        explicit Profiler(nvrhi::IDevice* device);
+        ~Profiler();
+
+        // Sets the profiler that the zone macros record into, or nullptr.
+        static void SetActive(Profiler* profiler);
+        static Profiler* GetActive() { return s_Active.load(std::memory_order_relaxed); }
+
+        void SetEnabled(bool enabled) { m_Enabled = enabled; }
+        [[nodiscard]] bool IsEnabled() const { return m_Enabled; }
+
+        // True between BeginFrame and EndFrame of a frame that started with the profiler enabled.
+        [[nodiscard]] bool IsRecording() const { return m_FrameActive.load(std::memory_order_relaxed); }
+
+        void BeginFrame();
+        void EndFrame();
+
+        // Zone indices are only valid in the frame that returned them.
+        uint32_t BeginCpuZone(const char* name);
+        void EndCpuZone(uint32_t event);
+        nvrhi::ITimerQuery* BeginGpuZone(nvrhi::ICommandList* commandList, const char* name);
+        void EndGpuZone(nvrhi::ICommandList* commandList, nvrhi::ITimerQuery* query);
+
+        // Returns the statistics of the zones that were recorded in the last c_HistoryLength frames,
+        // in the order of their first use.
+        [[nodiscard]] std::vector<ZoneStatistics> GetZoneStatistics();
+
+        // Copies the CPU frame times, oldest first.
+        void GetFrameTimes(std::vector<float>& frameTimesMs);
+
+        // Writes the recorded frames in the Chrome trace event format, for chrome://tracing or Perfetto.
+        bool WriteChromeTrace(vfs::IFileSystem& fs, const std::filesystem::path& path);
+
+        // Drops the statistics and the recorded frames.
+        void Reset();
+    };
+
+    class ProfilerCpuZone
+    {
+    private:
+        Profiler* m_Profiler = nullptr;
+        uint32_t m_Event = 0;
+
+    public:
+        explicit ProfilerCpuZone(const char* name)
+        {
+            Profiler* profiler = Profiler::GetActive();
+            if (profiler && profiler->IsRecording())
+            {
+                m_Profiler = profiler;
+                m_Event = profiler->BeginCpuZone(name);
+            }
+        }
+
+        ~ProfilerCpuZone()
+        {
+            if (m_Profiler)
+                m_Profiler->EndCpuZone(m_Event);
+        }
+
+        ProfilerCpuZone(const ProfilerCpuZone&) = delete;
+        ProfilerCpuZone& operator=(const ProfilerCpuZone&) = delete;
+    };
+
+    class ProfilerGpuZone
+    {
+    private:
+        Profiler* m_Profiler = nullptr;
+        nvrhi::ICommandList* m_CommandList = nullptr;
+        nvrhi::ITimerQuery* m_Query = nullptr;
+
+    public:
+        ProfilerGpuZone(nvrhi::ICommandList* commandList, const char* name)
+        {
+            Profiler* profiler = Profiler::GetActive();
+            if (profiler && profiler->IsRecording())
+            {
+                m_Profiler = profiler;
+                m_CommandList = commandList;
+                m_Query = profiler->BeginGpuZone(commandList, name);
+            }
+        }
+
+        ~ProfilerGpuZone()
+        {
+            if (m_Query)
+                m_Profiler->EndGpuZone(m_CommandList, m_Query);
+        }
+
+        ProfilerGpuZone(const ProfilerGpuZone&) = delete;
+        ProfilerGpuZone& operator=(const ProfilerGpuZone&) = delete;
+    };
+}
+
+#define DONUT_PROFILER_CONCAT_IMPL(a, b) a##b
+#define DONUT_PROFILER_CONCAT(a, b) DONUT_PROFILER_CONCAT_IMPL(a, b)
+
+// Measures the CPU time until the end of the enclosing scope.
+#define DONUT_PROFILE_CPU(name) donut::engine::ProfilerCpuZone DONUT_PROFILER_CONCAT(_profilerCpuZone, __LINE__)(name)
+
+// Measures the GPU time of the commands recorded into 'commandList' until the end of the enclosing scope.
+#define DONUT_PROFILE_GPU(commandList, name) donut::engine::ProfilerGpuZone DONUT_PROFILER_CONCAT(_profilerGpuZone, __LINE__)(commandList, name)
@@ -114,13 +114,17 @@ namespace donut::engine
     public:
         virtual ~Scene() = default;
 
+        // Slots released or updated in 'descriptorTable' wait for 'framesInFlight' frames before they are reused,
+        // see DescriptorTableManager::SetFramesInFlight. It must be at least the number of frames that the device
+        // keeps in flight, app::DeviceCreationParameters::maxFramesInFlight.
         Scene(
             nvrhi::IDevice* device,
             ShaderFactory& shaderFactory,
             std::shared_ptr<vfs::IFileSystem> fs,
             std::shared_ptr<TextureCache> textureCache,
             std::shared_ptr<DescriptorTableManager> descriptorTable,
-            std::shared_ptr<SceneTypeFactory> sceneTypeFactory);
+            std::shared_ptr<SceneTypeFactory> sceneTypeFactory,
+            uint32_t framesInFlight = 2);
         
         void FinishedLoading(uint32_t frameIndex);
 
@@ -130,7 +134,9 @@ namespace donut::engine
         // Creates missing buffers, uploads vertex buffers, instance data, materials, etc.
         void RefreshBuffers(nvrhi::ICommandList* commandList, uint32_t frameIndex);
 
-        // A combination of RefreshSceneGraph and RefreshBuffers
+        // A combination of RefreshSceneGraph and RefreshBuffers.
+        // Also begins the frame in the descriptor table, see DescriptorTableManager::BeginFrame,
+        // so 'frameIndex' must count the rendered frames, like app::DeviceManager::GetFrameIndex does.
         void Refresh(nvrhi::ICommandList* commandList, uint32_t frameIndex);
 
         bool Load(const std::filesystem::path& jsonFileName);
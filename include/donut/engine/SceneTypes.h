@@ -48,6 +48,8 @@ namespace donut::engine
         CUSTOM = 4,
     };
 
+    class VirtualTexture;
+
     struct LoadedTexture
     {
         nvrhi::TextureHandle texture;
@@ -117,6 +119,7 @@ namespace donut::engine
         std::shared_ptr<LoadedTexture> emissiveTexture;
         std::shared_ptr<LoadedTexture> occlusionTexture;
         std::shared_ptr<LoadedTexture> transmissionTexture; // see KHR_materials_transmission; undefined on specular-gloss materials
+        std::shared_ptr<VirtualTexture> virtualTexture; // replaces the base or diffuse and normal textures in the passes that support virtual texturing
         nvrhi::BufferHandle materialConstants;
         dm::float3 baseOrDiffuseColor = 1.f; // metal-rough: base color, spec-gloss: diffuse color (if no texture present)
         dm::float3 specularColor = 0.f; // spec-gloss: specular color
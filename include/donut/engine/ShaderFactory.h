@@ -24,6 +24,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <unordered_map>
 #include <nvrhi/nvrhi.h>
 #include <memory>
@@ -85,20 +88,62 @@ namespace donut::engine
 
     class ShaderFactory
     {
+    public:
+        struct CacheStatistics
+        {
+            size_t bytecodeFiles = 0;
+            size_t bytecodeBytes = 0;
+            size_t indexedBlobs = 0;
+            size_t indexedPermutations = 0;
+            size_t shaders = 0;
+            size_t shaderLibraries = 0;
+            size_t shaderHits = 0;
+        };
+
     private:
+        // One permutation of a ShaderMake blob, with the defines sorted by name
+        struct Permutation
+        {
+            std::vector<std::pair<std::string, std::string>> defines;
+            const void* bytecode = nullptr;
+            size_t size = 0;
+        };
+
+        struct PermutationIndex
+        {
+            size_t blobSize = 0;
+            std::unordered_map<size_t, std::vector<Permutation>> permutations; // by hash of the sorted defines
+            size_t numPermutations = 0;
+        };
+
+        // Permutation bytecode and the value fields of nvrhi::ShaderDesc
+        typedef std::tuple<const void*, nvrhi::ShaderType, std::string, std::string, int, bool, uint32_t> ShaderKey;
+
         nvrhi::DeviceHandle m_Device;
         std::unordered_map<std::string, std::shared_ptr<vfs::IBlob>> m_BytecodeCache;
 		std::shared_ptr<vfs::IFileSystem> m_fs;
 		std::filesystem::path m_basePath;
 
+        std::unordered_map<const void*, PermutationIndex> m_PermutationIndices;
+        std::map<ShaderKey, nvrhi::ShaderHandle> m_Shaders;
+        std::unordered_map<const void*, nvrhi::ShaderLibraryHandle> m_ShaderLibraries;
+        size_t m_ShaderHits = 0;
+        std::mutex m_Mutex;
+
+        const PermutationIndex& GetPermutationIndex(const void* blob, size_t blobSize);
+        bool FindPermutation(StaticShader shader, const std::vector<ShaderMacro>* pDefines, const void** ppBytecode, size_t* pSize);
+
     public:
         ShaderFactory(
             nvrhi::DeviceHandle device,
             std::shared_ptr<vfs::IFileSystem> fs,
 			const std::filesystem::path& basePath);
 
+        // Releases the cached bytecode files, permutation indices and shaders.
         void ClearCache();
 
+        [[nodiscard]] CacheStatistics GetCacheStatistics();
+
         std::shared_ptr<vfs::IBlob> GetBytecode(const char* fileName, const char* entryName);
 
         // Creates a shader from binary file.
@@ -107,7 +152,9 @@ namespace donut::engine
         // Creates a shader library from binary file.
         nvrhi::ShaderLibraryHandle CreateShaderLibrary(const char* fileName, const std::vector<ShaderMacro>* pDefines);
 
-        // Creates a shader from the bytecode array.
+        // Creates a shader from the bytecode array. The array is indexed by address on first use, so it must stay
+        // valid until the factory is destroyed or ClearCache is called, which is the case for the static arrays.
+        // Identical requests return the same shader object.
         nvrhi::ShaderHandle CreateStaticShader(StaticShader shader, const std::vector<ShaderMacro>* pDefines, const nvrhi::ShaderDesc& desc);
 
         // Creates a shader from one of the platform-speficic bytecode arrays, selecting it based on the device's graphics API.
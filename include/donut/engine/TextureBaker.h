@@ -0,0 +1,67 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <filesystem>
+#include <memory>
+
+namespace donut::vfs
+{
+    class IBlob;
+}
+
+namespace donut::engine
+{
+    enum class TextureBakeMode : uint8_t
+    {
+        Auto,      // BC4 for 1-channel images, BC5 for 2 channels, color otherwise
+        Color,     // BC7, or BC1 for opaque images with TextureBakeSettings::preferBC1
+        NormalMap, // BC5 with the X and Y components, material shaders reconstruct Z
+        Mask       // BC4 with the first channel
+    };
+
+    struct TextureBakeSettings
+    {
+        TextureBakeMode mode = TextureBakeMode::Auto;
+
+        // Must match the sRGB flag that the image is loaded with by TextureCache,
+        // as it is a part of the baked file name.
+        bool sRGB = false;
+
+        // Use BC1 instead of BC7 for opaque color images: half the size at a lower quality.
+        bool preferBC1 = false;
+    };
+
+    // Content hash of an image file combined with a variant of its processing, which keys baked and cached textures.
+    uint64_t HashTextureSourceData(const void* data, size_t size, uint64_t variant);
+
+    // Returns the path of the baked version of an image with the given contents.
+    // Baked files are content-addressed and live in a cache directory next to the image: <dir>/.baked/<hash>.dds
+    std::filesystem::path GetBakedTexturePath(const std::filesystem::path& sourcePath, const void* sourceData, size_t sourceSize, bool sRGB);
+
+    // Decodes an 8-bit image file (PNG, JPEG, TGA, BMP...), generates its full mip chain with a box filter
+    // in linear space and encodes every level into a block compressed DDS file.
+    // Returns nullptr if the image can't be decoded or is HDR. 'outFormat' receives the chosen format.
+    std::shared_ptr<vfs::IBlob> BakeTexture(const void* sourceData, size_t sourceSize, const TextureBakeSettings& settings, nvrhi::Format* outFormat = nullptr);
+}
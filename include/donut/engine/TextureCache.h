@@ -24,14 +24,16 @@
 
 #include <donut/engine/SceneTypes.h>
 #include <donut/core/log.h>
+#include <donut/core/sharded_map.h>
 
 #include <nvrhi/nvrhi.h>
 #include <atomic>
+#include <condition_variable>
 #include <filesystem>
 #include <unordered_map>
 #include <memory>
 #include <shared_mutex>
-#include <queue>
+#include <vector>
 
 #ifdef DONUT_WITH_TASKFLOW
 namespace tf
@@ -44,11 +46,14 @@ namespace donut::vfs
 {
     class IBlob;
     class IFileSystem;
+    class NativeFileSystem;
 }
 
 namespace donut::engine
 {
     class CommonRenderPasses;
+    class IView;
+    class MeshInstance;
 
     struct TextureSubresourceData
     {
@@ -74,6 +79,86 @@ namespace donut::engine
 
         // ArraySlice -> MipLevel -> TextureSubresourceData
         std::vector<std::vector<TextureSubresourceData>> dataLayout;
+
+        // Residency of streamed textures, see TextureCache::SetStreamingBudget.
+        // Streamed textures keep their data after finalization to upload the evicted mips again.
+        bool isStreamed = false;
+        uint32_t residentMip = 0;        // most detailed mip level resident on the GPU
+        uint32_t requestedMip = 0;       // most detailed mip level requested in the last frame it was used
+        uint64_t lastRequestFrame = 0;   // streaming frame of the last request, for LRU eviction
+        uint64_t residentBytes = 0;      // GPU memory used by the resident mip levels
+
+        // Decode and finalization order, higher first, see TextureCache::SetTexturePriority
+        int priority = 0;
+    };
+
+    // A texture waiting for decoding or finalization
+    struct TextureLoadRequest
+    {
+        std::shared_ptr<TextureData> texture;
+        std::shared_ptr<vfs::IBlob> fileData; // only for decoding
+        int priority = 0;
+        uint64_t sequence = 0;
+
+        // Heap order: higher priority first, then requests in submission order
+        bool operator<(const TextureLoadRequest& other) const
+        {
+            return priority != other.priority ? priority < other.priority : sequence > other.sequence;
+        }
+    };
+
+    // Statistics of the texture uploads done by TextureCache::ProcessRenderingThreadCommands.
+    struct TextureFinalizationStats
+    {
+        uint32_t texturesFinalized = 0;
+        uint32_t commandListsSubmitted = 0;
+        uint64_t uploadBytes = 0;
+        uint64_t largestBatchBytes = 0; // upload bytes recorded into one command list
+    };
+
+    // Textures recorded into one command list by TextureCache::ProcessRenderingThreadCommands.
+    struct TextureUploadBatch
+    {
+        uint64_t maxBytes = 0;
+        uint64_t bytes = 0;
+        uint32_t textures = 0;
+
+        // Adds a texture's upload size, see TextureCache::GetUploadBytes.
+        // Returns true when the batch has reached 'maxBytes' and should be submitted.
+        bool Add(uint64_t textureBytes)
+        {
+            bytes += textureBytes;
+            textures += 1;
+            return bytes >= maxBytes;
+        }
+
+        void Clear()
+        {
+            bytes = 0;
+            textures = 0;
+        }
+    };
+
+    // Residency statistics of streamed textures, see TextureCache::SetStreamingBudget.
+    struct TextureStreamingStats
+    {
+        uint32_t streamedTextures = 0;
+        uint64_t residentBytes = 0;
+        uint64_t budgetBytes = 0;
+
+        // Changes made by the last UpdateStreaming call
+        uint32_t texturesStreamedIn = 0;
+        uint32_t texturesEvicted = 0;
+        uint64_t uploadBytes = 0;
+    };
+
+    // Statistics of the persistent decoded texture cache, see TextureCache::SetDecodedTextureCacheDirectory.
+    struct DecodedTextureCacheStats
+    {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint64_t bytesSaved = 0;   // decoded data mapped from the cache instead of decoding
+        uint64_t bytesWritten = 0; // new cache files
     };
 
     class TextureCache
@@ -81,10 +166,12 @@ namespace donut::engine
     protected:
         nvrhi::DeviceHandle m_Device;
         nvrhi::CommandListHandle m_CommandList;
-        std::unordered_map<std::string, std::shared_ptr<TextureData>> m_LoadedTextures;
-        mutable std::shared_mutex m_LoadedTexturesMutex;
+        core::sharded_map<std::string, std::shared_ptr<TextureData>> m_LoadedTextures;
 
-        std::queue<std::shared_ptr<TextureData>> m_TexturesToFinalize;
+        // Heaps of pending requests, both guarded by m_TexturesToFinalizeMutex
+        std::vector<TextureLoadRequest> m_TexturesToDecode;
+        std::vector<TextureLoadRequest> m_TexturesToFinalize;
+        uint64_t m_LoadRequestSequence = 0;
         std::shared_ptr<DescriptorTableManager> m_DescriptorTable;
         std::mutex m_TexturesToFinalizeMutex;
 
@@ -101,9 +188,44 @@ namespace donut::engine
         std::atomic<uint32_t> m_TexturesLoaded = 0;
         uint32_t m_TexturesFinalized = 0;
 
-        bool FindTextureInCache(const std::filesystem::path& path, std::shared_ptr<TextureData>& texture);
+        bool m_UseBakedTextures = true;
+
+        uint64_t m_MaxFinalizationBatchBytes = 256ull * 1024 * 1024;
+        TextureFinalizationStats m_LastFinalizationStats;
+        TextureFinalizationStats m_TotalFinalizationStats;
+
+        // Texture streaming, enabled with a non-zero budget
+        uint64_t m_StreamingBudget = 0;
+        uint64_t m_StreamingUploadLimit = 64ull * 1024 * 1024;
+        uint32_t m_StreamingTailSize = 128;
+        uint64_t m_StreamingFrame = 1;
+        std::vector<std::shared_ptr<TextureData>> m_StreamedTextures;
+        TextureStreamingStats m_StreamingStats;
+        std::mutex m_StreamingMutex;
+
+        // Persistent cache of decoded images, see SetDecodedTextureCacheDirectory
+        std::filesystem::path m_DecodedCacheDirectory;
+        std::shared_ptr<vfs::NativeFileSystem> m_DecodedCacheFS;
+        mutable std::atomic<uint32_t> m_DecodedCacheHits = 0;
+        mutable std::atomic<uint32_t> m_DecodedCacheMisses = 0;
+        mutable std::atomic<uint64_t> m_DecodedCacheBytesSaved = 0;
+        mutable std::atomic<uint64_t> m_DecodedCacheBytesWritten = 0;
+
+        // file reads started by LoadTextureFromFileAsync whose decoding has not been scheduled yet
+        uint32_t m_PendingFileReads = 0;
+        std::mutex m_PendingFileReadsMutex;
+        std::condition_variable m_PendingFileReadsCondition;
+
+        bool FindTextureInCache(const std::filesystem::path& path, bool sRGB, std::shared_ptr<TextureData>& texture);
+        void PushLoadRequest(std::vector<TextureLoadRequest>& queue, std::shared_ptr<TextureData> texture, std::shared_ptr<vfs::IBlob> fileData = nullptr);
+        bool PopLoadRequest(std::vector<TextureLoadRequest>& queue, TextureLoadRequest& request);
+        void DecodeNextTexture();
         std::shared_ptr<vfs::IBlob> ReadTextureFile(const std::filesystem::path& path) const;
 
+        bool FillTextureDataFromBakedFile(
+            const std::shared_ptr<vfs::IBlob>& fileData,
+            const std::shared_ptr<TextureData>& texture) const;
+
         bool FillTextureData(
             const std::shared_ptr<vfs::IBlob>& fileData,
             const std::shared_ptr<TextureData>& texture,
@@ -115,6 +237,25 @@ namespace donut::engine
             CommonRenderPasses* passes,
             nvrhi::ICommandList* commandList);
 
+        // Decodes images with stb_image or tinyexr
+        bool DecodeTextureData(
+            const std::shared_ptr<vfs::IBlob>& fileData,
+            const std::shared_ptr<TextureData>& texture,
+            const std::string& extension,
+            const std::string& mimeType) const;
+
+        std::filesystem::path GetDecodedCachePath(const vfs::IBlob& fileData, const TextureData& texture) const;
+        bool FillTextureDataFromDecodedCache(const std::filesystem::path& cachePath, const std::shared_ptr<TextureData>& texture) const;
+        void StoreDecodedTexture(const std::filesystem::path& cachePath, TextureData& texture) const;
+
+        // Downscales decoded single-mip data on the CPU to fit into m_MaxTextureSize before it is uploaded
+        void DownscaleTextureData(TextureData& texture) const;
+
+        bool CanStreamTexture(const TextureData& texture) const;
+        uint32_t GetStreamingTailMip(const TextureData& texture) const;
+        void FinalizeStreamedTexture(std::shared_ptr<TextureData> texture, nvrhi::ICommandList* commandList);
+        uint64_t ChangeTextureResidency(TextureData& texture, uint32_t residentMip, nvrhi::ICommandList* commandList);
+
         virtual void TextureLoaded(std::shared_ptr<TextureData> texture);
         virtual std::shared_ptr<TextureData> CreateTextureData();
 
@@ -143,6 +284,9 @@ namespace donut::engine
 
 #ifdef DONUT_WITH_TASKFLOW
         // Asynchronous read and decode, deferred upload and mip generation (in the ProcessRenderingThreadCommands queue).
+        // The file is read with IFileSystem::readFileAsync, and decoding is scheduled on the executor when the data arrives.
+        // The read completes outside of the executor, so executor.wait_for_all() alone doesn't wait for the texture
+        // to be decoded: use WaitForAsyncLoads for that.
         virtual std::shared_ptr<LoadedTexture> LoadTextureFromFileAsync(
             const std::filesystem::path& path,
             bool sRGB,
@@ -189,14 +333,87 @@ namespace donut::engine
 
         // Process a portion of the upload queue, taking up to `timeLimitMilliseconds` CPU time.
         // If `timeLimitMilliseconds` is 0, processes the entire queue.
+        // Textures are recorded into one command list until its uploads reach the batch size
+        // (see SetFinalizationBatchSize), and garbage collection runs once per call.
         // Returns true if any textures have been processed.
         bool ProcessRenderingThreadCommands(CommonRenderPasses& passes, float timeLimitMilliseconds);
 
+        // Enables loading the block compressed versions of images produced by the texture baker
+        // (see TextureBaker.h) instead of decoding the images. Enabled by default.
+        void SetUseBakedTextures(bool useBakedTextures) { m_UseBakedTextures = useBakedTextures; }
+
+        // Sets the amount of texture data uploaded with one command list in ProcessRenderingThreadCommands.
+        // Larger batches mean fewer submissions, but more upload memory held until the GPU is done with them.
+        void SetFinalizationBatchSize(uint64_t maxUploadBytes) { m_MaxFinalizationBatchBytes = maxUploadBytes; }
+
+        // Size of the data that finalizing the texture uploads, taken from its data layout
+        // because decoded image blobs don't necessarily report their size.
+        static uint64_t GetUploadBytes(const TextureData& texture);
+
+        // Statistics of the last ProcessRenderingThreadCommands call that processed any textures,
+        // and the totals since the last Reset.
+        const TextureFinalizationStats& GetLastFinalizationStats() const { return m_LastFinalizationStats; }
+        const TextureFinalizationStats& GetTotalFinalizationStats() const { return m_TotalFinalizationStats; }
+
         // Destroys the internal command list in order to release the upload buffers used in it.
         void LoadingFinished();
 
-        // Set the maximum texture size allowed after load. Larger textures are resized to fit this constraint.
-        // Currently does not affect DDS textures.
+        // Enables the persistent cache of decoded images in a native directory, or disables it with an empty path.
+        // Images that are not DDS or baked are stored with their generated mips after decoding, keyed by
+        // the content hash of the file and the load options, and later loads map the cache files directly.
+        void SetDecodedTextureCacheDirectory(const std::filesystem::path& directory);
+
+        DecodedTextureCacheStats GetDecodedCacheStats() const;
+
+        // Sets the priority of a texture that is waiting to be decoded or finalized. Textures with higher
+        // priority are processed first, textures with equal priority in the order of their requests.
+        // The priority can be set before or after the load starts. Thread-safe.
+        void SetTexturePriority(const std::shared_ptr<LoadedTexture>& texture, int priority);
+
+        // Raises the priority of all textures used by a material to at least 'priority'.
+        void PrioritizeMaterialTextures(const Material& material, int priority);
+
+        // Enables texture streaming for textures loaded afterwards that come with a full mip chain, such as DDS
+        // and baked textures. Streamed textures are created with their tail mips only, and UpdateStreaming moves
+        // their residency towards the requested mip levels, evicting the least recently requested mips to stay
+        // within 'budgetBytes' of GPU memory. A budget of 0 disables streaming.
+        // Residency changes keep the bindless descriptor index of a texture and replace its resource, which is
+        // only safe while the descriptor table defers its writes, see DescriptorTableManager::SetFramesInFlight.
+        // A Scene enables that for its table; a table used without a scene must also begin its frames.
+        void SetStreamingBudget(uint64_t budgetBytes, uint32_t tailSize = 128);
+
+        // Reads only the header of a DDS file to find the texture dimensions and format before loading it,
+        // and returns the GPU memory the full mip chain will occupy in 'memoryBytes'.
+        // Returns false for other file types and for invalid or missing files.
+        bool ReadTextureHeader(const std::filesystem::path& path, TextureData& textureInfo, uint64_t& memoryBytes);
+
+        // Limits the amount of mip data uploaded by one UpdateStreaming call.
+        void SetStreamingUploadLimit(uint64_t maxUploadBytes) { m_StreamingUploadLimit = maxUploadBytes; }
+
+        // Requests at least the given mip level of a streamed texture for the current streaming frame.
+        // Requests from several sources are combined, the most detailed one wins. Thread-safe.
+        void RequestTextureMip(const std::shared_ptr<LoadedTexture>& texture, uint32_t mipLevel);
+
+        // Requests the mip level for a texture that covers about 'projectedPixels' on screen along its larger axis.
+        void RequestTextureSize(const std::shared_ptr<LoadedTexture>& texture, float projectedPixels);
+
+        // CPU residency feedback: requests the texture mips for the materials of the given mesh instances,
+        // based on the projected size of their bounding boxes in the view.
+        void RequestMipsForMeshInstances(const std::vector<std::shared_ptr<MeshInstance>>& instances, const IView& view);
+
+        // GPU residency feedback: 'minMipPerDescriptor' is indexed by the bindless descriptor index of textures
+        // and holds the most detailed mip level sampled from each, or ~0u for textures that weren't sampled.
+        void ApplyMipFeedback(const uint32_t* minMipPerDescriptor, size_t count);
+
+        // Streams requested mips in and evicts mips of least recently requested textures, recording the copies and
+        // uploads into 'commandList', which must be open. Starts a new streaming frame for the requests.
+        // Returns true if any texture objects have been replaced.
+        bool UpdateStreaming(nvrhi::ICommandList* commandList);
+
+        const TextureStreamingStats& GetStreamingStats() const { return m_StreamingStats; }
+
+        // Set the maximum texture size allowed after load. Larger textures are resized to fit this constraint,
+        // decoded images on the CPU before upload. Currently does not affect DDS textures.
         void SetMaxTextureSize(uint32_t size);
 
         // Enables or disables automatic mip generation for loaded textures.
@@ -208,6 +425,12 @@ namespace donut::engine
         // Sets the Severity of log messages about textures that couldn't be loaded.
         void SetErrorLogSeverity(log::Severity value) { m_ErrorLogSeverity = value; }
 
+#ifdef DONUT_WITH_TASKFLOW
+        // Blocks until all work on the executor has finished and all textures requested with
+        // LoadTextureFromFileAsync, including those requested by that work, have been read and decoded.
+        void WaitForAsyncLoads(tf::Executor& executor);
+#endif
+
         uint32_t GetNumberOfLoadedTextures() { return m_TexturesLoaded.load(); }
         uint32_t GetNumberOfRequestedTextures() { return m_TexturesRequested.load(); }
         uint32_t GetNumberOfFinalizedTextures() { return m_TexturesFinalized; }
@@ -215,32 +438,43 @@ namespace donut::engine
 		std::shared_ptr<TextureData> GetLoadedTexture(std::filesystem::path const& path);
 
 		// Texture cache traversal
-		// Note: the iterator locks all cache write-accesses for the duration its lifespan !
+		// Iterates over a snapshot of the cache taken by begin(), which doesn't block cache writes.
+		// Textures added or removed after begin() are not reflected in the iteration.
 		class Iterator
 		{
 		public:
-			typedef std::unordered_map<std::string, std::shared_ptr<TextureData>>::iterator CacheIter;
+			typedef std::pair<std::string, std::shared_ptr<TextureData>> Entry;
+			typedef std::vector<Entry> Snapshot;
 
-			Iterator& operator++() { ++m_Iterator; return *this; }
+			Iterator& operator++() { ++m_Index; return *this; }
 			
-			friend bool operator==(Iterator const& a, Iterator const& b) { return a.m_Iterator == b.m_Iterator; }
+			friend bool operator==(Iterator const& a, Iterator const& b)
+			{
+				if (a.AtEnd() || b.AtEnd())
+					return a.AtEnd() == b.AtEnd();
+				return a.m_Snapshot == b.m_Snapshot && a.m_Index == b.m_Index;
+			}
 			friend bool operator!=(Iterator const& a, Iterator const& b) { return !(a == b); }
 
-			CacheIter const& operator->() const { return m_Iterator; }
+			Entry const* operator->() const { return &(*m_Snapshot)[m_Index]; }
+			Entry const& operator*() const { return (*m_Snapshot)[m_Index]; }
 
 		private:
 
 			friend class TextureCache;
 			
-			Iterator(std::shared_mutex& mutex, CacheIter it) : m_Lock(mutex), m_Iterator(it) { }
+			Iterator() = default;
+			Iterator(std::shared_ptr<const Snapshot> snapshot) : m_Snapshot(std::move(snapshot)) { }
+
+			bool AtEnd() const { return !m_Snapshot || m_Index >= m_Snapshot->size(); }
 
-			std::shared_lock<std::shared_mutex> m_Lock;
-			CacheIter m_Iterator;
+			std::shared_ptr<const Snapshot> m_Snapshot;
+			size_t m_Index = 0;
 		};
 
-		Iterator begin() { return Iterator(m_LoadedTexturesMutex, m_LoadedTextures.begin()); }
+		Iterator begin() { return Iterator(std::make_shared<const Iterator::Snapshot>(m_LoadedTextures.snapshot())); }
 
-		Iterator end() { return Iterator(m_LoadedTexturesMutex, m_LoadedTextures.end()); }
+		Iterator end() { return Iterator(); }
     };
 
     // Saves the contents of texture's slice 0 mip level 0 into a BMP file. 
@@ -0,0 +1,221 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace donut::vfs
+{
+    class IBlob;
+    class IFileSystem;
+}
+
+namespace donut::engine
+{
+    // Software virtual texturing for textures that are too large to be resident in video memory,
+    // such as terrain textures. The texture is split into square pages stored in a tiled file
+    // (see BuildVirtualTextureFile), and only the pages requested by the shaders are loaded into
+    // a shared physical page atlas. The shaders translate virtual texture coordinates into the
+    // atlas through a per-texture indirection texture, see virtual_texture.hlsli.
+
+    constexpr uint32_t c_VirtualTextureFileMagic = 0x58545644; // 'DVTX'
+    constexpr uint32_t c_VirtualTextureFileVersion = 1;
+
+    // Header of a tiled virtual texture file. The header is followed by the page table that
+    // contains one VirtualTexturePageEntry for every page of every mip level, starting with mip 0,
+    // in row-major order within each level, and then by the page payloads. Every page is stored as
+    // uncompressed RGBA8 texels, including a border of 'pageBorder' texels on each side.
+    struct VirtualTextureFileHeader
+    {
+        uint32_t magic = c_VirtualTextureFileMagic;
+        uint32_t version = c_VirtualTextureFileVersion;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t pageSize = 0;
+        uint32_t pageBorder = 0;
+        uint32_t mipLevels = 0;
+        uint32_t sRGB = 0;
+    };
+
+    struct VirtualTexturePageEntry
+    {
+        uint64_t offset = 0; // from the beginning of the file
+        uint32_t size = 0;
+        uint32_t reserved = 0;
+    };
+
+    // Builds the contents of a tiled virtual texture file from an RGBA8 image, generating all mip levels
+    // down to a single page. The image dimensions must be powers of two no smaller than 'pageSize'.
+    // Returns nullptr if the parameters are invalid.
+    std::shared_ptr<vfs::IBlob> BuildVirtualTextureFile(const void* rgba8, uint32_t width, uint32_t height, bool sRGB,
+        uint32_t pageSize = 128, uint32_t pageBorder = 4);
+
+    struct VirtualTextureSystemDesc
+    {
+        // Page layout, must match the files of all virtual textures used with the system
+        uint32_t pageSize = 128;
+        uint32_t pageBorder = 4;
+
+        // Size of the physical page atlas in pages along each axis
+        uint32_t atlasPages = 32;
+
+        // Upper limit for the number of pages that are read and uploaded by one BeginFrame call
+        uint32_t maxPageUploadsPerFrame = 32;
+    };
+
+    struct VirtualTextureStats
+    {
+        uint32_t virtualTextures = 0;
+        uint32_t residentPages = 0;
+        uint32_t atlasPages = 0;
+
+        // Changes made by the last BeginFrame call
+        uint32_t requestedPages = 0;
+        uint32_t pagesLoaded = 0;
+        uint32_t pagesEvicted = 0;
+        uint32_t failedLoads = 0;
+    };
+
+    class VirtualTexture
+    {
+    private:
+        struct Layer
+        {
+            std::filesystem::path path;
+            std::vector<VirtualTexturePageEntry> pageTable;
+        };
+
+        std::vector<Layer> m_Layers;
+        uint32_t m_ID = 0;
+        uint32_t m_Width = 0;
+        uint32_t m_Height = 0;
+        uint32_t m_PageSize = 0;
+        uint32_t m_MipLevels = 0;
+        bool m_LoadFailureReported = false;
+
+        // Per mip level: the index of the first page in the page table, the atlas slot
+        // of each resident page or -1, and the indirection texture contents
+        std::vector<uint32_t> m_MipPageOffsets;
+        std::vector<std::vector<int>> m_PageSlots;
+        std::vector<std::vector<uint32_t>> m_Indirection;
+        uint32_t m_DirtyMipLevels = 0; // mips [0, m_DirtyMipLevels) of the indirection need to be rebuilt
+
+        nvrhi::TextureHandle m_IndirectionTexture;
+        nvrhi::BufferHandle m_ConstantBuffer;
+        nvrhi::BindingSetHandle m_BindingSet;
+
+        friend class VirtualTextureSystem;
+
+    public:
+        [[nodiscard]] uint32_t GetWidth() const { return m_Width; }
+        [[nodiscard]] uint32_t GetHeight() const { return m_Height; }
+        [[nodiscard]] uint32_t GetMipLevels() const { return m_MipLevels; }
+        [[nodiscard]] uint32_t GetLayerCount() const { return uint32_t(m_Layers.size()); }
+        [[nodiscard]] uint32_t GetPageCountX(uint32_t mipLevel) const;
+        [[nodiscard]] uint32_t GetPageCountY(uint32_t mipLevel) const;
+
+        // The binding set for the 'VirtualTextureSystem::GetBindingLayout()' layout
+        [[nodiscard]] nvrhi::IBindingSet* GetBindingSet() const { return m_BindingSet; }
+    };
+
+    // Owns the physical page atlas shared by all virtual textures and streams pages in and out
+    // based on the page requests written by the shaders into a feedback buffer.
+    // The feedback is read back with a latency of two frames, and the least recently requested
+    // pages are evicted when the atlas is full. The coarsest mip level of every virtual texture
+    // stays resident, so that a sample always finds some resident page.
+    // Usage per frame: BeginFrame, render the passes that sample virtual textures, EndFrame.
+    class VirtualTextureSystem
+    {
+    private:
+        struct AtlasSlot
+        {
+            int textureID = -1;
+            uint32_t mipLevel = 0;
+            uint32_t pageX = 0;
+            uint32_t pageY = 0;
+            uint64_t lastUsedFrame = 0;
+            bool pinned = false;
+        };
+
+        struct PageRequest
+        {
+            uint32_t textureID = 0;
+            uint32_t mipLevel = 0;
+            uint32_t pageX = 0;
+            uint32_t pageY = 0;
+        };
+
+        static constexpr uint32_t c_ReadbackLatency = 3;
+
+        nvrhi::DeviceHandle m_Device;
+        std::shared_ptr<vfs::IFileSystem> m_FS;
+        VirtualTextureSystemDesc m_Desc;
+        std::mutex m_Mutex;
+
+        std::vector<std::weak_ptr<VirtualTexture>> m_Textures;
+        std::vector<AtlasSlot> m_Slots;
+        std::vector<int> m_FreeSlots;
+        uint64_t m_FrameIndex = 0;
+        VirtualTextureStats m_Stats;
+
+        nvrhi::TextureHandle m_AtlasTextures[2];
+        nvrhi::TextureHandle m_PageUploadTextures[2];
+        nvrhi::SamplerHandle m_Sampler;
+        nvrhi::BindingLayoutHandle m_BindingLayout;
+        nvrhi::BufferHandle m_FeedbackBuffer;
+        nvrhi::BufferHandle m_ReadbackBuffers[c_ReadbackLatency];
+        uint64_t m_ReadbackFrames[c_ReadbackLatency] = {};
+
+        [[nodiscard]] uint32_t GetPaddedPageSize() const { return m_Desc.pageSize + m_Desc.pageBorder * 2; }
+        bool ReadLayerHeader(const std::filesystem::path& path, VirtualTextureFileHeader& header, std::vector<VirtualTexturePageEntry>& pageTable);
+        void ReleaseExpiredTextures();
+        void CollectFeedback(std::vector<PageRequest>& loads);
+        int AllocateSlot();
+        bool LoadPage(nvrhi::ICommandList* commandList, VirtualTexture& texture, uint32_t mipLevel, uint32_t pageX, uint32_t pageY, bool pinned);
+        void UpdateIndirection(nvrhi::ICommandList* commandList, VirtualTexture& texture);
+
+    public:
+        VirtualTextureSystem(nvrhi::IDevice* device, std::shared_ptr<vfs::IFileSystem> fs, const VirtualTextureSystemDesc& desc = VirtualTextureSystemDesc());
+
+        // Opens the tiled files of a virtual texture and loads its coarsest mip level.
+        // Layer 0 is the base or diffuse color and must be stored as sRGB, the optional layer 1 is
+        // the normal map. All layers must have the same dimensions and the page layout of the system.
+        // Returns nullptr if the files cannot be read or do not match.
+        std::shared_ptr<VirtualTexture> LoadVirtualTexture(nvrhi::ICommandList* commandList, const std::vector<std::filesystem::path>& layerFiles);
+
+        // Processes the oldest available page feedback, loads the requested pages into the atlas,
+        // updates the indirection textures and clears the feedback buffer for the new frame.
+        void BeginFrame(nvrhi::ICommandList* commandList);
+
+        // Copies the page feedback written by this frame into a readback buffer.
+        void EndFrame(nvrhi::ICommandList* commandList);
+
+        [[nodiscard]] nvrhi::IBindingLayout* GetBindingLayout() const { return m_BindingLayout; }
+        [[nodiscard]] VirtualTextureStats GetStats();
+    };
+}
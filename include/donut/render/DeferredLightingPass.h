@@ -42,6 +42,7 @@ namespace donut::engine
 namespace donut::render
 {
     class GBufferRenderTargets;
+    class LightClusteringPass;
     
     class DeferredLightingPass
     {
@@ -53,8 +54,14 @@ namespace donut::render
         nvrhi::SamplerHandle m_ShadowSamplerComparison;
         nvrhi::BufferHandle m_DeferredLightingCB;
         nvrhi::ComputePipelineHandle m_Pso;
+        nvrhi::ComputePipelineHandle m_ClusteredPso;
+        nvrhi::ComputePipelineHandle m_TiledPso;
+        nvrhi::BufferHandle m_TiledLightBuffer;
+        uint32_t m_TiledLightBufferCapacity = 0;
 
         nvrhi::BindingLayoutHandle m_BindingLayout;
+        nvrhi::BindingLayoutHandle m_ClusteredBindingLayout;
+        nvrhi::BindingLayoutHandle m_TiledBindingLayout;
         engine::BindingCache m_BindingSets;
 
         std::shared_ptr<engine::CommonRenderPasses> m_CommonPasses;
@@ -64,6 +71,14 @@ namespace donut::render
         virtual nvrhi::ShaderHandle CreateComputeShader(
             engine::ShaderFactory& shaderFactory);
 
+        virtual nvrhi::ShaderHandle CreateClusteredComputeShader(
+            engine::ShaderFactory& shaderFactory);
+
+        virtual nvrhi::ShaderHandle CreateTiledComputeShader(
+            engine::ShaderFactory& shaderFactory);
+
+        void CreateTiledLightBuffer(uint32_t capacity);
+
     public:
         struct Inputs
         {
@@ -81,6 +96,21 @@ namespace donut::render
             const std::vector<std::shared_ptr<engine::Light>>* lights = nullptr;
             const std::vector<std::shared_ptr<engine::LightProbe>>* lightProbes = nullptr;
 
+            // Optional cluster light lists, built with LightClusteringPass::Render for the same view.
+            // When provided, the lights without shadows are shaded from the clusters and are not limited
+            // by DEFERRED_MAX_LIGHTS. Only valid for composite views with a single planar view.
+            LightClusteringPass* lightClusters = nullptr;
+
+            // Culls the lights without shadows against the depth bounds of 16x16 pixel tiles and shades
+            // only the lights that reach each tile. These lights are not limited by DEFERRED_MAX_LIGHTS.
+            // Ignored when 'lightClusters' is provided.
+            bool tiledLighting = false;
+
+            // Blends a heatmap of the per-tile light counts into the output, for tiled lighting only.
+            // The heatmap goes from blue for no lights to red for 'tileHeatmapMaxLights' lights or more.
+            bool tileHeatmap = false;
+            float tileHeatmapMaxLights = 32.f;
+
             dm::float3 ambientColorTop = 0.f;
             dm::float3 ambientColorBottom = 0.f;
 
@@ -31,6 +31,7 @@
 namespace donut::engine
 {
     class ShaderFactory;
+    class SceneGraph;
     class CommonRenderPasses;
     class FramebufferFactory;
     class MaterialBindingCache;
@@ -114,6 +115,12 @@ namespace donut::render
             const CreateParameters& params);
 
         void ResetBindingCache() const;
+
+        // Pipeline warm-up and the persistent list of pipeline keys, see ForwardShadingPass::GetPipelineKeys.
+        void GetPipelineKeys(const engine::SceneGraph& scene, const engine::IView& view, std::vector<PipelineKey>& keys) const;
+        void PrecompilePipelines(const std::vector<PipelineKey>& keys, nvrhi::IFramebuffer* framebuffer, tf::Executor* executor = nullptr);
+        bool SavePipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path);
+        bool LoadPipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path, std::vector<PipelineKey>& keys) const;
         
         // IGeometryPass implementation
 
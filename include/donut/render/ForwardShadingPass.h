@@ -32,10 +32,13 @@
 namespace donut::engine
 {
     class ShaderFactory;
+    class SceneGraph;
     class Light;
     class CommonRenderPasses;
     class FramebufferFactory;
     class MaterialBindingCache;
+    class VirtualTextureSystem;
+    class Scene;
     struct Material;
     struct LightProbe;
 }
@@ -55,6 +58,8 @@ namespace std
 
 namespace donut::render
 {
+    class LightClusteringPass;
+
     class ForwardShadingPass : public IGeometryPass
     {
     public:
@@ -66,17 +71,20 @@ namespace donut::render
                 nvrhi::RasterCullMode cullMode : 2;
                 bool frontCounterClockwise : 1;
                 bool reverseDepth : 1;
+                bool virtualTexture : 1;
             } bits;
             uint32_t value;
 
-            static constexpr size_t Count = 1 << 7;
+            static constexpr size_t Count = 1 << 8;
         };
 
         class Context : public GeometryPassContext
         {
         public:
             nvrhi::BindingSetHandle lightBindingSet;
+            nvrhi::BindingSetHandle bindlessBindingSet;
             PipelineKey keyTemplate;
+            uint32_t geometryIndex = 0;
 
             Context()
             {
@@ -87,6 +95,19 @@ namespace donut::render
         struct CreateParameters
         {
             std::shared_ptr<engine::MaterialBindingCache> materialBindings;
+            // Enables the materials with a virtual texture; without it, such materials use their regular textures.
+            // Not supported together with bindless materials.
+            std::shared_ptr<engine::VirtualTextureSystem> virtualTextures;
+            // Shades the lights without shadows from the cluster light lists instead of the constant buffer.
+            // The clusters must be built for the same view with LightClusteringPass::Render before rendering.
+            std::shared_ptr<LightClusteringPass> lightClusters;
+            // Enables the bindless material path: the material of each draw is read from the scene's material buffer
+            // through its geometry data, and the textures come from the scene's descriptor table. All materials then
+            // use the same bindings, and RenderView draws the materials that share a pipeline without state changes.
+            // Requires a scene created with a descriptor table and the layout of that table, which must hold the
+            // textures in register space 2 (binding 1 on Vulkan). Virtual textures are not used in this mode.
+            std::shared_ptr<engine::Scene> bindlessScene;
+            nvrhi::BindingLayoutHandle bindlessLayout;
             bool singlePassCubemap = false;
             bool trackLiveness = true;
             uint32_t numConstantBufferVersions = 16;
@@ -99,6 +120,8 @@ namespace donut::render
         nvrhi::ShaderHandle m_VertexShader;
         nvrhi::ShaderHandle m_PixelShader;
         nvrhi::ShaderHandle m_PixelShaderTransmissive;
+        nvrhi::ShaderHandle m_PixelShaderVirtualTexture;
+        nvrhi::ShaderHandle m_PixelShaderVirtualTextureTransmissive;
         nvrhi::ShaderHandle m_GeometryShader;
         nvrhi::SamplerHandle m_ShadowSampler;
         nvrhi::BindingLayoutHandle m_ViewBindingLayout;
@@ -115,10 +138,14 @@ namespace donut::render
         
         std::shared_ptr<engine::CommonRenderPasses> m_CommonPasses;
         std::shared_ptr<engine::MaterialBindingCache> m_MaterialBindings;
+        std::shared_ptr<engine::VirtualTextureSystem> m_VirtualTextures;
+        std::shared_ptr<LightClusteringPass> m_LightClusters;
+        std::shared_ptr<BindlessMaterialBindings> m_BindlessMaterials;
         
         virtual nvrhi::ShaderHandle CreateVertexShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params);
         virtual nvrhi::ShaderHandle CreateGeometryShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params);
         virtual nvrhi::ShaderHandle CreatePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool transmissiveMaterial);
+        virtual nvrhi::ShaderHandle CreateVirtualTexturePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool transmissiveMaterial);
         virtual nvrhi::InputLayoutHandle CreateInputLayout(nvrhi::IShader* vertexShader, const CreateParameters& params);
         virtual nvrhi::BindingLayoutHandle CreateViewBindingLayout();
         virtual nvrhi::BindingSetHandle CreateViewBindingSet();
@@ -126,6 +153,8 @@ namespace donut::render
         virtual nvrhi::BindingSetHandle CreateLightBindingSet(nvrhi::ITexture* shadowMapTexture, nvrhi::ITexture* diffuse, nvrhi::ITexture* specular, nvrhi::ITexture* environmentBrdf);
         virtual std::shared_ptr<engine::MaterialBindingCache> CreateMaterialBindingCache(engine::CommonRenderPasses& commonPasses);
         virtual nvrhi::GraphicsPipelineHandle CreateGraphicsPipeline(PipelineKey key, nvrhi::IFramebuffer* framebuffer);
+
+        bool FillPipelineKey(const Context& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, PipelineKey& key) const;
         
     public:
         ForwardShadingPass(
@@ -146,13 +175,28 @@ namespace donut::render
             dm::float3 ambientColorBottom,
             const std::vector<std::shared_ptr<engine::LightProbe>>& lightProbes);
 
+        // Pipeline warm-up: lists the keys of the pipelines needed to draw the materials of 'scene' into 'view'.
+        // The keys are appended to 'keys' unless already present.
+        void GetPipelineKeys(const engine::SceneGraph& scene, const engine::IView& view, std::vector<PipelineKey>& keys) const;
+
+        // Creates the pipelines for 'keys' before the first draws that need them, in parallel on the executor's
+        // threads when provided. 'framebuffer' must be compatible with the framebuffers that the pass renders into.
+        void PrecompilePipelines(const std::vector<PipelineKey>& keys, nvrhi::IFramebuffer* framebuffer, tf::Executor* executor = nullptr);
+
+        // Saves the keys of all pipelines created so far, including the ones created on demand while rendering,
+        // and loads them in a later run to precompile the same set of pipelines.
+        bool SavePipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path);
+        bool LoadPipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path, std::vector<PipelineKey>& keys) const;
+
         // IGeometryPass implementation
 
         [[nodiscard]] engine::ViewType::Enum GetSupportedViewTypes() const override;
         void SetupView(GeometryPassContext& context, nvrhi::ICommandList* commandList, const engine::IView* view, const engine::IView* viewPrev) override;
         bool SetupMaterial(GeometryPassContext& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state) override;
         void SetupInputBuffers(GeometryPassContext& context, const engine::BufferGroup* buffers, nvrhi::GraphicsState& state) override;
-        void SetPushConstants(GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) override { }
+        void SetPushConstants(GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) override;
+        bool GetMaterialPipelineKey(GeometryPassContext& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, uint32_t& key) override;
+        void SetupGeometry(GeometryPassContext& context, const engine::MeshGeometry* geometry) override;
     };
 
 }
@@ -31,9 +31,12 @@
 namespace donut::engine
 {
     class ShaderFactory;
+    class SceneGraph;
     class CommonRenderPasses;
     class FramebufferFactory;
     class MaterialBindingCache;
+    class VirtualTextureSystem;
+    class Scene;
     struct Material;
 }
 
@@ -50,16 +53,19 @@ namespace donut::render
                 bool alphaTested : 1;
                 bool frontCounterClockwise : 1;
                 bool reverseDepth : 1;
+                bool virtualTexture : 1;
             } bits;
             uint32_t value;
 
-            static constexpr size_t Count = 1 << 5;
+            static constexpr size_t Count = 1 << 6;
         };
 
         class Context : public GeometryPassContext
         {
         public:
             PipelineKey keyTemplate;
+            nvrhi::BindingSetHandle bindlessBindingSet;
+            uint32_t geometryIndex = 0;
 
             Context()
             {
@@ -70,6 +76,12 @@ namespace donut::render
         struct CreateParameters
         {
             std::shared_ptr<engine::MaterialBindingCache> materialBindings;
+            // Enables the materials with a virtual texture; without it, such materials use their regular textures.
+            // Not supported together with bindless materials.
+            std::shared_ptr<engine::VirtualTextureSystem> virtualTextures;
+            // Enables the bindless material path, see ForwardShadingPass::CreateParameters::bindlessScene.
+            std::shared_ptr<engine::Scene> bindlessScene;
+            nvrhi::BindingLayoutHandle bindlessLayout;
             bool enableSinglePassCubemap = false;
             bool enableDepthWrite = true;
             bool enableMotionVectors = false;
@@ -84,6 +96,8 @@ namespace donut::render
         nvrhi::ShaderHandle m_VertexShader;
         nvrhi::ShaderHandle m_PixelShader;
         nvrhi::ShaderHandle m_PixelShaderAlphaTested;
+        nvrhi::ShaderHandle m_PixelShaderVirtualTexture;
+        nvrhi::ShaderHandle m_PixelShaderVirtualTextureAlphaTested;
         nvrhi::ShaderHandle m_GeometryShader;
         nvrhi::BindingLayoutHandle m_ViewBindingLayout;
         nvrhi::BufferHandle m_GBufferCB;
@@ -94,6 +108,8 @@ namespace donut::render
 
         std::shared_ptr<engine::CommonRenderPasses> m_CommonPasses;
         std::shared_ptr<engine::MaterialBindingCache> m_MaterialBindings;
+        std::shared_ptr<engine::VirtualTextureSystem> m_VirtualTextures;
+        std::shared_ptr<BindlessMaterialBindings> m_BindlessMaterials;
 
         bool m_EnableDepthWrite = true;
         uint32_t m_StencilWriteMask = 0;
@@ -101,10 +117,13 @@ namespace donut::render
         virtual nvrhi::ShaderHandle CreateVertexShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params);
         virtual nvrhi::ShaderHandle CreateGeometryShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params);
         virtual nvrhi::ShaderHandle CreatePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested);
+        virtual nvrhi::ShaderHandle CreateVirtualTexturePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested);
         virtual nvrhi::InputLayoutHandle CreateInputLayout(nvrhi::IShader* vertexShader, const CreateParameters& params);
         virtual void CreateViewBindings(nvrhi::BindingLayoutHandle& layout, nvrhi::BindingSetHandle& set, const CreateParameters& params);
         virtual std::shared_ptr<engine::MaterialBindingCache> CreateMaterialBindingCache(engine::CommonRenderPasses& commonPasses);
         virtual nvrhi::GraphicsPipelineHandle CreateGraphicsPipeline(PipelineKey key, nvrhi::IFramebuffer* sampleFramebuffer);
+
+        bool FillPipelineKey(const Context& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, PipelineKey& key) const;
         
     public:
         GBufferFillPass(nvrhi::IDevice* device, std::shared_ptr<engine::CommonRenderPasses> commonPasses);
@@ -114,6 +133,12 @@ namespace donut::render
             const CreateParameters& params);
 
         void ResetBindingCache() const;
+
+        // Pipeline warm-up and the persistent list of pipeline keys, see ForwardShadingPass::GetPipelineKeys.
+        void GetPipelineKeys(const engine::SceneGraph& scene, const engine::IView& view, std::vector<PipelineKey>& keys) const;
+        void PrecompilePipelines(const std::vector<PipelineKey>& keys, nvrhi::IFramebuffer* framebuffer, tf::Executor* executor = nullptr);
+        bool SavePipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path);
+        bool LoadPipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path, std::vector<PipelineKey>& keys) const;
         
         // IGeometryPass implementation
 
@@ -121,18 +146,24 @@ namespace donut::render
         void SetupView(GeometryPassContext& context, nvrhi::ICommandList* commandList, const engine::IView* view, const engine::IView* viewPrev) override;
         bool SetupMaterial(GeometryPassContext& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state) override;
         void SetupInputBuffers(GeometryPassContext& context, const engine::BufferGroup* buffers, nvrhi::GraphicsState& state) override;
-        void SetPushConstants(GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) override { }
+        void SetPushConstants(GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) override;
+        bool GetMaterialPipelineKey(GeometryPassContext& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, uint32_t& key) override;
+        void SetupGeometry(GeometryPassContext& context, const engine::MeshGeometry* geometry) override;
     };
 
     class MaterialIDPass : public GBufferFillPass
     {
     protected:
         nvrhi::ShaderHandle CreatePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested) override;
+        nvrhi::ShaderHandle CreateVirtualTexturePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested) override;
         void CreateViewBindings(nvrhi::BindingLayoutHandle& layout, nvrhi::BindingSetHandle& set, const CreateParameters& params) override;
 
     public:
         using GBufferFillPass::GBufferFillPass;
 
+        // The material ID pass has no bindless mode, its push constants hold the instance offset.
+        void Init(engine::ShaderFactory& shaderFactory, const CreateParameters& params) override;
+
         void SetPushConstants(GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) override;
     };
 }
\ No newline at end of file
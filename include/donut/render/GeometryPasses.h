@@ -24,6 +24,21 @@
 
 #include <donut/engine/View.h>
 #include <nvrhi/nvrhi.h>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace tf
+{
+    class Executor;
+}
+
+namespace donut::vfs
+{
+    class IFileSystem;
+}
 
 namespace donut::engine
 {
@@ -34,6 +49,7 @@ namespace donut::engine
     struct Material;
     struct BufferGroup;
     class FramebufferFactory;
+    class Scene;
 }
 
 namespace donut::render
@@ -63,9 +79,57 @@ namespace donut::render
         virtual bool SetupMaterial(GeometryPassContext& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state) = 0;
         virtual void SetupInputBuffers(GeometryPassContext& context, const engine::BufferGroup* buffers, nvrhi::GraphicsState& state) = 0;
         virtual void SetPushConstants(GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) = 0;
+
+        // Passes that bind the same resources for all materials, like the bindless material path, return true and
+        // a key that identifies the pipeline used for the material. RenderView then calls SetupMaterial only when
+        // the key changes, so that consecutive materials with the same pipeline are drawn without state changes.
+        virtual bool GetMaterialPipelineKey(GeometryPassContext& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, uint32_t& key) { return false; }
+
+        // Called before SetPushConstants with the geometry that the draw renders.
+        virtual void SetupGeometry(GeometryPassContext& context, const engine::MeshGeometry* geometry) { }
+
         virtual ~IGeometryPass() = default;
     };
 
+    // Resources of the bindless material path in GBufferFillPass and ForwardShadingPass. The binding set holds the
+    // scene's material and geometry buffers, the material sampler and the per-draw BindlessDrawConstants with the
+    // geometry index; the textures come from the scene's descriptor table.
+    class BindlessMaterialBindings
+    {
+    private:
+        nvrhi::DeviceHandle m_Device;
+        std::shared_ptr<engine::Scene> m_Scene;
+        nvrhi::BindingLayoutHandle m_Layout;
+        nvrhi::BindingLayoutHandle m_DescriptorTableLayout;
+        nvrhi::SamplerHandle m_Sampler;
+        nvrhi::BindingSetHandle m_BindingSet;
+        nvrhi::IBuffer* m_MaterialBuffer = nullptr;
+        nvrhi::IBuffer* m_GeometryBuffer = nullptr;
+        bool m_TrackLiveness;
+        std::mutex m_Mutex;
+
+    public:
+        BindlessMaterialBindings(
+            nvrhi::IDevice* device,
+            std::shared_ptr<engine::Scene> scene,
+            nvrhi::IBindingLayout* descriptorTableLayout,
+            nvrhi::ISampler* sampler,
+            bool trackLiveness);
+
+        // Checks that the scene has a descriptor table for the bindless textures.
+        static bool IsSupported(const engine::Scene* scene, nvrhi::IBindingLayout* descriptorTableLayout);
+
+        [[nodiscard]] nvrhi::IBindingLayout* GetLayout() const { return m_Layout; }
+        [[nodiscard]] nvrhi::IBindingLayout* GetDescriptorTableLayout() const { return m_DescriptorTableLayout; }
+        [[nodiscard]] nvrhi::IDescriptorTable* GetDescriptorTable() const;
+
+        // Returns the binding set for the current scene buffers, which the scene reallocates when it grows,
+        // or nullptr if the scene has no buffers yet.
+        nvrhi::BindingSetHandle GetBindingSet();
+
+        static void SetDrawConstants(nvrhi::ICommandList* commandList, uint32_t geometryIndex);
+    };
+
     void RenderView(
         nvrhi::ICommandList* commandList, 
         const engine::IView* view, 
@@ -87,4 +151,101 @@ namespace donut::render
         GeometryPassContext& passContext,
         const char* passEvent = nullptr,
         bool materialEvents = false);
-}
\ No newline at end of file
+
+    // Records RenderCompositeView into several command lists in parallel. The draw items of every child view are
+    // collected on the calling thread and split into chunks; each chunk is recorded by a worker into its own
+    // command list, with its own pass context, and Execute submits the lists in the order of the draw items.
+    // The pass must be safe to call from several threads, which is the case for the passes in donut::render.
+    // Render passes in the parallel lists load the framebuffer contents, so clears have to be recorded and
+    // executed before, and the framebuffer textures should use keepInitialState to avoid conflicting transitions.
+    // On D3D11, which has no deferred command lists, or when a command list can't be created, the pass is recorded
+    // into the caller's command list instead, and Execute has nothing to submit for it.
+    class ParallelGeometryRenderer
+    {
+    public:
+        // Called on the worker threads to create the pass context for a command list. Passes that write
+        // volatile constant buffers in their context setup, like ForwardShadingPass::PrepareLights,
+        // have to do that here because the buffer contents are only visible in the same command list.
+        typedef std::function<std::unique_ptr<GeometryPassContext>(nvrhi::ICommandList* commandList)> ContextFactory;
+
+    private:
+        struct Task
+        {
+            uint32_t viewIndex;
+            uint32_t firstItem;
+            uint32_t numItems;
+            uint32_t commandListIndex;
+        };
+
+        nvrhi::DeviceHandle m_Device;
+        tf::Executor* m_Executor;
+        uint32_t m_MaxTasksPerView;
+        uint32_t m_MinItemsPerTask;
+        std::vector<nvrhi::CommandListHandle> m_CommandLists;
+        std::vector<std::vector<DrawItem>> m_ViewItems;
+        uint32_t m_NumRecordedCommandLists = 0;
+        bool m_ParallelRecording;
+
+        // Returns nullptr if the command list can't be created
+        nvrhi::ICommandList* GetCommandList(uint32_t index);
+
+    public:
+        // Without an executor, the command lists are recorded serially on the calling thread.
+        ParallelGeometryRenderer(nvrhi::IDevice* device, tf::Executor* executor, uint32_t maxTasksPerView = 8, uint32_t minItemsPerTask = 128);
+
+        // Records the pass into new command lists that are submitted with the next Execute call.
+        // The draw strategy is only used on the calling thread. 'commandList' must be open,
+        // it is only used when the pass can't be recorded in parallel.
+        void RenderCompositeView(
+            nvrhi::ICommandList* commandList,
+            const engine::ICompositeView* compositeView,
+            const engine::ICompositeView* compositeViewPrev,
+            engine::FramebufferFactory& framebufferFactory,
+            const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+            IDrawStrategy& drawStrategy,
+            IGeometryPass& pass,
+            const ContextFactory& createContext,
+            const char* passEvent = nullptr,
+            bool materialEvents = false);
+
+        // Submits the command lists recorded since the previous call, in recording order.
+        void Execute();
+
+        [[nodiscard]] uint32_t GetNumRecordedCommandLists() const { return m_NumRecordedCommandLists; }
+    };
+
+    // Pipeline warm-up support for the geometry passes, which keep their pipelines in arrays indexed by a key.
+
+    // Returns the cull modes that the draw strategies use with a material: back face culling for single-sided
+    // materials, no culling for double-sided ones, and separate front and back passes for double-sided
+    // transparent materials.
+    std::vector<nvrhi::RasterCullMode> GetMaterialCullModes(const engine::Material& material);
+
+    // Creates the pipelines for 'keys' that are missing from 'pipelines'. With an executor, the pipelines are
+    // created in parallel on its worker threads; the function returns when all of them are done.
+    void PrecompileGeometryPipelines(
+        const std::vector<uint32_t>& keys,
+        nvrhi::GraphicsPipelineHandle* pipelines,
+        size_t pipelineCount,
+        std::mutex& mutex,
+        const std::function<nvrhi::GraphicsPipelineHandle(uint32_t key)>& createPipeline,
+        tf::Executor* executor);
+
+    // Writes the keys of the existing pipelines into a file through the VFS, so that the next run can
+    // precompile the same pipelines before the first frame.
+    bool SaveGeometryPipelineKeys(
+        vfs::IFileSystem& fs,
+        const std::filesystem::path& path,
+        const char* passName,
+        const nvrhi::GraphicsPipelineHandle* pipelines,
+        size_t pipelineCount);
+
+    // Reads the keys written by SaveGeometryPipelineKeys for the same pass.
+    // Returns false if the file is missing or was written by a different pass or key layout.
+    bool LoadGeometryPipelineKeys(
+        vfs::IFileSystem& fs,
+        const std::filesystem::path& path,
+        const char* passName,
+        size_t pipelineCount,
+        std::vector<uint32_t>& keys);
+}
@@ -0,0 +1,130 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+#include <memory>
+#include <vector>
+
+struct LightClusterConstants;
+struct LightClusteringConstants;
+
+namespace donut::engine
+{
+    class ShaderFactory;
+    class Light;
+    class IView;
+}
+
+namespace donut::render
+{
+    // Bins lights into a grid of view space clusters (froxels): screen tiles split into exponential depth slices.
+    // The forward and deferred lighting passes use the cluster light lists to shade any number of lights
+    // while only evaluating the lights that can reach each pixel.
+    // Lights with a shadow map or a shadow channel are not clustered, they stay in the constant buffers
+    // of the lighting passes together with their shadow data.
+    class LightClusteringPass
+    {
+    public:
+        struct CreateParameters
+        {
+            // Capacity of the clustered light buffer, further lights are ignored.
+            uint32_t maxLights = 4096;
+            // Capacity of the cluster grid; the tile size grows for large views to stay within it.
+            uint32_t maxClusters = 65536;
+            // Capacity of the light index buffer shared by all clusters.
+            uint32_t maxLightIndices = 1024 * 1024;
+            // Screen size of the cluster tiles, in pixels.
+            uint32_t tileSize = 64;
+            uint32_t depthSlices = 24;
+            // View depth where the last depth slice starts. The last slice extends to infinity.
+            float maxDistance = 1000.f;
+            // Bins the lights on the CPU and uploads the lists instead of running the compute shader.
+            // Slower with many lights, but useful for testing and validating the GPU results.
+            bool binOnCPU = false;
+        };
+
+    private:
+        nvrhi::DeviceHandle m_Device;
+        nvrhi::ShaderHandle m_ComputeShader;
+        nvrhi::ComputePipelineHandle m_Pipeline;
+        nvrhi::BindingLayoutHandle m_BindingLayout;
+        nvrhi::BindingSetHandle m_BindingSet;
+        nvrhi::BufferHandle m_ConstantBuffer;
+        nvrhi::BufferHandle m_LightBuffer;
+        nvrhi::BufferHandle m_LightBoundsBuffer;
+        nvrhi::BufferHandle m_ClusterGridBuffer;
+        nvrhi::BufferHandle m_LightIndexBuffer;
+        nvrhi::BufferHandle m_LightIndexCounterBuffer;
+
+        CreateParameters m_Params;
+
+        dm::uint3 m_GridSize = dm::uint3::zero();
+        uint32_t m_ClusterTileSize = 0;
+        float m_DepthScale = 0.f;
+        float m_DepthBias = 0.f;
+        uint32_t m_NumLights = 0;
+
+        std::vector<dm::uint2> m_CpuClusterGrid;
+        std::vector<uint32_t> m_CpuLightIndices;
+
+        void BinLightsOnCPU(const LightClusteringConstants& constants, const std::vector<dm::float4>& lightBounds);
+
+    protected:
+        virtual nvrhi::ShaderHandle CreateComputeShader(engine::ShaderFactory& shaderFactory);
+
+    public:
+        explicit LightClusteringPass(nvrhi::IDevice* device);
+        virtual ~LightClusteringPass() = default;
+
+        virtual void Init(engine::ShaderFactory& shaderFactory, const CreateParameters& params);
+
+        // Uploads the lights that are not shadowed and builds the cluster light lists for 'view'.
+        // Must be called before the lighting passes that use the clusters render the same view.
+        void Render(
+            nvrhi::ICommandList* commandList,
+            const engine::IView& view,
+            const std::vector<std::shared_ptr<engine::Light>>& lights);
+
+        // Fills the grid description of the last Render call, for the constant buffers of the lighting passes.
+        void FillClusterConstants(LightClusterConstants& constants) const;
+
+        // StructuredBuffer<LightConstants> with the clustered lights.
+        [[nodiscard]] nvrhi::IBuffer* GetLightBuffer() const { return m_LightBuffer; }
+        // StructuredBuffer<uint2> with the offset and count of each cluster's lights in the index buffer.
+        [[nodiscard]] nvrhi::IBuffer* GetClusterGridBuffer() const { return m_ClusterGridBuffer; }
+        // StructuredBuffer<uint> with the light indices of all clusters.
+        [[nodiscard]] nvrhi::IBuffer* GetLightIndexBuffer() const { return m_LightIndexBuffer; }
+
+        [[nodiscard]] uint32_t GetNumClusteredLights() const { return m_NumLights; }
+        [[nodiscard]] dm::uint3 GetGridSize() const { return m_GridSize; }
+
+        // Results of the last Render call when binning on the CPU, empty otherwise.
+        [[nodiscard]] const std::vector<dm::uint2>& GetCPUClusterGrid() const { return m_CpuClusterGrid; }
+        [[nodiscard]] const std::vector<uint32_t>& GetCPULightIndices() const { return m_CpuLightIndices; }
+
+        // Returns true for the lights that are binned into clusters, i.e. lights without shadows.
+        static bool IsClusteredLight(const engine::Light& light);
+    };
+}
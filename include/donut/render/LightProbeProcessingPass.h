@@ -24,6 +24,7 @@
 
 
 #include <donut/core/math/math.h>
+#include <donut/engine/BindingCache.h>
 #include <nvrhi/nvrhi.h>
 #include <memory>
 #include <unordered_map>
@@ -84,7 +85,7 @@ namespace donut::render
         std::unordered_map<TextureSubresourcesKey, nvrhi::FramebufferHandle, TextureSubresourcesKey::Hash> m_FramebufferCache;
         nvrhi::FramebufferHandle GetCachedFramebuffer(nvrhi::ITexture* texture, nvrhi::TextureSubresourceSet subresources);
 
-        std::unordered_map<TextureSubresourcesKey, nvrhi::BindingSetHandle, TextureSubresourcesKey::Hash> m_BindingSetCache;
+        engine::BindingCache m_BindingSetCache;
         nvrhi::BindingSetHandle GetCachedBindingSet(nvrhi::ITexture* texture, nvrhi::TextureSubresourceSet subresources);
 
 
@@ -136,5 +137,8 @@ namespace donut::render
         nvrhi::ITexture* GetEnvironmentBrdfTexture();
 
         void ResetCaches();
+
+        // Drops the cached binding sets and framebuffers that reference the texture, call it before releasing a light probe texture.
+        void InvalidateTexture(nvrhi::ITexture* texture);
     };
 }
\ No newline at end of file
@@ -22,9 +22,9 @@
 
 #pragma once
 
+#include <donut/engine/BindingCache.h>
 #include <nvrhi/nvrhi.h>
 #include <memory>
-#include <unordered_map>
 
 namespace donut::engine
 {
@@ -80,10 +80,13 @@ namespace donut::render
         std::shared_ptr<engine::CommonRenderPasses> m_CommonPasses;
         std::shared_ptr<engine::FramebufferFactory> m_FramebufferFactory;
 
-        std::unordered_map<nvrhi::ITexture*, nvrhi::BindingSetHandle> m_HistogramBindingSets;
-        std::unordered_map<nvrhi::ITexture*, nvrhi::BindingSetHandle> m_RenderBindingSets;
+        engine::BindingCache m_BindingCache;
 
     public:
+        // Number of AdvanceFrame calls after which an unused binding set, e.g. for a source texture
+        // of a previous resolution, is dropped from the cache.
+        static constexpr uint64_t c_BindingSetMaxAge = 16;
+
         struct CreateParameters
         {
             bool isTextureArray = false;
@@ -117,6 +120,10 @@ namespace donut::render
         
         void AdvanceFrame(float frameTime);
 
+        // Drops the cached binding sets that reference the texture. Sets that are not used for
+        // c_BindingSetMaxAge calls to AdvanceFrame are dropped anyway, this releases the texture sooner.
+        void InvalidateTexture(nvrhi::ITexture* texture);
+
         void ResetExposure(nvrhi::ICommandList* commandList, float initialExposure = 0.f);
         void ResetHistogram(nvrhi::ICommandList* commandList);
         void AddFrameToHistogram(nvrhi::ICommandList* commandList, const engine::ICompositeView& compositeView, nvrhi::ITexture* sourceTexture);
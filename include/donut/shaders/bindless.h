@@ -59,6 +59,12 @@ struct InstanceData
     float3x4 prevTransform;
 };
 
+// Per-draw constants of the bindless material path in the geometry passes
+struct BindlessDrawConstants
+{
+    uint geometryIndex;
+};
+
 #ifndef __cplusplus
 
 static const uint c_SizeOfTriangleIndices = 12;
@@ -67,6 +73,8 @@ static const uint c_SizeOfTexcoord = 8;
 static const uint c_SizeOfNormal = 4;
 static const uint c_SizeOfJointIndices = 8;
 static const uint c_SizeOfJointWeights = 16;
+static const uint c_SizeOfGeometryData = 48;
+static const uint c_SizeOfMaterialConstants = 96;
 
 GeometryData LoadGeometryData(ByteAddressBuffer buffer, uint offset)
 {
@@ -24,12 +24,18 @@
 #define DEFERRED_LIGHTING_CB_H
 
 #include "light_cb.h"
+#include "light_clustering_cb.h"
 #include "view_cb.h"
 
 #define DEFERRED_MAX_LIGHTS 16
 #define DEFERRED_MAX_SHADOWS 16
 #define DEFERRED_MAX_LIGHT_PROBES 16
 
+// Tile size of the tiled lighting permutation, equal to the thread group size
+#define DEFERRED_TILE_SIZE 16
+// Lights beyond this count in a single tile are dropped by the tiled lighting permutation
+#define DEFERRED_MAX_LIGHTS_PER_TILE 512
+
 struct DeferredLightingConstants
 {
     PlanarViewConstants view;
@@ -51,6 +57,13 @@ struct DeferredLightingConstants
 
     float4      noisePattern[4];
 
+    LightClusterConstants clusters;
+
+    uint        numTiledLights;
+    int         enableTileHeatmap;
+    float       tileHeatmapMaxLights;
+    float       padding3;
+
     LightConstants lights[DEFERRED_MAX_LIGHTS];
     ShadowConstants shadows[DEFERRED_MAX_SHADOWS];
     LightProbeConstants lightProbes[DEFERRED_MAX_LIGHT_PROBES];
@@ -24,6 +24,7 @@
 #define FORWARD_CB_H
 
 #include "light_cb.h"
+#include "light_clustering_cb.h"
 #include "view_cb.h"
 
 #define FORWARD_MAX_LIGHTS 16
@@ -46,6 +47,8 @@ struct ForwardShadingLightConstants
     uint        numLights;
     uint        numLightProbes;
 
+    LightClusterConstants clusters;
+
     LightConstants lights[FORWARD_MAX_LIGHTS];
     ShadowConstants shadows[FORWARD_MAX_SHADOWS];
     LightProbeConstants lightProbes[FORWARD_MAX_LIGHT_PROBES];
@@ -0,0 +1,46 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef GENERATE_MIPS_CB_H
+#define GENERATE_MIPS_CB_H
+
+// Number of mip levels written by one dispatch of generate_mips_cs:
+// every thread group reduces a 64x64 tile by 6 levels, then the last group
+// of each array slice reduces the remaining 64x64 values by 6 more levels.
+#define GENERATE_MIPS_MAX_LEVELS 12
+#define GENERATE_MIPS_TILE_SIZE 64
+
+// Upper bound of array slices supported by one dispatch, sizes the group counter buffer.
+#define GENERATE_MIPS_MAX_SLICES 2048
+
+struct GenerateMipsConstants
+{
+    uint2 sourceSize;
+    float2 invSourceSize;
+
+    uint numMips;
+    uint numWorkGroups; // per array slice
+    uint srgb;          // the output views are UNORM aliases of an sRGB texture
+    uint padding;
+};
+
+#endif // GENERATE_MIPS_CB_H
@@ -0,0 +1,56 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef LIGHT_CLUSTERING_CB_H
+#define LIGHT_CLUSTERING_CB_H
+
+#include "view_cb.h"
+
+// Each cluster is binned by one thread group of this size
+#define LIGHT_CLUSTERING_GROUP_SIZE 64
+
+// Lights beyond this count in a single cluster are dropped
+#define LIGHT_CLUSTERING_MAX_LIGHTS_PER_CLUSTER 256
+
+// Describes the cluster grid of a view, used by the passes that read the cluster light lists
+struct LightClusterConstants
+{
+    uint3   gridSize;           // clusters along X, Y and depth
+    uint    tileSize;           // size of a cluster tile in pixels
+
+    float   depthScale;         // slice = log(viewDepth) * depthScale + depthBias
+    float   depthBias;
+    uint    numLights;          // lights in the clustered light buffer
+    uint    padding;
+};
+
+struct LightClusteringConstants
+{
+    PlanarViewConstants view;
+    LightClusterConstants clusters;
+
+    uint    maxLightIndices;    // capacity of the light index buffer
+    float   farSliceDepth;      // far bound of the last depth slice
+    uint2   padding;
+};
+
+#endif // LIGHT_CLUSTERING_CB_H
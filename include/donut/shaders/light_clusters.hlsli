@@ -0,0 +1,50 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef LIGHT_CLUSTERS_HLSLI
+#define LIGHT_CLUSTERS_HLSLI
+
+#include "light_clustering_cb.h"
+
+uint GetLightClusterIndex(LightClusterConstants clusters, uint3 cluster)
+{
+    return (cluster.z * clusters.gridSize.y + cluster.y) * clusters.gridSize.x + cluster.x;
+}
+
+uint GetLightClusterSlice(LightClusterConstants clusters, float viewDepth)
+{
+    float slice = log(max(viewDepth, 1e-6)) * clusters.depthScale + clusters.depthBias;
+    return min(uint(max(slice, 0)), clusters.gridSize.z - 1);
+}
+
+// Returns the offset and count of the lights affecting a surface in the light index buffer.
+// 'viewportPixel' is relative to the view origin, 'viewDepth' is the view space Z of the surface.
+uint2 GetLightClusterRange(StructuredBuffer<uint2> clusterGrid, LightClusterConstants clusters, float2 viewportPixel, float viewDepth)
+{
+    uint3 cluster;
+    cluster.xy = min(uint2(max(viewportPixel, 0)) / clusters.tileSize, clusters.gridSize.xy - 1);
+    cluster.z = GetLightClusterSlice(clusters, viewDepth);
+
+    return clusterGrid[GetLightClusterIndex(clusters, cluster)];
+}
+
+#endif // LIGHT_CLUSTERS_HLSLI
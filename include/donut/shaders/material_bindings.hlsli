@@ -57,6 +57,72 @@
 #define MATERIAL_SAMPLER_SLOT s0
 #endif
 
+// Shader model 5.0 has no unbounded resource arrays, so the DX11 permutations use the regular bindings.
+// DX11 devices have no descriptor tables, and the passes never select the bindless permutations there.
+#if BINDLESS_MATERIALS && defined(__SHADER_TARGET_MAJOR) && __SHADER_TARGET_MAJOR < 6
+#undef BINDLESS_MATERIALS
+#define BINDLESS_MATERIALS 0
+#endif
+
+#if BINDLESS_MATERIALS
+
+// Bindless path: the material comes from the scene material buffer, through the geometry data
+// of the draw, and the textures from the scene descriptor table.
+// LoadBindlessMaterial() must be called before g_Material or the sampling functions are used.
+
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/vulkan.hlsli>
+
+// Index of the descriptor table in the pipeline binding layouts
+#ifndef BINDLESS_DESCRIPTOR_SET
+#define BINDLESS_DESCRIPTOR_SET 2
+#endif
+
+ByteAddressBuffer t_MaterialConstants : register(t0);
+ByteAddressBuffer t_GeometryData : register(t1);
+
+#ifdef SPIRV
+VK_PUSH_CONSTANT ConstantBuffer<BindlessDrawConstants> g_BindlessDraw : register(b3);
+#else
+cbuffer c_BindlessDraw : register(b3)
+{
+    BindlessDrawConstants g_BindlessDraw;
+};
+#endif
+
+VK_BINDING(1, BINDLESS_DESCRIPTOR_SET) Texture2D t_BindlessTextures[] : register(t0, space2);
+
+static MaterialConstants g_Material;
+
+#define t_BaseOrDiffuse         t_BindlessTextures[g_Material.baseOrDiffuseTextureIndex]
+#define t_MetalRoughOrSpecular  t_BindlessTextures[g_Material.metalRoughOrSpecularTextureIndex]
+#define t_Normal                t_BindlessTextures[g_Material.normalTextureIndex]
+#define t_Emissive              t_BindlessTextures[g_Material.emissiveTextureIndex]
+#define t_Occlusion             t_BindlessTextures[g_Material.occlusionTextureIndex]
+#define t_Transmission          t_BindlessTextures[g_Material.transmissionTextureIndex]
+
+void LoadBindlessMaterial()
+{
+    GeometryData geometry = LoadGeometryData(t_GeometryData, g_BindlessDraw.geometryIndex * c_SizeOfGeometryData);
+    g_Material = LoadMaterialConstants(t_MaterialConstants, geometry.materialIndex * c_SizeOfMaterialConstants);
+
+    // Textures that are still loading have no descriptor yet
+    if (g_Material.baseOrDiffuseTextureIndex < 0)
+        g_Material.flags &= ~MaterialFlags_UseBaseOrDiffuseTexture;
+    if (g_Material.metalRoughOrSpecularTextureIndex < 0)
+        g_Material.flags &= ~MaterialFlags_UseMetalRoughOrSpecularTexture;
+    if (g_Material.normalTextureIndex < 0)
+        g_Material.flags &= ~MaterialFlags_UseNormalTexture;
+    if (g_Material.emissiveTextureIndex < 0)
+        g_Material.flags &= ~MaterialFlags_UseEmissiveTexture;
+    if (g_Material.occlusionTextureIndex < 0)
+        g_Material.flags &= ~MaterialFlags_UseOcclusionTexture;
+    if (g_Material.transmissionTextureIndex < 0)
+        g_Material.flags &= ~MaterialFlags_UseTransmissionTexture;
+}
+
+#else
+
 cbuffer c_Material : register(MATERIAL_CB_SLOT)
 {
     MaterialConstants g_Material;
@@ -69,6 +135,8 @@ Texture2D t_Emissive : register(MATERIAL_EMISSIVE_SLOT);
 Texture2D t_Occlusion : register(MATERIAL_OCCLUSION_SLOT);
 Texture2D t_Transmission : register(MATERIAL_TRANSMISSION_SLOT);
 
+#endif
+
 SamplerState s_MaterialSampler : register(MATERIAL_SAMPLER_SLOT);
 
 MaterialTextureSample SampleMaterialTexturesAuto(float2 texCoord)
@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#ifndef VIRTUAL_TEXTURE_HLSLI
+#define VIRTUAL_TEXTURE_HLSLI
+
+#include "donut/shaders/virtual_texture_cb.h"
+#include "donut/shaders/scene_material.hlsli"
+#include "donut/shaders/vulkan.hlsli"
+
+// Bindings - the virtual texture binding set follows the other binding sets of the pass,
+// so the descriptor set index must be defined before including this file on Vulkan.
+
+#ifndef VIRTUAL_TEXTURE_DESCRIPTOR_SET
+#define VIRTUAL_TEXTURE_DESCRIPTOR_SET 2
+#endif
+
+#define VIRTUAL_TEXTURE_REGISTER(slot, dset) register(slot VK_DESCRIPTOR_SET(dset))
+
+cbuffer c_VirtualTexture : VIRTUAL_TEXTURE_REGISTER(b4, VIRTUAL_TEXTURE_DESCRIPTOR_SET)
+{
+    VirtualTextureConstants g_VirtualTexture;
+};
+
+Texture2D<uint> t_VirtualTextureIndirection : VIRTUAL_TEXTURE_REGISTER(t20, VIRTUAL_TEXTURE_DESCRIPTOR_SET);
+Texture2D t_VirtualTextureLayer0 : VIRTUAL_TEXTURE_REGISTER(t21, VIRTUAL_TEXTURE_DESCRIPTOR_SET);
+Texture2D t_VirtualTextureLayer1 : VIRTUAL_TEXTURE_REGISTER(t22, VIRTUAL_TEXTURE_DESCRIPTOR_SET);
+SamplerState s_VirtualTextureSampler : VIRTUAL_TEXTURE_REGISTER(s4, VIRTUAL_TEXTURE_DESCRIPTOR_SET);
+RWStructuredBuffer<uint> u_VirtualTextureFeedback : VIRTUAL_TEXTURE_REGISTER(u7, VIRTUAL_TEXTURE_DESCRIPTOR_SET);
+
+struct VirtualTextureAddress
+{
+    float2 atlasUV;
+    float2 ddx;
+    float2 ddy;
+};
+
+uint2 GetVirtualTexturePageCounts(uint mip)
+{
+    return max(g_VirtualTexture.pageCounts >> mip, 1);
+}
+
+// Records a request for the page that covers 'uv' at 'mip'. Only one pixel in each 2x2 quad writes
+// the request, and the requests are hashed into the shared feedback buffer without atomics:
+// identical requests overwrite each other, and different requests that collide are retried
+// on subsequent frames.
+void WriteVirtualTextureFeedback(float2 uv, uint mip, uint2 pixelPosition)
+{
+    if (any(pixelPosition & 1))
+        return;
+
+    uint2 page = min(uint2(uv * GetVirtualTexturePageCounts(mip)), GetVirtualTexturePageCounts(mip) - 1);
+
+    uint request = page.x
+        | (page.y << VIRTUAL_TEXTURE_FEEDBACK_PAGE_BITS)
+        | (mip << VIRTUAL_TEXTURE_FEEDBACK_MIP_SHIFT)
+        | (g_VirtualTexture.textureID << VIRTUAL_TEXTURE_FEEDBACK_ID_SHIFT);
+
+    uint slot = (request * 0x9E3779B1u) >> 20; // Fibonacci hashing into 4096 entries
+    u_VirtualTextureFeedback[slot % VIRTUAL_TEXTURE_FEEDBACK_ENTRIES] = request;
+}
+
+// Translates virtual texture coordinates into the physical page atlas, using the finest resident
+// page for the mip level selected by the UV derivatives. Writes a feedback request for that mip level.
+VirtualTextureAddress ResolveVirtualTexture(float2 texCoord, float2 ddxUV, float2 ddyUV, uint2 pixelPosition)
+{
+    float2 uv = frac(texCoord);
+
+    float2 dx = ddxUV * g_VirtualTexture.virtualSize;
+    float2 dy = ddyUV * g_VirtualTexture.virtualSize;
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint mip = uint(clamp(floor(lod), 0, float(g_VirtualTexture.mipLevels - 1)));
+
+    WriteVirtualTextureFeedback(uv, mip, pixelPosition);
+
+    uint2 page = min(uint2(uv * GetVirtualTexturePageCounts(mip)), GetVirtualTexturePageCounts(mip) - 1);
+    uint entry = t_VirtualTextureIndirection.Load(int3(page, mip));
+
+    uint pageMask = (1u << VIRTUAL_TEXTURE_INDIRECTION_PAGE_BITS) - 1;
+    uint2 physicalPage = uint2(entry & pageMask, (entry >> VIRTUAL_TEXTURE_INDIRECTION_PAGE_BITS) & pageMask);
+    uint residentMip = entry >> VIRTUAL_TEXTURE_INDIRECTION_MIP_SHIFT;
+
+    // Texel position of the sample within the resident page. Pages of the mips where the texture
+    // is smaller than a page only contain the texture in their top-left corner.
+    float2 residentScale = g_VirtualTexture.virtualSize / float(g_VirtualTexture.pageSize << residentMip);
+    float2 inPage = frac(uv * residentScale);
+
+    float paddedPageSize = float(g_VirtualTexture.pageSize + 2 * g_VirtualTexture.pageBorder);
+    float2 texelInAtlas = float2(physicalPage) * paddedPageSize + g_VirtualTexture.pageBorder + inPage * g_VirtualTexture.pageSize;
+
+    float2 gradientScale = residentScale * g_VirtualTexture.pageSize * g_VirtualTexture.invAtlasSize;
+
+    VirtualTextureAddress address;
+    address.atlasUV = texelInAtlas * g_VirtualTexture.invAtlasSize;
+    address.ddx = ddxUV * gradientScale;
+    address.ddy = ddyUV * gradientScale;
+    return address;
+}
+
+// Replaces the material texture samples that are provided by the virtual texture:
+// layer 0 holds the base or diffuse color, layer 1 holds the normal map if present.
+// The texture flags of 'material' are updated so that EvaluateSceneMaterial uses these samples.
+void SampleVirtualMaterialTextures(inout MaterialTextureSample values, inout MaterialConstants material, float2 texCoord, uint2 pixelPosition)
+{
+    VirtualTextureAddress address = ResolveVirtualTexture(texCoord, ddx(texCoord), ddy(texCoord), pixelPosition);
+
+    values.baseOrDiffuse = t_VirtualTextureLayer0.SampleGrad(s_VirtualTextureSampler, address.atlasUV, address.ddx, address.ddy);
+    material.flags |= MaterialFlags_UseBaseOrDiffuseTexture;
+
+    if (g_VirtualTexture.layerCount > 1)
+    {
+        values.normal = t_VirtualTextureLayer1.SampleGrad(s_VirtualTextureSampler, address.atlasUV, address.ddx, address.ddy);
+        material.flags |= MaterialFlags_UseNormalTexture;
+    }
+}
+
+#endif // VIRTUAL_TEXTURE_HLSLI
@@ -0,0 +1,55 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#ifndef VIRTUAL_TEXTURE_CB_H
+#define VIRTUAL_TEXTURE_CB_H
+
+// Number of entries in the page feedback buffer shared by all virtual textures.
+// Page requests are hashed into this buffer, so collisions only drop some requests for a frame.
+#define VIRTUAL_TEXTURE_FEEDBACK_ENTRIES 4096
+
+// Layout of the indirection texture entries: physical page coordinates and the mip level
+// of the page that is actually resident for this virtual page.
+#define VIRTUAL_TEXTURE_INDIRECTION_PAGE_BITS 12
+#define VIRTUAL_TEXTURE_INDIRECTION_MIP_SHIFT 24
+
+// Layout of the feedback entries: virtual page coordinates, mip level and texture ID.
+#define VIRTUAL_TEXTURE_FEEDBACK_PAGE_BITS 10
+#define VIRTUAL_TEXTURE_FEEDBACK_MIP_SHIFT 20
+#define VIRTUAL_TEXTURE_FEEDBACK_ID_SHIFT 24
+#define VIRTUAL_TEXTURE_FEEDBACK_EMPTY 0xffffffff
+
+struct VirtualTextureConstants
+{
+    float2  virtualSize;        // size of mip 0 in texels
+    float2  invAtlasSize;
+
+    uint2   pageCounts;         // pages in mip 0
+    uint    pageSize;           // page size in texels, excluding the border
+    uint    pageBorder;
+
+    uint    mipLevels;
+    uint    textureID;
+    uint    layerCount;
+    uint    padding;
+};
+
+#endif // VIRTUAL_TEXTURE_CB_H
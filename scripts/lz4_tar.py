@@ -23,7 +23,6 @@
 
 import tarfile
 import os
-import lz4.frame
 import argparse
 import sys
 import io
@@ -31,15 +30,25 @@ import io
 parser = argparse.ArgumentParser(description = "Tar/LZ4 packaging tool", fromfile_prefix_chars='@')
 parser.add_argument('inputs', nargs = '*')
 parser.add_argument('--output', '-o', required = True, help = "Output file name")
-parser.add_argument('--compress', '-c', default = 0, type = int, help = "LZ4 compression level, 0 = uncompressed")
+parser.add_argument('--compress', '-c', default = 0, type = int, help = "Compression level, 0 = uncompressed")
+parser.add_argument('--zstd', '-z', action = 'store_true', help = "Use Zstandard (.zst) instead of LZ4, requires the 'zstandard' module")
+parser.add_argument('--dictionary', '-d', default = None, help = "Zstandard only: train a dictionary on the inputs, save it to this file and compress with it")
+parser.add_argument('--dictionary-size', default = 112640, type = int, help = "Maximum size of the trained dictionary in bytes")
 parser.add_argument('--prefix', '-p', default = '', help="Path prefix for archive files")
 parser.add_argument('--no-compress', '-n', action = 'append', default = [], help="File types to skip compression for")
+parser.add_argument('--independent-blocks', '-i', action = 'store_true', help="Compress blocks independently, enabling parallel decompression")
 
 
 args = parser.parse_args()
 
+if args.zstd:
+    import zstandard
+else:
+    import lz4.frame
+
 original_size = 0
 compressed_size = 0
+zstd_compressor = None
 
 def normalize_path(path):
     path = os.path.normpath(path)
@@ -48,6 +57,24 @@ def normalize_path(path):
     path = path.replace('\\', '/')
     return path
 
+def should_compress(path):
+    extension = os.path.splitext(path)[1]
+    return args.compress and (extension not in args.no_compress)
+
+def create_zstd_compressor(paths):
+    dictionary = None
+    if args.dictionary:
+        samples = []
+        for path in paths:
+            if should_compress(path):
+                with open(path, 'rb') as file:
+                    samples.append(file.read())
+        dictionary = zstandard.train_dictionary(args.dictionary_size, samples)
+        with open(args.dictionary, 'wb') as file:
+            file.write(dictionary.as_bytes())
+        print("Trained a {0:,} byte dictionary with ID {1}".format(len(dictionary.as_bytes()), dictionary.dict_id()))
+    return zstandard.ZstdCompressor(level = args.compress, dict_data = dictionary, write_checksum = True, write_content_size = True)
+
 def process_file(path, tar):
     global original_size, compressed_size
 
@@ -63,10 +90,12 @@ def process_file(path, tar):
 
     original_size += len(contents)
 
-    extension = os.path.splitext(path)[1]
-
-    if args.compress and (extension not in args.no_compress):
-        contents = lz4.frame.compress(contents, compression_level = args.compress, store_size = True, return_bytearray = True)
+    if should_compress(path) and args.zstd:
+        contents = zstd_compressor.compress(contents)
+        archive_path += '.zst'
+    elif should_compress(path):
+        contents = lz4.frame.compress(contents, compression_level = args.compress, store_size = True, return_bytearray = True,
+            block_linked = not args.independent_blocks)
         archive_path += '.lz4'
 
     compressed_size += len(contents)
@@ -75,17 +104,23 @@ def process_file(path, tar):
     tarinfo.size = len(contents)
     tar.addfile(tarinfo, io.BytesIO(contents))
     
+input_paths = []
+for input_name in args.inputs:
+    if os.path.isdir(input_name):
+        # if the line references a directory, recursively collect everything from that directory
+        for dirpath, dirnames, filenames in os.walk(input_name):
+            for file_name in filenames:
+                input_paths.append(os.path.join(dirpath, file_name))
+    else:
+        # just take one file
+        input_paths.append(input_name)
+
+if args.zstd and args.compress:
+    zstd_compressor = create_zstd_compressor(input_paths)
+
 with tarfile.open(args.output, mode = 'w', format = tarfile.USTAR_FORMAT) as tar:
-    for input_name in args.inputs:
-        if os.path.isdir(input_name):
-            # if the line references a directory, recursively collect everything from that directory
-            for dirpath, dirnames, filenames in os.walk(input_name):
-                for file_name in filenames:
-                    path = os.path.join(dirpath, file_name)
-                    process_file(path, tar)
-        else:
-            # just take one file
-            process_file(input_name, tar)
+    for path in input_paths:
+        process_file(path, tar)
 
 if args.compress:
     print("Original size: {0:,} bytes, compressed size: {1:,} bytes (ratio = {2:.2f}x)"
@@ -0,0 +1,145 @@
+#!/usr/bin/python
+#
+# Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+
+# Converts tar and zip archives into Donut packages (.dpk), see include/donut/core/vfs/PackageFile.h
+# Files with the '.lz4' or '.zst' extension, such as those made by lz4_tar.py,
+# are stored as compressed entries under the name without the extension.
+
+import argparse
+import os
+import struct
+import tarfile
+import zipfile
+
+parser = argparse.ArgumentParser(description = "Donut package conversion tool", fromfile_prefix_chars='@')
+parser.add_argument('inputs', nargs = '+', help = "Input .tar or .zip archives, later archives override earlier ones")
+parser.add_argument('--output', '-o', required = True, help = "Output file name")
+
+args = parser.parse_args()
+
+PACKAGE_MAGIC = 0x474b5044
+PACKAGE_VERSION = 1
+PACKAGE_ALIGNMENT = 4096
+EMPTY_SLOT = 0xffffffff
+HEADER_FORMAT = '<IIIIQQQQQQ'
+ENTRY_FORMAT = '<QQQQIHBB'
+
+COMPRESSION_NONE = 0
+COMPRESSION_LZ4 = 1
+COMPRESSION_ZSTD = 2
+COMPRESSION_EXTENSIONS = { '.lz4': COMPRESSION_LZ4, '.zst': COMPRESSION_ZSTD }
+
+def name_hash(name):
+    # 64-bit FNV-1a
+    value = 0xcbf29ce484222325
+    for byte in name:
+        value = ((value ^ byte) * 0x100000001b3) & 0xffffffffffffffff
+    return value
+
+def align(offset):
+    return (offset + PACKAGE_ALIGNMENT - 1) & ~(PACKAGE_ALIGNMENT - 1)
+
+def content_size(compression, data):
+    if compression == COMPRESSION_NONE:
+        return len(data)
+    if compression == COMPRESSION_LZ4:
+        # the content size is present if FLG bit 3 is set
+        if len(data) >= 14 and struct.unpack_from('<I', data)[0] == 0x184d2204 and (data[4] & 0x08):
+            return struct.unpack_from('<Q', data, 6)[0]
+        return 0
+    try:
+        import zstandard
+    except ImportError:
+        return 0
+    try:
+        return max(zstandard.frame_content_size(data), 0)
+    except zstandard.ZstdError:
+        return 0
+
+def read_archive(path):
+    if tarfile.is_tarfile(path):
+        with tarfile.open(path, 'r') as tar:
+            for member in tar.getmembers():
+                if member.isfile():
+                    yield member.name, tar.extractfile(member).read()
+    elif zipfile.is_zipfile(path):
+        with zipfile.ZipFile(path, 'r') as archive:
+            for info in archive.infolist():
+                if not info.is_dir():
+                    yield info.filename, archive.read(info)
+    else:
+        raise ValueError("'{0}' is not a tar or zip archive".format(path))
+
+files = {}
+for input_path in args.inputs:
+    for name, data in read_archive(input_path):
+        name = os.path.normpath(name).replace('\\', '/').lstrip('/')
+        compression = COMPRESSION_EXTENSIONS.get(os.path.splitext(name)[1], COMPRESSION_NONE)
+        if compression != COMPRESSION_NONE:
+            name = os.path.splitext(name)[0]
+        files[name] = (compression, data)
+
+names = sorted(files.keys())
+encoded_names = [name.encode('utf-8') for name in names]
+
+hash_table_size = 0
+if names:
+    hash_table_size = 1
+    while hash_table_size < len(names) * 2:
+        hash_table_size <<= 1
+
+entries_offset = struct.calcsize(HEADER_FORMAT)
+hash_table_offset = entries_offset + len(names) * struct.calcsize(ENTRY_FORMAT)
+strings_offset = hash_table_offset + hash_table_size * 4
+strings_size = sum(len(name) for name in encoded_names)
+data_offset = align(strings_offset + strings_size)
+
+entries = []
+hash_table = [EMPTY_SLOT] * hash_table_size
+name_offset = 0
+payload_offset = data_offset
+for index, name in enumerate(encoded_names):
+    compression, data = files[names[index]]
+    hash = name_hash(name)
+    entries.append(struct.pack(ENTRY_FORMAT, hash, payload_offset, len(data), content_size(compression, data),
+        name_offset, len(name), compression, 0))
+    name_offset += len(name)
+    payload_offset = align(payload_offset + len(data))
+
+    slot = hash & (hash_table_size - 1)
+    while hash_table[slot] != EMPTY_SLOT:
+        slot = (slot + 1) & (hash_table_size - 1)
+    hash_table[slot] = index
+
+with open(args.output, 'wb') as package:
+    package.write(struct.pack(HEADER_FORMAT, PACKAGE_MAGIC, PACKAGE_VERSION, len(names), hash_table_size,
+        entries_offset, hash_table_offset, strings_offset, strings_size, data_offset, 0))
+    package.write(b''.join(entries))
+    package.write(struct.pack('<{0}I'.format(hash_table_size), *hash_table))
+    package.write(b''.join(encoded_names))
+    for name in names:
+        package.write(b'\0' * (align(package.tell()) - package.tell()))
+        package.write(files[name][1])
+    package.write(b'\0' * (align(package.tell()) - package.tell()))
+
+print("Packaged {0} files into '{1}' ({2:,} bytes)".format(len(names), args.output, payload_offset))
@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// Single-pass mip chain generation for all slices of a 2D texture array.
+// Every thread group downsamples a 64x64 tile of the source level into 6 levels.
+// The last group to finish in each slice, detected with an atomic counter,
+// reduces the resulting level into 6 more levels without another dispatch.
+
+#include <donut/shaders/generate_mips_cb.h>
+
+#ifdef SPIRV
+[[vk::push_constant]] ConstantBuffer<GenerateMipsConstants> g_Const;
+#else
+cbuffer g_Const : register(b0) { GenerateMipsConstants g_Const; }
+#endif
+
+Texture2DArray<float4> t_Source : register(t0);
+SamplerState s_LinearClamp : register(s0);
+RWStructuredBuffer<uint> u_Counters : register(u0);
+#ifdef SPIRV
+// See the comment in passes/mipmapgen_cs.hlsl about unsized UAV arrays on Vulkan.
+globallycoherent RWTexture2DArray<float4> u_Mips[] : register(u1);
+#else
+globallycoherent RWTexture2DArray<float4> u_Mips[GENERATE_MIPS_MAX_LEVELS] : register(u1);
+#endif
+
+groupshared float4 s_Values[16][16];
+groupshared uint s_IsLastGroup;
+
+float3 SrgbToLinear(float3 color)
+{
+    float3 lo = color / 12.92;
+    float3 hi = pow((color + 0.055) / 1.055, 2.4);
+    return lerp(lo, hi, step(0.04045, color));
+}
+
+float3 LinearToSrgb(float3 color)
+{
+    color = saturate(color);
+    float3 lo = color * 12.92;
+    float3 hi = 1.055 * pow(color, 1.0 / 2.4) - 0.055;
+    return lerp(lo, hi, step(0.0031308, color));
+}
+
+// 'level' is relative to the source level, starting at 1
+uint2 GetLevelSize(uint level)
+{
+    return max(g_Const.sourceSize >> level, 1);
+}
+
+float4 LoadLevel(uint level, uint2 pos, uint slice)
+{
+    float4 value = u_Mips[level - 1][uint3(min(pos, GetLevelSize(level) - 1), slice)];
+    if (g_Const.srgb)
+        value.rgb = SrgbToLinear(value.rgb);
+    return value;
+}
+
+void StoreLevel(uint level, uint2 pos, uint slice, float4 value)
+{
+    if (any(pos >= GetLevelSize(level)))
+        return;
+
+    if (g_Const.srgb)
+        value.rgb = LinearToSrgb(value.rgb);
+    u_Mips[level - 1][uint3(pos, slice)] = value;
+}
+
+// Reduces the 16x16 values of 'level' held by the group's threads into up to 4 following levels.
+void ReduceGroup(uint2 threadPos, uint2 groupPos, uint slice, uint level, float4 value)
+{
+    s_Values[threadPos.y][threadPos.x] = value;
+
+    for (uint step = 1; step <= 4; step++)
+    {
+        if (level + step > g_Const.numMips)
+            break;
+
+        GroupMemoryBarrierWithGroupSync();
+
+        uint size = 16 >> step;
+        bool active = all(threadPos < size);
+        if (active)
+        {
+            uint2 pos = threadPos * 2;
+            value = 0.25 * (s_Values[pos.y][pos.x] + s_Values[pos.y][pos.x + 1]
+                + s_Values[pos.y + 1][pos.x] + s_Values[pos.y + 1][pos.x + 1]);
+        }
+
+        GroupMemoryBarrierWithGroupSync();
+
+        if (active)
+        {
+            s_Values[threadPos.y][threadPos.x] = value;
+            StoreLevel(level + step, groupPos * size + threadPos, slice, value);
+        }
+    }
+}
+
+[numthreads(16, 16, 1)]
+void main(
+    uint3 groupIdx : SV_GroupID,
+    uint2 threadPos : SV_GroupThreadID,
+    uint threadIndex : SV_GroupIndex)
+{
+    const uint slice = groupIdx.z;
+
+    // Level 1: every thread produces a 2x2 quad with bilinear taps centered between 2x2 source texels.
+    // The source view has the texture's own format, so sRGB data is filtered in linear space.
+    float4 sum = 0;
+    for (uint i = 0; i < 4; i++)
+    {
+        uint2 pos = groupIdx.xy * 32 + threadPos * 2 + uint2(i & 1, i >> 1);
+        float2 uv = (float2(pos * 2) + 1.0) * g_Const.invSourceSize;
+        float4 value = t_Source.SampleLevel(s_LinearClamp, float3(uv, slice), 0);
+        StoreLevel(1, pos, slice, value);
+        sum += value;
+    }
+
+    if (g_Const.numMips < 2)
+        return;
+
+    float4 value = sum * 0.25;
+    StoreLevel(2, groupIdx.xy * 16 + threadPos, slice, value);
+    ReduceGroup(threadPos, groupIdx.xy, slice, 2, value);
+
+    if (g_Const.numMips <= 6)
+        return;
+
+    // Make level 6 visible to the other groups and find out if this group is the last one in the slice.
+    DeviceMemoryBarrierWithGroupSync();
+
+    if (threadIndex == 0)
+    {
+        uint previousCount;
+        InterlockedAdd(u_Counters[slice], 1, previousCount);
+        s_IsLastGroup = (previousCount == g_Const.numWorkGroups - 1) ? 1 : 0;
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    if (s_IsLastGroup == 0)
+        return;
+
+    // Leave the counter ready for the next dispatch
+    if (threadIndex == 0)
+        u_Counters[slice] = 0;
+
+    // Level 7: reduce the (up to) 64x64 values of level 6 written by all groups.
+    sum = 0;
+    for (uint j = 0; j < 4; j++)
+    {
+        uint2 pos = threadPos * 2 + uint2(j & 1, j >> 1);
+        uint2 src = pos * 2;
+        float4 quad = 0.25 * (LoadLevel(6, src, slice) + LoadLevel(6, src + uint2(1, 0), slice)
+            + LoadLevel(6, src + uint2(0, 1), slice) + LoadLevel(6, src + uint2(1, 1), slice));
+        StoreLevel(7, pos, slice, quad);
+        sum += quad;
+    }
+
+    if (g_Const.numMips < 8)
+        return;
+
+    value = sum * 0.25;
+    StoreLevel(8, threadPos, slice, value);
+    ReduceGroup(threadPos, uint2(0, 0), slice, 8, value);
+}
@@ -27,6 +27,14 @@
 #include <donut/shaders/shadows.hlsli>
 #include <donut/shaders/deferred_lighting_cb.h>
 
+#if LIGHT_CLUSTERING && TILED_LIGHTING
+#error "LIGHT_CLUSTERING and TILED_LIGHTING are alternative light selection modes"
+#endif
+
+#if LIGHT_CLUSTERING
+#include <donut/shaders/light_clusters.hlsli>
+#endif
+
 cbuffer c_Deferred : register(b0)
 {
     DeferredLightingConstants g_Deferred;
@@ -37,6 +45,14 @@ TextureCubeArray t_DiffuseLightProbe : register(t1);
 TextureCubeArray t_SpecularLightProbe : register(t2);
 Texture2D t_EnvironmentBrdf : register(t3);
 
+#if TILED_LIGHTING
+StructuredBuffer<LightConstants> t_TiledLights : register(t4);
+#elif LIGHT_CLUSTERING
+StructuredBuffer<LightConstants> t_ClusteredLights : register(t4);
+StructuredBuffer<uint2> t_LightClusterGrid : register(t5);
+StructuredBuffer<uint> t_LightClusterIndices : register(t6);
+#endif
+
 SamplerState s_ShadowSampler : register(s0);
 SamplerComparisonState s_ShadowSamplerComparison : register(s1);
 SamplerState s_LightProbeSampler : register(s2);
@@ -62,13 +78,136 @@ float GetRandom(float2 pos)
     return g_Deferred.noisePattern[y][x];
 }
 
-[numthreads(16, 16, 1)]
-void main(int2 i_globalIdx : SV_DispatchThreadID)
+#if TILED_LIGHTING
+
+groupshared uint s_TileMinDepth;
+groupshared uint s_TileMaxDepth;
+groupshared uint s_TileLightCount;
+groupshared uint s_TileLights[DEFERRED_MAX_LIGHTS_PER_TILE];
+
+// Tests the light's range against the tile frustum, given as 4 inward facing side planes and the depth bounds
+bool IsLightInTile(LightConstants light, float4 tilePlanes[4], float minDepth, float maxDepth)
+{
+    if (light.lightType == LightType_Directional || light.angularSizeOrInvRange <= 0)
+        return true;
+
+    float radius = 1.0 / light.angularSizeOrInvRange;
+    float3 center = mul(float4(light.position, 1), g_Deferred.view.matWorldToView).xyz;
+
+    if (center.z + radius < minDepth || center.z - radius > maxDepth)
+        return false;
+
+    [unroll]
+    for (uint plane = 0; plane < 4; plane++)
+    {
+        if (dot(tilePlanes[plane].xyz, center) + tilePlanes[plane].w < -radius)
+            return false;
+    }
+
+    return true;
+}
+
+// Finds the depth bounds of the tile and collects the tiled lights that can reach it into s_TileLights.
+// Must be called by all threads of the group.
+void CullTileLights(int2 tileIndex, uint threadIdx, bool insideViewport, int2 pixelPosition)
 {
-    if (any(i_globalIdx.xy >= int2(g_Deferred.view.viewportSize)))
+    if (threadIdx == 0)
+    {
+        s_TileMinDepth = 0x7f7fffff; // FLT_MAX
+        s_TileMaxDepth = 0;
+        s_TileLightCount = 0;
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    // Depth bounds of the tile in view space, ignoring the pixels without geometry
+    if (insideViewport)
+    {
+        float viewDepth = ReconstructViewPosition(g_Deferred.view, float2(pixelPosition) + 0.5, t_GBufferDepth[pixelPosition].x).z;
+
+        if (viewDepth > 0 && viewDepth < 3.402823466e+38)
+        {
+            InterlockedMin(s_TileMinDepth, asuint(viewDepth));
+            InterlockedMax(s_TileMaxDepth, asuint(viewDepth));
+        }
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    // No geometry in the tile, nothing to shade
+    if (s_TileMaxDepth == 0)
         return;
 
+    float minDepth = asfloat(s_TileMinDepth);
+    float maxDepth = asfloat(s_TileMaxDepth);
+
+    float2 tileMin = g_Deferred.view.viewportOrigin + float2(tileIndex * DEFERRED_TILE_SIZE);
+    float2 tileMax = min(tileMin + DEFERRED_TILE_SIZE, g_Deferred.view.viewportOrigin + g_Deferred.view.viewportSize);
+
+    // Two points on the view ray through each tile corner, which works for perspective and orthographic views
+    float2 corners[4] = { tileMin, float2(tileMax.x, tileMin.y), tileMax, float2(tileMin.x, tileMax.y) };
+    float3 nearPoints[4];
+    float3 farPoints[4];
+    float3 tileCenter = 0;
+
+    [unroll]
+    for (uint corner = 0; corner < 4; corner++)
+    {
+        nearPoints[corner] = ReconstructViewPosition(g_Deferred.view, corners[corner], 0.25);
+        farPoints[corner] = ReconstructViewPosition(g_Deferred.view, corners[corner], 0.75);
+        tileCenter += nearPoints[corner] * 0.25;
+    }
+
+    float4 tilePlanes[4];
+
+    [unroll]
+    for (uint plane = 0; plane < 4; plane++)
+    {
+        uint next = (plane + 1) & 3;
+        float3 normal = normalize(cross(farPoints[plane] - nearPoints[plane], nearPoints[next] - nearPoints[plane]));
+        tilePlanes[plane] = float4(normal, -dot(normal, nearPoints[plane]));
+
+        if (dot(tilePlanes[plane].xyz, tileCenter) + tilePlanes[plane].w < 0)
+            tilePlanes[plane] = -tilePlanes[plane];
+    }
+
+    for (uint lightIndex = threadIdx; lightIndex < g_Deferred.numTiledLights; lightIndex += DEFERRED_TILE_SIZE * DEFERRED_TILE_SIZE)
+    {
+        if (IsLightInTile(t_TiledLights[lightIndex], tilePlanes, minDepth, maxDepth))
+        {
+            uint slot;
+            InterlockedAdd(s_TileLightCount, 1, slot);
+
+            if (slot < DEFERRED_MAX_LIGHTS_PER_TILE)
+                s_TileLights[slot] = lightIndex;
+        }
+    }
+}
+
+// Blue to green to red ramp for the tile light count visualization
+float3 GetTileHeatmapColor(uint lightCount)
+{
+    float t = saturate(float(lightCount) / max(g_Deferred.tileHeatmapMaxLights, 1));
+    return saturate(float3(t * 2 - 1, 1 - abs(t * 2 - 1), 1 - t * 2));
+}
+
+#endif // TILED_LIGHTING
+
+[numthreads(DEFERRED_TILE_SIZE, DEFERRED_TILE_SIZE, 1)]
+void main(int2 i_globalIdx : SV_DispatchThreadID, int2 i_groupIdx : SV_GroupID, uint i_threadIdx : SV_GroupIndex)
+{
     int2 pixelPosition = i_globalIdx.xy + int2(g_Deferred.view.viewportOrigin);
+    bool insideViewport = all(i_globalIdx.xy < int2(g_Deferred.view.viewportSize));
+
+#if TILED_LIGHTING
+    // All threads take part in the tile culling, so return only after it
+    CullTileLights(i_groupIdx, i_threadIdx, insideViewport, pixelPosition);
+
+    GroupMemoryBarrierWithGroupSync();
+#endif
+
+    if (!insideViewport)
+        return;
 
     float4 gbufferChannels[4];
     gbufferChannels[0] = t_GBuffer0[pixelPosition];
@@ -143,6 +282,39 @@ void main(int2 i_globalIdx : SV_DispatchThreadID)
         specularTerm += (shadow.x * specularRadiance) * light.color;
     }
 
+#if TILED_LIGHTING
+    // Lights without shadows that passed the tile culling
+    uint tileLightCount = min(s_TileLightCount, DEFERRED_MAX_LIGHTS_PER_TILE);
+
+    [loop]
+    for (uint nTileLight = 0; nTileLight < tileLightCount; nTileLight++)
+    {
+        LightConstants light = t_TiledLights[s_TileLights[nTileLight]];
+
+        float3 diffuseRadiance, specularRadiance;
+        ShadeSurface(light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseRadiance, specularRadiance);
+
+        diffuseTerm += diffuseRadiance * light.color;
+        specularTerm += specularRadiance * light.color;
+    }
+#elif LIGHT_CLUSTERING
+    // Lights without shadows, from the light list of the cluster containing the surface
+    float viewDepth = mul(float4(surfaceWorldPos, 1), g_Deferred.view.matWorldToView).z;
+    uint2 clusterRange = GetLightClusterRange(t_LightClusterGrid, g_Deferred.clusters, float2(i_globalIdx.xy) + 0.5, viewDepth);
+
+    [loop]
+    for (uint nClusterLight = 0; nClusterLight < clusterRange.y; nClusterLight++)
+    {
+        LightConstants light = t_ClusteredLights[t_LightClusterIndices[clusterRange.x + nClusterLight]];
+
+        float3 diffuseRadiance, specularRadiance;
+        ShadeSurface(light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseRadiance, specularRadiance);
+
+        diffuseTerm += diffuseRadiance * light.color;
+        specularTerm += specularRadiance * light.color;
+    }
+#endif
+
     float ambientOcclusion = 1;
     if (g_Deferred.enableAmbientOcclusion != 0)
     {
@@ -212,6 +384,11 @@ void main(int2 i_globalIdx : SV_DispatchThreadID)
     float3 outputColor = diffuseTerm
         + specularTerm
         + surfaceMaterial.emissiveColor;
+
+#if TILED_LIGHTING
+    if (g_Deferred.enableTileHeatmap != 0)
+        outputColor = lerp(outputColor, GetTileHeatmapColor(s_TileLightCount + g_Deferred.numLights), 0.5);
+#endif
     
     u_Output[pixelPosition] = float4(outputColor, 0);
 }
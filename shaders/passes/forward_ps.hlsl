@@ -22,6 +22,9 @@
 
 #pragma pack_matrix(row_major)
 
+// The light bindings use descriptor set 2, the descriptor table of the bindless materials comes after them
+#define BINDLESS_DESCRIPTOR_SET 3
+
 #include <donut/shaders/forward_cb.h>
 #include <donut/shaders/scene_material.hlsli>
 #include <donut/shaders/material_bindings.hlsli>
@@ -30,6 +33,19 @@
 #include <donut/shaders/shadows.hlsli>
 #include <donut/shaders/vulkan.hlsli>
 
+#if LIGHT_CLUSTERING
+#include <donut/shaders/light_clusters.hlsli>
+#endif
+
+#if VIRTUAL_TEXTURING && BINDLESS_MATERIALS
+#error "Virtual texturing is not supported together with bindless materials"
+#endif
+
+#if VIRTUAL_TEXTURING
+#define VIRTUAL_TEXTURE_DESCRIPTOR_SET 3
+#include <donut/shaders/virtual_texture.hlsli>
+#endif
+
 cbuffer c_ForwardView : register(b1 VK_DESCRIPTOR_SET(1))
 {
     ForwardShadingViewConstants g_ForwardView;
@@ -45,6 +61,12 @@ TextureCubeArray t_DiffuseLightProbe : register(t11 VK_DESCRIPTOR_SET(2));
 TextureCubeArray t_SpecularLightProbe : register(t12 VK_DESCRIPTOR_SET(2));
 Texture2D t_EnvironmentBrdf : register(t13 VK_DESCRIPTOR_SET(2));
 
+#if LIGHT_CLUSTERING
+StructuredBuffer<LightConstants> t_ClusteredLights : register(t14 VK_DESCRIPTOR_SET(2));
+StructuredBuffer<uint2> t_LightClusterGrid : register(t15 VK_DESCRIPTOR_SET(2));
+StructuredBuffer<uint> t_LightClusterIndices : register(t16 VK_DESCRIPTOR_SET(2));
+#endif
+
 SamplerState s_ShadowSampler : register(s1 VK_DESCRIPTOR_SET(1));
 SamplerState s_LightProbeSampler : register(s2 VK_DESCRIPTOR_SET(2));
 SamplerState s_BrdfSampler : register(s3 VK_DESCRIPTOR_SET(2));
@@ -67,9 +89,18 @@ void main(
 #endif
 )
 {
+#if BINDLESS_MATERIALS
+    LoadBindlessMaterial();
+#endif
+
+    MaterialConstants material = g_Material;
     MaterialTextureSample textures = SampleMaterialTexturesAuto(i_vtx.texCoord);
 
-    MaterialSample surfaceMaterial = EvaluateSceneMaterial(i_vtx.normal, i_vtx.tangent, g_Material, textures);
+#if VIRTUAL_TEXTURING
+    SampleVirtualMaterialTextures(textures, material, i_vtx.texCoord, uint2(i_position.xy));
+#endif
+
+    MaterialSample surfaceMaterial = EvaluateSceneMaterial(i_vtx.normal, i_vtx.tangent, material, textures);
     float3 surfaceWorldPos = i_vtx.pos;
 
     if (!i_isFrontFace)
@@ -128,6 +159,25 @@ void main(
         specularTerm += (shadow.x * specularRadiance) * light.color;
     }
 
+#if LIGHT_CLUSTERING
+    // Lights without shadows, from the light list of the cluster containing the surface
+    float viewDepth = mul(float4(surfaceWorldPos, 1), g_ForwardView.view.matWorldToView).z;
+    uint2 clusterRange = GetLightClusterRange(t_LightClusterGrid, g_ForwardLight.clusters,
+        i_position.xy - g_ForwardView.view.viewportOrigin, viewDepth);
+
+    [loop]
+    for (uint nClusterLight = 0; nClusterLight < clusterRange.y; nClusterLight++)
+    {
+        LightConstants light = t_ClusteredLights[t_LightClusterIndices[clusterRange.x + nClusterLight]];
+
+        float3 diffuseRadiance, specularRadiance;
+        ShadeSurface(light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseRadiance, specularRadiance);
+
+        diffuseTerm += diffuseRadiance * light.color;
+        specularTerm += specularRadiance * light.color;
+    }
+#endif
+
     float NdotV = saturate(-dot(surfaceMaterial.shadingNormal, viewIncident));
 
     if(g_ForwardLight.numLightProbes > 0)
@@ -29,6 +29,15 @@
 #include <donut/shaders/gbuffer_cb.h>
 #include <donut/shaders/vulkan.hlsli>
 
+#if VIRTUAL_TEXTURING && BINDLESS_MATERIALS
+#error "Virtual texturing is not supported together with bindless materials"
+#endif
+
+#if VIRTUAL_TEXTURING
+#define VIRTUAL_TEXTURE_DESCRIPTOR_SET 2
+#include <donut/shaders/virtual_texture.hlsli>
+#endif
+
 cbuffer c_GBuffer : register(b1 VK_DESCRIPTOR_SET(1))
 {
     GBufferFillConstants c_GBuffer;
@@ -50,9 +59,18 @@ void main(
 #endif
 )
 {
+#if BINDLESS_MATERIALS
+    LoadBindlessMaterial();
+#endif
+
+    MaterialConstants material = g_Material;
     MaterialTextureSample textures = SampleMaterialTexturesAuto(i_vtx.texCoord);
 
-    MaterialSample surface = EvaluateSceneMaterial(i_vtx.normal, i_vtx.tangent, g_Material, textures);
+#if VIRTUAL_TEXTURING
+    SampleVirtualMaterialTextures(textures, material, i_vtx.texCoord, uint2(i_position.xy));
+#endif
+
+    MaterialSample surface = EvaluateSceneMaterial(i_vtx.normal, i_vtx.tangent, material, textures);
 
 #if ALPHA_TESTED
     if (g_Material.domain != MaterialDomain_Opaque)
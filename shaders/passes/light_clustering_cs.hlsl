@@ -0,0 +1,126 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/light_clustering_cb.h>
+#include <donut/shaders/light_clusters.hlsli>
+
+cbuffer c_LightClustering : register(b0)
+{
+    LightClusteringConstants g_Clustering;
+};
+
+// View space bounding spheres of the clustered lights: center and radius
+StructuredBuffer<float4> t_LightBounds : register(t0);
+
+RWStructuredBuffer<uint2> u_ClusterGrid : register(u0);
+RWStructuredBuffer<uint> u_LightIndices : register(u1);
+RWStructuredBuffer<uint> u_LightIndexCounter : register(u2);
+
+groupshared uint s_Lights[LIGHT_CLUSTERING_MAX_LIGHTS_PER_CLUSTER];
+groupshared uint s_LightCount;
+groupshared uint s_LightOffset;
+groupshared uint s_StoredCount;
+
+// Returns the view space point on the ray through 'windowPosition' that has the given view depth.
+// The ray is found from two unprojected points, which works for both perspective and orthographic views.
+float3 GetViewPositionAtDepth(float2 windowPosition, float viewDepth)
+{
+    float2 clipXY = windowPosition * g_Clustering.view.windowToClipScale + g_Clustering.view.windowToClipBias;
+
+    float4 nearPoint = mul(float4(clipXY, 0.25, 1), g_Clustering.view.matClipToView);
+    float4 farPoint = mul(float4(clipXY, 0.75, 1), g_Clustering.view.matClipToView);
+    nearPoint.xyz /= nearPoint.w;
+    farPoint.xyz /= farPoint.w;
+
+    float3 direction = farPoint.xyz - nearPoint.xyz;
+    return nearPoint.xyz + direction * ((viewDepth - nearPoint.z) / direction.z);
+}
+
+[numthreads(LIGHT_CLUSTERING_GROUP_SIZE, 1, 1)]
+void main(uint3 i_cluster : SV_GroupID, uint i_threadIdx : SV_GroupIndex)
+{
+    LightClusterConstants clusters = g_Clustering.clusters;
+
+    if (i_threadIdx == 0)
+        s_LightCount = 0;
+
+    // Bounding box of the cluster in view space
+    float2 tileMin = g_Clustering.view.viewportOrigin + float2(i_cluster.xy * clusters.tileSize);
+    float2 tileMax = min(tileMin + float(clusters.tileSize), g_Clustering.view.viewportOrigin + g_Clustering.view.viewportSize);
+
+    float sliceNear = (i_cluster.z == 0) ? 0 : exp((float(i_cluster.z) - clusters.depthBias) / clusters.depthScale);
+    float sliceFar = (i_cluster.z == clusters.gridSize.z - 1) ? g_Clustering.farSliceDepth : exp((float(i_cluster.z + 1) - clusters.depthBias) / clusters.depthScale);
+
+    float3 boxMin = float3(GetViewPositionAtDepth(tileMin, sliceNear).xy, sliceNear);
+    float3 boxMax = boxMin;
+
+    [unroll]
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        float2 windowPosition = float2((corner & 1) ? tileMax.x : tileMin.x, (corner & 2) ? tileMax.y : tileMin.y);
+        float3 position = GetViewPositionAtDepth(windowPosition, (corner & 4) ? sliceFar : sliceNear);
+        boxMin = min(boxMin, position);
+        boxMax = max(boxMax, position);
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint lightIndex = i_threadIdx; lightIndex < clusters.numLights; lightIndex += LIGHT_CLUSTERING_GROUP_SIZE)
+    {
+        float4 sphere = t_LightBounds[lightIndex];
+        float3 offset = clamp(sphere.xyz, boxMin, boxMax) - sphere.xyz;
+
+        if (dot(offset, offset) <= sphere.w * sphere.w)
+        {
+            uint slot;
+            InterlockedAdd(s_LightCount, 1, slot);
+
+            if (slot < LIGHT_CLUSTERING_MAX_LIGHTS_PER_CLUSTER)
+                s_Lights[slot] = lightIndex;
+        }
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    if (i_threadIdx == 0)
+    {
+        uint lightCount = min(s_LightCount, LIGHT_CLUSTERING_MAX_LIGHTS_PER_CLUSTER);
+        uint offset = 0;
+        if (lightCount > 0)
+            InterlockedAdd(u_LightIndexCounter[0], lightCount, offset);
+
+        // The index buffer is full, leave the cluster unlit rather than writing out of bounds
+        if (offset + lightCount > g_Clustering.maxLightIndices)
+            lightCount = 0;
+
+        s_LightOffset = offset;
+        s_StoredCount = lightCount;
+        u_ClusterGrid[GetLightClusterIndex(clusters, i_cluster)] = uint2(offset, lightCount);
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint slot = i_threadIdx; slot < s_StoredCount; slot += LIGHT_CLUSTERING_GROUP_SIZE)
+        u_LightIndices[s_LightOffset + slot] = s_Lights[slot];
+}
@@ -26,6 +26,7 @@
 #include <donut/core/string_utils.h>
 #include <donut/core/vfs/TarFile.h>
 #include <donut/core/vfs/Compression.h>
+#include <donut/core/vfs/PackageFile.h>
 #ifdef DONUT_WITH_MINIZ
 #include <donut/core/vfs/ZipFile.h>
 #endif
@@ -49,7 +50,7 @@ MediaFileSystem::MediaFileSystem(
 	if (nativeFS)
 	{
 		std::vector<std::string> packs;
-		if (mediafs->enumerateFiles("", { ".tar", ".zip", ".pkz" }, vfs::enumerate_to_vector(packs)) > 0)
+		if (mediafs->enumerateFiles("", { ".dpk", ".tar", ".zip", ".pkz" }, vfs::enumerate_to_vector(packs)) > 0)
 		{
 			// sort the packs in reverse because want to search
 			// from 'highest revision' of a pack file down (ex: pack2.pkz is
@@ -61,12 +62,22 @@ MediaFileSystem::MediaFileSystem(
 				std::filesystem::path filePath = mediaFolder / fileName;
 
 				bool mounted = false;
-				if (string_utils::ends_with(fileName, ".tar"))
+				std::vector<std::string> files;
+				if (string_utils::ends_with(fileName, ".dpk"))
+				{
+					if (auto packfs = std::make_shared<PackageFile>(filePath); packfs->isOpen())
+					{
+						packfs->enumerateAllFiles(vfs::enumerate_to_vector(files));
+						AddPackage(std::make_shared<CompressionLayer>(packfs), files, true);
+						mounted = true;
+					}
+				}
+				else if (string_utils::ends_with(fileName, ".tar"))
 				{
 					if (auto packfs = std::make_shared<TarFile>(filePath); packfs->isOpen())
 					{
-						auto tarDecompressionLayer = std::make_shared<CompressionLayer>(packfs);
-						m_FileSystems.push_back(tarDecompressionLayer);
+						packfs->enumerateAllFiles(vfs::enumerate_to_vector(files));
+						AddPackage(std::make_shared<CompressionLayer>(packfs), files, true);
 						mounted = true;
 					}
 				}
@@ -75,7 +86,8 @@ MediaFileSystem::MediaFileSystem(
 				{
 					if (auto packfs = std::make_shared<ZipFile>(filePath); packfs->isOpen())
 					{
-						m_FileSystems.push_back(packfs);
+						packfs->enumerateAllFiles(vfs::enumerate_to_vector(files));
+						AddPackage(packfs, files, false);
 						mounted = true;
 					}
 				}
@@ -95,6 +107,33 @@ MediaFileSystem::MediaFileSystem(
 	}
 }
 
+void MediaFileSystem::AddPackage(std::shared_ptr<IFileSystem> fs, const std::vector<std::string>& files, bool compressed)
+{
+	size_t packageIndex = m_FileSystems.size();
+	m_FileSystems.push_back(fs);
+
+	// packages are added in search order, so keep the existing entries
+	for (const auto& fileName : files)
+	{
+		m_PackageIndex.emplace(fileName, packageIndex);
+
+		// files behind a compression layer are also readable without the compression extension
+		if (compressed && (string_utils::ends_with(fileName, ".lz4") || string_utils::ends_with(fileName, ".zst")))
+			m_PackageIndex.emplace(fileName.substr(0, fileName.size() - 4), packageIndex);
+	}
+}
+
+IFileSystem* MediaFileSystem::FindPackage(const std::filesystem::path& name) const
+{
+	std::string normalizedName = name.lexically_normal().relative_path().generic_string();
+
+	auto it = m_PackageIndex.find(normalizedName);
+	if (it == m_PackageIndex.end())
+		return nullptr;
+
+	return m_FileSystems[it->second].get();
+}
+
 std::vector<std::string> MediaFileSystem::GetAvailableScenes() const
 {
 	std::unordered_set<std::string> resultSet;
@@ -121,20 +160,75 @@ bool MediaFileSystem::folderExists(const std::filesystem::path & path)
 
 bool MediaFileSystem::fileExists(const std::filesystem::path & path)
 {
-	for (const auto& fs : m_FileSystems)
-		if (fs->fileExists(path))
-			return true;
-	return false;
+	// the media folder comes first, then the package that the index points to
+	if (m_FileSystems[0]->fileExists(path))
+		return true;
+
+	IFileSystem* packagefs = FindPackage(path);
+	return packagefs && packagefs->fileExists(path);
 }
 
 std::shared_ptr<IBlob> MediaFileSystem::readFile(const std::filesystem::path & name)
 {
-	for (const auto& fs : m_FileSystems)
-		if (std::shared_ptr<vfs::IBlob> blob = fs->readFile(name))
-			return blob;
+	// the media folder comes first, then the package that the index points to
+	if (std::shared_ptr<vfs::IBlob> blob = m_FileSystems[0]->readFile(name))
+		return blob;
+
+	if (IFileSystem* packagefs = FindPackage(name))
+		return packagefs->readFile(name);
+
 	return nullptr;
 }
 
+std::shared_ptr<IBlob> MediaFileSystem::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+	// resolve the file first, so that a range outside of a media file doesn't fall through to a package
+	if (m_FileSystems[0]->fileExists(name))
+		return m_FileSystems[0]->readFileRange(name, offset, size);
+
+	if (IFileSystem* packagefs = FindPackage(name))
+		return packagefs->readFileRange(name, offset, size);
+
+	return nullptr;
+}
+
+void MediaFileSystem::readFileAsync(const std::filesystem::path& name, read_callback_t callback)
+{
+	std::vector<ReadRequest> requests;
+	requests.push_back({ name, std::move(callback) });
+	readFilesAsync(std::move(requests));
+}
+
+void MediaFileSystem::readFilesAsync(std::vector<ReadRequest> requests)
+{
+	// resolve each file to one file system up front, then submit a batch per file system
+	std::vector<std::vector<ReadRequest>> batches(m_FileSystems.size());
+
+	for (auto& request : requests)
+	{
+		if (m_FileSystems[0]->fileExists(request.name))
+		{
+			batches[0].push_back(std::move(request));
+			continue;
+		}
+
+		auto it = m_PackageIndex.find(request.name.lexically_normal().relative_path().generic_string());
+		if (it == m_PackageIndex.end())
+		{
+			request.callback(nullptr);
+			continue;
+		}
+
+		batches[it->second].push_back(std::move(request));
+	}
+
+	for (size_t index = 0; index < batches.size(); index++)
+	{
+		if (!batches[index].empty())
+			m_FileSystems[index]->readFilesAsync(std::move(batches[index]));
+	}
+}
+
 bool MediaFileSystem::writeFile(const std::filesystem::path & name, const void* data, size_t size)
 {
 	for (const auto& fs : m_FileSystems)
@@ -22,9 +22,12 @@
 
 #include <donut/app/UserInterfaceUtils.h>
 #include <donut/engine/SceneGraph.h>
+#include <donut/engine/Profiler.h>
 #include <donut/core/log.h>
 #include <donut/core/string_utils.h>
 
+#include <cfloat>
+#include <cstdio>
 #include <filesystem>
 #include <imgui.h>
 
@@ -400,3 +403,55 @@ bool donut::app::AzimuthElevationSliders(math::double3& direction, bool negative
 
     return changed;
 }
+
+void donut::app::ProfilerOverlay(engine::Profiler& profiler)
+{
+    bool enabled = profiler.IsEnabled();
+    if (ImGui::Checkbox("Enable Profiler", &enabled))
+        profiler.SetEnabled(enabled);
+
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+        profiler.Reset();
+
+    std::vector<float> frameTimes;
+    profiler.GetFrameTimes(frameTimes);
+
+    if (!frameTimes.empty())
+    {
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "%.2f ms", frameTimes.back());
+        ImGui::PlotLines("CPU Frame", frameTimes.data(), int(frameTimes.size()), 0, overlay, 0.f, FLT_MAX, ImVec2(0.f, 40.f));
+    }
+
+    const std::vector<Profiler::ZoneStatistics> zones = profiler.GetZoneStatistics();
+    if (zones.empty())
+        return;
+
+    if (ImGui::BeginTable("Zones", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV))
+    {
+        ImGui::TableSetupColumn("Zone", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Last", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Avg", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Max", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableHeadersRow();
+
+        for (const Profiler::ZoneStatistics& zone : zones)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%*s%s", int(zone.depth * 2), "", zone.name.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::TextUnformatted(zone.gpu ? "GPU" : "CPU");
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.3f", zone.lastMs);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.3f", zone.averageMs);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%.3f", zone.maxMs);
+        }
+
+        ImGui::EndTable();
+    }
+}
@@ -688,7 +688,8 @@ bool DeviceManager_VK::findQueueFamilies(vk::PhysicalDevice physicalDevice)
             }
         }
 
-        if (m_PresentQueueFamily == -1)
+        // GLFW is not initialized for headless devices, which don't present anyway
+        if (m_PresentQueueFamily == -1 && !m_DeviceParams.headlessDevice)
         {
             if (queueFamily.queueCount > 0 &&
                 glfwGetPhysicalDevicePresentationSupport(m_VulkanInstance, physicalDevice, i))
@@ -23,14 +23,323 @@
 #include <donut/core/vfs/Compression.h>
 #include <donut/core/log.h>
 #include <donut/core/string_utils.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
 #include <unordered_set>
 
 #ifdef DONUT_WITH_LZ4
+#include <lz4.h>
 #include <lz4frame.h>
+#include <xxhash.h>
+#endif
+
+#ifdef DONUT_WITH_ZSTD
+// for ZSTD_findDecompressedSize, zstd is always linked statically
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#endif
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
 #endif
 
 using namespace donut::vfs;
 
+#ifdef DONUT_WITH_ZSTD
+
+struct ZstdDecompressionContextDeleter
+{
+    void operator()(ZSTD_DCtx* context) const { ZSTD_freeDCtx(context); }
+};
+
+// Decompression contexts are expensive to create relative to small files, so keep one per thread.
+static ZSTD_DCtx* getZstdDecompressionContext()
+{
+    static thread_local std::unique_ptr<ZSTD_DCtx, ZstdDecompressionContextDeleter> context(ZSTD_createDCtx());
+    return context.get();
+}
+
+#endif // DONUT_WITH_ZSTD
+
+#if defined(DONUT_WITH_LZ4) && defined(DONUT_WITH_TASKFLOW)
+
+static uint32_t readLittleEndian32(const uint8_t* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static size_t getBlockMaxSize(LZ4F_blockSizeID_t blockSizeID)
+{
+    switch (blockSizeID)
+    {
+    case LZ4F_max256KB: return 256 * 1024;
+    case LZ4F_max1MB: return 1024 * 1024;
+    case LZ4F_max4MB: return 4 * 1024 * 1024;
+    default: return 64 * 1024;
+    }
+}
+
+struct FrameBlock
+{
+    size_t srcOffset = 0;
+    size_t srcSize = 0;
+    size_t dstOffset = 0;
+    size_t dstSize = 0;
+    bool uncompressed = false;
+};
+
+// Shared between the calling thread and the executor tasks helping with decompression.
+// Tasks that start after all blocks have been taken only touch this object, which they co-own.
+struct ParallelDecompressionState
+{
+    const uint8_t* compressedData = nullptr;
+    uint8_t* decompressedData = nullptr;
+    std::vector<FrameBlock> blocks;
+    bool verifyChecksums = false;
+
+    std::atomic<size_t> nextBlock = 0;
+    std::atomic<size_t> finishedBlocks = 0;
+    std::atomic<bool> failed = false;
+
+    std::mutex mutex;
+    std::condition_variable allBlocksFinished;
+
+    void decompressBlock(const FrameBlock& block)
+    {
+        const uint8_t* src = compressedData + block.srcOffset;
+        uint8_t* dst = decompressedData + block.dstOffset;
+
+        if (verifyChecksums && XXH32(src, block.srcSize, 0) != readLittleEndian32(src + block.srcSize))
+        {
+            failed = true;
+            return;
+        }
+
+        if (block.uncompressed)
+        {
+            if (block.srcSize != block.dstSize)
+                failed = true;
+            else
+                memcpy(dst, src, block.srcSize);
+            return;
+        }
+
+        int result = LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+            int(block.srcSize), int(block.dstSize));
+
+        // every block except the last one must be full, otherwise the output offsets are wrong
+        if (result != int(block.dstSize))
+            failed = true;
+    }
+
+    void run()
+    {
+        const size_t numBlocks = blocks.size();
+        size_t index;
+        while ((index = nextBlock++) < numBlocks)
+        {
+            if (!failed)
+                decompressBlock(blocks[index]);
+
+            if (++finishedBlocks == numBlocks)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                allBlocksFinished.notify_all();
+            }
+        }
+    }
+};
+
+// Builds the block list for a frame with independent blocks, starting after the frame header.
+// Returns false if the frame layout doesn't allow placing every block at a known output offset.
+static bool parseFrameBlocks(const uint8_t* data, size_t size, size_t readPtr,
+    const LZ4F_frameInfo_t& frameInfo, std::vector<FrameBlock>& blocks)
+{
+    const size_t blockMaxSize = getBlockMaxSize(frameInfo.blockSizeID);
+    const size_t checksumSize = (frameInfo.blockChecksumFlag == LZ4F_blockChecksumEnabled) ? 4 : 0;
+    const size_t contentSize = size_t(frameInfo.contentSize);
+    size_t dstOffset = 0;
+
+    while (true)
+    {
+        if (readPtr + 4 > size)
+            return false;
+
+        uint32_t blockHeader = readLittleEndian32(data + readPtr);
+        readPtr += 4;
+
+        // end mark
+        if (blockHeader == 0)
+            break;
+
+        FrameBlock block;
+        block.uncompressed = (blockHeader & 0x80000000u) != 0;
+        block.srcSize = blockHeader & 0x7fffffffu;
+        block.srcOffset = readPtr;
+        block.dstOffset = dstOffset;
+
+        if (block.srcSize > blockMaxSize || readPtr + block.srcSize + checksumSize > size || dstOffset >= contentSize)
+            return false;
+
+        block.dstSize = std::min(blockMaxSize, contentSize - dstOffset);
+
+        readPtr += block.srcSize + checksumSize;
+        dstOffset += block.dstSize;
+
+        blocks.push_back(block);
+    }
+
+    return dstOffset == contentSize;
+}
+
+// Decompresses a frame with independent blocks on the executor, with the calling thread participating.
+// The content checksum is not verified on this path, only the block checksums.
+// Returns false if the frame cannot be decoded in parallel, in which case the caller should use the sequential path.
+static bool decompressIndependentBlocks(tf::Executor& executor, const std::filesystem::path& name,
+    const uint8_t* compressedData, size_t compressedSize, size_t readPtr, const LZ4F_frameInfo_t& frameInfo,
+    std::shared_ptr<IBlob>& outBlob)
+{
+    auto state = std::make_shared<ParallelDecompressionState>();
+
+    if (!parseFrameBlocks(compressedData, compressedSize, readPtr, frameInfo, state->blocks))
+        return false;
+
+    const size_t decompressedSize = size_t(frameInfo.contentSize);
+    uint8_t* decompressedData = (uint8_t*)malloc(decompressedSize);
+
+    if (!decompressedData)
+    {
+        donut::log::warning("Failed to decompress LZ4 frame for file '%s': couldn't allocate %llu bytes of memory",
+            name.generic_string().c_str(), decompressedSize);
+        return false;
+    }
+
+    state->compressedData = compressedData;
+    state->decompressedData = decompressedData;
+    state->verifyChecksums = (frameInfo.blockChecksumFlag == LZ4F_blockChecksumEnabled);
+
+    const size_t numBlocks = state->blocks.size();
+    const size_t numHelpers = std::min(executor.num_workers(), numBlocks - 1);
+    for (size_t helper = 0; helper < numHelpers; helper++)
+    {
+        executor.silent_async([state]() { state->run(); });
+    }
+
+    state->run();
+
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->allBlocksFinished.wait(lock, [&state, numBlocks]() { return state->finishedBlocks == numBlocks; });
+    }
+
+    if (state->failed)
+    {
+        free(decompressedData);
+        return false;
+    }
+
+    outBlob = std::make_shared<Blob>(decompressedData, decompressedSize);
+    return true;
+}
+
+#endif // DONUT_WITH_LZ4 && DONUT_WITH_TASKFLOW
+
+bool CompressionLayer::findKnownFormat(const std::string& name, CompressionFormat& format)
+{
+    std::shared_lock<std::shared_mutex> lock(m_KnownFormatsMutex);
+    auto it = m_KnownFormats.find(name);
+    if (it == m_KnownFormats.end())
+        return false;
+
+    format = it->second;
+    return true;
+}
+
+void CompressionLayer::setKnownFormat(const std::string& name, CompressionFormat format)
+{
+    std::lock_guard<std::shared_mutex> lock(m_KnownFormatsMutex);
+    m_KnownFormats[name] = format;
+}
+
+void CompressionLayer::forgetKnownFormat(const std::string& name)
+{
+    std::lock_guard<std::shared_mutex> lock(m_KnownFormatsMutex);
+    m_KnownFormats.erase(name);
+}
+
+void CompressionLayer::clearLookupCache()
+{
+    std::lock_guard<std::shared_mutex> lock(m_KnownFormatsMutex);
+    m_KnownFormats.clear();
+}
+
+CompressionLayer::~CompressionLayer()
+{
+#ifdef DONUT_WITH_ZSTD
+    if (m_ZstdCompressionDictionary)
+    {
+        ZSTD_freeCDict(m_ZstdCompressionDictionary);
+        m_ZstdCompressionDictionary = nullptr;
+    }
+
+    for (auto& [dictionaryID, dictionary] : m_ZstdDecompressionDictionaries)
+        ZSTD_freeDDict(dictionary);
+
+    m_ZstdDecompressionDictionaries.clear();
+#endif
+}
+
+#ifdef DONUT_WITH_ZSTD
+bool CompressionLayer::addZstdDictionary(const void* data, size_t size, bool useForCompression)
+{
+    // raw content dictionaries have no ID, so frames compressed with them cannot be told apart from regular frames
+    uint32_t dictionaryID = ZSTD_getDictID_fromDict(data, size);
+    if (dictionaryID == 0)
+    {
+        log::warning("Cannot use a Zstandard dictionary without an ID, such dictionaries should be created with 'zstd --train'");
+        return false;
+    }
+
+    ZSTD_DDict* decompressionDictionary = ZSTD_createDDict(data, size);
+    if (!decompressionDictionary)
+    {
+        log::warning("Failed to create a Zstandard decompression dictionary (ID %u)", dictionaryID);
+        return false;
+    }
+
+    ZSTD_CDict* compressionDictionary = nullptr;
+    if (useForCompression)
+    {
+        compressionDictionary = ZSTD_createCDict(data, size, m_ZstdCompressionLevel);
+        if (!compressionDictionary)
+        {
+            log::warning("Failed to create a Zstandard compression dictionary (ID %u)", dictionaryID);
+            ZSTD_freeDDict(decompressionDictionary);
+            return false;
+        }
+    }
+
+    std::lock_guard<std::shared_mutex> lock(m_ZstdDictionariesMutex);
+
+    ZSTD_DDict*& slot = m_ZstdDecompressionDictionaries[dictionaryID];
+    if (slot)
+        ZSTD_freeDDict(slot);
+    slot = decompressionDictionary;
+
+    if (compressionDictionary)
+    {
+        if (m_ZstdCompressionDictionary)
+            ZSTD_freeCDict(m_ZstdCompressionDictionary);
+        m_ZstdCompressionDictionary = compressionDictionary;
+    }
+
+    return true;
+}
+#endif
+
 bool CompressionLayer::folderExists(const std::filesystem::path& name)
 {
     return m_fs->folderExists(name);
@@ -41,19 +350,162 @@ bool CompressionLayer::fileExists(const std::filesystem::path& name)
     return m_fs->fileExists(name);
 }
 
-std::shared_ptr<IBlob> CompressionLayer::readFile(const std::filesystem::path& name)
+static const char* getFormatExtension(CompressionFormat format)
 {
+    switch (format)
+    {
 #ifdef DONUT_WITH_LZ4
-    std::filesystem::path nameWithExt = name;
-    nameWithExt += ".lz4";
-    auto compressedBlob = m_fs->readFile(nameWithExt);
+    case CompressionFormat::LZ4: return ".lz4";
+#endif
+#ifdef DONUT_WITH_ZSTD
+    case CompressionFormat::Zstd: return ".zst";
+#endif
+    default: return nullptr;
+    }
+}
 
-    if (!compressedBlob)
-        return m_fs->readFile(name);
-    
-    if (compressedBlob->size() == 0)
-        return compressedBlob;
+std::shared_ptr<IBlob> CompressionLayer::readFile(const std::filesystem::path& name)
+{
+    std::string nameString = name.lexically_normal().generic_string();
+
+    CompressionFormat knownFormat = CompressionFormat::None;
+    bool formatIsKnown = findKnownFormat(nameString, knownFormat);
+
+    for (CompressionFormat format : { CompressionFormat::Zstd, CompressionFormat::LZ4 })
+    {
+        const char* extension = getFormatExtension(format);
+        if (!extension || (formatIsKnown && knownFormat != format))
+            continue;
+
+        std::filesystem::path nameWithExt = name;
+        nameWithExt += extension;
+        auto compressedBlob = m_fs->readFile(nameWithExt);
+
+        if (!compressedBlob)
+            continue;
+
+        if (!formatIsKnown)
+            setKnownFormat(nameString, format);
+
+        if (compressedBlob->size() == 0)
+            return compressedBlob;
+
+        if (format == CompressionFormat::Zstd)
+            return decompressZstd(name, compressedBlob);
 
+        return decompressLZ4(name, compressedBlob);
+    }
+
+    auto uncompressedBlob = m_fs->readFile(name);
+
+    // only remember files that exist, so that lookups of missing files don't grow the cache
+    if (uncompressedBlob && !formatIsKnown)
+        setKnownFormat(nameString, CompressionFormat::None);
+
+    return uncompressedBlob;
+}
+
+CompressionFormat CompressionLayer::probeFormat(const std::filesystem::path& name)
+{
+    for (CompressionFormat format : { CompressionFormat::Zstd, CompressionFormat::LZ4 })
+    {
+        const char* extension = getFormatExtension(format);
+        std::filesystem::path nameWithExt = name;
+        if (extension && m_fs->fileExists(nameWithExt += extension))
+            return format;
+    }
+
+    return CompressionFormat::None;
+}
+
+std::shared_ptr<IBlob> CompressionLayer::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+    std::string nameString = name.lexically_normal().generic_string();
+
+    CompressionFormat format = CompressionFormat::None;
+    bool formatIsKnown = findKnownFormat(nameString, format);
+
+    if (!formatIsKnown)
+        format = probeFormat(name);
+
+    if (format != CompressionFormat::None)
+    {
+        if (!formatIsKnown)
+            setKnownFormat(nameString, format);
+
+        // a range of the decompressed data can only be produced by decompressing everything before it
+        log::error("Cannot read a range of file '%s' because it is stored as '%s%s'. "
+            "Files that are read in ranges, such as virtual textures, must be stored uncompressed.",
+            nameString.c_str(), nameString.c_str(), getFormatExtension(format));
+        return nullptr;
+    }
+
+    auto blob = m_fs->readFileRange(name, offset, size);
+
+    if (blob && !formatIsKnown)
+        setKnownFormat(nameString, CompressionFormat::None);
+
+    return blob;
+}
+
+void CompressionLayer::readFileAsync(const std::filesystem::path& name, read_callback_t callback)
+{
+    std::vector<ReadRequest> requests;
+    requests.push_back({ name, std::move(callback) });
+    readFilesAsync(std::move(requests));
+}
+
+void CompressionLayer::readFilesAsync(std::vector<ReadRequest> requests)
+{
+    for (auto& request : requests)
+    {
+        std::string nameString = request.name.lexically_normal().generic_string();
+
+        CompressionFormat format = CompressionFormat::None;
+        bool formatIsKnown = findKnownFormat(nameString, format);
+
+        // choose the version to read up front, in the same order as readFile does
+        if (!formatIsKnown)
+            format = probeFormat(request.name);
+
+        std::filesystem::path name = request.name;
+        if (format != CompressionFormat::None)
+            request.name += getFormatExtension(format);
+
+        request.callback = [this, name, nameString, format, formatIsKnown, callback = std::move(request.callback)](std::shared_ptr<IBlob> blob)
+        {
+            if (blob && !formatIsKnown)
+                setKnownFormat(nameString, format);
+
+            if (!blob || blob->size() == 0 || format == CompressionFormat::None)
+            {
+                callback(std::move(blob));
+                return;
+            }
+
+            auto decompress = [this, name, format, callback, blob]()
+            {
+                callback(format == CompressionFormat::Zstd ? decompressZstd(name, blob) : decompressLZ4(name, blob));
+            };
+
+#ifdef DONUT_WITH_TASKFLOW
+            // don't block the thread that completes the reads
+            if (m_Executor)
+            {
+                m_Executor->silent_async(decompress);
+                return;
+            }
+#endif
+            decompress();
+        };
+    }
+
+    m_fs->readFilesAsync(std::move(requests));
+}
+
+std::shared_ptr<IBlob> CompressionLayer::decompressLZ4(const std::filesystem::path& name, const std::shared_ptr<IBlob>& compressedBlob)
+{
+#ifdef DONUT_WITH_LZ4
     // initialize the decompression context
     LZ4F_dctx* context = nullptr;
     LZ4F_errorCode_t err = LZ4F_createDecompressionContext(&context, LZ4F_VERSION);
@@ -89,6 +541,21 @@ std::shared_ptr<IBlob> CompressionLayer::readFile(const std::filesystem::path& n
         readPtr += srcSize;
     }
 
+#ifdef DONUT_WITH_TASKFLOW
+    if (m_Executor && frameInfo.blockMode == LZ4F_blockIndependent && frameInfo.dictID == 0 &&
+        frameInfo.contentSize > 0 && frameInfo.contentSize >= m_MinParallelSize)
+    {
+        std::shared_ptr<IBlob> blob;
+        if (decompressIndependentBlocks(*m_Executor, name, compressedData, compressedSize, readPtr, frameInfo, blob))
+        {
+            LZ4F_freeDecompressionContext(context);
+            return blob;
+        }
+
+        // fall through to the sequential path, which reports errors in detail
+    }
+#endif
+
     // get or guess the decompressed data size
     size_t decompressedSize = frameInfo.contentSize;
     size_t decompressionFactor;
@@ -166,20 +633,158 @@ std::shared_ptr<IBlob> CompressionLayer::readFile(const std::filesystem::path& n
     return std::static_pointer_cast<IBlob>(blob);
 
 #else // DONUT_WITH_LZ4
-    return m_fs->readFile(name);
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<IBlob> CompressionLayer::decompressZstd(const std::filesystem::path& name, const std::shared_ptr<IBlob>& compressedBlob)
+{
+#ifdef DONUT_WITH_ZSTD
+    const void* compressedData = compressedBlob->data();
+    const size_t compressedSize = compressedBlob->size();
+
+    // total size of all frames in the file, as files may contain several concatenated frames
+    unsigned long long contentSize = ZSTD_findDecompressedSize(compressedData, compressedSize);
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR)
+    {
+        log::warning("Failed to parse Zstandard frame header for file '%s'", name.generic_string().c_str());
+        return nullptr;
+    }
+
+    // find the dictionary that the frame was compressed with, if any;
+    // keep the lock until decompression is done so that the dictionary cannot be replaced
+    std::shared_lock<std::shared_mutex> lock(m_ZstdDictionariesMutex);
+    ZSTD_DDict* dictionary = nullptr;
+    uint32_t dictionaryID = ZSTD_getDictID_fromFrame(compressedData, compressedSize);
+    if (dictionaryID != 0)
+    {
+        auto it = m_ZstdDecompressionDictionaries.find(dictionaryID);
+        if (it == m_ZstdDecompressionDictionaries.end())
+        {
+            log::warning("Failed to decompress file '%s': Zstandard dictionary %u is not loaded",
+                name.generic_string().c_str(), dictionaryID);
+            return nullptr;
+        }
+        dictionary = it->second;
+    }
+
+    ZSTD_DCtx* context = getZstdDecompressionContext();
+
+    if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN)
+    {
+        // the decompressed size is stored in every frame, decompress in one call
+        uint8_t* decompressedData = (uint8_t*)malloc(std::max(size_t(contentSize), size_t(1)));
+        if (!decompressedData)
+        {
+            log::warning("Failed to decompress file '%s': couldn't allocate %llu bytes of memory",
+                name.generic_string().c_str(), contentSize);
+            return nullptr;
+        }
+
+        size_t result = dictionary
+            ? ZSTD_decompress_usingDDict(context, decompressedData, size_t(contentSize), compressedData, compressedSize, dictionary)
+            : ZSTD_decompressDCtx(context, decompressedData, size_t(contentSize), compressedData, compressedSize);
+
+        if (ZSTD_isError(result) || result != contentSize)
+        {
+            log::warning("Failed to decompress Zstandard frame for file '%s': %s",
+                name.generic_string().c_str(), ZSTD_isError(result) ? ZSTD_getErrorName(result) : "size mismatch");
+            free(decompressedData);
+            return nullptr;
+        }
+
+        return std::make_shared<Blob>(decompressedData, size_t(contentSize));
+    }
+
+    // unknown decompressed size, stream the frames and grow the output buffer as necessary
+    ZSTD_DCtx_reset(context, ZSTD_reset_session_and_parameters);
+    if (dictionary)
+        ZSTD_DCtx_refDDict(context, dictionary);
+
+    size_t decompressedSize = std::max(compressedSize * 3, ZSTD_DStreamOutSize());
+    uint8_t* decompressedData = (uint8_t*)malloc(decompressedSize);
+    ZSTD_inBuffer input = { compressedData, compressedSize, 0 };
+    size_t writePtr = 0;
+
+    while (decompressedData)
+    {
+        ZSTD_outBuffer output = { decompressedData, decompressedSize, writePtr };
+        size_t result = ZSTD_decompressStream(context, &output, &input);
+        writePtr = output.pos;
+
+        if (ZSTD_isError(result) || (result != 0 && input.pos == input.size && writePtr < decompressedSize))
+        {
+            log::warning("Failed to decompress Zstandard frame for file '%s': %s",
+                name.generic_string().c_str(), ZSTD_isError(result) ? ZSTD_getErrorName(result) : "truncated data");
+            free(decompressedData);
+            decompressedData = nullptr;
+            break;
+        }
+
+        if (result == 0 && input.pos == input.size)
+            break;
+
+        if (writePtr == decompressedSize)
+        {
+            decompressedSize *= 2;
+            uint8_t* newData = (uint8_t*)realloc(decompressedData, decompressedSize);
+            if (!newData)
+            {
+                log::warning("Failed to decompress file '%s': couldn't allocate %llu bytes of memory",
+                    name.generic_string().c_str(), decompressedSize);
+                free(decompressedData);
+            }
+            decompressedData = newData;
+        }
+    }
+
+    ZSTD_DCtx_reset(context, ZSTD_reset_session_and_parameters);
+
+    if (!decompressedData)
+        return nullptr;
+
+    return std::make_shared<Blob>(decompressedData, writePtr);
+#else // DONUT_WITH_ZSTD
+    return nullptr;
 #endif
 }
 
 bool CompressionLayer::writeFile(const std::filesystem::path& name, const void* data, size_t size)
 {
-#ifdef DONUT_WITH_LZ4
-    if (!string_utils::ends_with(name.generic_string(), ".lz4"))
-        return m_fs->writeFile(name, data, size);
+    CompressionFormat format = CompressionFormat::None;
+    std::string extension = name.extension().generic_string();
+
+    if (extension == ".lz4" && getFormatExtension(CompressionFormat::LZ4))
+        format = CompressionFormat::LZ4;
+    else if (extension == ".zst" && getFormatExtension(CompressionFormat::Zstd))
+        format = CompressionFormat::Zstd;
+
+    std::filesystem::path uncompressedName = name;
+    if (format != CompressionFormat::None)
+        uncompressedName.replace_extension();
+
+    bool writeSuccessful;
+    if (format == CompressionFormat::None || data == nullptr || size == 0)
+        writeSuccessful = m_fs->writeFile(name, data, size);
+    else if (format == CompressionFormat::Zstd)
+        writeSuccessful = compressZstd(name, data, size);
+    else
+        writeSuccessful = compressLZ4(name, data, size);
 
-    if (data == nullptr || size == 0)
-        return m_fs->writeFile(name, data, size);
+    // subsequent reads of the name return the version that was written last, in either direction
+    std::string uncompressedNameString = uncompressedName.lexically_normal().generic_string();
+    if (writeSuccessful)
+        setKnownFormat(uncompressedNameString, format);
+    else
+        forgetKnownFormat(uncompressedNameString);
 
-    // initialize the decompression context
+    return writeSuccessful;
+}
+
+bool CompressionLayer::compressLZ4(const std::filesystem::path& name, const void* data, size_t size)
+{
+#ifdef DONUT_WITH_LZ4
+    // initialize the compression context
     LZ4F_cctx* context = nullptr;
     LZ4F_errorCode_t err = LZ4F_createCompressionContext(&context, LZ4F_VERSION);
 
@@ -198,6 +803,7 @@ bool CompressionLayer::writeFile(const std::filesystem::path& name, const void*
     LZ4F_preferences_t preferences{};
     preferences.frameInfo.contentSize = uncompressedSize;
     preferences.frameInfo.blockChecksumFlag = LZ4F_blockChecksumEnabled;
+    preferences.frameInfo.blockMode = m_IndependentBlocks ? LZ4F_blockIndependent : LZ4F_blockLinked;
     preferences.compressionLevel = m_CompressionLevel;
 
     // get the maximum size 
@@ -237,9 +843,66 @@ bool CompressionLayer::writeFile(const std::filesystem::path& name, const void*
     compressedData = nullptr;
 
     return writeSuccessful;
-    
+
 #else // DONUT_WITH_LZ4
-    return m_fs->writeFile(name, data, size);
+    return false;
+#endif
+}
+
+bool CompressionLayer::compressZstd(const std::filesystem::path& name, const void* data, size_t size)
+{
+#ifdef DONUT_WITH_ZSTD
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    if (!context)
+    {
+        log::warning("Failed to create a Zstandard compression context");
+        return false;
+    }
+
+    ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+
+    // keep the lock until compression is done so that the dictionary cannot be replaced
+    std::shared_lock<std::shared_mutex> lock(m_ZstdDictionariesMutex);
+
+    // the dictionary carries its own compression level
+    if (m_ZstdCompressionDictionary)
+        ZSTD_CCtx_refCDict(context, m_ZstdCompressionDictionary);
+    else
+        ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, m_ZstdCompressionLevel);
+
+    size_t compressedSizeBound = ZSTD_compressBound(size);
+    uint8_t* compressedData = (uint8_t*)malloc(compressedSizeBound);
+
+    if (!compressedData)
+    {
+        log::warning("Failed to compress file '%s': couldn't allocate %llu bytes of memory",
+            name.generic_string().c_str(), compressedSizeBound);
+
+        ZSTD_freeCCtx(context);
+        return false;
+    }
+
+    // the content size is stored in the frame by default, which enables single-call decompression
+    size_t compressedSize = ZSTD_compress2(context, compressedData, compressedSizeBound, data, size);
+
+    ZSTD_freeCCtx(context);
+
+    if (ZSTD_isError(compressedSize))
+    {
+        log::warning("Failed to compress file '%s': %s",
+            name.generic_string().c_str(), ZSTD_getErrorName(compressedSize));
+
+        free(compressedData);
+        return false;
+    }
+
+    bool writeSuccessful = m_fs->writeFile(name, compressedData, compressedSize);
+
+    free(compressedData);
+
+    return writeSuccessful;
+#else // DONUT_WITH_ZSTD
+    return false;
 #endif
 }
 
@@ -247,8 +910,15 @@ int CompressionLayer::enumerateFiles(const std::filesystem::path& path,
     const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates)
 {
     std::vector<std::string> patchedExtensions = extensions;
-    for (const auto& ext : extensions)
-        patchedExtensions.push_back(ext + ".lz4");
+    for (CompressionFormat format : { CompressionFormat::Zstd, CompressionFormat::LZ4 })
+    {
+        const char* compressedExtension = getFormatExtension(format);
+        if (!compressedExtension)
+            continue;
+
+        for (const auto& ext : extensions)
+            patchedExtensions.push_back(ext + compressedExtension);
+    }
 
     // use a set to de-duplicate the names in case some file exists
     // in both compressed and uncompressed versions
@@ -257,7 +927,7 @@ int CompressionLayer::enumerateFiles(const std::filesystem::path& path,
     int numRawResults = m_fs->enumerateFiles(path, patchedExtensions,
         [&resultSet, allowDuplicates, callback](std::string_view name)
         {
-            if (string_utils::ends_with(name, ".lz4"))
+            if (string_utils::ends_with(name, ".lz4") || string_utils::ends_with(name, ".zst"))
                 name.remove_suffix(4);
             
             if (allowDuplicates)
@@ -0,0 +1,362 @@
+/*
+* Copyright (c) 2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "IoUringReader.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// older C libraries do not define the io_uring system call numbers, which are the same on all architectures
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+using namespace donut::vfs;
+
+struct IoUringReader::ReadOperation
+{
+    int fd = -1;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t bytesRead = 0;
+    iovec buffer{};
+    read_callback_t callback;
+};
+
+// Linux transfers at most about 2 GB in a single read, larger files are read in several parts
+static constexpr size_t c_MaxReadSize = size_t(1) << 30;
+
+// user data of the no-op entry that wakes up the completion thread on shutdown
+static constexpr uint64_t c_WakeupUserData = 0;
+
+static int ioUringSetup(unsigned entries, io_uring_params* params)
+{
+    return int(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return int(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+IoUringReader::IoUringReader(unsigned queueDepth)
+{
+    io_uring_params params{};
+    int ringFd = ioUringSetup(queueDepth, &params);
+    if (ringFd < 0)
+        return; // not supported by the kernel or blocked by the sandbox, the caller falls back to synchronous reads
+
+    m_SubmissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_CompletionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_SubmissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMapping)
+        m_SubmissionRingSize = m_CompletionRingSize = std::max(m_SubmissionRingSize, m_CompletionRingSize);
+
+    auto mapRing = [ringFd](size_t size, off_t offset) -> void*
+    {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return (ptr == MAP_FAILED) ? nullptr : ptr;
+    };
+
+    m_RingFd = ringFd;
+    m_SubmissionRing = mapRing(m_SubmissionRingSize, IORING_OFF_SQ_RING);
+    m_CompletionRing = singleMapping ? m_SubmissionRing : mapRing(m_CompletionRingSize, IORING_OFF_CQ_RING);
+    m_SubmissionEntries = static_cast<io_uring_sqe*>(mapRing(m_SubmissionEntriesSize, IORING_OFF_SQES));
+
+    if (!m_SubmissionRing || !m_CompletionRing || !m_SubmissionEntries)
+    {
+        log::warning("Failed to map the io_uring queues: %s", strerror(errno));
+        release();
+        return;
+    }
+
+    uint8_t* submissionRing = static_cast<uint8_t*>(m_SubmissionRing);
+    m_SubmissionTail = reinterpret_cast<unsigned*>(submissionRing + params.sq_off.tail);
+    m_SubmissionMask = reinterpret_cast<unsigned*>(submissionRing + params.sq_off.ring_mask);
+    m_SubmissionArray = reinterpret_cast<unsigned*>(submissionRing + params.sq_off.array);
+    m_SubmissionCapacity = params.sq_entries;
+
+    uint8_t* completionRing = static_cast<uint8_t*>(m_CompletionRing);
+    m_CompletionHead = reinterpret_cast<unsigned*>(completionRing + params.cq_off.head);
+    m_CompletionTail = reinterpret_cast<unsigned*>(completionRing + params.cq_off.tail);
+    m_CompletionMask = reinterpret_cast<unsigned*>(completionRing + params.cq_off.ring_mask);
+    m_CompletionEntries = reinterpret_cast<io_uring_cqe*>(completionRing + params.cq_off.cqes);
+
+    m_CompletionThread = std::thread(&IoUringReader::processCompletions, this);
+}
+
+IoUringReader::~IoUringReader()
+{
+    if (m_CompletionThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lockGuard(m_SubmissionMutex);
+            m_ShuttingDown = true;
+            queueNop();
+            flushSubmissions(1);
+        }
+
+        // the thread exits after all reads in flight have completed
+        m_CompletionThread.join();
+    }
+
+    release();
+}
+
+void IoUringReader::release()
+{
+    if (m_SubmissionEntries)
+        munmap(m_SubmissionEntries, m_SubmissionEntriesSize);
+    if (m_CompletionRing && m_CompletionRing != m_SubmissionRing)
+        munmap(m_CompletionRing, m_CompletionRingSize);
+    if (m_SubmissionRing)
+        munmap(m_SubmissionRing, m_SubmissionRingSize);
+    if (m_RingFd >= 0)
+        close(m_RingFd);
+
+    m_SubmissionEntries = nullptr;
+    m_CompletionRing = nullptr;
+    m_SubmissionRing = nullptr;
+    m_RingFd = -1;
+}
+
+bool IoUringReader::queueRead(ReadOperation* operation)
+{
+    if (m_OperationsInFlight >= m_SubmissionCapacity)
+    {
+        m_PendingOperations.push_back(operation);
+        return false;
+    }
+
+    // the submission ring has a single producer because all submissions hold m_SubmissionMutex,
+    // and it is drained by every io_uring_enter call, so there is always space
+    unsigned tail = *m_SubmissionTail;
+    unsigned index = tail & *m_SubmissionMask;
+
+    operation->buffer.iov_base = operation->data + operation->bytesRead;
+    operation->buffer.iov_len = std::min(operation->size - operation->bytesRead, c_MaxReadSize);
+
+    io_uring_sqe& entry = m_SubmissionEntries[index];
+    memset(&entry, 0, sizeof(entry));
+    entry.opcode = IORING_OP_READV;
+    entry.fd = operation->fd;
+    entry.addr = uint64_t(&operation->buffer);
+    entry.len = 1;
+    entry.off = operation->bytesRead;
+    entry.user_data = uint64_t(operation);
+
+    m_SubmissionArray[index] = index;
+    __atomic_store_n(m_SubmissionTail, tail + 1, __ATOMIC_RELEASE);
+
+    ++m_OperationsInFlight;
+    return true;
+}
+
+void IoUringReader::queueNop()
+{
+    unsigned tail = *m_SubmissionTail;
+    unsigned index = tail & *m_SubmissionMask;
+
+    io_uring_sqe& entry = m_SubmissionEntries[index];
+    memset(&entry, 0, sizeof(entry));
+    entry.opcode = IORING_OP_NOP;
+    entry.user_data = c_WakeupUserData;
+
+    m_SubmissionArray[index] = index;
+    __atomic_store_n(m_SubmissionTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void IoUringReader::flushSubmissions(unsigned count)
+{
+    while (count > 0)
+    {
+        int submitted = ioUringEnter(m_RingFd, count, 0, 0);
+
+        if (submitted < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+
+            log::error("io_uring submission failed: %s", strerror(errno));
+            return;
+        }
+
+        count -= std::min(count, unsigned(submitted));
+    }
+}
+
+void IoUringReader::processCompletions()
+{
+    std::vector<ReadOperation*> finishedOperations;
+    std::vector<ReadOperation*> unfinishedOperations;
+
+    while (true)
+    {
+        if (ioUringEnter(m_RingFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            log::error("Waiting for io_uring completions failed: %s", strerror(errno));
+            return;
+        }
+
+        unsigned head = *m_CompletionHead;
+        unsigned tail = __atomic_load_n(m_CompletionTail, __ATOMIC_ACQUIRE);
+        unsigned numCompletions = 0;
+
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& completion = m_CompletionEntries[head & *m_CompletionMask];
+            if (completion.user_data == c_WakeupUserData)
+                continue;
+
+            ReadOperation* operation = reinterpret_cast<ReadOperation*>(completion.user_data);
+            ++numCompletions;
+
+            if (completion.res == -EINTR || completion.res == -EAGAIN)
+            {
+                unfinishedOperations.push_back(operation);
+            }
+            else if (completion.res <= 0)
+            {
+                // an error, or the file became shorter than it was when the read was submitted
+                free(operation->data);
+                operation->data = nullptr;
+                finishedOperations.push_back(operation);
+            }
+            else
+            {
+                operation->bytesRead += size_t(completion.res);
+
+                if (operation->bytesRead < operation->size)
+                    unfinishedOperations.push_back(operation);
+                else
+                    finishedOperations.push_back(operation);
+            }
+        }
+
+        __atomic_store_n(m_CompletionHead, head, __ATOMIC_RELEASE);
+
+        bool exit;
+        {
+            std::lock_guard<std::mutex> lockGuard(m_SubmissionMutex);
+            m_OperationsInFlight -= numCompletions;
+
+            // continue partially read files before starting new ones
+            m_PendingOperations.insert(m_PendingOperations.begin(), unfinishedOperations.begin(), unfinishedOperations.end());
+            unfinishedOperations.clear();
+
+            unsigned numQueued = 0;
+            while (!m_PendingOperations.empty() && m_OperationsInFlight < m_SubmissionCapacity)
+            {
+                ReadOperation* operation = m_PendingOperations.front();
+                m_PendingOperations.pop_front();
+                queueRead(operation);
+                ++numQueued;
+            }
+            flushSubmissions(numQueued);
+
+            exit = m_ShuttingDown && m_OperationsInFlight == 0 && m_PendingOperations.empty();
+        }
+
+        // call the callbacks without holding the lock, they may submit more reads
+        for (ReadOperation* operation : finishedOperations)
+        {
+            close(operation->fd);
+
+            std::shared_ptr<IBlob> blob;
+            if (operation->data)
+                blob = std::make_shared<Blob>(operation->data, operation->size);
+            
+            operation->callback(std::move(blob));
+            delete operation;
+        }
+        finishedOperations.clear();
+
+        if (exit)
+            return;
+    }
+}
+
+void IoUringReader::submit(std::vector<ReadRequest> requests)
+{
+    std::vector<ReadOperation*> operations;
+    operations.reserve(requests.size());
+
+    for (auto& request : requests)
+    {
+        int fd = open(request.name.c_str(), O_RDONLY | O_CLOEXEC);
+
+        struct stat fileStat{};
+        if (fd < 0 || fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+        {
+            // file does not exist or is not accessible
+            if (fd >= 0)
+                close(fd);
+            request.callback(nullptr);
+            continue;
+        }
+
+        size_t size = size_t(fileStat.st_size);
+        void* data = malloc(std::max(size, size_t(1)));
+
+        if (size == 0 || !data)
+        {
+            close(fd);
+            request.callback(data ? std::make_shared<Blob>(data, 0) : nullptr);
+            continue;
+        }
+
+        ReadOperation* operation = new ReadOperation();
+        operation->fd = fd;
+        operation->data = static_cast<uint8_t*>(data);
+        operation->size = size;
+        operation->callback = std::move(request.callback);
+        operations.push_back(operation);
+    }
+
+    if (operations.empty())
+        return;
+
+    std::lock_guard<std::mutex> lockGuard(m_SubmissionMutex);
+
+    unsigned numQueued = 0;
+    for (ReadOperation* operation : operations)
+    {
+        if (queueRead(operation))
+            ++numQueued;
+    }
+
+    flushSubmissions(numQueued);
+}
@@ -0,0 +1,86 @@
+/*
+* Copyright (c) 2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/vfs/VFS.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace donut::vfs
+{
+    /*
+    Reads whole native files through a Linux io_uring instance.
+    Files are opened and their sizes queried on the submitting thread, then the reads
+    are queued to the kernel in batches. A completion thread owned by the reader resubmits
+    short reads and calls the request callbacks once each file is complete.
+    The number of reads in flight is limited by the ring size; excess reads wait in a queue.
+    */
+    class IoUringReader
+    {
+    private:
+        struct ReadOperation;
+
+        int m_RingFd = -1;
+        void* m_SubmissionRing = nullptr;
+        void* m_CompletionRing = nullptr;
+        size_t m_SubmissionRingSize = 0;
+        size_t m_CompletionRingSize = 0;
+        io_uring_sqe* m_SubmissionEntries = nullptr;
+        size_t m_SubmissionEntriesSize = 0;
+
+        unsigned* m_SubmissionTail = nullptr;
+        unsigned* m_SubmissionMask = nullptr;
+        unsigned* m_SubmissionArray = nullptr;
+        unsigned m_SubmissionCapacity = 0;
+        unsigned* m_CompletionHead = nullptr;
+        unsigned* m_CompletionTail = nullptr;
+        unsigned* m_CompletionMask = nullptr;
+        io_uring_cqe* m_CompletionEntries = nullptr;
+
+        // protects the submission ring and the fields below
+        std::mutex m_SubmissionMutex;
+        std::deque<ReadOperation*> m_PendingOperations;
+        unsigned m_OperationsInFlight = 0;
+        bool m_ShuttingDown = false;
+
+        std::thread m_CompletionThread;
+
+        void release();
+        bool queueRead(ReadOperation* operation);
+        void queueNop();
+        void flushSubmissions(unsigned count);
+        void processCompletions();
+
+    public:
+        explicit IoUringReader(unsigned queueDepth = 64);
+        ~IoUringReader();
+
+        [[nodiscard]] bool isValid() const { return m_RingFd >= 0; }
+
+        void submit(std::vector<ReadRequest> requests);
+    };
+}
@@ -0,0 +1,552 @@
+/*
+* Copyright (c) 2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/vfs/PackageFile.h>
+#include <donut/core/log.h>
+#include <donut/core/string_utils.h>
+#include <algorithm>
+#include <cstring>
+#include <regex>
+
+#ifdef DONUT_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+using namespace donut::vfs;
+
+static const char* getCompressionExtension(CompressionFormat format)
+{
+    switch (format)
+    {
+    case CompressionFormat::LZ4: return ".lz4";
+    case CompressionFormat::Zstd: return ".zst";
+    default: return "";
+    }
+}
+
+static uint64_t alignPackageOffset(uint64_t offset)
+{
+    return (offset + PackageAlignment - 1) & ~(PackageAlignment - 1);
+}
+
+uint64_t donut::vfs::getPackageNameHash(std::string_view name)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : name)
+    {
+        hash ^= uint8_t(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+PackageFile::PackageFile(const std::filesystem::path& packagePath)
+{
+    m_PackagePath = packagePath.lexically_normal().generic_string();
+    m_PackageFile = fopen(m_PackagePath.c_str(), "rb");
+
+    if (m_PackageFile && !loadTableOfContents())
+    {
+        fclose(m_PackageFile);
+        m_PackageFile = nullptr;
+        m_TableOfContents.clear();
+        m_EntryCount = 0;
+        m_HashTableSize = 0;
+    }
+}
+
+PackageFile::~PackageFile()
+{
+    // make sure we're not closing the file while some other thread is reading from it
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (m_PackageFile)
+    {
+        fclose(m_PackageFile);
+        m_PackageFile = nullptr;
+    }
+}
+
+bool PackageFile::loadTableOfContents()
+{
+    fseeko(m_PackageFile, 0, SEEK_END);
+    uint64_t packageSize = ftello(m_PackageFile);
+    fseeko(m_PackageFile, 0, SEEK_SET);
+
+    PackageHeader header;
+    if (fread(&header, sizeof(header), 1, m_PackageFile) != 1 || header.magic != PackageMagic)
+    {
+        log::warning("File '%s' is not a valid package", m_PackagePath.c_str());
+        return false;
+    }
+
+    if (header.version != PackageVersion)
+    {
+        log::warning("Package '%s' has unsupported version %d (expected %d)",
+            m_PackagePath.c_str(), header.version, PackageVersion);
+        return false;
+    }
+
+    // validate the table of contents layout before trusting any of the offsets
+    bool validLayout = header.entriesOffset == sizeof(PackageHeader)
+        && header.hashTableOffset == header.entriesOffset + uint64_t(header.entryCount) * sizeof(PackageEntry)
+        && header.stringsOffset == header.hashTableOffset + uint64_t(header.hashTableSize) * sizeof(uint32_t)
+        && header.stringsOffset + header.stringsSize <= header.dataOffset
+        && header.dataOffset <= packageSize
+        && (header.hashTableSize & (header.hashTableSize - 1)) == 0
+        && header.hashTableSize >= header.entryCount
+        && (header.entryCount == 0 || header.hashTableSize > 0);
+
+    if (!validLayout)
+    {
+        log::warning("Malformed package '%s': invalid table of contents", m_PackagePath.c_str());
+        return false;
+    }
+
+    // load the whole table of contents with one read
+    m_TableOfContents.resize(header.dataOffset);
+    memcpy(m_TableOfContents.data(), &header, sizeof(header));
+    size_t remainingSize = header.dataOffset - sizeof(header);
+    if (remainingSize > 0 && fread(m_TableOfContents.data() + sizeof(header), 1, remainingSize, m_PackageFile) != remainingSize)
+    {
+        log::warning("Error reading the table of contents of package '%s'", m_PackagePath.c_str());
+        return false;
+    }
+
+    m_Entries = reinterpret_cast<const PackageEntry*>(m_TableOfContents.data() + header.entriesOffset);
+    m_HashTable = reinterpret_cast<const uint32_t*>(m_TableOfContents.data() + header.hashTableOffset);
+    m_Strings = reinterpret_cast<const char*>(m_TableOfContents.data() + header.stringsOffset);
+    m_EntryCount = header.entryCount;
+    m_HashTableSize = header.hashTableSize;
+
+    for (uint32_t index = 0; index < m_EntryCount; index++)
+    {
+        const PackageEntry& entry = m_Entries[index];
+        if (uint64_t(entry.nameOffset) + entry.nameLength > header.stringsSize
+            || entry.offset < header.dataOffset
+            || entry.offset + entry.storedSize > packageSize)
+        {
+            log::warning("Malformed package '%s': entry %d is out of range", m_PackagePath.c_str(), index);
+            return false;
+        }
+    }
+
+    for (uint32_t slot = 0; slot < m_HashTableSize; slot++)
+    {
+        if (m_HashTable[slot] != PackageEmptySlot && m_HashTable[slot] >= m_EntryCount)
+        {
+            log::warning("Malformed package '%s': invalid hash table", m_PackagePath.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool PackageFile::isOpen() const
+{
+    return m_PackageFile != nullptr;
+}
+
+std::string_view PackageFile::getEntryName(const PackageEntry& entry) const
+{
+    return std::string_view(m_Strings + entry.nameOffset, entry.nameLength);
+}
+
+std::string PackageFile::getVisibleName(const PackageEntry& entry) const
+{
+    std::string name(getEntryName(entry));
+    name += getCompressionExtension(entry.compression);
+    return name;
+}
+
+const PackageEntry* PackageFile::findEntry(std::string_view normalizedName) const
+{
+    if (m_HashTableSize == 0)
+        return nullptr;
+
+    uint64_t hash = getPackageNameHash(normalizedName);
+    uint32_t mask = m_HashTableSize - 1;
+
+    // the table is at least as large as the entry count, so the probe always terminates
+    // at an empty slot or after visiting every slot once
+    for (uint32_t probe = 0, slot = uint32_t(hash) & mask; probe < m_HashTableSize; probe++, slot = (slot + 1) & mask)
+    {
+        uint32_t index = m_HashTable[slot];
+        if (index == PackageEmptySlot)
+            return nullptr;
+
+        const PackageEntry& entry = m_Entries[index];
+        if (entry.nameHash == hash && getEntryName(entry) == normalizedName)
+            return &entry;
+    }
+
+    return nullptr;
+}
+
+const PackageEntry* PackageFile::findVisibleEntry(const std::filesystem::path& name) const
+{
+    std::string normalizedName = name.lexically_normal().relative_path().generic_string();
+
+    if (normalizedName.empty())
+        return nullptr;
+
+    // an uncompressed entry may legitimately have a name ending with a compression extension
+    const PackageEntry* entry = findEntry(normalizedName);
+    if (entry && entry->compression == CompressionFormat::None)
+        return entry;
+
+    for (CompressionFormat format : { CompressionFormat::LZ4, CompressionFormat::Zstd })
+    {
+        std::string_view extension = getCompressionExtension(format);
+        if (string_utils::ends_with(normalizedName, extension))
+        {
+            std::string_view baseName(normalizedName.data(), normalizedName.size() - extension.size());
+            entry = findEntry(baseName);
+            if (entry && entry->compression == format)
+                return entry;
+            break;
+        }
+    }
+
+    return nullptr;
+}
+
+const std::unordered_set<std::string>& PackageFile::getDirectories()
+{
+    std::call_once(m_DirectoriesFlag, [this]()
+    {
+        for (uint32_t index = 0; index < m_EntryCount; index++)
+        {
+            std::filesystem::path filePath = getEntryName(m_Entries[index]);
+            while (filePath.has_parent_path())
+            {
+                filePath = filePath.parent_path();
+                if (!m_Directories.insert(filePath.generic_string()).second)
+                    break;
+            }
+        }
+    });
+
+    return m_Directories;
+}
+
+void PackageFile::enumerateAllFiles(enumerate_callback_t callback) const
+{
+    for (uint32_t index = 0; index < m_EntryCount; index++)
+        callback(getVisibleName(m_Entries[index]));
+}
+
+bool PackageFile::folderExists(const std::filesystem::path& name)
+{
+    std::string normalizedName = name.lexically_normal().relative_path().generic_string();
+
+    const auto& directories = getDirectories();
+    return directories.find(normalizedName) != directories.end();
+}
+
+bool PackageFile::fileExists(const std::filesystem::path& name)
+{
+    return findVisibleEntry(name) != nullptr;
+}
+
+std::shared_ptr<IBlob> PackageFile::readFile(const std::filesystem::path& name)
+{
+    const PackageEntry* entry = findVisibleEntry(name);
+
+    if (!entry)
+        return nullptr;
+
+    void* data = malloc(entry->storedSize);
+
+    if (!data)
+        return nullptr;
+
+    // prevent concurrent file operations from multiple threads from this point on
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (fseeko(m_PackageFile, entry->offset, SEEK_SET) != 0
+        || fread(data, 1, entry->storedSize, m_PackageFile) != entry->storedSize)
+    {
+        log::warning("Error reading file '%s' (%llu bytes) from package '%s'",
+            getVisibleName(*entry).c_str(), (unsigned long long)entry->storedSize, m_PackagePath.c_str());
+        free(data);
+        return nullptr;
+    }
+
+    return std::make_shared<Blob>(data, entry->storedSize);
+}
+
+std::shared_ptr<IBlob> PackageFile::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+    const PackageEntry* entry = findVisibleEntry(name);
+
+    if (!entry || offset > entry->storedSize || size > entry->storedSize - offset)
+        return nullptr;
+
+    void* data = malloc(size);
+
+    if (!data && size != 0)
+        return nullptr;
+
+    // prevent concurrent file operations from multiple threads from this point on
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (fseeko(m_PackageFile, entry->offset + offset, SEEK_SET) != 0
+        || fread(data, 1, size, m_PackageFile) != size)
+    {
+        log::warning("Error reading %llu bytes at offset %llu of file '%s' from package '%s'",
+            (unsigned long long)size, (unsigned long long)offset, getVisibleName(*entry).c_str(), m_PackagePath.c_str());
+        free(data);
+        return nullptr;
+    }
+
+    return std::make_shared<Blob>(data, size);
+}
+
+bool PackageFile::writeFile(const std::filesystem::path&, const void*, size_t)
+{
+    // packages are mounted read-only
+    return false;
+}
+
+int PackageFile::enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates)
+{
+    (void)allowDuplicates;
+    std::basic_regex<char> regex(getFileSearchRegex(path.relative_path(), extensions));
+
+    int numEntries = 0;
+    for (uint32_t index = 0; index < m_EntryCount; index++)
+    {
+        std::string name = getVisibleName(m_Entries[index]);
+        if (std::regex_match(name, regex))
+        {
+            std::filesystem::path filePath = name;
+            callback(filePath.filename().generic_string());
+            ++numEntries;
+        }
+    }
+
+    return numEntries;
+}
+
+int PackageFile::enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates)
+{
+    (void)allowDuplicates;
+    std::filesystem::path normalizedPath = path.relative_path().lexically_normal();
+
+    int numEntries = 0;
+    for (const auto& name : getDirectories())
+    {
+        std::filesystem::path dirPath = name;
+        if (dirPath.parent_path() == normalizedPath)
+        {
+            callback(dirPath.filename().generic_string());
+            ++numEntries;
+        }
+    }
+
+    return numEntries;
+}
+
+// Returns the decompressed size stored in the frame header, or 0 if it's not available.
+static uint64_t getContentSize(CompressionFormat format, const std::shared_ptr<IBlob>& data)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data->data());
+    size_t size = data->size();
+
+    if (format == CompressionFormat::LZ4)
+    {
+        // LZ4 frame: magic, FLG, BD, [content size], ... - see the LZ4 frame format description
+        const uint32_t lz4FrameMagic = 0x184d2204;
+        const uint8_t contentSizeFlag = 0x08;
+        if (size < 14 || memcmp(bytes, &lz4FrameMagic, sizeof(lz4FrameMagic)) != 0 || !(bytes[4] & contentSizeFlag))
+            return 0;
+
+        uint64_t contentSize;
+        memcpy(&contentSize, bytes + 6, sizeof(contentSize));
+        return contentSize;
+    }
+
+#ifdef DONUT_WITH_ZSTD
+    if (format == CompressionFormat::Zstd)
+    {
+        unsigned long long contentSize = ZSTD_getFrameContentSize(bytes, size);
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR)
+            return 0;
+        return contentSize;
+    }
+#endif
+
+    return format == CompressionFormat::None ? size : 0;
+}
+
+bool PackageWriter::addFile(const std::filesystem::path& name, std::shared_ptr<IBlob> data)
+{
+    PendingFile file;
+    file.name = name.lexically_normal().relative_path().generic_string();
+    file.data = std::move(data);
+
+    for (CompressionFormat format : { CompressionFormat::LZ4, CompressionFormat::Zstd })
+    {
+        std::string_view extension = getCompressionExtension(format);
+        if (string_utils::ends_with(file.name, extension))
+        {
+            file.name.erase(file.name.size() - extension.size());
+            file.compression = format;
+            break;
+        }
+    }
+
+    if (file.name.empty() || file.name.size() > UINT16_MAX || !file.data)
+        return false;
+
+    if (!m_Names.insert(file.name).second)
+    {
+        log::warning("Package already contains file '%s'", file.name.c_str());
+        return false;
+    }
+
+    m_Files.push_back(std::move(file));
+    return true;
+}
+
+int PackageWriter::addFiles(IFileSystem& fs, const std::vector<std::string>& names)
+{
+    int numFiles = 0;
+    for (const auto& name : names)
+    {
+        std::shared_ptr<IBlob> data = fs.readFile(name);
+        if (!data)
+        {
+            log::warning("Cannot read file '%s' for packaging", name.c_str());
+            continue;
+        }
+
+        if (addFile(name, data))
+            ++numFiles;
+    }
+
+    return numFiles;
+}
+
+bool PackageWriter::write(const std::filesystem::path& packagePath) const
+{
+    // sort the files to keep the files in each directory together
+    std::vector<const PendingFile*> files;
+    files.reserve(m_Files.size());
+    for (const auto& file : m_Files)
+        files.push_back(&file);
+    std::sort(files.begin(), files.end(), [](const PendingFile* a, const PendingFile* b) { return a->name < b->name; });
+
+    uint32_t entryCount = uint32_t(files.size());
+    uint32_t hashTableSize = 0;
+    if (entryCount > 0)
+    {
+        // keep the load factor at or below 0.5 to make the probe sequences short
+        hashTableSize = 1;
+        while (hashTableSize < entryCount * 2)
+            hashTableSize <<= 1;
+    }
+
+    std::vector<PackageEntry> entries(entryCount);
+    std::vector<uint32_t> hashTable(hashTableSize, PackageEmptySlot);
+    std::string strings;
+
+    for (uint32_t index = 0; index < entryCount; index++)
+    {
+        const PendingFile& file = *files[index];
+        PackageEntry& entry = entries[index];
+        entry.nameHash = getPackageNameHash(file.name);
+        entry.nameOffset = uint32_t(strings.size());
+        entry.nameLength = uint16_t(file.name.size());
+        entry.compression = file.compression;
+        entry.storedSize = file.data->size();
+        entry.size = getContentSize(file.compression, file.data);
+        strings += file.name;
+
+        uint32_t slot = uint32_t(entry.nameHash) & (hashTableSize - 1);
+        while (hashTable[slot] != PackageEmptySlot)
+            slot = (slot + 1) & (hashTableSize - 1);
+        hashTable[slot] = index;
+    }
+
+    PackageHeader header;
+    header.entryCount = entryCount;
+    header.hashTableSize = hashTableSize;
+    header.entriesOffset = sizeof(PackageHeader);
+    header.hashTableOffset = header.entriesOffset + entries.size() * sizeof(PackageEntry);
+    header.stringsOffset = header.hashTableOffset + hashTable.size() * sizeof(uint32_t);
+    header.stringsSize = strings.size();
+    header.dataOffset = alignPackageOffset(header.stringsOffset + header.stringsSize);
+
+    uint64_t offset = header.dataOffset;
+    for (auto& entry : entries)
+    {
+        entry.offset = offset;
+        offset = alignPackageOffset(offset + entry.storedSize);
+    }
+
+    std::string pathString = packagePath.generic_string();
+    FILE* packageFile = fopen(pathString.c_str(), "wb");
+    if (!packageFile)
+    {
+        log::warning("Cannot create package '%s'", pathString.c_str());
+        return false;
+    }
+
+    static const uint8_t padding[PackageAlignment] = {};
+    uint64_t position = 0;
+    auto writeData = [packageFile, &position](const void* data, size_t size)
+    {
+        position += size;
+        return size == 0 || fwrite(data, 1, size, packageFile) == size;
+    };
+    auto writePadding = [&writeData, &position]()
+    {
+        return writeData(padding, size_t(alignPackageOffset(position) - position));
+    };
+
+    bool success = writeData(&header, sizeof(header))
+        && writeData(entries.data(), entries.size() * sizeof(PackageEntry))
+        && writeData(hashTable.data(), hashTable.size() * sizeof(uint32_t))
+        && writeData(strings.data(), strings.size())
+        && writePadding();
+
+    for (uint32_t index = 0; success && index < entryCount; index++)
+    {
+        success = writeData(files[index]->data->data(), files[index]->data->size())
+            && writePadding();
+    }
+
+    fclose(packageFile);
+
+    if (!success)
+        log::warning("Error writing package '%s'", pathString.c_str());
+
+    return success;
+}
@@ -166,6 +166,12 @@ bool TarFile::isOpen() const
     return m_ArchiveFile != nullptr;
 }
 
+void TarFile::enumerateAllFiles(enumerate_callback_t callback) const
+{
+    for (const auto& [name, record] : m_Files)
+        callback(name);
+}
+
 bool TarFile::folderExists(const std::filesystem::path& name)
 {
     std::string normalizedName = name.lexically_normal().relative_path().generic_string();
@@ -222,6 +228,35 @@ std::shared_ptr<IBlob> TarFile::readFile(const std::filesystem::path& name)
     return std::static_pointer_cast<IBlob>(blob);
 }
 
+std::shared_ptr<IBlob> TarFile::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+    std::string normalizedName = name.lexically_normal().relative_path().generic_string();
+
+    auto entry = m_Files.find(normalizedName);
+
+    if (entry == m_Files.end() || offset > entry->second.size || size > entry->second.size - offset)
+        return nullptr;
+
+    void* data = malloc(size);
+
+    if (!data && size != 0)
+        return nullptr;
+
+    // prevent concurrent file operations from multiple threads from this point on
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (fseeko(m_ArchiveFile, entry->second.offset + offset, SEEK_SET) != 0
+        || fread(data, 1, size, m_ArchiveFile) != size)
+    {
+        log::warning("Error reading %llu bytes at offset %llu of file '%s' from tar archive '%s'",
+            (unsigned long long)size, (unsigned long long)offset, normalizedName.c_str(), m_ArchivePath.c_str());
+        free(data);
+        return nullptr;
+    }
+
+    return std::make_shared<Blob>(data, size);
+}
+
 bool TarFile::writeFile(const std::filesystem::path&, const void*, size_t)
 {
     // tar files are mounted read-only
@@ -25,15 +25,26 @@
 #include <donut/core/string_utils.h>
 #include <fstream>
 #include <cassert>
+#include <cstring>
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <utility>
 #include <sstream>
 
+#ifdef DONUT_WITH_IO_URING
+#include "IoUringReader.h"
+#endif
+
 #ifdef WIN32
 #include <Shlwapi.h>
 #else
 extern "C" {
 #include <glob.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 }
 #endif // _WIN32
 
@@ -67,6 +78,56 @@ Blob::~Blob()
     m_size = 0;
 }
 
+std::shared_ptr<IBlob> IFileSystem::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+    std::shared_ptr<IBlob> file = readFile(name);
+
+    if (!file || offset > file->size() || size > file->size() - offset)
+        return nullptr;
+
+    void* data = malloc(size);
+
+    if (data == nullptr && size != 0)
+    {
+        // out of memory
+        assert(false);
+        return nullptr;
+    }
+
+    memcpy(data, static_cast<const char*>(file->data()) + offset, size);
+
+    return std::make_shared<Blob>(data, size);
+}
+
+void IFileSystem::readFileAsync(const std::filesystem::path& name, read_callback_t callback)
+{
+    callback(readFile(name));
+}
+
+void IFileSystem::readFilesAsync(std::vector<ReadRequest> requests)
+{
+    for (auto& request : requests)
+        readFileAsync(request.name, std::move(request.callback));
+}
+
+std::future<std::shared_ptr<IBlob>> IFileSystem::readFileFuture(const std::filesystem::path& name)
+{
+    auto promise = std::make_shared<std::promise<std::shared_ptr<IBlob>>>();
+    std::future<std::shared_ptr<IBlob>> future = promise->get_future();
+
+    readFileAsync(name, [promise](std::shared_ptr<IBlob> blob)
+    {
+        promise->set_value(std::move(blob));
+    });
+
+    return future;
+}
+
+NativeFileSystem::NativeFileSystem() = default;
+
+// defined here because IoUringReader is an incomplete type in the header
+NativeFileSystem::~NativeFileSystem() = default;
+
 bool NativeFileSystem::folderExists(const std::filesystem::path& name)
 {
 	return std::filesystem::exists(name) && std::filesystem::is_directory(name);
@@ -121,6 +182,131 @@ std::shared_ptr<IBlob> NativeFileSystem::readFile(const std::filesystem::path& n
     return std::make_shared<Blob>(data, size);
 }
 
+std::shared_ptr<IBlob> NativeFileSystem::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+    std::ifstream file(name, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        // file does not exist or is locked
+        return nullptr;
+    }
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = file.tellg();
+
+    if (offset > fileSize || size > fileSize - offset)
+    {
+        // range outside of the file
+        return nullptr;
+    }
+
+    char* data = static_cast<char*>(malloc(size));
+
+    if (data == nullptr && size != 0)
+    {
+        // out of memory
+        assert(false);
+        return nullptr;
+    }
+
+    file.seekg(std::streamoff(offset), std::ios::beg);
+    file.read(data, std::streamsize(size));
+
+    if (!file.good())
+    {
+        // reading error
+        free(data);
+        assert(false);
+        return nullptr;
+    }
+
+    return std::make_shared<Blob>(data, size);
+}
+
+// Read-only view of a whole file, unmapped when the blob is destroyed
+class MappedFileBlob : public IBlob
+{
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef WIN32
+    HANDLE m_mapping = nullptr;
+#endif
+
+public:
+#ifdef WIN32
+    MappedFileBlob(void* data, size_t size, HANDLE mapping) : m_data(data), m_size(size), m_mapping(mapping) { }
+
+    ~MappedFileBlob() override
+    {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+    }
+#else
+    MappedFileBlob(void* data, size_t size) : m_data(data), m_size(size) { }
+
+    ~MappedFileBlob() override
+    {
+        munmap(m_data, m_size);
+    }
+#endif
+
+    [[nodiscard]] const void* data() const override { return m_data; }
+    [[nodiscard]] size_t size() const override { return m_size; }
+};
+
+std::shared_ptr<IBlob> NativeFileSystem::mapFile(const std::filesystem::path& name)
+{
+#ifdef WIN32
+    HANDLE file = CreateFileW(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    // the mapping keeps the file open
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+
+    return std::make_shared<MappedFileBlob>(data, size_t(size.QuadPart), mapping);
+#else
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = size_t(fileStat.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    return std::make_shared<MappedFileBlob>(data, size);
+#endif
+}
+
 bool NativeFileSystem::writeFile(const std::filesystem::path& name, const void* data, size_t size)
 {
     // TODO: better error reporting
@@ -250,40 +436,185 @@ int NativeFileSystem::enumerateDirectories(const std::filesystem::path& path, en
     return enumerateNativeFiles(pattern.c_str(), true, callback);
 }
 
+#ifdef DONUT_WITH_IO_URING
+IoUringReader* NativeFileSystem::getAsyncReader()
+{
+    std::call_once(m_AsyncReaderFlag, [this]()
+    {
+        auto reader = std::make_unique<IoUringReader>();
+        if (reader->isValid())
+            m_AsyncReader = std::move(reader);
+        else
+            log::info("io_uring is not available, asynchronous file reads will be synchronous");
+    });
+
+    return m_AsyncReader.get();
+}
+#endif
+
+void NativeFileSystem::readFileAsync(const std::filesystem::path& name, read_callback_t callback)
+{
+    std::vector<ReadRequest> requests;
+    requests.push_back({ name, std::move(callback) });
+    readFilesAsync(std::move(requests));
+}
+
+void NativeFileSystem::readFilesAsync(std::vector<ReadRequest> requests)
+{
+#ifdef DONUT_WITH_IO_URING
+    if (IoUringReader* reader = getAsyncReader())
+    {
+        reader->submit(std::move(requests));
+        return;
+    }
+#endif
+
+    // not IFileSystem::readFilesAsync, which would call back into readFileAsync
+    for (auto& request : requests)
+        request.callback(readFile(request.name));
+}
+
 RelativeFileSystem::RelativeFileSystem(std::shared_ptr<IFileSystem> fs, const std::filesystem::path& basePath)
     : m_UnderlyingFS(std::move(fs))
     , m_BasePath(basePath.lexically_normal())
 {
+    m_BasePrefix = m_BasePath.native();
+    if (!m_BasePrefix.empty() && m_BasePrefix.back() != '/' && m_BasePrefix.back() != std::filesystem::path::preferred_separator)
+        m_BasePrefix += std::filesystem::path::preferred_separator;
+}
+
+std::filesystem::path RelativeFileSystem::getUnderlyingPath(const std::filesystem::path& name) const
+{
+    // paths with a root name (Windows drive letters) need the full path decomposition
+    if (name.has_root_name())
+        return m_BasePath / name.relative_path();
+
+    // equivalent to m_BasePath / name.relative_path() for the other paths, but with one allocation
+    const auto& nameString = name.native();
+    size_t start = 0;
+    while (start < nameString.size() && (nameString[start] == '/' || nameString[start] == std::filesystem::path::preferred_separator))
+        ++start;
+
+    std::filesystem::path::string_type result;
+    result.reserve(m_BasePrefix.size() + nameString.size() - start);
+    result += m_BasePrefix;
+    result.append(nameString, start, std::filesystem::path::string_type::npos);
+    return std::filesystem::path(std::move(result));
 }
 
 bool RelativeFileSystem::folderExists(const std::filesystem::path& name)
 {
-	return m_UnderlyingFS->folderExists(m_BasePath / name.relative_path());
+	return m_UnderlyingFS->folderExists(getUnderlyingPath(name));
 }
 
 bool RelativeFileSystem::fileExists(const std::filesystem::path& name)
 {
-    return m_UnderlyingFS->fileExists(m_BasePath / name.relative_path());
+    return m_UnderlyingFS->fileExists(getUnderlyingPath(name));
 }
 
 std::shared_ptr<IBlob> RelativeFileSystem::readFile(const std::filesystem::path& name)
 {
-    return m_UnderlyingFS->readFile(m_BasePath / name.relative_path());
+    return m_UnderlyingFS->readFile(getUnderlyingPath(name));
+}
+
+std::shared_ptr<IBlob> RelativeFileSystem::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+    return m_UnderlyingFS->readFileRange(getUnderlyingPath(name), offset, size);
 }
 
 bool RelativeFileSystem::writeFile(const std::filesystem::path& name, const void* data, size_t size)
 {
-    return m_UnderlyingFS->writeFile(m_BasePath / name.relative_path(), data, size);
+    return m_UnderlyingFS->writeFile(getUnderlyingPath(name), data, size);
 }
 
 int RelativeFileSystem::enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates)
 {
-    return m_UnderlyingFS->enumerateFiles(m_BasePath / path.relative_path(), extensions, callback, allowDuplicates);
+    return m_UnderlyingFS->enumerateFiles(getUnderlyingPath(path), extensions, callback, allowDuplicates);
 }
 
 int RelativeFileSystem::enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates)
 {
-    return m_UnderlyingFS->enumerateDirectories(m_BasePath / path.relative_path(), callback, allowDuplicates);
+    return m_UnderlyingFS->enumerateDirectories(getUnderlyingPath(path), callback, allowDuplicates);
+}
+
+void RelativeFileSystem::readFileAsync(const std::filesystem::path& name, read_callback_t callback)
+{
+    m_UnderlyingFS->readFileAsync(getUnderlyingPath(name), std::move(callback));
+}
+
+void RelativeFileSystem::readFilesAsync(std::vector<ReadRequest> requests)
+{
+    for (auto& request : requests)
+        request.name = getUnderlyingPath(request.name);
+
+    m_UnderlyingFS->readFilesAsync(std::move(requests));
+}
+
+namespace
+{
+    // Results of recent RootFileSystem::findMountPoint calls, per thread, so that no locking is needed.
+    // Entries are only valid for the file system and mount table state that 'generation' identifies.
+    struct MountLookupCache
+    {
+        struct Entry
+        {
+            std::filesystem::path::string_type path;
+            IFileSystem* fs = nullptr;
+            std::filesystem::path relativePath;
+        };
+
+        static constexpr size_t Size = 64;
+
+        uint64_t generation = 0;
+        std::array<Entry, Size> entries;
+    };
+
+    thread_local MountLookupCache t_MountLookupCache;
+
+    // unique across all RootFileSystem instances, so that a cache filled for one instance is never used for another
+    std::atomic<uint64_t> g_NextMountGeneration = 1;
+
+    // Calls 'callback' for each component of a normalized generic path, and the position after it.
+    // The root directory of an absolute path is reported as a "/" component.
+    template<typename Callback>
+    void forEachPathComponent(const std::string& path, Callback callback)
+    {
+        size_t position = 0;
+        if (!path.empty() && path[0] == '/')
+        {
+            if (!callback(std::string_view(path.data(), 1), size_t(1)))
+                return;
+            position = 1;
+        }
+
+        while (position < path.size())
+        {
+            size_t end = path.find('/', position);
+            if (end == std::string::npos)
+                end = path.size();
+
+            if (end > position && !callback(std::string_view(path.data() + position, end - position), end))
+                return;
+
+            position = end + 1;
+        }
+    }
+}
+
+RootFileSystem::MountNode* RootFileSystem::MountNode::findChild(std::string_view childName) const
+{
+    for (const auto& child : children)
+    {
+        if (child->name == childName)
+            return child.get();
+    }
+
+    return nullptr;
+}
+
+RootFileSystem::RootFileSystem()
+    : m_MountGeneration(g_NextMountGeneration++)
+{
 }
 
 void RootFileSystem::mount(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs)
@@ -294,7 +625,22 @@ void RootFileSystem::mount(const std::filesystem::path& path, std::shared_ptr<IF
         return;
     }
 
-    m_MountPoints.push_back(std::make_pair(path.lexically_normal().generic_string(), fs));
+    MountNode* node = &m_MountRoot;
+    forEachPathComponent(path.lexically_normal().generic_string(), [&node](std::string_view component, size_t)
+    {
+        MountNode* child = node->findChild(component);
+        if (!child)
+        {
+            node->children.push_back(std::make_unique<MountNode>());
+            child = node->children.back().get();
+            child->name = component;
+        }
+        node = child;
+        return true;
+    });
+
+    node->fs = std::move(fs);
+    m_MountGeneration = g_NextMountGeneration++;
 }
 
 void donut::vfs::RootFileSystem::mount(const std::filesystem::path& path, const std::filesystem::path& nativePath)
@@ -304,44 +650,90 @@ void donut::vfs::RootFileSystem::mount(const std::filesystem::path& path, const
 
 bool RootFileSystem::unmount(const std::filesystem::path& path)
 {
-    std::string spath = path.lexically_normal().generic_string();
+    MountNode* node = &m_MountRoot;
+    forEachPathComponent(path.lexically_normal().generic_string(), [&node](std::string_view component, size_t)
+    {
+        node = node->findChild(component);
+        return node != nullptr;
+    });
+
+    if (!node || !node->fs)
+        return false;
 
-    for (size_t index = 0; index < m_MountPoints.size(); index++)
+    node->fs.reset();
+    m_MountGeneration = g_NextMountGeneration++;
+    return true;
+}
+
+RootFileSystem::MountNode* RootFileSystem::findMountNode(const std::string& normalizedPath, size_t* pRelativePathStart)
+{
+    // find the deepest node with a file system along the path
+    MountNode* node = &m_MountRoot;
+    MountNode* mountNode = node->fs ? node : nullptr;
+    size_t mountEnd = 0;
+
+    forEachPathComponent(normalizedPath, [&node, &mountNode, &mountEnd](std::string_view component, size_t end)
     {
-        if (m_MountPoints[index].first == spath)
+        node = node->findChild(component);
+        if (!node)
+            return false;
+
+        if (node->fs)
         {
-            m_MountPoints.erase(m_MountPoints.begin() + index);
-            return true;
+            mountNode = node;
+            mountEnd = end;
         }
+        return true;
+    });
+
+    if (mountNode && pRelativePathStart)
+    {
+        // skip the separator between the mount point and the relative path
+        if (mountEnd < normalizedPath.size() && normalizedPath[mountEnd] == '/')
+            ++mountEnd;
+        *pRelativePathStart = mountEnd;
     }
 
-    return false;
+    return mountNode;
 }
 
 bool RootFileSystem::findMountPoint(const std::filesystem::path& path, std::filesystem::path* pRelativePath, IFileSystem** ppFS)
 {
-    std::string spath = path.lexically_normal().generic_string();
-
-    for (auto it : m_MountPoints)
+    MountLookupCache& cache = t_MountLookupCache;
+    if (cache.generation != m_MountGeneration)
     {
-        if (spath.find(it.first, 0) == 0 && ((spath.length() == it.first.length()) || (spath[it.first.length()] == '/')))
+        for (auto& entry : cache.entries)
         {
-            if (pRelativePath)
-            {
-                std::string relative = (spath.length() == it.first.length()) ? "" : spath.substr(it.first.size() + 1);
-                *pRelativePath = relative;
-            }
+            entry.fs = nullptr;
+            entry.path.clear();
+        }
+        cache.generation = m_MountGeneration;
+    }
 
-            if (ppFS)
-            {
-                *ppFS = it.second.get();
-            }
+    const auto& key = path.native();
+    MountLookupCache::Entry& entry = cache.entries[std::hash<std::filesystem::path::string_type>()(key) % MountLookupCache::Size];
 
-            return true;
-        }
+    if (!entry.fs || entry.path != key)
+    {
+        std::string normalizedPath = path.lexically_normal().generic_string();
+
+        size_t relativePathStart = 0;
+        MountNode* node = findMountNode(normalizedPath, &relativePathStart);
+        if (!node)
+            return false;
+
+        entry.path = key;
+        entry.fs = node->fs.get();
+        entry.relativePath = normalizedPath.substr(relativePathStart);
     }
 
-    return false;
+    if (pRelativePath)
+        *pRelativePath = entry.relativePath;
+
+    if (ppFS)
+        *ppFS = entry.fs;
+
+    return true;
 }
 
 bool RootFileSystem::folderExists(const std::filesystem::path& name)
@@ -383,6 +775,19 @@ std::shared_ptr<IBlob> RootFileSystem::readFile(const std::filesystem::path& nam
     return nullptr;
 }
 
+std::shared_ptr<IBlob> RootFileSystem::readFileRange(const std::filesystem::path& name, uint64_t offset, size_t size)
+{
+    std::filesystem::path relativePath;
+    IFileSystem* fs = nullptr;
+
+    if (findMountPoint(name, &relativePath, &fs))
+    {
+        return fs->readFileRange(relativePath, offset, size);
+    }
+
+    return nullptr;
+}
+
 bool RootFileSystem::writeFile(const std::filesystem::path& name, const void* data, size_t size)
 {
     std::filesystem::path relativePath;
@@ -422,6 +827,50 @@ int RootFileSystem::enumerateDirectories(const std::filesystem::path& path, enum
     return status::PathNotFound;
 }
 
+void RootFileSystem::readFileAsync(const std::filesystem::path& name, read_callback_t callback)
+{
+    std::filesystem::path relativePath;
+    IFileSystem* fs = nullptr;
+
+    if (findMountPoint(name, &relativePath, &fs))
+    {
+        fs->readFileAsync(relativePath, std::move(callback));
+        return;
+    }
+
+    callback(nullptr);
+}
+
+void RootFileSystem::readFilesAsync(std::vector<ReadRequest> requests)
+{
+    // split the batch by mount point, keeping the batches for the underlying file systems intact
+    std::vector<std::pair<IFileSystem*, std::vector<ReadRequest>>> batches;
+
+    for (auto& request : requests)
+    {
+        std::filesystem::path relativePath;
+        IFileSystem* fs = nullptr;
+
+        if (!findMountPoint(request.name, &relativePath, &fs))
+        {
+            request.callback(nullptr);
+            continue;
+        }
+
+        auto batch = std::find_if(batches.begin(), batches.end(), [fs](const auto& item) { return item.first == fs; });
+        if (batch == batches.end())
+        {
+            batches.emplace_back(fs, std::vector<ReadRequest>());
+            batch = batches.end() - 1;
+        }
+
+        batch->second.push_back({ relativePath, std::move(request.callback) });
+    }
+
+    for (auto& [fs, batch] : batches)
+        fs->readFilesAsync(std::move(batch));
+}
+
 static void appendPatternToRegex(const std::string& pattern, std::stringstream& regex)
 {
     for (char c : pattern)
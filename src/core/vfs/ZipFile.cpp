@@ -86,6 +86,12 @@ bool ZipFile::isOpen() const
     return m_ZipArchive != nullptr;
 }
 
+void ZipFile::enumerateAllFiles(enumerate_callback_t callback) const
+{
+    for (const auto& [name, index] : m_Files)
+        callback(name);
+}
+
 bool ZipFile::folderExists(const std::filesystem::path& name)
 {
     std::string normalizedName = name.lexically_normal().relative_path().generic_string();
@@ -21,76 +21,238 @@
 */
 
 #include <donut/engine/BindingCache.h>
+#include <algorithm>
+#include <mutex>
 
 using namespace donut::engine;
 
-nvrhi::BindingSetHandle BindingCache::GetCachedBindingSet(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout)
+size_t BindingCache::ComputeHash(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout)
 {
     size_t hash = 0;
     nvrhi::hash_combine(hash, desc);
     nvrhi::hash_combine(hash, layout);
+    return hash;
+}
 
-    m_Mutex.lock_shared();
-
-    nvrhi::BindingSetHandle result = nullptr;
+BindingCache::Entry* BindingCache::FindEntry(size_t hash, const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout)
+{
     auto it = m_BindingSets.find(hash);
-    if (it != m_BindingSets.end())
-        result = it->second;
+    if (it == m_BindingSets.end())
+        return nullptr;
+
+    for (const auto& entry : it->second)
+    {
+        if (entry->layout == layout && entry->desc == desc)
+            return entry.get();
+    }
+
+    return nullptr;
+}
+
+nvrhi::BindingSetHandle BindingCache::GetCachedBindingSet(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout)
+{
+    size_t hash = ComputeHash(desc, layout);
 
-    m_Mutex.unlock_shared();
+    std::shared_lock lock(m_Mutex);
 
-    if (result)
+    Entry* entry = FindEntry(hash, desc, layout);
+    if (!entry)
     {
-        assert(result->getDesc());
-        assert(*result->getDesc() == desc);
+        ++m_Misses;
+        return nullptr;
     }
 
-    return result;
+    ++m_Hits;
+    entry->lastUsedFrame = m_CurrentFrame.load();
+    return entry->bindingSet;
 }
 
 nvrhi::BindingSetHandle BindingCache::GetOrCreateBindingSet(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout)
 {
-    size_t hash = 0;
-    nvrhi::hash_combine(hash, desc);
-    nvrhi::hash_combine(hash, layout);
+    size_t hash = ComputeHash(desc, layout);
 
-    m_Mutex.lock_shared();
+    {
+        std::shared_lock lock(m_Mutex);
 
-    nvrhi::BindingSetHandle result;
-    auto it = m_BindingSets.find(hash);
-    if (it != m_BindingSets.end())
-        result = it->second;
-    
-    m_Mutex.unlock_shared();
+        Entry* entry = FindEntry(hash, desc, layout);
+        if (entry)
+        {
+            ++m_Hits;
+            entry->lastUsedFrame = m_CurrentFrame.load();
+            return entry->bindingSet;
+        }
+    }
+
+    std::unique_lock lock(m_Mutex);
+
+    // Another thread may have created the same binding set while the lock was released
+    Entry* entry = FindEntry(hash, desc, layout);
+    if (entry)
+    {
+        ++m_Hits;
+        entry->lastUsedFrame = m_CurrentFrame.load();
+        return entry->bindingSet;
+    }
 
+    ++m_Misses;
+
+    nvrhi::BindingSetHandle result = m_Device->createBindingSet(desc, layout);
     if (!result)
+        return nullptr;
+
+    auto newEntry = std::make_unique<Entry>();
+    newEntry->desc = desc;
+    newEntry->layout = layout;
+    newEntry->bindingSet = result;
+    newEntry->lastUsedFrame = m_CurrentFrame.load();
+    m_BindingSets[hash].push_back(std::move(newEntry));
+    ++m_NumEntries;
+
+    if (m_Capacity != 0 && m_NumEntries > m_Capacity)
+        EvictLeastRecentlyUsed();
+
+    return result;
+}
+
+void BindingCache::EvictLeastRecentlyUsed()
+{
+    // Evict down to 7/8 of the capacity so that a cache running at its limit
+    // does not go through all entries on every insertion.
+    size_t targetSize = m_Capacity - m_Capacity / 8;
+    if (m_NumEntries <= targetSize)
+        return;
+    size_t numToEvict = m_NumEntries - targetSize;
+
+    std::vector<Entry*> entries;
+    entries.reserve(m_NumEntries);
+    for (const auto& bucket : m_BindingSets)
     {
-        m_Mutex.lock();
+        for (const auto& entry : bucket.second)
+            entries.push_back(entry.get());
+    }
 
-        nvrhi::BindingSetHandle& entry = m_BindingSets[hash];
-        if (!entry)
-        {
-            result = m_Device->createBindingSet(desc, layout);
-            entry = result;
-        }
-        else
-            result = entry;
+    std::nth_element(entries.begin(), entries.begin() + (numToEvict - 1), entries.end(),
+        [](const Entry* a, const Entry* b) { return a->lastUsedFrame.load() < b->lastUsedFrame.load(); });
 
-        m_Mutex.unlock();
+    // Mark the victims, then sweep the buckets
+    for (size_t i = 0; i < numToEvict; i++)
+        entries[i]->bindingSet = nullptr;
+
+    for (auto it = m_BindingSets.begin(); it != m_BindingSets.end(); )
+    {
+        auto& bucket = it->second;
+        bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
+            [](const std::unique_ptr<Entry>& entry) { return !entry->bindingSet; }), bucket.end());
+
+        if (bucket.empty())
+            it = m_BindingSets.erase(it);
+        else
+            ++it;
     }
 
-    if (result)
+    m_NumEntries -= numToEvict;
+    m_Evictions += numToEvict;
+}
+
+void BindingCache::EvictUnusedSince(uint64_t frame)
+{
+    for (auto it = m_BindingSets.begin(); it != m_BindingSets.end(); )
     {
-        assert(result->getDesc());
-        assert(*result->getDesc() == desc);
+        auto& bucket = it->second;
+        auto newEnd = std::remove_if(bucket.begin(), bucket.end(), [frame](const std::unique_ptr<Entry>& entry)
+        {
+            return entry->lastUsedFrame.load() < frame;
+        });
+
+        size_t numEvicted = size_t(bucket.end() - newEnd);
+        m_NumEntries -= numEvicted;
+        m_Evictions += numEvicted;
+        bucket.erase(newEnd, bucket.end());
+
+        if (bucket.empty())
+            it = m_BindingSets.erase(it);
+        else
+            ++it;
     }
+}
 
-    return result;
+void BindingCache::AdvanceFrame()
+{
+    uint64_t currentFrame = ++m_CurrentFrame;
+
+    if (m_MaxAge == 0 || currentFrame <= m_MaxAge)
+        return;
+
+    std::unique_lock lock(m_Mutex);
+    EvictUnusedSince(currentFrame - m_MaxAge);
+}
+
+void BindingCache::Invalidate(nvrhi::IResource* resource)
+{
+    if (!resource)
+        return;
+
+    std::unique_lock lock(m_Mutex);
+
+    for (auto it = m_BindingSets.begin(); it != m_BindingSets.end(); )
+    {
+        auto& bucket = it->second;
+        auto newEnd = std::remove_if(bucket.begin(), bucket.end(), [resource](const std::unique_ptr<Entry>& entry)
+        {
+            if (entry->layout == resource)
+                return true;
+
+            for (const auto& item : entry->desc.bindings)
+            {
+                if (item.resourceHandle == resource)
+                    return true;
+            }
+
+            return false;
+        });
+
+        m_NumEntries -= size_t(bucket.end() - newEnd);
+        bucket.erase(newEnd, bucket.end());
+
+        if (bucket.empty())
+            it = m_BindingSets.erase(it);
+        else
+            ++it;
+    }
 }
 
 void BindingCache::Clear()
 {
-    m_Mutex.lock();
+    std::unique_lock lock(m_Mutex);
     m_BindingSets.clear();
-    m_Mutex.unlock();
+    m_NumEntries = 0;
+}
+
+void BindingCache::SetCapacity(size_t capacity)
+{
+    std::unique_lock lock(m_Mutex);
+    m_Capacity = capacity;
+
+    if (m_Capacity != 0 && m_NumEntries > m_Capacity)
+        EvictLeastRecentlyUsed();
+}
+
+BindingCache::Statistics BindingCache::GetStatistics()
+{
+    Statistics stats;
+    stats.hits = m_Hits;
+    stats.misses = m_Misses;
+    stats.evictions = m_Evictions;
+
+    std::shared_lock lock(m_Mutex);
+    stats.size = m_NumEntries;
+
+    return stats;
+}
+
+void BindingCache::ResetStatistics()
+{
+    m_Hits = 0;
+    m_Misses = 0;
+    m_Evictions = 0;
 }
@@ -0,0 +1,455 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace donut::engine::bc
+{
+    // Unit-length principal axis of the pixels around their mean, found with a few power iterations
+    template<int N>
+    static void FindPrincipalAxis(const float (*pixels)[4], float* mean, float* axis)
+    {
+        for (int c = 0; c < N; c++)
+        {
+            mean[c] = 0.f;
+            for (int i = 0; i < 16; i++)
+                mean[c] += pixels[i][c];
+            mean[c] *= 1.f / 16.f;
+        }
+
+        float covariance[N][N] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            for (int a = 0; a < N; a++)
+                for (int b = 0; b < N; b++)
+                    covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+        }
+
+        for (int c = 0; c < N; c++)
+            axis[c] = 1.f;
+
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[N] = {};
+            for (int a = 0; a < N; a++)
+                for (int b = 0; b < N; b++)
+                    next[a] += covariance[a][b] * axis[b];
+
+            float length = 0.f;
+            for (int c = 0; c < N; c++)
+                length = std::max(length, std::abs(next[c]));
+
+            if (length < 1e-6f)
+                break;
+
+            for (int c = 0; c < N; c++)
+                axis[c] = next[c] / length;
+        }
+
+        // Unit length, so that the projections onto the axis are distances along it
+        float lengthSquared = 0.f;
+        for (int c = 0; c < N; c++)
+            lengthSquared += axis[c] * axis[c];
+
+        const float invLength = 1.f / std::sqrt(lengthSquared);
+        for (int c = 0; c < N; c++)
+            axis[c] *= invLength;
+    }
+
+    // Endpoints at the extremes of the pixels projected onto the principal axis
+    template<int N>
+    static void FindEndpoints(const float (*pixels)[4], float* endpoint0, float* endpoint1)
+    {
+        float mean[N];
+        float axis[N];
+        FindPrincipalAxis<N>(pixels, mean, axis);
+
+        float minT = 0.f;
+        float maxT = 0.f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.f;
+            for (int c = 0; c < N; c++)
+                t += (pixels[i][c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (int c = 0; c < N; c++)
+        {
+            endpoint0[c] = std::clamp(mean[c] + axis[c] * maxT, 0.f, 255.f);
+            endpoint1[c] = std::clamp(mean[c] + axis[c] * minT, 0.f, 255.f);
+        }
+    }
+
+    // Least-squares endpoints for the given per-pixel interpolation weights of endpoint 1.
+    // Returns false when the weights don't determine the endpoints.
+    template<int N>
+    static bool RefineEndpoints(const float (*pixels)[4], const float* weights, float* endpoint0, float* endpoint1)
+    {
+        float aa = 0.f, bb = 0.f, ab = 0.f;
+        float ax[N] = {}, bx[N] = {};
+
+        for (int i = 0; i < 16; i++)
+        {
+            float b = weights[i];
+            float a = 1.f - b;
+            aa += a * a;
+            bb += b * b;
+            ab += a * b;
+            for (int c = 0; c < N; c++)
+            {
+                ax[c] += a * pixels[i][c];
+                bx[c] += b * pixels[i][c];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (std::abs(determinant) < 1e-6f)
+            return false;
+
+        float invDeterminant = 1.f / determinant;
+        for (int c = 0; c < N; c++)
+        {
+            endpoint0[c] = std::clamp((bb * ax[c] - ab * bx[c]) * invDeterminant, 0.f, 255.f);
+            endpoint1[c] = std::clamp((aa * bx[c] - ab * ax[c]) * invDeterminant, 0.f, 255.f);
+        }
+
+        return true;
+    }
+
+    template<int N>
+    static float SquaredDistance(const float* a, const float* b)
+    {
+        float sum = 0.f;
+        for (int c = 0; c < N; c++)
+            sum += (a[c] - b[c]) * (a[c] - b[c]);
+        return sum;
+    }
+
+    // Picks the closest palette entry for every pixel and returns the total squared error
+    template<int N>
+    static float SelectIndices(const float (*pixels)[4], const float (*palette)[4], int paletteSize, uint8_t* indices)
+    {
+        float totalError = 0.f;
+        for (int i = 0; i < 16; i++)
+        {
+            float bestError = SquaredDistance<N>(pixels[i], palette[0]);
+            int bestIndex = 0;
+            for (int p = 1; p < paletteSize; p++)
+            {
+                float error = SquaredDistance<N>(pixels[i], palette[p]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+            indices[i] = uint8_t(bestIndex);
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    static void LoadPixels(const uint8_t* rgba, float (*pixels)[4])
+    {
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 4; c++)
+                pixels[i][c] = float(rgba[i * 4 + c]);
+    }
+
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(uint8_t* data, size_t size)
+            : m_Data(data)
+        {
+            memset(data, 0, size);
+        }
+
+        void Write(uint32_t value, uint32_t bits)
+        {
+            for (uint32_t bit = 0; bit < bits; bit++, m_Position++)
+            {
+                if (value & (1u << bit))
+                    m_Data[m_Position >> 3] |= uint8_t(1u << (m_Position & 7));
+            }
+        }
+
+    private:
+        uint8_t* m_Data;
+        uint32_t m_Position = 0;
+    };
+
+    // BC1
+
+    static uint16_t PackRGB565(const float* color)
+    {
+        uint32_t r = uint32_t(std::lround(color[0] * 31.f / 255.f));
+        uint32_t g = uint32_t(std::lround(color[1] * 63.f / 255.f));
+        uint32_t b = uint32_t(std::lround(color[2] * 31.f / 255.f));
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    static void UnpackRGB565(uint16_t packed, float* color)
+    {
+        uint32_t r = (packed >> 11) & 31;
+        uint32_t g = (packed >> 5) & 63;
+        uint32_t b = packed & 31;
+        color[0] = float((r << 3) | (r >> 2));
+        color[1] = float((g << 2) | (g >> 4));
+        color[2] = float((b << 3) | (b >> 2));
+        color[3] = 255.f;
+    }
+
+    // Quantizes the endpoints, selects the indices in 4-color mode and returns the error
+    static float QuantizeBC1(const float (*pixels)[4], const float* endpoint0, const float* endpoint1,
+        uint16_t& color0, uint16_t& color1, uint8_t* indices)
+    {
+        color0 = PackRGB565(endpoint0);
+        color1 = PackRGB565(endpoint1);
+
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        if (color0 == color1)
+        {
+            // 3-color mode with every pixel at color0
+            memset(indices, 0, 16);
+            float palette[1][4];
+            UnpackRGB565(color0, palette[0]);
+            return SelectIndices<3>(pixels, palette, 1, indices);
+        }
+
+        float palette[4][4];
+        UnpackRGB565(color0, palette[0]);
+        UnpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+            palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+        }
+
+        return SelectIndices<3>(pixels, palette, 4, indices);
+    }
+
+    void EncodeBC1Block(const uint8_t* rgba, uint8_t* output)
+    {
+        float pixels[16][4];
+        LoadPixels(rgba, pixels);
+
+        float endpoint0[3], endpoint1[3];
+        FindEndpoints<3>(pixels, endpoint0, endpoint1);
+
+        uint16_t color0, color1;
+        uint8_t indices[16];
+        float error = QuantizeBC1(pixels, endpoint0, endpoint1, color0, color1, indices);
+
+        if (color0 != color1)
+        {
+            static const float weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+            float pixelWeights[16];
+            for (int i = 0; i < 16; i++)
+                pixelWeights[i] = weights[indices[i]];
+
+            if (RefineEndpoints<3>(pixels, pixelWeights, endpoint0, endpoint1))
+            {
+                uint16_t refinedColor0, refinedColor1;
+                uint8_t refinedIndices[16];
+                float refinedError = QuantizeBC1(pixels, endpoint0, endpoint1, refinedColor0, refinedColor1, refinedIndices);
+                if (refinedError < error)
+                {
+                    color0 = refinedColor0;
+                    color1 = refinedColor1;
+                    memcpy(indices, refinedIndices, sizeof(indices));
+                }
+            }
+        }
+
+        BitWriter writer(output, 8);
+        writer.Write(color0, 16);
+        writer.Write(color1, 16);
+        for (int i = 0; i < 16; i++)
+            writer.Write(indices[i], 2);
+    }
+
+    // BC4 and BC5
+
+    void EncodeBC4Block(const uint8_t* rgba, int channel, uint8_t* output)
+    {
+        uint8_t minValue = 255;
+        uint8_t maxValue = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            minValue = std::min(minValue, rgba[i * 4 + channel]);
+            maxValue = std::max(maxValue, rgba[i * 4 + channel]);
+        }
+
+        BitWriter writer(output, 8);
+        writer.Write(maxValue, 8);
+        writer.Write(minValue, 8);
+
+        if (minValue == maxValue)
+            return; // all indices select the first endpoint
+
+        // 8-value mode: index 0 and 1 are the endpoints, 2-7 interpolate from max to min
+        float palette[8];
+        palette[0] = float(maxValue);
+        palette[1] = float(minValue);
+        for (int i = 2; i < 8; i++)
+            palette[i] = (float(8 - i) * palette[0] + float(i - 1) * palette[1]) / 7.f;
+
+        for (int i = 0; i < 16; i++)
+        {
+            float value = float(rgba[i * 4 + channel]);
+            int bestIndex = 0;
+            float bestError = std::abs(value - palette[0]);
+            for (int p = 1; p < 8; p++)
+            {
+                float error = std::abs(value - palette[p]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+            writer.Write(uint32_t(bestIndex), 3);
+        }
+    }
+
+    void EncodeBC5Block(const uint8_t* rgba, uint8_t* output)
+    {
+        EncodeBC4Block(rgba, 0, output);
+        EncodeBC4Block(rgba, 1, output + 8);
+    }
+
+    // BC7 mode 6
+
+    static const int c_BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // 7-bit endpoint components with a shared p-bit, choosing the p-bit with the smaller error
+    static void QuantizeBC7Endpoint(const float* endpoint, uint8_t* quantized, uint8_t& pbit)
+    {
+        float bestError = 0.f;
+        for (uint8_t p = 0; p < 2; p++)
+        {
+            uint8_t candidate[4];
+            float error = 0.f;
+            for (int c = 0; c < 4; c++)
+            {
+                int q = std::clamp(int(std::lround((endpoint[c] - float(p)) * 0.5f)), 0, 127);
+                candidate[c] = uint8_t(q);
+                float reconstructed = float((q << 1) | p);
+                error += (reconstructed - endpoint[c]) * (reconstructed - endpoint[c]);
+            }
+
+            if (p == 0 || error < bestError)
+            {
+                bestError = error;
+                pbit = p;
+                memcpy(quantized, candidate, 4);
+            }
+        }
+    }
+
+    static float QuantizeBC7(const float (*pixels)[4], const float* endpoint0, const float* endpoint1,
+        uint8_t (*quantized)[4], uint8_t* pbits, uint8_t* indices)
+    {
+        QuantizeBC7Endpoint(endpoint0, quantized[0], pbits[0]);
+        QuantizeBC7Endpoint(endpoint1, quantized[1], pbits[1]);
+
+        int e0[4], e1[4];
+        for (int c = 0; c < 4; c++)
+        {
+            e0[c] = (quantized[0][c] << 1) | pbits[0];
+            e1[c] = (quantized[1][c] << 1) | pbits[1];
+        }
+
+        float palette[16][4];
+        for (int p = 0; p < 16; p++)
+        {
+            int w = c_BC7Weights4[p];
+            for (int c = 0; c < 4; c++)
+                palette[p][c] = float(((64 - w) * e0[c] + w * e1[c] + 32) >> 6);
+        }
+
+        return SelectIndices<4>(pixels, palette, 16, indices);
+    }
+
+    void EncodeBC7Block(const uint8_t* rgba, uint8_t* output)
+    {
+        float pixels[16][4];
+        LoadPixels(rgba, pixels);
+
+        float endpoint0[4], endpoint1[4];
+        FindEndpoints<4>(pixels, endpoint0, endpoint1);
+
+        uint8_t quantized[2][4];
+        uint8_t pbits[2];
+        uint8_t indices[16];
+        float error = QuantizeBC7(pixels, endpoint0, endpoint1, quantized, pbits, indices);
+
+        float pixelWeights[16];
+        for (int i = 0; i < 16; i++)
+            pixelWeights[i] = float(c_BC7Weights4[indices[i]]) / 64.f;
+
+        if (error > 0.f && RefineEndpoints<4>(pixels, pixelWeights, endpoint0, endpoint1))
+        {
+            uint8_t refinedQuantized[2][4];
+            uint8_t refinedPbits[2];
+            uint8_t refinedIndices[16];
+            float refinedError = QuantizeBC7(pixels, endpoint0, endpoint1, refinedQuantized, refinedPbits, refinedIndices);
+            if (refinedError < error)
+            {
+                memcpy(quantized, refinedQuantized, sizeof(quantized));
+                memcpy(pbits, refinedPbits, sizeof(pbits));
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        // The most significant index bit of the first pixel is implicitly zero: swap the endpoints if it's set
+        if (indices[0] & 8)
+        {
+            std::swap(quantized[0], quantized[1]);
+            std::swap(pbits[0], pbits[1]);
+            for (int i = 0; i < 16; i++)
+                indices[i] = uint8_t(15 - indices[i]);
+        }
+
+        BitWriter writer(output, 16);
+        writer.Write(1u << 6, 7); // mode 6
+        for (int c = 0; c < 4; c++)
+        {
+            writer.Write(quantized[0][c], 7);
+            writer.Write(quantized[1][c], 7);
+        }
+        writer.Write(pbits[0], 1);
+        writer.Write(pbits[1], 1);
+        writer.Write(indices[0], 3);
+        for (int i = 1; i < 16; i++)
+            writer.Write(indices[i], 4);
+    }
+}
@@ -0,0 +1,43 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+// CPU encoders for the block compressed formats produced by the texture baker.
+// Every function encodes one 4x4 block given as 16 RGBA8 pixels in row-major order.
+
+namespace donut::engine::bc
+{
+    // BC1 without the 1-bit alpha mode, for opaque color. Writes 8 bytes.
+    void EncodeBC1Block(const uint8_t* rgba, uint8_t* output);
+
+    // BC4 with the 8-value interpolation mode, from one channel of the pixels. Writes 8 bytes.
+    void EncodeBC4Block(const uint8_t* rgba, int channel, uint8_t* output);
+
+    // BC5 from the first two channels of the pixels. Writes 16 bytes.
+    void EncodeBC5Block(const uint8_t* rgba, uint8_t* output);
+
+    // BC7 using mode 6 (one subset, RGBA endpoints with a shared bit, 4-bit indices). Writes 16 bytes.
+    void EncodeBC7Block(const uint8_t* rgba, uint8_t* output);
+}
@@ -23,6 +23,7 @@
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/BindingCache.h>
+#include <algorithm>
 
 #if DONUT_WITH_STATIC_SHADERS
 #if DONUT_WITH_DX11
@@ -30,23 +31,27 @@
 #include "compiled_shaders/rect_vs.dxbc.h"
 #include "compiled_shaders/blit_ps.dxbc.h"
 #include "compiled_shaders/sharpen_ps.dxbc.h"
+#include "compiled_shaders/generate_mips_cs.dxbc.h"
 #endif
 #if DONUT_WITH_DX12
 #include "compiled_shaders/fullscreen_vs.dxil.h"
 #include "compiled_shaders/rect_vs.dxil.h"
 #include "compiled_shaders/blit_ps.dxil.h"
 #include "compiled_shaders/sharpen_ps.dxil.h"
+#include "compiled_shaders/generate_mips_cs.dxil.h"
 #endif
 #if DONUT_WITH_VULKAN
 #include "compiled_shaders/fullscreen_vs.spirv.h"
 #include "compiled_shaders/rect_vs.spirv.h"
 #include "compiled_shaders/blit_ps.spirv.h"
 #include "compiled_shaders/sharpen_ps.spirv.h"
+#include "compiled_shaders/generate_mips_cs.spirv.h"
 #endif
 #endif
 
 using namespace donut::math;
 #include <donut/shaders/blit_cb.h>
+#include <donut/shaders/generate_mips_cb.h>
 
 using namespace donut::engine;
 
@@ -70,6 +75,8 @@ CommonRenderPasses::CommonRenderPasses(nvrhi::IDevice* device, std::shared_ptr<S
     blitMacros[0].definition = "1"; // TEXTURE_ARRAY
     m_BlitArrayPS = shaderFactory->CreateAutoShader("donut/blit_ps", "main", DONUT_MAKE_PLATFORM_SHADER(g_blit_ps), &blitMacros, nvrhi::ShaderType::Pixel);
     m_SharpenArrayPS = shaderFactory->CreateAutoShader("donut/sharpen_ps", "main", DONUT_MAKE_PLATFORM_SHADER(g_sharpen_ps), &blitMacros, nvrhi::ShaderType::Pixel);
+
+    m_GenerateMipsCS = shaderFactory->CreateAutoShader("donut/generate_mips_cs", "main", DONUT_MAKE_PLATFORM_SHADER(g_generate_mips_cs), nullptr, nvrhi::ShaderType::Compute);
     
     auto samplerDesc = nvrhi::SamplerDesc()
         .setAllFilters(false)
@@ -117,6 +124,16 @@ CommonRenderPasses::CommonRenderPasses(nvrhi::IDevice* device, std::shared_ptr<S
         textureDesc.debugName = "WhiteTexture2DArray";
         m_WhiteTexture2DArray = m_Device->createTexture(textureDesc);
 
+        // Per-slice group counters of GenerateMips, the shader resets them after use
+        nvrhi::BufferDesc counterBufferDesc;
+        counterBufferDesc.byteSize = GENERATE_MIPS_MAX_SLICES * sizeof(uint32_t);
+        counterBufferDesc.structStride = sizeof(uint32_t);
+        counterBufferDesc.canHaveUAVs = true;
+        counterBufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+        counterBufferDesc.keepInitialState = true;
+        counterBufferDesc.debugName = "GenerateMipsCounters";
+        m_GenerateMipsCounters = m_Device->createBuffer(counterBufferDesc);
+
         // Write the textures using a temporary CL
 
         nvrhi::CommandListHandle commandList = m_Device->createCommandList();
@@ -140,6 +157,8 @@ CommonRenderPasses::CommonRenderPasses(nvrhi::IDevice* device, std::shared_ptr<S
             commandList->writeTexture(m_BlackCubeMapArray, arraySlice, 0, &blackImage, 0);
         }
         
+        commandList->clearBufferUInt(m_GenerateMipsCounters, 0);
+
         commandList->setPermanentTextureState(m_BlackTexture, nvrhi::ResourceStates::ShaderResource);
         commandList->setPermanentTextureState(m_GrayTexture, nvrhi::ResourceStates::ShaderResource);
         commandList->setPermanentTextureState(m_WhiteTexture, nvrhi::ResourceStates::ShaderResource);
@@ -163,6 +182,26 @@ CommonRenderPasses::CommonRenderPasses(nvrhi::IDevice* device, std::shared_ptr<S
 
         m_BlitBindingLayout = m_Device->createBindingLayout(layoutDesc);
     }
+
+    {
+        nvrhi::BindingLayoutDesc layoutDesc;
+        layoutDesc.visibility = nvrhi::ShaderType::Compute;
+        layoutDesc.bindings = {
+            nvrhi::BindingLayoutItem::PushConstants(0, sizeof(GenerateMipsConstants)),
+            nvrhi::BindingLayoutItem::Texture_SRV(0),
+            nvrhi::BindingLayoutItem::Sampler(0),
+            nvrhi::BindingLayoutItem::StructuredBuffer_UAV(0)
+        };
+        for (uint32_t level = 0; level < GENERATE_MIPS_MAX_LEVELS; level++)
+            layoutDesc.bindings.push_back(nvrhi::BindingLayoutItem::Texture_UAV(1 + level));
+
+        m_GenerateMipsBindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+        nvrhi::ComputePipelineDesc psoDesc;
+        psoDesc.CS = m_GenerateMipsCS;
+        psoDesc.bindingLayouts = { m_GenerateMipsBindingLayout };
+        m_GenerateMipsPso = m_Device->createComputePipeline(psoDesc);
+    }
 }
 
 static bool IsSupportedBlitDimension(nvrhi::TextureDimension dimension)
@@ -288,3 +327,94 @@ void CommonRenderPasses::BlitTexture(nvrhi::ICommandList* commandList, nvrhi::IF
     params.sourceTexture = sourceTexture;
     BlitTexture(commandList, params, bindingCache);
 }
+
+// sRGB formats can't be used for UAVs, so GenerateMips writes through their UNORM aliases and encodes in the shader
+static nvrhi::Format GetGenerateMipsUavFormat(nvrhi::Format format, bool& isSrgb)
+{
+    isSrgb = true;
+    switch (format)
+    {
+    case nvrhi::Format::SRGBA8_UNORM: return nvrhi::Format::RGBA8_UNORM;
+    case nvrhi::Format::SBGRA8_UNORM: return nvrhi::Format::BGRA8_UNORM;
+    default: isSrgb = false; return format;
+    }
+}
+
+bool CommonRenderPasses::SupportsGenerateMips(nvrhi::Format format) const
+{
+    bool isSrgb = false;
+    const nvrhi::Format uavFormat = GetGenerateMipsUavFormat(format, isSrgb);
+
+    const nvrhi::FormatSupport requiredUavSupport = nvrhi::FormatSupport::ShaderUavLoad | nvrhi::FormatSupport::ShaderUavStore;
+
+    return (m_Device->queryFormatSupport(format) & nvrhi::FormatSupport::ShaderSample) == nvrhi::FormatSupport::ShaderSample
+        && (m_Device->queryFormatSupport(uavFormat) & requiredUavSupport) == requiredUavSupport;
+}
+
+void CommonRenderPasses::GenerateMips(nvrhi::ICommandList* commandList, nvrhi::ITexture* texture, uint32_t sourceMip, BindingCache* bindingCache)
+{
+    assert(commandList);
+    assert(texture);
+
+    const nvrhi::TextureDesc& desc = texture->getDesc();
+    assert(desc.isUAV);
+    assert(IsSupportedBlitDimension(desc.dimension));
+    assert(desc.arraySize <= GENERATE_MIPS_MAX_SLICES);
+
+    bool isSrgb = false;
+    const nvrhi::Format uavFormat = GetGenerateMipsUavFormat(desc.format, isSrgb);
+
+    while (sourceMip + 1 < desc.mipLevels)
+    {
+        uint32_t sourceWidth = std::max(desc.width >> sourceMip, 1u);
+        uint32_t sourceHeight = std::max(desc.height >> sourceMip, 1u);
+
+        // The last group of a dispatch reduces a single 64x64 tile of the 6th level,
+        // so larger sources take one dispatch per 6 levels until they get small enough.
+        uint32_t maxLevels = std::max(sourceWidth, sourceHeight) <= GENERATE_MIPS_TILE_SIZE * GENERATE_MIPS_TILE_SIZE
+            ? GENERATE_MIPS_MAX_LEVELS
+            : GENERATE_MIPS_MAX_LEVELS / 2;
+        uint32_t numMips = std::min(desc.mipLevels - sourceMip - 1, maxLevels);
+
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::PushConstants(0, sizeof(GenerateMipsConstants)),
+            nvrhi::BindingSetItem::Texture_SRV(0, texture, nvrhi::Format::UNKNOWN,
+                nvrhi::TextureSubresourceSet(sourceMip, 1, 0, desc.arraySize), nvrhi::TextureDimension::Texture2DArray),
+            nvrhi::BindingSetItem::Sampler(0, m_LinearClampSampler),
+            nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_GenerateMipsCounters)
+        };
+        for (uint32_t level = 0; level < GENERATE_MIPS_MAX_LEVELS; level++)
+        {
+            // Slots past the last generated level alias it, the shader doesn't access them
+            uint32_t mipLevel = sourceMip + 1 + std::min(level, numMips - 1);
+            bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::Texture_UAV(1 + level, texture, uavFormat,
+                nvrhi::TextureSubresourceSet(mipLevel, 1, 0, desc.arraySize), nvrhi::TextureDimension::Texture2DArray));
+        }
+
+        nvrhi::BindingSetHandle bindingSet;
+        if (bindingCache)
+            bindingSet = bindingCache->GetOrCreateBindingSet(bindingSetDesc, m_GenerateMipsBindingLayout);
+        else
+            bindingSet = m_Device->createBindingSet(bindingSetDesc, m_GenerateMipsBindingLayout);
+
+        uint32_t groupsX = (sourceWidth + GENERATE_MIPS_TILE_SIZE - 1) / GENERATE_MIPS_TILE_SIZE;
+        uint32_t groupsY = (sourceHeight + GENERATE_MIPS_TILE_SIZE - 1) / GENERATE_MIPS_TILE_SIZE;
+
+        GenerateMipsConstants constants = {};
+        constants.sourceSize = uint2(sourceWidth, sourceHeight);
+        constants.invSourceSize = float2(1.f / float(sourceWidth), 1.f / float(sourceHeight));
+        constants.numMips = numMips;
+        constants.numWorkGroups = groupsX * groupsY;
+        constants.srgb = isSrgb ? 1 : 0;
+
+        nvrhi::ComputeState state;
+        state.pipeline = m_GenerateMipsPso;
+        state.bindings = { bindingSet };
+        commandList->setComputeState(state);
+        commandList->setPushConstants(&constants, sizeof(constants));
+        commandList->dispatch(groupsX, groupsY, desc.arraySize);
+
+        sourceMip += numMips;
+    }
+}
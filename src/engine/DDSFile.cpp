@@ -65,6 +65,8 @@
 
 #include "dds.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iterator>
 
 #include <donut/engine/TextureCache.h>
@@ -562,20 +564,66 @@ namespace donut::engine
         return dataOffset;
     }
 
-    bool LoadDDSTextureFromMemory(TextureData& textureInfo)
+    // Bounds that keep the layout computations below from overflowing. They are far above what any device
+    // supports; the actual limits are enforced by the device when the texture is created.
+    constexpr uint32_t c_MaxTextureDimension = 65536;
+    constexpr uint32_t c_MaxTextureArraySize = 65536;
+
+    // Rejects headers that describe textures which can't exist, before any memory is allocated for them
+    static bool ValidateTextureInfo(const TextureData& textureInfo)
     {
-        if (textureInfo.data->size() < sizeof(uint32_t) + sizeof(DDS_HEADER))
+        if (textureInfo.width == 0 || textureInfo.height == 0 || textureInfo.depth == 0 || textureInfo.arraySize == 0)
+            return false;
+
+        if (textureInfo.width > c_MaxTextureDimension || textureInfo.height > c_MaxTextureDimension ||
+            textureInfo.depth > c_MaxTextureDimension || textureInfo.arraySize > c_MaxTextureArraySize)
+            return false;
+
+        uint32_t maxDimension = std::max(std::max(textureInfo.width, textureInfo.height), textureInfo.depth);
+        uint32_t fullMipChain = 1;
+        while (maxDimension >>= 1)
+            ++fullMipChain;
+
+        if (textureInfo.mipLevels > fullMipChain)
+            return false;
+
+        switch (textureInfo.dimension)  // NOLINT(clang-diagnostic-switch-enum)
         {
+        case nvrhi::TextureDimension::Texture1D:
+        case nvrhi::TextureDimension::Texture1DArray:
+            return textureInfo.height == 1 && textureInfo.depth == 1;
+
+        case nvrhi::TextureDimension::Texture2D:
+        case nvrhi::TextureDimension::Texture2DArray:
+            return textureInfo.depth == 1;
+
+        case nvrhi::TextureDimension::TextureCube:
+        case nvrhi::TextureDimension::TextureCubeArray:
+            // Cube faces must be square, and every cube must have all six faces
+            return textureInfo.width == textureInfo.height && textureInfo.depth == 1 && (textureInfo.arraySize % 6) == 0;
+
+        case nvrhi::TextureDimension::Texture3D:
+            return textureInfo.arraySize == 1;
+
+        default:
             return false;
         }
+    }
 
-        auto dwMagicNumber = *reinterpret_cast<const uint32_t*>(textureInfo.data->data());
+    static bool ParseDDSHeaders(const void* data, size_t size, TextureData& textureInfo, ptrdiff_t& dataOffset)
+    {
+        if (size < sizeof(uint32_t) + sizeof(DDS_HEADER))
+        {
+            return false;
+        }
+
+        auto dwMagicNumber = *reinterpret_cast<const uint32_t*>(data);
         if (dwMagicNumber != DDS_MAGIC)
         {
             return false;
         }
 
-        auto header = reinterpret_cast<const DDS_HEADER*>(static_cast<const char*>(textureInfo.data->data()) + sizeof(uint32_t));
+        auto header = reinterpret_cast<const DDS_HEADER*>(static_cast<const char*>(data) + sizeof(uint32_t));
 
         // Verify header to validate DDS file
         if (header->size != sizeof(DDS_HEADER) ||
@@ -590,7 +638,7 @@ namespace donut::engine
             (MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC))
         {
             // Must be long enough for both headers and magic value
-            if (textureInfo.data->size() < (sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10)))
+            if (size < (sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10)))
             {
                 return false;
             }
@@ -598,7 +646,7 @@ namespace donut::engine
             bDXT10Header = true;
         }
 
-        ptrdiff_t dataOffset = sizeof(uint32_t)
+        dataOffset = sizeof(uint32_t)
             + sizeof(DDS_HEADER)
             + (bDXT10Header ? sizeof(DDS_HEADER_DXT10) : 0);
 
@@ -682,6 +730,10 @@ namespace donut::engine
             case DDS_DIMENSION_TEXTURE2D:
                 if (d3d10ext->miscFlag & D3D11_RESOURCE_MISC_TEXTURECUBE)
                 {
+                    if (d3d10ext->arraySize > c_MaxTextureArraySize / 6)
+                    {
+                        return false;
+                    }
                     textureInfo.arraySize = d3d10ext->arraySize * 6;
                     textureInfo.dimension = d3d10ext->arraySize > 1 ? nvrhi::TextureDimension::TextureCubeArray : nvrhi::TextureDimension::TextureCube;
                 }
@@ -740,10 +792,115 @@ namespace donut::engine
             }
         }
 
-        if (FillTextureInfoOffsets(textureInfo, textureInfo.data->size(), dataOffset) == 0)
-            return false;
+        return ValidateTextureInfo(textureInfo);
+    }
 
-        return true;
+    size_t ReadDDSHeader(const void* data, size_t size, TextureData& textureInfo)
+    {
+        ptrdiff_t dataOffset = 0;
+        if (!data || !ParseDDSHeaders(data, size, textureInfo, dataOffset))
+            return 0;
+
+        return FillTextureInfoOffsets(textureInfo, 0, dataOffset);
+    }
+
+    bool LoadDDSTextureFromMemory(TextureData& textureInfo)
+    {
+        size_t requiredSize = ReadDDSHeader(textureInfo.data->data(), textureInfo.data->size(), textureInfo);
+
+        return requiredSize != 0 && requiredSize <= textureInfo.data->size();
+    }
+
+    static void WriteSubresource(nvrhi::ICommandList* commandList, nvrhi::ITexture* texture, uint32_t arraySlice, uint32_t mipLevel,
+        const char* dataPointer, const TextureSubresourceData& layout)
+    {
+        commandList->writeTexture(texture, arraySlice, mipLevel, dataPointer + layout.dataOffset, layout.rowPitch, layout.depthPitch);
+    }
+
+    // Textures with less data than this are written through the command list's upload manager, which suballocates
+    // its shared upload buffers. Larger ones are copied from a staging texture of their own instead of growing those buffers.
+    constexpr uint64_t c_MinStagingUploadSize = 16 * 1024 * 1024;
+
+    uint64_t UploadDDSTextureData(nvrhi::IDevice* device, nvrhi::ICommandList* commandList, nvrhi::ITexture* texture,
+        const TextureData& textureInfo, uint32_t firstMipLevel /*= 0*/, uint32_t mipCount /*= ~0u*/)
+    {
+        const char* dataPointer = static_cast<const char*>(textureInfo.data->data());
+        const nvrhi::TextureDesc& textureDesc = texture->getDesc();
+        const uint32_t mipLevels = std::min(std::min(textureDesc.mipLevels, textureInfo.mipLevels - firstMipLevel), mipCount);
+
+        uint64_t uploadBytes = 0;
+        for (uint32_t arraySlice = 0; arraySlice < textureInfo.arraySize; arraySlice++)
+            for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+                uploadBytes += textureInfo.dataLayout[arraySlice][firstMipLevel + mipLevel].dataSize * std::max(textureDesc.depth >> mipLevel, 1u);
+
+        // On D3D11, writeTexture maps to UpdateSubresource, while mapping a staging texture waits for the GPU
+        nvrhi::StagingTextureHandle stagingTexture;
+        if (uploadBytes >= c_MinStagingUploadSize && textureInfo.arraySize * mipLevels > 1 &&
+            device->getGraphicsAPI() != nvrhi::GraphicsAPI::D3D11)
+        {
+            nvrhi::TextureDesc stagingDesc;
+            stagingDesc.format = textureDesc.format;
+            stagingDesc.width = textureDesc.width;
+            stagingDesc.height = textureDesc.height;
+            stagingDesc.depth = textureDesc.depth;
+            stagingDesc.arraySize = textureDesc.arraySize;
+            stagingDesc.dimension = textureDesc.dimension;
+            stagingDesc.mipLevels = mipLevels;
+            stagingDesc.debugName = "DDS upload";
+            stagingTexture = device->createStagingTexture(stagingDesc, nvrhi::CpuAccessMode::Write);
+        }
+
+        for (uint32_t arraySlice = 0; arraySlice < textureInfo.arraySize; arraySlice++)
+        {
+            for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+            {
+                const TextureSubresourceData& layout = textureInfo.dataLayout[arraySlice][firstMipLevel + mipLevel];
+                const uint32_t depth = std::max(textureDesc.depth >> mipLevel, 1u);
+
+                if (!stagingTexture)
+                {
+                    WriteSubresource(commandList, texture, arraySlice, mipLevel, dataPointer, layout);
+                    continue;
+                }
+
+                const nvrhi::TextureSlice slice = nvrhi::TextureSlice().setArraySlice(arraySlice).setMipLevel(mipLevel);
+
+                size_t stagingRowPitch = 0;
+                char* mappedData = static_cast<char*>(device->mapStagingTexture(stagingTexture, slice, nvrhi::CpuAccessMode::Write, &stagingRowPitch));
+                if (!mappedData)
+                {
+                    WriteSubresource(commandList, texture, arraySlice, mipLevel, dataPointer, layout);
+                    continue;
+                }
+
+                const char* sourceData = dataPointer + layout.dataOffset;
+
+                if (stagingRowPitch == layout.rowPitch)
+                {
+                    // Footprints match, the subresource is contiguous in both places
+                    memcpy(mappedData, sourceData, layout.dataSize * depth);
+                }
+                else
+                {
+                    const size_t rowCount = layout.rowPitch ? layout.depthPitch / layout.rowPitch : 0;
+                    const size_t rowSize = std::min(stagingRowPitch, layout.rowPitch);
+                    for (uint32_t slice3D = 0; slice3D < depth; slice3D++)
+                    {
+                        for (size_t row = 0; row < rowCount; row++)
+                        {
+                            memcpy(mappedData + (slice3D * rowCount + row) * stagingRowPitch,
+                                sourceData + slice3D * layout.depthPitch + row * layout.rowPitch, rowSize);
+                        }
+                    }
+                }
+
+                device->unmapStagingTexture(stagingTexture);
+
+                commandList->copyTexture(texture, slice, stagingTexture, slice);
+            }
+        }
+
+        return uploadBytes;
     }
 
     static nvrhi::TextureHandle CreateDDSTextureInternal(nvrhi::IDevice* device, nvrhi::ICommandList* commandList, TextureData& info, const char* debugName)
@@ -768,15 +925,7 @@ namespace donut::engine
 
         commandList->beginTrackingTextureState(texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Common);
 
-        for (uint32_t arraySlice = 0; arraySlice < info.arraySize; arraySlice++)
-        {
-            for (uint32_t mipLevel = 0; mipLevel < info.mipLevels; mipLevel++)
-            {
-                const TextureSubresourceData& layout = info.dataLayout[arraySlice][mipLevel];
-
-                commandList->writeTexture(texture, arraySlice, mipLevel, static_cast<const char*>(info.data->data()) + layout.dataOffset, layout.rowPitch);
-            }
-        }
+        UploadDDSTextureData(device, commandList, texture, info);
 
         commandList->setPermanentTextureState(texture, nvrhi::ResourceStates::ShaderResource);
         commandList->commitBarriers();
@@ -796,11 +945,11 @@ namespace donut::engine
         return CreateDDSTextureInternal(device, commandList, info, debugName);
     }
 
-    std::shared_ptr<IBlob> SaveStagingTextureAsDDS(nvrhi::IDevice* device, nvrhi::IStagingTexture* stagingTexture)
+    // Fills the DDS headers describing a texture, returns false if the texture can't be stored in DDS
+    static bool FillDDSHeaders(const nvrhi::TextureDesc& textureDesc, DDS_HEADER& header, DDS_HEADER_DXT10& dx10header)
     {
-        DDS_HEADER header = {};
-        DDS_HEADER_DXT10 dx10header = {};
-        const nvrhi::TextureDesc& textureDesc = stagingTexture->getDesc();
+        header = {};
+        dx10header = {};
 
         header.size = sizeof(DDS_HEADER);
         header.flags = DDS_HEADER_FLAGS_TEXTURE;
@@ -828,7 +977,7 @@ namespace donut::engine
 
         case nvrhi::TextureDimension::Texture3D:
             // Unsupported
-            return nullptr;
+            return false;
             /*header.flags |= DDS_HEADER_FLAGS_VOLUME;
             dx10header.resourceDimension = DDS_DIMENSION_TEXTURE3D;
             break;*/
@@ -837,7 +986,7 @@ namespace donut::engine
         case nvrhi::TextureDimension::Texture2DMSArray:
         case nvrhi::TextureDimension::Unknown:
             // Unsupported
-            return nullptr;
+            return false;
         }
 
         dx10header.arraySize = textureDesc.arraySize;
@@ -859,9 +1008,21 @@ namespace donut::engine
         if (dx10header.dxgiFormat == DXGI_FORMAT_UNKNOWN)
         {
             // Unsupported
-            return nullptr;
+            return false;
         }
 
+        return true;
+    }
+
+    std::shared_ptr<IBlob> SaveStagingTextureAsDDS(nvrhi::IDevice* device, nvrhi::IStagingTexture* stagingTexture)
+    {
+        DDS_HEADER header;
+        DDS_HEADER_DXT10 dx10header;
+        const nvrhi::TextureDesc& textureDesc = stagingTexture->getDesc();
+
+        if (!FillDDSHeaders(textureDesc, header, dx10header))
+            return nullptr;
+
         TextureData textureInfo = {};
         textureInfo.format = textureDesc.format;
         textureInfo.arraySize = textureDesc.arraySize;
@@ -921,4 +1082,37 @@ namespace donut::engine
 
         return std::make_shared<Blob>(data, dataSize);
     }
-}
\ No newline at end of file
+
+    std::shared_ptr<IBlob> SaveTextureDataAsDDS(const nvrhi::TextureDesc& textureDesc, const void* data, size_t dataSize)
+    {
+        DDS_HEADER header;
+        DDS_HEADER_DXT10 dx10header;
+
+        if (!FillDDSHeaders(textureDesc, header, dx10header))
+            return nullptr;
+
+        TextureData textureInfo = {};
+        textureInfo.format = textureDesc.format;
+        textureInfo.arraySize = textureDesc.arraySize;
+        textureInfo.width = textureDesc.width;
+        textureInfo.height = textureDesc.height;
+        textureInfo.depth = textureDesc.depth;
+        textureInfo.dimension = textureDesc.dimension;
+        textureInfo.mipLevels = textureDesc.mipLevels;
+
+        const ptrdiff_t headerSize = sizeof(uint32_t)
+            + sizeof(DDS_HEADER)
+            + sizeof(DDS_HEADER_DXT10);
+
+        if (FillTextureInfoOffsets(textureInfo, 0, 0) != dataSize)
+            return nullptr;
+
+        char* fileData = reinterpret_cast<char*>(malloc(headerSize + dataSize));
+        *reinterpret_cast<uint32_t*>(fileData) = DDS_MAGIC;
+        *reinterpret_cast<DDS_HEADER*>(fileData + sizeof(uint32_t)) = header;
+        *reinterpret_cast<DDS_HEADER_DXT10*>(fileData + sizeof(uint32_t) + sizeof(DDS_HEADER)) = dx10header;
+        memcpy(fileData + headerSize, data, dataSize);
+
+        return std::make_shared<Blob>(fileData, headerSize + dataSize);
+    }
+}
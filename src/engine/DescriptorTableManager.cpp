@@ -21,6 +21,8 @@
 */
 
 #include <donut/engine/DescriptorTableManager.h>
+#include <algorithm>
+#include <cstring>
 
 donut::engine::DescriptorHandle::DescriptorHandle()
     : m_DescriptorIndex(-1)
@@ -44,8 +46,9 @@ donut::engine::DescriptorHandle::~DescriptorHandle()
     }
 }
 
-donut::engine::DescriptorTableManager::DescriptorTableManager(nvrhi::IDevice* device, nvrhi::IBindingLayout* layout)
+donut::engine::DescriptorTableManager::DescriptorTableManager(nvrhi::IDevice* device, nvrhi::IBindingLayout* layout, uint32_t framesInFlight)
     : m_Device(device)
+    , m_FramesInFlight(framesInFlight)
 {
     m_DescriptorTable = m_Device->createDescriptorTable(layout);
 
@@ -53,42 +56,43 @@ donut::engine::DescriptorTableManager::DescriptorTableManager(nvrhi::IDevice* de
     m_AllocatedDescriptors.resize(capacity);
     m_Descriptors.resize(capacity);
     memset(m_Descriptors.data(), 0, sizeof(nvrhi::BindingSetItem) * capacity);
+
+    // Push the indices in reverse order so that the lowest ones are allocated first
+    m_FreeDescriptors.reserve(capacity);
+    for (size_t index = capacity; index > 0; index--)
+        m_FreeDescriptors.push_back(DescriptorIndex(index - 1));
+}
+
+void donut::engine::DescriptorTableManager::GrowDescriptorTable()
+{
+    uint32_t capacity = m_DescriptorTable->getCapacity();
+    uint32_t newCapacity = std::max(64u, capacity * 2); // handle the initial case when capacity == 0
+    m_Device->resizeDescriptorTable(m_DescriptorTable, newCapacity);
+    m_AllocatedDescriptors.resize(newCapacity);
+    m_Descriptors.resize(newCapacity);
+
+    // zero-fill the new descriptors
+    memset(&m_Descriptors[capacity], 0, sizeof(nvrhi::BindingSetItem) * (newCapacity - capacity));
+
+    for (uint32_t index = newCapacity; index > capacity; index--)
+        m_FreeDescriptors.push_back(DescriptorIndex(index - 1));
 }
 
 donut::engine::DescriptorIndex donut::engine::DescriptorTableManager::CreateDescriptor(nvrhi::BindingSetItem item)
 {
+    std::lock_guard lock(m_Mutex);
+
     const auto& found = m_DescriptorIndexMap.find(item);
     if (found != m_DescriptorIndexMap.end())
         return found->second;
 
-    uint32_t capacity = m_DescriptorTable->getCapacity();
-    bool foundFreeSlot = false;
-    uint32_t index = 0;
-    for (index = m_SearchStart; index < capacity; index++)
-    {
-        if (!m_AllocatedDescriptors[index])
-        {
-            foundFreeSlot = true;
-            break;
-        }
-    }
+    if (m_FreeDescriptors.empty())
+        GrowDescriptorTable();
 
-    if (!foundFreeSlot)
-    {
-        uint32_t newCapacity = std::max(64u, capacity * 2); // handle the initial case when capacity == 0
-        m_Device->resizeDescriptorTable(m_DescriptorTable, newCapacity);
-        m_AllocatedDescriptors.resize(newCapacity);
-        m_Descriptors.resize(newCapacity);
-
-        // zero-fill the new descriptors
-        memset(&m_Descriptors[capacity], 0, sizeof(nvrhi::BindingSetItem) * (newCapacity - capacity));
-        
-        index = capacity;
-        capacity = newCapacity;
-    }
+    DescriptorIndex index = m_FreeDescriptors.back();
+    m_FreeDescriptors.pop_back();
 
     item.slot = index;
-    m_SearchStart = index + 1;
     m_AllocatedDescriptors[index] = true;
     m_Descriptors[index] = item;
     m_DescriptorIndexMap[item] = index;
@@ -108,34 +112,146 @@ donut::engine::DescriptorHandle donut::engine::DescriptorTableManager::CreateDes
 
 nvrhi::BindingSetItem donut::engine::DescriptorTableManager::GetDescriptor(DescriptorIndex index)
 {
+    std::lock_guard lock(m_Mutex);
+
     if (size_t(index) >= m_Descriptors.size())
         return nvrhi::BindingSetItem::None(0);
 
     return m_Descriptors[index];
 }
 
-void donut::engine::DescriptorTableManager::ReleaseDescriptor(DescriptorIndex index)
+void donut::engine::DescriptorTableManager::FreeDescriptorSlot(DescriptorIndex index)
 {
     nvrhi::BindingSetItem& descriptor = m_Descriptors[index];
 
     if (descriptor.resourceHandle)
         descriptor.resourceHandle->Release();
 
+    descriptor = nvrhi::BindingSetItem::None(index);
+
+    m_Device->writeDescriptorTable(m_DescriptorTable, descriptor);
+
+    m_AllocatedDescriptors[index] = false;
+    m_FreeDescriptors.push_back(index);
+}
+
+// Writes an item that has already been referenced into an allocated or pending slot
+void donut::engine::DescriptorTableManager::WriteDescriptorSlot(DescriptorIndex index, const nvrhi::BindingSetItem& item)
+{
+    nvrhi::BindingSetItem& descriptor = m_Descriptors[index];
+
+    const auto indexMapEntry = m_DescriptorIndexMap.find(descriptor);
+    if (indexMapEntry != m_DescriptorIndexMap.end() && indexMapEntry->second == index)
+        m_DescriptorIndexMap.erase(indexMapEntry);
+
+    if (descriptor.resourceHandle)
+        descriptor.resourceHandle->Release();
+
+    descriptor = item;
+
+    // a slot released while the write was pending must not be found by CreateDescriptor
+    if (m_AllocatedDescriptors[index])
+        m_DescriptorIndexMap[item] = index;
+
+    m_Device->writeDescriptorTable(m_DescriptorTable, item);
+}
+
+void donut::engine::DescriptorTableManager::ReleaseDescriptor(DescriptorIndex index)
+{
+    std::lock_guard lock(m_Mutex);
+
+    if (size_t(index) >= m_AllocatedDescriptors.size() || !m_AllocatedDescriptors[index])
+        return;
+
     // Erase the existing descriptor from the index map to prevent its "reuse" later
     const auto indexMapEntry = m_DescriptorIndexMap.find(m_Descriptors[index]);
-    if (indexMapEntry != m_DescriptorIndexMap.end())
+    if (indexMapEntry != m_DescriptorIndexMap.end() && indexMapEntry->second == index)
         m_DescriptorIndexMap.erase(indexMapEntry);
 
-    descriptor = nvrhi::BindingSetItem::None(index);
-
-    m_Device->writeDescriptorTable(m_DescriptorTable, descriptor);
+    if (m_FramesInFlight == 0)
+    {
+        FreeDescriptorSlot(index);
+        return;
+    }
 
+    // Keep the slot out of the free list, and the resource referenced, until the GPU is done with it
     m_AllocatedDescriptors[index] = false;
-    m_SearchStart = std::min(m_SearchStart, index);
+    m_PendingWrites.push_back({ index, m_CurrentFrame, true, nvrhi::BindingSetItem::None(index) });
+}
+
+void donut::engine::DescriptorTableManager::UpdateDescriptor(DescriptorIndex index, nvrhi::BindingSetItem item)
+{
+    std::lock_guard lock(m_Mutex);
+
+    if (size_t(index) >= m_AllocatedDescriptors.size() || !m_AllocatedDescriptors[index])
+        return;
+
+    item.slot = index;
+    if (item.resourceHandle)
+        item.resourceHandle->AddRef();
+
+    if (m_FramesInFlight == 0)
+    {
+        WriteDescriptorSlot(index, item);
+        return;
+    }
+
+    // New descriptors must not share the outgoing resource, and the new one is found once it's written
+    const auto indexMapEntry = m_DescriptorIndexMap.find(m_Descriptors[index]);
+    if (indexMapEntry != m_DescriptorIndexMap.end() && indexMapEntry->second == index)
+        m_DescriptorIndexMap.erase(indexMapEntry);
+
+    m_PendingWrites.push_back({ index, m_CurrentFrame, false, item });
+}
+
+void donut::engine::DescriptorTableManager::ApplyPendingWrites()
+{
+    // Writes to the same slot are applied in the order they were made, so an update followed by a release frees the slot
+    while (!m_PendingWrites.empty() && m_PendingWrites.front().frame + m_FramesInFlight <= m_CurrentFrame)
+    {
+        const PendingWrite& write = m_PendingWrites.front();
+        if (write.release)
+            FreeDescriptorSlot(write.index);
+        else
+            WriteDescriptorSlot(write.index, write.item);
+        m_PendingWrites.pop_front();
+    }
+}
+
+void donut::engine::DescriptorTableManager::BeginFrame(uint64_t frameIndex)
+{
+    std::lock_guard lock(m_Mutex);
+
+    if (frameIndex <= m_CurrentFrame)
+        return;
+
+    m_CurrentFrame = frameIndex;
+    ApplyPendingWrites();
+}
+
+void donut::engine::DescriptorTableManager::AdvanceFrame()
+{
+    std::lock_guard lock(m_Mutex);
+
+    ++m_CurrentFrame;
+    ApplyPendingWrites();
+}
+
+void donut::engine::DescriptorTableManager::SetFramesInFlight(uint32_t framesInFlight)
+{
+    std::lock_guard lock(m_Mutex);
+
+    m_FramesInFlight = std::max(m_FramesInFlight, framesInFlight);
 }
 
 donut::engine::DescriptorTableManager::~DescriptorTableManager()
 {
+    for (auto& write : m_PendingWrites)
+    {
+        if (write.item.resourceHandle)
+            write.item.resourceHandle->Release();
+    }
+
     for (auto& descriptor : m_Descriptors)
     {
         if (descriptor.resourceHandle)
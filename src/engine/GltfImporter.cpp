@@ -31,6 +31,10 @@
 
 #include "nvrhi/common/misc.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
 using namespace donut::math;
 using namespace donut::vfs;
 using namespace donut::engine;
@@ -75,6 +79,7 @@ struct cgltf_vfs_context
 {
     std::shared_ptr<donut::vfs::IFileSystem> fs;
     std::vector<std::shared_ptr<IBlob>> blobs;
+    std::unordered_map<std::string, std::shared_ptr<IBlob>> prefetchedFiles;
 };
 
 static cgltf_result cgltf_read_file_vfs(const struct cgltf_memory_options* memory_options,
@@ -82,7 +87,12 @@ static cgltf_result cgltf_read_file_vfs(const struct cgltf_memory_options* memor
 {
     cgltf_vfs_context* context = (cgltf_vfs_context*)file_options->user_data;
 
-    auto blob = context->fs->readFile(path);
+    std::shared_ptr<IBlob> blob;
+    auto prefetched = context->prefetchedFiles.find(path);
+    if (prefetched != context->prefetchedFiles.end())
+        blob = prefetched->second;
+    else
+        blob = context->fs->readFile(path);
 
     if (!blob)
         return cgltf_result_file_not_found;
@@ -95,6 +105,49 @@ static cgltf_result cgltf_read_file_vfs(const struct cgltf_memory_options* memor
     return cgltf_result_success;
 }
 
+// Reads all external buffers of the model with one batch of asynchronous reads, so that the file system
+// can overlap them, and stores the results for cgltf_read_file_vfs to pick up in cgltf_load_buffers.
+static void cgltf_prefetch_buffers_vfs(const cgltf_data* objects, const std::string& gltfPath, cgltf_vfs_context& context)
+{
+    // cgltf resolves buffer URIs relative to the directory of the glTF file, see cgltf_load_buffer_file
+    size_t lastSlash = gltfPath.find_last_of("/\\");
+    std::string directory = (lastSlash == std::string::npos) ? "" : gltfPath.substr(0, lastSlash + 1);
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t remainingReads = 0;
+
+    std::vector<ReadRequest> requests;
+    for (size_t i = 0; i < objects->buffers_count; i++)
+    {
+        const cgltf_buffer& buffer = objects->buffers[i];
+        if (buffer.data || !buffer.uri || strncmp(buffer.uri, "data:", 5) == 0)
+            continue;
+
+        std::string path = directory + buffer.uri;
+        cgltf_decode_uri(path.data() + directory.size());
+        path.resize(strlen(path.c_str()));
+
+        requests.push_back({ path, [&context, &mutex, &condition, &remainingReads, path](std::shared_ptr<IBlob> blob)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (blob)
+                context.prefetchedFiles[path] = blob;
+            if (--remainingReads == 0)
+                condition.notify_all();
+        } });
+    }
+
+    if (requests.empty())
+        return;
+
+    remainingReads = requests.size();
+    context.fs->readFilesAsync(std::move(requests));
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&remainingReads]() { return remainingReads == 0; });
+}
+
 void cgltf_release_file_vfs(const struct cgltf_memory_options*, const struct cgltf_file_options*, void*)
 {
     // do nothing
@@ -243,6 +296,8 @@ bool GltfImporter::Load(
         return false;
     }
 
+    cgltf_prefetch_buffers_vfs(objects, normalizedFileName, vfsContext);
+
     res = cgltf_load_buffers(&options, objects, normalizedFileName.c_str());
     if (res != cgltf_result_success)
     {
@@ -0,0 +1,236 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "ImageProcessing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define DONUT_IMAGE_SSSE3 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DONUT_IMAGE_NEON 1
+#endif
+
+namespace donut::engine::image
+{
+    static thread_local uint32_t t_SerialScopeDepth = 0;
+
+    SerialScope::SerialScope()
+    {
+        ++t_SerialScopeDepth;
+    }
+
+    SerialScope::~SerialScope()
+    {
+        --t_SerialScopeDepth;
+    }
+
+    void ParallelFor(uint32_t count, uint32_t minItemsPerThread, const std::function<void(uint32_t begin, uint32_t end)>& function)
+    {
+        if (t_SerialScopeDepth > 0)
+        {
+            function(0, count);
+            return;
+        }
+
+        uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        threadCount = std::min(threadCount, count / std::max(minItemsPerThread, 1u));
+
+        if (threadCount <= 1)
+        {
+            function(0, count);
+            return;
+        }
+
+        uint32_t itemsPerThread = (count + threadCount - 1) / threadCount;
+
+        std::vector<std::thread> threads;
+        for (uint32_t begin = itemsPerThread; begin < count; begin += itemsPerThread)
+            threads.emplace_back(function, begin, std::min(begin + itemsPerThread, count));
+
+        function(0, std::min(itemsPerThread, count));
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    void ExpandRGBToRGBA(const uint8_t* rgb, uint8_t* rgba, size_t pixelCount)
+    {
+        size_t pixel = 0;
+
+#if DONUT_IMAGE_SSSE3
+        // 4 pixels per iteration, the 16-byte load reads 4 bytes past them
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32(int(0xff000000));
+
+        for (; pixel + 6 <= pixelCount; pixel += 4)
+        {
+            __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + pixel * 3));
+            __m128i result = _mm_or_si128(_mm_shuffle_epi8(source, shuffle), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + pixel * 4), result);
+        }
+#elif DONUT_IMAGE_NEON
+        const uint8x16_t alpha = vdupq_n_u8(255);
+
+        for (; pixel + 16 <= pixelCount; pixel += 16)
+        {
+            uint8x16x3_t source = vld3q_u8(rgb + pixel * 3);
+            uint8x16x4_t result = { { source.val[0], source.val[1], source.val[2], alpha } };
+            vst4q_u8(rgba + pixel * 4, result);
+        }
+#endif
+
+        for (; pixel < pixelCount; pixel++)
+        {
+            rgba[pixel * 4 + 0] = rgb[pixel * 3 + 0];
+            rgba[pixel * 4 + 1] = rgb[pixel * 3 + 1];
+            rgba[pixel * 4 + 2] = rgb[pixel * 3 + 2];
+            rgba[pixel * 4 + 3] = 255;
+        }
+    }
+
+    struct FilterTap
+    {
+        uint32_t index;
+        float weight;
+    };
+
+    // Source pixels covered by each destination pixel along one axis, with normalized weights.
+    // The taps of destination pixel 'i' are [offsets[i], offsets[i + 1]).
+    static void ComputeFilterTaps(uint32_t sourceSize, uint32_t destinationSize, std::vector<uint32_t>& offsets, std::vector<FilterTap>& taps)
+    {
+        const double scale = double(sourceSize) / double(destinationSize);
+
+        offsets.resize(destinationSize + 1);
+        taps.clear();
+
+        for (uint32_t i = 0; i < destinationSize; i++)
+        {
+            offsets[i] = uint32_t(taps.size());
+
+            double start = double(i) * scale;
+            double end = double(i + 1) * scale;
+            uint32_t last = std::min(uint32_t(std::ceil(end)), sourceSize);
+
+            for (uint32_t s = uint32_t(start); s < last; s++)
+            {
+                double coverage = std::min(end, double(s + 1)) - std::max(start, double(s));
+                if (coverage > 0.0)
+                    taps.push_back({ s, float(coverage / scale) });
+            }
+        }
+
+        offsets[destinationSize] = uint32_t(taps.size());
+    }
+
+    static float SrgbToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    static float LinearToSrgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+    }
+
+    void DownscaleImage(const void* source, uint32_t sourceWidth, uint32_t sourceHeight,
+        void* destination, uint32_t destinationWidth, uint32_t destinationHeight,
+        uint32_t channels, bool isFloat, bool srgb)
+    {
+        std::vector<uint32_t> offsetsX, offsetsY;
+        std::vector<FilterTap> tapsX, tapsY;
+        ComputeFilterTaps(sourceWidth, destinationWidth, offsetsX, tapsX);
+        ComputeFilterTaps(sourceHeight, destinationHeight, offsetsY, tapsY);
+
+        // Decoding table for 8-bit channels, sRGB for color channels when requested
+        float toLinear[2][256];
+        for (int value = 0; value < 256; value++)
+        {
+            toLinear[0][value] = float(value) / 255.f;
+            toLinear[1][value] = srgb ? SrgbToLinear(float(value) / 255.f) : float(value) / 255.f;
+        }
+
+        const size_t sourceRowSize = size_t(sourceWidth) * channels;
+        const size_t destinationRowSize = size_t(destinationWidth) * channels;
+
+        ParallelFor(destinationHeight, 16, [&](uint32_t beginRow, uint32_t endRow)
+        {
+            std::vector<float> row(sourceRowSize);
+
+            for (uint32_t y = beginRow; y < endRow; y++)
+            {
+                // Vertical pass into a row of source width
+                std::fill(row.begin(), row.end(), 0.f);
+
+                for (uint32_t tap = offsetsY[y]; tap < offsetsY[y + 1]; tap++)
+                {
+                    const float weight = tapsY[tap].weight;
+                    const size_t rowOffset = size_t(tapsY[tap].index) * sourceRowSize;
+
+                    if (isFloat)
+                    {
+                        const float* sourceRow = static_cast<const float*>(source) + rowOffset;
+                        for (size_t i = 0; i < sourceRowSize; i++)
+                            row[i] += sourceRow[i] * weight;
+                    }
+                    else
+                    {
+                        const uint8_t* sourceRow = static_cast<const uint8_t*>(source) + rowOffset;
+                        for (size_t i = 0; i < sourceRowSize; i++)
+                            row[i] += toLinear[(i % channels) < 3][sourceRow[i]] * weight;
+                    }
+                }
+
+                // Horizontal pass into the destination row
+                for (uint32_t x = 0; x < destinationWidth; x++)
+                {
+                    for (uint32_t channel = 0; channel < channels; channel++)
+                    {
+                        float value = 0.f;
+                        for (uint32_t tap = offsetsX[x]; tap < offsetsX[x + 1]; tap++)
+                            value += row[size_t(tapsX[tap].index) * channels + channel] * tapsX[tap].weight;
+
+                        const size_t index = size_t(y) * destinationRowSize + size_t(x) * channels + channel;
+
+                        if (isFloat)
+                        {
+                            static_cast<float*>(destination)[index] = value;
+                        }
+                        else
+                        {
+                            if (srgb && channel < 3)
+                                value = LinearToSrgb(std::max(value, 0.f));
+
+                            static_cast<uint8_t*>(destination)[index] = uint8_t(std::clamp(value * 255.f + 0.5f, 0.f, 255.f));
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// CPU-side processing of decoded images before they are uploaded by the texture cache.
+// The functions split large images into row bands and process them on several threads.
+
+namespace donut::engine::image
+{
+    // Calls 'function' for consecutive ranges of [0, count) on up to 'hardware_concurrency' threads.
+    // Work smaller than 'minItemsPerThread' per thread, or any work inside a SerialScope, runs on the calling thread.
+    void ParallelFor(uint32_t count, uint32_t minItemsPerThread, const std::function<void(uint32_t begin, uint32_t end)>& function);
+
+    // Makes ParallelFor run on the calling thread while an instance exists on that thread.
+    // Tasks of a thread pool such as the taskflow executor open one, because the pool already occupies the cores.
+    class SerialScope
+    {
+    public:
+        SerialScope();
+        ~SerialScope();
+        SerialScope(const SerialScope&) = delete;
+        SerialScope& operator=(const SerialScope&) = delete;
+    };
+
+    // Expands packed RGB8 pixels into RGBA8 with opaque alpha. Source and destination must not overlap.
+    void ExpandRGBToRGBA(const uint8_t* rgb, uint8_t* rgba, size_t pixelCount);
+
+    // Box-filters an image with 8-bit or 32-bit float channels to smaller dimensions, weighting the
+    // source pixels by their coverage of each destination pixel. With 'srgb', the first three channels
+    // of 8-bit images are filtered in linear space.
+    void DownscaleImage(const void* source, uint32_t sourceWidth, uint32_t sourceHeight,
+        void* destination, uint32_t destinationWidth, uint32_t destinationHeight,
+        uint32_t channels, bool isFloat, bool srgb);
+}
@@ -65,6 +65,9 @@ namespace donut::engine
         if (metalnessInRedChannel)
             constants.flags |= MaterialFlags_MetalnessInRedChannel;
 
+        if (virtualTexture)
+            constants.flags |= MaterialFlags_UseVirtualTexture;
+
         // free parameters
 
         constants.domain = (int)domain;
@@ -86,7 +86,8 @@ nvrhi::IBindingSet* donut::engine::MaterialBindingCache::GetMaterialBindingSet(c
 
     nvrhi::BindingSetHandle& bindingSet = m_BindingSets[material];
 
-    if (bindingSet)
+    // Streamed textures replace their texture objects when the resident mips change
+    if (bindingSet && IsMaterialBindingSetCurrent(material, bindingSet))
         return bindingSet;
 
     bindingSet = CreateMaterialBindingSet(material);
@@ -101,6 +102,40 @@ void donut::engine::MaterialBindingCache::Clear()
     m_BindingSets.clear();
 }
 
+const std::shared_ptr<LoadedTexture>* MaterialBindingCache::GetMaterialTexture(const Material* material, MaterialResource resource)
+{
+    switch (resource)
+    {
+    case MaterialResource::DiffuseTexture: return &material->baseOrDiffuseTexture;
+    case MaterialResource::SpecularTexture: return &material->metalRoughOrSpecularTexture;
+    case MaterialResource::NormalTexture: return &material->normalTexture;
+    case MaterialResource::EmissiveTexture: return &material->emissiveTexture;
+    case MaterialResource::OcclusionTexture: return &material->occlusionTexture;
+    case MaterialResource::TransmissionTexture: return &material->transmissionTexture;
+    default: return nullptr;
+    }
+}
+
+bool MaterialBindingCache::IsMaterialBindingSetCurrent(const Material* material, nvrhi::IBindingSet* bindingSet) const
+{
+    const nvrhi::BindingSetDesc* desc = bindingSet->getDesc();
+    if (!desc || desc->bindings.size() != m_BindingDesc.size())
+        return true;
+
+    for (size_t index = 0; index < m_BindingDesc.size(); index++)
+    {
+        const std::shared_ptr<LoadedTexture>* texture = GetMaterialTexture(material, m_BindingDesc[index].resource);
+        if (!texture)
+            continue;
+
+        nvrhi::ITexture* expected = *texture && (*texture)->texture ? (*texture)->texture.Get() : m_FallbackTexture.Get();
+        if (desc->bindings[index].resourceHandle != expected)
+            return false;
+    }
+
+    return true;
+}
+
 nvrhi::BindingSetItem MaterialBindingCache::GetTextureBindingSetItem(uint32_t slot, const std::shared_ptr<LoadedTexture>& texture) const
 {
     return nvrhi::BindingSetItem::Texture_SRV(slot, texture && texture->texture ? texture->texture.Get() : m_FallbackTexture.Get());
@@ -130,27 +165,12 @@ nvrhi::BindingSetHandle donut::engine::MaterialBindingCache::CreateMaterialBindi
             break;
 
         case MaterialResource::DiffuseTexture:
-            setItem = GetTextureBindingSetItem(item.slot, material->baseOrDiffuseTexture);
-            break;
-
         case MaterialResource::SpecularTexture:
-            setItem = GetTextureBindingSetItem(item.slot, material->metalRoughOrSpecularTexture);
-            break;
-
         case MaterialResource::NormalTexture:
-            setItem = GetTextureBindingSetItem(item.slot, material->normalTexture);
-            break;
-
         case MaterialResource::EmissiveTexture:
-            setItem = GetTextureBindingSetItem(item.slot, material->emissiveTexture);
-            break;
-
         case MaterialResource::OcclusionTexture:
-            setItem = GetTextureBindingSetItem(item.slot, material->occlusionTexture);
-            break;
-
         case MaterialResource::TransmissionTexture:
-            setItem = GetTextureBindingSetItem(item.slot, material->transmissionTexture);
+            setItem = GetTextureBindingSetItem(item.slot, *GetMaterialTexture(material, item.resource));
             break;
 
         default:
@@ -0,0 +1,365 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/Profiler.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/log.h>
+#include <json/writer.h>
+#include <algorithm>
+
+using namespace donut::engine;
+
+std::atomic<Profiler*> Profiler::s_Active = nullptr;
+
+// Nesting level of the zones that are open on the current thread
+static thread_local uint32_t t_ZoneDepth = 0;
+
+static uint32_t GetThreadIndex()
+{
+    static std::atomic<uint32_t> nextThreadIndex = 0;
+    static thread_local uint32_t threadIndex = nextThreadIndex++;
+    return threadIndex;
+}
+
+Profiler::Profiler(nvrhi::IDevice* device)
+    : m_Device(device)
+    , m_StartTime(std::chrono::high_resolution_clock::now())
+{
+}
+
+Profiler::~Profiler()
+{
+    Profiler* self = this;
+    s_Active.compare_exchange_strong(self, nullptr);
+}
+
+void Profiler::SetActive(Profiler* profiler)
+{
+    s_Active = profiler;
+}
+
+double Profiler::GetTimeUs() const
+{
+    auto duration = std::chrono::high_resolution_clock::now() - m_StartTime;
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) * 1e-3;
+}
+
+uint32_t Profiler::GetZoneIndex(const char* name, bool gpu)
+{
+    auto& indices = gpu ? m_GpuZoneIndices : m_CpuZoneIndices;
+
+    auto it = indices.find(name);
+    if (it != indices.end())
+        return it->second;
+
+    uint32_t index = uint32_t(m_Zones.size());
+    Zone& zone = m_Zones.emplace_back();
+    zone.name = name;
+    zone.gpu = gpu;
+    indices[zone.name] = index;
+    return index;
+}
+
+void Profiler::AddZoneTime(Zone& zone, double ms, uint64_t frameIndex)
+{
+    if (zone.lastFrame != frameIndex)
+    {
+        zone.lastFrame = frameIndex;
+        zone.frameMs = 0.0;
+    }
+
+    zone.frameMs += ms;
+}
+
+// Pushes the summed time of the zones that were used in 'frameIndex' into their histories
+void Profiler::FlushZoneTimes(uint64_t frameIndex)
+{
+    for (Zone& zone : m_Zones)
+    {
+        if (zone.lastFrame == frameIndex && zone.frameMs >= 0.0)
+        {
+            zone.history.push_back(float(zone.frameMs));
+            zone.frameMs = -1.0;
+        }
+    }
+}
+
+void Profiler::BeginFrame()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    ResolveGpuFrames();
+
+    const bool enabled = m_Enabled;
+    m_FrameActive = enabled;
+    if (!enabled)
+        return;
+
+    ++m_FrameIndex;
+    m_FrameBeginUs = GetTimeUs();
+    m_CpuEvents.clear();
+    m_CurrentGpuFrame.frameIndex = m_FrameIndex;
+    m_CurrentGpuFrame.events.clear();
+}
+
+void Profiler::EndFrame()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (!m_FrameActive)
+        return;
+
+    m_FrameActive = false;
+
+    const double frameEndUs = GetTimeUs();
+    m_FrameTimes.push_back(float((frameEndUs - m_FrameBeginUs) * 1e-3));
+
+    TraceFrame traceFrame;
+    traceFrame.frameIndex = m_FrameIndex;
+    traceFrame.events.reserve(m_CpuEvents.size() + m_CurrentGpuFrame.events.size());
+
+    for (TraceEvent& event : m_CpuEvents)
+    {
+        // Zones that are still open, which is a usage error, are cut at the end of the frame
+        if (event.durationUs < 0.0)
+            event.durationUs = frameEndUs - event.beginUs;
+
+        AddZoneTime(m_Zones[event.zone], event.durationUs * 1e-3, m_FrameIndex);
+        traceFrame.events.push_back(event);
+    }
+
+    FlushZoneTimes(m_FrameIndex);
+    m_TraceFrames.push_back(std::move(traceFrame));
+
+    if (!m_CurrentGpuFrame.events.empty())
+    {
+        m_PendingGpuFrames.push_back(std::move(m_CurrentGpuFrame));
+        m_CurrentGpuFrame = GpuFrame();
+    }
+}
+
+// Reads the timer queries of the frames that the GPU has finished, in order, without waiting
+void Profiler::ResolveGpuFrames()
+{
+    while (!m_PendingGpuFrames.empty())
+    {
+        GpuFrame& frame = m_PendingGpuFrames.front();
+
+        bool ready = true;
+        for (const GpuEvent& event : frame.events)
+        {
+            if (!m_Device->pollTimerQuery(event.query))
+            {
+                ready = false;
+                break;
+            }
+        }
+
+        if (!ready)
+        {
+            if (m_PendingGpuFrames.size() <= c_MaxPendingGpuFrames)
+                return;
+
+            // The queries of a command list that was never executed don't become ready, drop the frame so that
+            // the later ones can be resolved. Its queries may still be in use and are released instead of reused.
+            m_PendingGpuFrames.pop_front();
+            continue;
+        }
+
+        TraceFrame* traceFrame = nullptr;
+        for (size_t index = 0; index < m_TraceFrames.size(); index++)
+        {
+            if (m_TraceFrames[index].frameIndex == frame.frameIndex)
+                traceFrame = &m_TraceFrames[index];
+        }
+
+        for (GpuEvent& event : frame.events)
+        {
+            const double durationMs = double(m_Device->getTimerQueryTime(event.query)) * 1e3;
+            AddZoneTime(m_Zones[event.zone], durationMs, frame.frameIndex);
+
+            if (traceFrame)
+                traceFrame->events.push_back(TraceEvent{ event.zone, ~0u, event.beginUs, durationMs * 1e3 });
+
+            m_Device->resetTimerQuery(event.query);
+            m_FreeQueries.push_back(std::move(event.query));
+        }
+
+        FlushZoneTimes(frame.frameIndex);
+        m_PendingGpuFrames.pop_front();
+    }
+}
+
+uint32_t Profiler::BeginCpuZone(const char* name)
+{
+    const double beginUs = GetTimeUs();
+    const uint32_t depth = t_ZoneDepth++;
+
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    const uint32_t zoneIndex = GetZoneIndex(name, false);
+    m_Zones[zoneIndex].depth = depth;
+
+    m_CpuEvents.push_back(TraceEvent{ zoneIndex, GetThreadIndex(), beginUs, -1.0 });
+    return uint32_t(m_CpuEvents.size() - 1);
+}
+
+void Profiler::EndCpuZone(uint32_t event)
+{
+    const double endUs = GetTimeUs();
+    --t_ZoneDepth;
+
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (event < m_CpuEvents.size())
+        m_CpuEvents[event].durationUs = endUs - m_CpuEvents[event].beginUs;
+}
+
+nvrhi::ITimerQuery* Profiler::BeginGpuZone(nvrhi::ICommandList* commandList, const char* name)
+{
+    if (!m_Device)
+        return nullptr;
+
+    const double beginUs = GetTimeUs();
+    const uint32_t depth = t_ZoneDepth++;
+
+    nvrhi::TimerQueryHandle query;
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        if (m_FreeQueries.empty())
+        {
+            query = m_Device->createTimerQuery();
+        }
+        else
+        {
+            query = std::move(m_FreeQueries.back());
+            m_FreeQueries.pop_back();
+        }
+
+        const uint32_t zoneIndex = GetZoneIndex(name, true);
+        m_Zones[zoneIndex].depth = depth;
+
+        m_CurrentGpuFrame.events.push_back(GpuEvent{ zoneIndex, query, beginUs });
+    }
+
+    commandList->beginTimerQuery(query);
+    return query;
+}
+
+void Profiler::EndGpuZone(nvrhi::ICommandList* commandList, nvrhi::ITimerQuery* query)
+{
+    --t_ZoneDepth;
+    commandList->endTimerQuery(query);
+}
+
+std::vector<Profiler::ZoneStatistics> Profiler::GetZoneStatistics()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    std::vector<ZoneStatistics> result;
+    for (Zone& zone : m_Zones)
+    {
+        if (zone.history.empty())
+            continue;
+
+        ZoneStatistics stats;
+        stats.name = zone.name;
+        stats.gpu = zone.gpu;
+        stats.depth = zone.depth;
+        stats.lastMs = zone.history.back();
+
+        double sum = 0.0;
+        for (size_t index = 0; index < zone.history.size(); index++)
+        {
+            sum += zone.history[index];
+            stats.maxMs = std::max(stats.maxMs, zone.history[index]);
+        }
+        stats.averageMs = float(sum / double(zone.history.size()));
+
+        result.push_back(std::move(stats));
+    }
+
+    return result;
+}
+
+void Profiler::GetFrameTimes(std::vector<float>& frameTimesMs)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    frameTimesMs.resize(m_FrameTimes.size());
+    for (size_t index = 0; index < m_FrameTimes.size(); index++)
+        frameTimesMs[index] = m_FrameTimes[index];
+}
+
+bool Profiler::WriteChromeTrace(vfs::IFileSystem& fs, const std::filesystem::path& path)
+{
+    Json::Value events(Json::arrayValue);
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        for (size_t frame = 0; frame < m_TraceFrames.size(); frame++)
+        {
+            for (const TraceEvent& event : m_TraceFrames[frame].events)
+            {
+                const Zone& zone = m_Zones[event.zone];
+
+                Json::Value node;
+                node["name"] = zone.name;
+                node["cat"] = zone.gpu ? "gpu" : "cpu";
+                node["ph"] = "X";
+                node["ts"] = event.beginUs;
+                node["dur"] = event.durationUs;
+                node["pid"] = zone.gpu ? 1 : 0;
+                node["tid"] = zone.gpu ? 0 : event.thread;
+                events.append(node);
+            }
+        }
+    }
+
+    Json::Value root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    const std::string text = Json::writeString(builder, root);
+
+    if (!fs.writeFile(path, text.data(), text.size()))
+    {
+        log::warning("Couldn't write the profiler trace to '%s'", path.generic_string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void Profiler::Reset()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    for (Zone& zone : m_Zones)
+        zone.history.clear();
+
+    m_FrameTimes.clear();
+    m_TraceFrames.clear();
+}
@@ -36,6 +36,8 @@ this software is released into the Public Domain.
 
 #include <donut/engine/Scene.h>
 #include <donut/engine/GltfImporter.h>
+#include <donut/engine/Profiler.h>
+#include <donut/engine/TextureCache.h>
 #include <donut/core/json.h>
 #include <donut/core/log.h>
 #include <donut/core/string_utils.h>
@@ -89,7 +91,8 @@ Scene::Scene(
     std::shared_ptr<IFileSystem> fs,
     std::shared_ptr<TextureCache> textureCache,
     std::shared_ptr<DescriptorTableManager> descriptorTable,
-    std::shared_ptr<SceneTypeFactory> sceneTypeFactory)
+    std::shared_ptr<SceneTypeFactory> sceneTypeFactory,
+    uint32_t framesInFlight)
     : m_fs(std::move(fs))
     , m_SceneTypeFactory(std::move(sceneTypeFactory))
     , m_TextureCache(std::move(textureCache))
@@ -104,6 +107,8 @@ Scene::Scene(
     m_GltfImporter = std::make_shared<GltfImporter>(m_fs, m_SceneTypeFactory);
 
     m_EnableBindlessResources = !!m_DescriptorTable;
+    if (m_DescriptorTable)
+        m_DescriptorTable->SetFramesInFlight(framesInFlight);
     m_RayTracingSupported = m_Device->queryFeatureSupport(nvrhi::Feature::RayTracingAccelStruct);
 
     m_SkinningShader = shaderFactory.CreateAutoShader("donut/skinning_cs", "main", DONUT_MAKE_PLATFORM_SHADER(g_skinning_cs), nullptr, nvrhi::ShaderType::Compute);
@@ -158,7 +163,7 @@ bool Scene::LoadWithExecutor(const std::filesystem::path& sceneFileName, tf::Exe
 
 #ifdef DONUT_WITH_TASKFLOW
         if (executor)
-            executor->wait_for_all();
+            m_TextureCache->WaitForAsyncLoads(*executor);
 #endif
 
         auto modelResult = m_Models[0];
@@ -250,7 +255,7 @@ void Scene::LoadModels(
 
 #ifdef DONUT_WITH_TASKFLOW
     if (executor)
-        executor->wait_for_all();
+        m_TextureCache->WaitForAsyncLoads(*executor);
 #endif
 }
 
@@ -812,7 +817,14 @@ void Scene::UpdateSkinnedMeshes(nvrhi::ICommandList* commandList, uint32_t frame
 
 void Scene::Refresh(nvrhi::ICommandList* commandList, uint32_t frameIndex)
 {
+    DONUT_PROFILE_CPU("Scene::Refresh");
+
+    if (m_DescriptorTable)
+        m_DescriptorTable->BeginFrame(frameIndex);
+
     RefreshSceneGraph(frameIndex);
+
+    DONUT_PROFILE_GPU(commandList, "Scene::RefreshBuffers");
     RefreshBuffers(commandList, frameIndex);
 }
 
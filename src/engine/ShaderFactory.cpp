@@ -24,6 +24,7 @@
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/log.h>
 #include <ShaderMake/ShaderBlob.h>
+#include <algorithm>
 
 using namespace std;
 using namespace donut::vfs;
@@ -40,7 +41,156 @@ ShaderFactory::ShaderFactory(nvrhi::DeviceHandle rendererInterface,
 
 void ShaderFactory::ClearCache()
 {
+	std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
 	m_BytecodeCache.clear();
+	m_PermutationIndices.clear();
+	m_Shaders.clear();
+	m_ShaderLibraries.clear();
+	m_ShaderHits = 0;
+}
+
+ShaderFactory::CacheStatistics ShaderFactory::GetCacheStatistics()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    CacheStatistics stats;
+    stats.bytecodeFiles = m_BytecodeCache.size();
+    for (const auto& it : m_BytecodeCache)
+    {
+        if (it.second)
+            stats.bytecodeBytes += it.second->size();
+    }
+    stats.indexedBlobs = m_PermutationIndices.size();
+    for (const auto& it : m_PermutationIndices)
+        stats.indexedPermutations += it.second.numPermutations;
+    stats.shaders = m_Shaders.size();
+    stats.shaderLibraries = m_ShaderLibraries.size();
+    stats.shaderHits = m_ShaderHits;
+    return stats;
+}
+
+static size_t HashDefines(const vector<pair<string, string>>& defines)
+{
+    size_t hash = 0;
+    for (const auto& define : defines)
+    {
+        nvrhi::hash_combine(hash, define.first);
+        nvrhi::hash_combine(hash, define.second);
+    }
+    return hash;
+}
+
+static void SortDefines(vector<pair<string, string>>& defines)
+{
+    std::sort(defines.begin(), defines.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+}
+
+// ShaderMake describes a permutation as "NAME1=VALUE1 NAME2=VALUE2 ..." in the order of its config file
+static vector<pair<string, string>> ParsePermutation(const string& permutation)
+{
+    vector<pair<string, string>> defines;
+
+    size_t pos = 0;
+    while (pos < permutation.size())
+    {
+        size_t end = permutation.find(' ', pos);
+        if (end == string::npos)
+            end = permutation.size();
+
+        if (end > pos)
+        {
+            const string define = permutation.substr(pos, end - pos);
+            const size_t equals = define.find('=');
+            if (equals == string::npos)
+                defines.emplace_back(define, string());
+            else
+                defines.emplace_back(define.substr(0, equals), define.substr(equals + 1));
+        }
+
+        pos = end + 1;
+    }
+
+    return defines;
+}
+
+const ShaderFactory::PermutationIndex& ShaderFactory::GetPermutationIndex(const void* blob, size_t blobSize)
+{
+    PermutationIndex& index = m_PermutationIndices[blob];
+    if (index.blobSize == blobSize)
+        return index;
+
+    index = PermutationIndex();
+    index.blobSize = blobSize;
+
+    vector<string> permutationNames;
+    ShaderMake::EnumeratePermutationsInBlob(blob, blobSize, permutationNames);
+
+    // The bytecode of every permutation is located once here, so that later requests don't scan the blob
+    for (const string& name : permutationNames)
+    {
+        Permutation permutation;
+        permutation.defines = ParsePermutation(name);
+
+        vector<ShaderMake::ShaderConstant> constants;
+        for (const auto& define : permutation.defines)
+            constants.push_back(ShaderMake::ShaderConstant{ define.first.c_str(), define.second.c_str() });
+
+        if (!ShaderMake::FindPermutationInBlob(blob, blobSize, constants.data(), uint32_t(constants.size()), &permutation.bytecode, &permutation.size))
+            continue;
+
+        SortDefines(permutation.defines);
+        const size_t hash = HashDefines(permutation.defines);
+        index.permutations[hash].push_back(std::move(permutation));
+        ++index.numPermutations;
+    }
+
+    return index;
+}
+
+bool ShaderFactory::FindPermutation(StaticShader shader, const std::vector<ShaderMacro>* pDefines, const void** ppBytecode, size_t* pSize)
+{
+    vector<pair<string, string>> defines;
+    if (pDefines)
+    {
+        for (const ShaderMacro& define : *pDefines)
+            defines.emplace_back(define.name, define.definition);
+    }
+    SortDefines(defines);
+
+    const PermutationIndex& index = GetPermutationIndex(shader.pBytecode, shader.size);
+
+    auto bucket = index.permutations.find(HashDefines(defines));
+    if (bucket != index.permutations.end())
+    {
+        for (const Permutation& permutation : bucket->second)
+        {
+            if (permutation.defines == defines)
+            {
+                *ppBytecode = permutation.bytecode;
+                *pSize = permutation.size;
+                return true;
+            }
+        }
+    }
+
+    // Blobs that are not permutation containers are not indexed, ShaderMake returns them whole when there are no defines
+    vector<ShaderMake::ShaderConstant> constants;
+    if (pDefines)
+    {
+        for (const ShaderMacro& define : *pDefines)
+            constants.push_back(ShaderMake::ShaderConstant{ define.name.c_str(), define.definition.c_str() });
+    }
+
+    if (!ShaderMake::FindPermutationInBlob(shader.pBytecode, shader.size, constants.data(), uint32_t(constants.size()), ppBytecode, pSize))
+    {
+        const std::string message = ShaderMake::FormatShaderNotFoundMessage(shader.pBytecode, shader.size, constants.data(), uint32_t(constants.size()));
+        log::error("%s", message.c_str());
+
+        return false;
+    }
+
+    return true;
 }
 
 std::shared_ptr<IBlob> ShaderFactory::GetBytecode(const char* fileName, const char* entryName)
@@ -63,6 +213,8 @@ std::shared_ptr<IBlob> ShaderFactory::GetBytecode(const char* fileName, const ch
 
     std::filesystem::path shaderFilePath = m_basePath / (adjustedName + ".bin");
 
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
     std::shared_ptr<IBlob>& data = m_BytecodeCache[shaderFilePath.generic_string()];
 
     if (data)
@@ -109,24 +261,29 @@ nvrhi::ShaderHandle ShaderFactory::CreateStaticShader(StaticShader shader, const
     if (!shader.pBytecode || !shader.size)
         return nullptr;
 
-    vector<ShaderMake::ShaderConstant> constants;
-    if (pDefines)
-    {
-        for (const ShaderMacro& define : *pDefines)
-            constants.push_back(ShaderMake::ShaderConstant{ define.name.c_str(), define.definition.c_str() });
-    }
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
 
     const void* permutationBytecode = nullptr;
     size_t permutationSize = 0;
-    if (!ShaderMake::FindPermutationInBlob(shader.pBytecode, shader.size, constants.data(), uint32_t(constants.size()), &permutationBytecode, &permutationSize))
-    {
-        const std::string message = ShaderMake::FormatShaderNotFoundMessage(shader.pBytecode, shader.size, constants.data(), uint32_t(constants.size()));
-        log::error("%s", message.c_str());
-        
+    if (!FindPermutation(shader, pDefines, &permutationBytecode, &permutationSize))
         return nullptr;
+
+    // Descs with custom semantics or coordinate swizzling point to caller memory and are not cached
+    if (desc.pCustomSemantics || desc.pCoordinateSwizzling)
+        return m_Device->createShader(desc, permutationBytecode, permutationSize);
+
+    const ShaderKey key(permutationBytecode, desc.shaderType, desc.entryName, desc.debugName,
+        desc.hlslExtensionsUAV, desc.useSpecificShaderExt, uint32_t(desc.fastGSFlags));
+
+    nvrhi::ShaderHandle& cachedShader = m_Shaders[key];
+    if (cachedShader)
+    {
+        ++m_ShaderHits;
+        return cachedShader;
     }
 
-    return m_Device->createShader(desc, permutationBytecode, permutationSize);
+    cachedShader = m_Device->createShader(desc, permutationBytecode, permutationSize);
+    return cachedShader;
 }
 
 nvrhi::ShaderHandle ShaderFactory::CreateStaticPlatformShader(StaticShader dxbc, StaticShader dxil, StaticShader spirv, const std::vector<ShaderMacro>* pDefines, const nvrhi::ShaderDesc& desc)
@@ -153,24 +310,22 @@ nvrhi::ShaderLibraryHandle ShaderFactory::CreateStaticShaderLibrary(StaticShader
     if (!shader.pBytecode || !shader.size)
         return nullptr;
 
-    vector<ShaderMake::ShaderConstant> constants;
-    if (pDefines)
-    {
-        for (const ShaderMacro& define : *pDefines)
-            constants.push_back(ShaderMake::ShaderConstant{ define.name.c_str(), define.definition.c_str() });
-    }
-    
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
     const void* permutationBytecode = nullptr;
     size_t permutationSize = 0;
-    if (!ShaderMake::FindPermutationInBlob(shader.pBytecode, shader.size, constants.data(), uint32_t(constants.size()), &permutationBytecode, &permutationSize))
-    {
-        const std::string message = ShaderMake::FormatShaderNotFoundMessage(shader.pBytecode, shader.size, constants.data(), uint32_t(constants.size()));
-        log::error("%s", message.c_str());
-
+    if (!FindPermutation(shader, pDefines, &permutationBytecode, &permutationSize))
         return nullptr;
+
+    nvrhi::ShaderLibraryHandle& cachedLibrary = m_ShaderLibraries[permutationBytecode];
+    if (cachedLibrary)
+    {
+        ++m_ShaderHits;
+        return cachedLibrary;
     }
 
-    return m_Device->createShaderLibrary(permutationBytecode, permutationSize);
+    cachedLibrary = m_Device->createShaderLibrary(permutationBytecode, permutationSize);
+    return cachedLibrary;
 }
 
 nvrhi::ShaderLibraryHandle ShaderFactory::CreateStaticPlatformShaderLibrary(StaticShader dxil, StaticShader spirv, const std::vector<ShaderMacro>* pDefines)
@@ -0,0 +1,283 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/TextureBaker.h>
+#include <donut/engine/DDSFile.h>
+#include <donut/core/vfs/VFS.h>
+
+#include "BlockCompression.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace donut::vfs;
+using namespace donut::engine;
+
+// Increment when the encoders or the mip filter change to invalidate the baked files
+static constexpr uint64_t c_TextureBakeVersion = 2;
+
+uint64_t donut::engine::HashTextureSourceData(const void* data, size_t size, uint64_t variant)
+{
+    // FNV-1a over 8-byte words with an extra shift to mix the high bits down
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull ^ size;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + offset, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; offset < size; offset++)
+        hash = (hash ^ bytes[offset]) * prime;
+
+    hash ^= variant;
+
+    // MurmurHash3 finalizer, so that the variants of one image get unrelated hashes
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+std::filesystem::path donut::engine::GetBakedTexturePath(const std::filesystem::path& sourcePath, const void* sourceData, size_t sourceSize, bool sRGB)
+{
+    uint64_t hash = HashTextureSourceData(sourceData, sourceSize, c_TextureBakeVersion << 1 | (sRGB ? 1 : 0));
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.dds", static_cast<unsigned long long>(hash));
+
+    return sourcePath.parent_path() / ".baked" / name;
+}
+
+static float SrgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+}
+
+namespace
+{
+    // One mip level with 4 float channels in [0, 1], RGB in linear space for sRGB images
+    struct Image
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<float> pixels;
+
+        const float* At(uint32_t x, uint32_t y) const
+        {
+            x = std::min(x, width - 1);
+            y = std::min(y, height - 1);
+            return &pixels[(size_t(y) * width + x) * 4];
+        }
+    };
+}
+
+static Image Downsample(const Image& source)
+{
+    Image result;
+    result.width = std::max(source.width / 2, 1u);
+    result.height = std::max(source.height / 2, 1u);
+    result.pixels.resize(size_t(result.width) * result.height * 4);
+
+    for (uint32_t y = 0; y < result.height; y++)
+    {
+        for (uint32_t x = 0; x < result.width; x++)
+        {
+            const float* a = source.At(x * 2, y * 2);
+            const float* b = source.At(x * 2 + 1, y * 2);
+            const float* c = source.At(x * 2, y * 2 + 1);
+            const float* d = source.At(x * 2 + 1, y * 2 + 1);
+
+            float* output = &result.pixels[(size_t(y) * result.width + x) * 4];
+            for (int channel = 0; channel < 4; channel++)
+                output[channel] = 0.25f * (a[channel] + b[channel] + c[channel] + d[channel]);
+        }
+    }
+
+    return result;
+}
+
+static uint8_t ToUnorm8(float value)
+{
+    return uint8_t(std::lround(std::clamp(value, 0.f, 1.f) * 255.f));
+}
+
+// Encodes one level block by block, replicating the edge pixels into partial blocks
+static void EncodeLevel(const Image& image, nvrhi::Format format, bool sRGB, std::vector<uint8_t>& output)
+{
+    const uint32_t blocksX = (image.width + 3) / 4;
+    const uint32_t blocksY = (image.height + 3) / 4;
+    const bool isBC1orBC4 = format == nvrhi::Format::BC1_UNORM || format == nvrhi::Format::BC1_UNORM_SRGB
+        || format == nvrhi::Format::BC4_UNORM;
+    const size_t blockSize = isBC1orBC4 ? 8 : 16;
+
+    size_t offset = output.size();
+    output.resize(offset + size_t(blocksX) * blocksY * blockSize);
+
+    for (uint32_t blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+        {
+            uint8_t block[16 * 4];
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                const float* pixel = image.At(blockX * 4 + (i & 3), blockY * 4 + (i >> 2));
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    float value = pixel[channel];
+                    if (sRGB && channel < 3)
+                        value = LinearToSrgb(value);
+                    block[i * 4 + channel] = ToUnorm8(value);
+                }
+            }
+
+            uint8_t* encoded = output.data() + offset;
+            switch (format)
+            {
+            case nvrhi::Format::BC1_UNORM:
+            case nvrhi::Format::BC1_UNORM_SRGB:
+                bc::EncodeBC1Block(block, encoded);
+                break;
+            case nvrhi::Format::BC4_UNORM:
+                bc::EncodeBC4Block(block, 0, encoded);
+                break;
+            case nvrhi::Format::BC5_UNORM:
+                bc::EncodeBC5Block(block, encoded);
+                break;
+            default:
+                bc::EncodeBC7Block(block, encoded);
+                break;
+            }
+            offset += blockSize;
+        }
+    }
+}
+
+std::shared_ptr<IBlob> donut::engine::BakeTexture(const void* sourceData, size_t sourceSize, const TextureBakeSettings& settings, nvrhi::Format* outFormat)
+{
+    const stbi_uc* fileData = static_cast<const stbi_uc*>(sourceData);
+
+    if (stbi_is_hdr_from_memory(fileData, int(sourceSize)))
+        return nullptr;
+
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* bitmap = stbi_load_from_memory(fileData, int(sourceSize), &width, &height, &channels, 0);
+    if (!bitmap)
+        return nullptr;
+
+    // Expand to RGBA the same way TextureCache uploads the uncompressed image:
+    // R8 and RG8 for 1- and 2-channel images, opaque alpha for RGB.
+    bool isOpaque = true;
+    bool convertSrgb = false;
+    nvrhi::Format format;
+
+    switch (settings.mode)
+    {
+    case TextureBakeMode::NormalMap:
+        format = nvrhi::Format::BC5_UNORM;
+        break;
+    case TextureBakeMode::Mask:
+        format = nvrhi::Format::BC4_UNORM;
+        break;
+    default:
+        if (settings.mode == TextureBakeMode::Auto && channels == 1)
+            format = nvrhi::Format::BC4_UNORM;
+        else if (settings.mode == TextureBakeMode::Auto && channels == 2)
+            format = nvrhi::Format::BC5_UNORM;
+        else
+        {
+            format = settings.sRGB ? nvrhi::Format::BC7_UNORM_SRGB : nvrhi::Format::BC7_UNORM;
+            convertSrgb = settings.sRGB;
+        }
+        break;
+    }
+
+    Image image;
+    image.width = uint32_t(width);
+    image.height = uint32_t(height);
+    image.pixels.resize(size_t(width) * height * 4);
+
+    for (size_t index = 0; index < size_t(width) * height; index++)
+    {
+        const stbi_uc* input = bitmap + index * channels;
+        float* pixel = &image.pixels[index * 4];
+
+        pixel[0] = float(input[0]) / 255.f;
+        pixel[1] = channels >= 2 ? float(input[1]) / 255.f : 0.f;
+        pixel[2] = channels >= 3 ? float(input[2]) / 255.f : 0.f;
+        pixel[3] = channels == 4 ? float(input[3]) / 255.f : 1.f;
+
+        if (channels == 4 && input[3] != 255)
+            isOpaque = false;
+
+        if (convertSrgb)
+        {
+            for (int channel = 0; channel < 3; channel++)
+                pixel[channel] = SrgbToLinear(pixel[channel]);
+        }
+    }
+
+    stbi_image_free(bitmap);
+
+    if (settings.preferBC1 && isOpaque && (format == nvrhi::Format::BC7_UNORM || format == nvrhi::Format::BC7_UNORM_SRGB))
+        format = settings.sRGB ? nvrhi::Format::BC1_UNORM_SRGB : nvrhi::Format::BC1_UNORM;
+
+    nvrhi::TextureDesc desc;
+    desc.width = image.width;
+    desc.height = image.height;
+    desc.format = format;
+    desc.dimension = nvrhi::TextureDimension::Texture2D;
+    desc.mipLevels = 1;
+    while ((std::max(desc.width, desc.height) >> desc.mipLevels) > 0)
+        desc.mipLevels++;
+
+    std::vector<uint8_t> encodedData;
+    for (uint32_t mipLevel = 0; mipLevel < desc.mipLevels; mipLevel++)
+    {
+        if (mipLevel > 0)
+            image = Downsample(image);
+
+        EncodeLevel(image, format, convertSrgb, encodedData);
+    }
+
+    if (outFormat)
+        *outFormat = format;
+
+    return SaveTextureDataAsDDS(desc, encodedData.data(), encodedData.size());
+}
@@ -46,10 +46,14 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include <donut/engine/TextureCache.h>
+#include "ImageProcessing.h"
 
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/ConsoleObjects.h>
 #include <donut/engine/DDSFile.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/TextureBaker.h>
+#include <donut/engine/View.h>
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/log.h>
 
@@ -91,6 +95,8 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <algorithm>
 #include <chrono>
 #include <regex>
+#include <thread>
+#include <tuple>
 
 using namespace donut::math;
 using namespace donut::vfs;
@@ -144,12 +150,17 @@ TextureCache::~TextureCache()
 
 void TextureCache::Reset()
 {
-	std::lock_guard<std::shared_mutex> guard(m_LoadedTexturesMutex);
-
 	m_LoadedTextures.clear();
 
     m_TexturesRequested = 0;
     m_TexturesLoaded = 0;
+
+    m_LastFinalizationStats = TextureFinalizationStats();
+    m_TotalFinalizationStats = TextureFinalizationStats();
+
+    std::lock_guard<std::mutex> streamingGuard(m_StreamingMutex);
+    m_StreamedTextures.clear();
+    m_StreamingStats = TextureStreamingStats();
 }
 
 void TextureCache::SetGenerateMipmaps(bool generateMipmaps)
@@ -157,24 +168,24 @@ void TextureCache::SetGenerateMipmaps(bool generateMipmaps)
     m_GenerateMipmaps = generateMipmaps;
 }
 
-bool TextureCache::FindTextureInCache(const std::filesystem::path& path, std::shared_ptr<TextureData>& texture)
+bool TextureCache::FindTextureInCache(const std::filesystem::path& path, bool sRGB, std::shared_ptr<TextureData>& texture)
 {
-    std::lock_guard<std::shared_mutex> guard(m_LoadedTexturesMutex);
-
     // First see if this texture is already loaded (or being loaded).
+    // Otherwise, allocate a new texture slot for this file name and return it. Load the file later in a thread pool.
+    // The slot is created and initialized under the shard lock, so concurrent requests for the same path
+    // get the same texture object and share one read and decode.
 
-    texture = m_LoadedTextures[path.generic_string()];
-    if (texture)
+    bool inserted;
+    std::tie(texture, inserted) = m_LoadedTextures.find_or_insert(path.generic_string(), [this, &path, sRGB]()
     {
-        return true;
-    }
-
-    // Allocate a new texture slot for this file name and return it. Load the file later in a thread pool.
-    // LoadTextureFromFileAsync function for a given scene is only called from one thread, so there is no 
-    // chance of loading the same texture twice.
+        std::shared_ptr<TextureData> newTexture = CreateTextureData();
+        newTexture->forceSRGB = sRGB;
+        newTexture->path = path.generic_string();
+        return newTexture;
+    });
 
-    texture = CreateTextureData();
-    m_LoadedTextures[path.generic_string()] = texture;
+    if (!inserted)
+        return true;
 
     ++m_TexturesRequested;
 
@@ -196,24 +207,35 @@ std::shared_ptr<TextureData> TextureCache::CreateTextureData()
     return std::make_shared<TextureData>();
 }
 
-bool TextureCache::FillTextureData(
+bool TextureCache::FillTextureDataFromBakedFile(
+    const std::shared_ptr<vfs::IBlob>& fileData,
+    const std::shared_ptr<TextureData>& texture) const
+{
+    if (texture->path.empty())
+        return false;
+
+    std::filesystem::path bakedPath = GetBakedTexturePath(texture->path, fileData->data(), fileData->size(), texture->forceSRGB);
+
+    if (!m_fs->fileExists(bakedPath))
+        return false;
+
+    texture->data = m_fs->readFile(bakedPath);
+    if (texture->data && LoadDDSTextureFromMemory(*texture))
+        return true;
+
+    texture->data = nullptr;
+    log::warning("Couldn't load baked texture '%s' for '%s'", bakedPath.generic_string().c_str(), texture->path.c_str());
+    return false;
+}
+
+bool TextureCache::DecodeTextureData(
     const std::shared_ptr<vfs::IBlob>& fileData,
     const std::shared_ptr<TextureData>& texture,
     const std::string& extension,
     const std::string& mimeType) const
 {
-    if (extension == ".dds" || extension == ".DDS" || mimeType == "image/vnd-ms.dds")
-    {
-        texture->data = fileData;
-        if (!LoadDDSTextureFromMemory(*texture))
-        {
-            texture->data = nullptr;
-            log::message(m_ErrorLogSeverity, "Couldn't load DDS texture '%s'", texture->path.c_str());
-            return false;
-        }
-    }
 #ifdef DONUT_WITH_TINYEXR
-    else if (extension == ".exr" || extension == ".EXR" || mimeType == "image/aces")
+    if (extension == ".exr" || extension == ".EXR" || mimeType == "image/aces")
     {
         float* data = nullptr;
         int width = 0, height = 0;
@@ -251,104 +273,457 @@ bool TextureCache::FillTextureData(
         }
     }
 #endif // DONUT_WITH_TINYEXR
-    else
+
+    int width = 0, height = 0, originalChannels = 0, channels = 0;
+
+    if (!stbi_info_from_memory(
+        static_cast<const stbi_uc*>(fileData->data()), 
+        static_cast<int>(fileData->size()), 
+        &width, &height, &originalChannels))
     {
-        int width = 0, height = 0, originalChannels = 0, channels = 0;
+        log::message(m_ErrorLogSeverity, "Couldn't process image header for texture '%s'", texture->path.c_str());
+        return false;
+    }
 
-        if (!stbi_info_from_memory(
-            static_cast<const stbi_uc*>(fileData->data()), 
-            static_cast<int>(fileData->size()), 
-            &width, &height, &originalChannels))
-        {
-            log::message(m_ErrorLogSeverity, "Couldn't process image header for texture '%s'", texture->path.c_str());
-            return false;
-        }
+    bool is_hdr = stbi_is_hdr_from_memory(
+        static_cast<const stbi_uc*>(fileData->data()),
+        static_cast<int>(fileData->size()));
+
+    if (originalChannels == 3)
+    {
+        channels = 4;
+    }
+    else {
+        channels = originalChannels;
+    }
+
+    unsigned char* bitmap;
+    int bytesPerPixel = channels * (is_hdr ? 4 : 1);
 
-        bool is_hdr = stbi_is_hdr_from_memory(
+    // 8-bit RGB images are decoded as RGB and expanded below, which is faster than stb's conversion
+    bool expandRGB = !is_hdr && originalChannels == 3;
+    
+    if (is_hdr)
+    {
+        float* floatmap = stbi_loadf_from_memory(
             static_cast<const stbi_uc*>(fileData->data()),
-            static_cast<int>(fileData->size()));
+            static_cast<int>(fileData->size()),
+            &width, &height, &originalChannels, channels);
+
+        bitmap = reinterpret_cast<unsigned char*>(floatmap);
+    }
+    else
+    {
+        bitmap = stbi_load_from_memory(
+            static_cast<const stbi_uc*>(fileData->data()),
+            static_cast<int>(fileData->size()),
+            &width, &height, &originalChannels, expandRGB ? 3 : channels);
+    }
+
+    if (!bitmap)
+    {
+        log::message(m_ErrorLogSeverity, "Couldn't load generic texture '%s'", texture->path.c_str());
+        return false;
+    }
 
-        if (originalChannels == 3)
+    texture->originalBitsPerPixel = static_cast<uint32_t>(originalChannels) * (is_hdr ? 32 : 8);
+    texture->width = static_cast<uint32_t>(width);
+    texture->height = static_cast<uint32_t>(height);
+    texture->isRenderTarget = true;
+    texture->mipLevels = 1;
+    texture->dimension = nvrhi::TextureDimension::Texture2D;
+
+    texture->dataLayout.resize(1);
+    texture->dataLayout[0].resize(1);
+    texture->dataLayout[0][0].dataOffset = 0;
+    texture->dataLayout[0][0].rowPitch = static_cast<size_t>(width * bytesPerPixel);
+    texture->dataLayout[0][0].dataSize = static_cast<size_t>(width * height * bytesPerPixel);
+
+    if (expandRGB)
+    {
+        size_t pixelCount = size_t(width) * size_t(height);
+        uint8_t* expanded = static_cast<uint8_t*>(malloc(pixelCount * 4));
+        if (!expanded)
         {
-            channels = 4;
-        }
-        else {
-            channels = originalChannels;
+            stbi_image_free(bitmap);
+            log::message(m_ErrorLogSeverity, "Out of memory while loading texture '%s'", texture->path.c_str());
+            return false;
         }
 
-        unsigned char* bitmap;
-        int bytesPerPixel = channels * (is_hdr ? 4 : 1);
-        
-        if (is_hdr)
+        image::ParallelFor(uint32_t(height), 64, [bitmap, expanded, width](uint32_t beginRow, uint32_t endRow)
         {
-            float* floatmap = stbi_loadf_from_memory(
-                static_cast<const stbi_uc*>(fileData->data()),
-                static_cast<int>(fileData->size()),
-                &width, &height, &originalChannels, channels);
+            size_t offset = size_t(beginRow) * size_t(width);
+            image::ExpandRGBToRGBA(bitmap + offset * 3, expanded + offset * 4, size_t(endRow - beginRow) * size_t(width));
+        });
+
+        stbi_image_free(bitmap);
+        texture->data = std::make_shared<Blob>(expanded, pixelCount * 4);
+    }
+    else
+        texture->data = std::make_shared<StbImageBlob>(bitmap);
+    bitmap = nullptr; // ownership transferred to the blob
+
+    switch (channels)
+    {
+    case 1:
+        texture->format = is_hdr ? nvrhi::Format::R32_FLOAT : nvrhi::Format::R8_UNORM;
+        break;
+    case 2:
+        texture->format = is_hdr ? nvrhi::Format::RG32_FLOAT : nvrhi::Format::RG8_UNORM;
+        break;
+    case 4:
+        texture->format = is_hdr ? nvrhi::Format::RGBA32_FLOAT :
+            (texture->forceSRGB ? nvrhi::Format::SRGBA8_UNORM : nvrhi::Format::RGBA8_UNORM);
+        break;
+    default:
+        texture->data.reset(); // release the bitmap data
+
+        log::message(m_ErrorLogSeverity, "Unsupported number of components (%d) for texture '%s'", channels, texture->path.c_str());
+        return false;
+    }
 
-            bitmap = reinterpret_cast<unsigned char*>(floatmap);
+    return true;
+}
+
+bool TextureCache::FillTextureData(
+    const std::shared_ptr<vfs::IBlob>& fileData,
+    const std::shared_ptr<TextureData>& texture,
+    const std::string& extension,
+    const std::string& mimeType) const
+{
+    if (extension == ".dds" || extension == ".DDS" || mimeType == "image/vnd-ms.dds")
+    {
+        texture->data = fileData;
+        if (!LoadDDSTextureFromMemory(*texture))
+        {
+            texture->data = nullptr;
+            log::message(m_ErrorLogSeverity, "Couldn't load DDS texture '%s'", texture->path.c_str());
+            return false;
         }
-        else
+    }
+    else if (m_UseBakedTextures && FillTextureDataFromBakedFile(fileData, texture))
+    {
+        return true;
+    }
+    else
+    {
+        std::filesystem::path decodedCachePath;
+        if (!m_DecodedCacheDirectory.empty())
         {
-            bitmap = stbi_load_from_memory(
-                static_cast<const stbi_uc*>(fileData->data()),
-                static_cast<int>(fileData->size()),
-                &width, &height, &originalChannels, channels);
+            decodedCachePath = GetDecodedCachePath(*fileData, *texture);
+            if (FillTextureDataFromDecodedCache(decodedCachePath, texture))
+                return true;
         }
 
-        if (!bitmap)
-        {
-            log::message(m_ErrorLogSeverity, "Couldn't load generic texture '%s'", texture->path.c_str());
+        if (!DecodeTextureData(fileData, texture, extension, mimeType))
             return false;
-        }
 
-        texture->originalBitsPerPixel = static_cast<uint32_t>(originalChannels) * (is_hdr ? 32 : 8);
-        texture->width = static_cast<uint32_t>(width);
-        texture->height = static_cast<uint32_t>(height);
-        texture->isRenderTarget = true;
-        texture->mipLevels = 1;
-        texture->dimension = nvrhi::TextureDimension::Texture2D;
+        DownscaleTextureData(*texture);
 
-        texture->dataLayout.resize(1);
-        texture->dataLayout[0].resize(1);
-        texture->dataLayout[0][0].dataOffset = 0;
-        texture->dataLayout[0][0].rowPitch = static_cast<size_t>(width * bytesPerPixel);
-        texture->dataLayout[0][0].dataSize = static_cast<size_t>(width * height * bytesPerPixel);
+        if (!decodedCachePath.empty())
+            StoreDecodedTexture(decodedCachePath, *texture);
+    }
 
-        texture->data = std::make_shared<StbImageBlob>(bitmap);
-        bitmap = nullptr; // ownership transferred to the blob
+    return true;
+}
 
-        switch (channels)
-        {
-        case 1:
-            texture->format = is_hdr ? nvrhi::Format::R32_FLOAT : nvrhi::Format::R8_UNORM;
-            break;
-        case 2:
-            texture->format = is_hdr ? nvrhi::Format::RG32_FLOAT : nvrhi::Format::RG8_UNORM;
-            break;
-        case 4:
-            texture->format = is_hdr ? nvrhi::Format::RGBA32_FLOAT :
-                (texture->forceSRGB ? nvrhi::Format::SRGBA8_UNORM : nvrhi::Format::RGBA8_UNORM);
-            break;
-        default:
-            texture->data.reset(); // release the bitmap data
+// Channel layout of the uncompressed formats produced by image decoding
+static bool GetDecodedFormatLayout(nvrhi::Format format, uint32_t& channels, bool& isFloat, bool& srgb)
+{
+    isFloat = false;
+    srgb = false;
+    switch (format)
+    {
+    case nvrhi::Format::R8_UNORM: channels = 1; return true;
+    case nvrhi::Format::RG8_UNORM: channels = 2; return true;
+    case nvrhi::Format::RGBA8_UNORM: channels = 4; return true;
+    case nvrhi::Format::SRGBA8_UNORM: channels = 4; srgb = true; return true;
+    case nvrhi::Format::R32_FLOAT: channels = 1; isFloat = true; return true;
+    case nvrhi::Format::RG32_FLOAT: channels = 2; isFloat = true; return true;
+    case nvrhi::Format::RGBA32_FLOAT: channels = 4; isFloat = true; return true;
+    default: return false;
+    }
+}
 
-            log::message(m_ErrorLogSeverity, "Unsupported number of components (%d) for texture '%s'", channels, texture->path.c_str());
-            return false;
-        }
+void TextureCache::DownscaleTextureData(TextureData& texture) const
+{
+    if (m_MaxTextureSize == 0 || std::max(texture.width, texture.height) <= m_MaxTextureSize)
+        return;
+
+    uint32_t channels;
+    bool isFloat, srgb;
+    if (!GetDecodedFormatLayout(texture.format, channels, isFloat, srgb))
+        return; // scaled on the GPU when finalized
+
+    uint32_t scaledWidth, scaledHeight;
+    if (texture.width >= texture.height)
+    {
+        scaledHeight = std::max(texture.height * m_MaxTextureSize / texture.width, 1u);
+        scaledWidth = m_MaxTextureSize;
+    }
+    else
+    {
+        scaledWidth = std::max(texture.width * m_MaxTextureSize / texture.height, 1u);
+        scaledHeight = m_MaxTextureSize;
     }
 
-    return true;
+    size_t rowPitch = size_t(scaledWidth) * channels * (isFloat ? 4 : 1);
+    size_t dataSize = rowPitch * scaledHeight;
+    void* scaledData = malloc(dataSize);
+    if (!scaledData)
+        return;
+
+    image::DownscaleImage(texture.data->data(), texture.width, texture.height,
+        scaledData, scaledWidth, scaledHeight, channels, isFloat, srgb);
+
+    texture.data = std::make_shared<Blob>(scaledData, dataSize);
+    texture.width = scaledWidth;
+    texture.height = scaledHeight;
+    texture.dataLayout[0][0].rowPitch = rowPitch;
+    texture.dataLayout[0][0].dataSize = dataSize;
 }
 
 uint GetMipLevelsNum(uint width, uint height)
 {
-    uint size = std::min(width, height);
-    uint levelsNum = (uint)(logf((float)size) / logf(2.0f)) + 1;
+    // full mip chain, down to 1x1
+    uint size = std::max(width, height);
+    uint levelsNum = 1;
+    while (size > 1)
+    {
+        size >>= 1;
+        ++levelsNum;
+    }
 
     return levelsNum;
 }
 
+static bool IsSrgbFormat(nvrhi::Format format)
+{
+    return format == nvrhi::Format::SRGBA8_UNORM || format == nvrhi::Format::SBGRA8_UNORM;
+}
+
+// Increment when the layout or the mip filter of decoded cache files change
+static constexpr uint32_t c_DecodedTextureCacheVersion = 1;
+static constexpr uint32_t c_DecodedTextureCacheMagic = 0x58455444; // 'DTEX'
+
+// Decoded cache file: header, mip table, then the mip levels of a single 2D slice at 16-byte aligned offsets
+struct DecodedTextureFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint32_t originalBitsPerPixel;
+    uint32_t reserved;
+};
+
+struct DecodedTextureFileMip
+{
+    uint64_t dataOffset;
+    uint64_t rowPitch;
+    uint64_t dataSize;
+};
+
+void TextureCache::SetDecodedTextureCacheDirectory(const std::filesystem::path& directory)
+{
+    m_DecodedCacheDirectory = directory;
+
+    if (directory.empty())
+        return;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        log::warning("Couldn't create the decoded texture cache directory '%s'", directory.generic_string().c_str());
+        m_DecodedCacheDirectory.clear();
+        return;
+    }
+
+    if (!m_DecodedCacheFS)
+        m_DecodedCacheFS = std::make_shared<NativeFileSystem>();
+}
+
+DecodedTextureCacheStats TextureCache::GetDecodedCacheStats() const
+{
+    DecodedTextureCacheStats stats;
+    stats.hits = m_DecodedCacheHits;
+    stats.misses = m_DecodedCacheMisses;
+    stats.bytesSaved = m_DecodedCacheBytesSaved;
+    stats.bytesWritten = m_DecodedCacheBytesWritten;
+    return stats;
+}
+
+std::filesystem::path TextureCache::GetDecodedCachePath(const vfs::IBlob& fileData, const TextureData& texture) const
+{
+    // Everything that changes the decoded payload is a part of the key
+    uint64_t variant = uint64_t(m_MaxTextureSize) << 32
+        | uint64_t(c_DecodedTextureCacheVersion) << 8
+        | (m_GenerateMipmaps ? 2 : 0)
+        | (texture.forceSRGB ? 1 : 0);
+
+    uint64_t hash = HashTextureSourceData(fileData.data(), fileData.size(), variant);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.dtex", static_cast<unsigned long long>(hash));
+
+    return m_DecodedCacheDirectory / name;
+}
+
+bool TextureCache::FillTextureDataFromDecodedCache(const std::filesystem::path& cachePath, const std::shared_ptr<TextureData>& texture) const
+{
+    std::shared_ptr<IBlob> blob = m_DecodedCacheFS->mapFile(cachePath);
+    if (!blob || blob->size() < sizeof(DecodedTextureFileHeader))
+    {
+        ++m_DecodedCacheMisses;
+        return false;
+    }
+
+    const uint8_t* fileData = static_cast<const uint8_t*>(blob->data());
+    const DecodedTextureFileHeader* header = reinterpret_cast<const DecodedTextureFileHeader*>(fileData);
+    const DecodedTextureFileMip* mips = reinterpret_cast<const DecodedTextureFileMip*>(header + 1);
+
+    // The dimension limit keeps the size computations below from overflowing
+    uint32_t channels = 0;
+    bool isFloat = false, srgb = false;
+    bool valid = header->magic == c_DecodedTextureCacheMagic && header->version == c_DecodedTextureCacheVersion
+        && GetDecodedFormatLayout(nvrhi::Format(header->format), channels, isFloat, srgb)
+        && header->width > 0 && header->height > 0 && header->width <= 65536 && header->height <= 65536
+        && header->mipLevels > 0 && header->mipLevels <= 16
+        && blob->size() >= sizeof(DecodedTextureFileHeader) + header->mipLevels * sizeof(DecodedTextureFileMip);
+
+    // The mips are uploaded straight from the mapped file with their row pitch,
+    // so each one must be tightly packed and entirely inside the file.
+    const uint64_t bytesPerPixel = uint64_t(channels) * (isFloat ? 4 : 1);
+    for (uint32_t mipLevel = 0; valid && mipLevel < header->mipLevels; mipLevel++)
+    {
+        const DecodedTextureFileMip& mip = mips[mipLevel];
+        valid = mip.rowPitch == std::max(header->width >> mipLevel, 1u) * bytesPerPixel
+            && mip.rowPitch * std::max(header->height >> mipLevel, 1u) <= mip.dataSize
+            && mip.dataOffset <= blob->size() && mip.dataSize <= blob->size() - mip.dataOffset;
+    }
+
+    if (!valid)
+    {
+        log::warning("Ignoring invalid decoded texture cache file '%s'", cachePath.generic_string().c_str());
+        ++m_DecodedCacheMisses;
+        return false;
+    }
+
+    texture->format = nvrhi::Format(header->format);
+    texture->width = header->width;
+    texture->height = header->height;
+    texture->depth = 1;
+    texture->arraySize = 1;
+    texture->mipLevels = header->mipLevels;
+    texture->originalBitsPerPixel = header->originalBitsPerPixel;
+    texture->dimension = nvrhi::TextureDimension::Texture2D;
+    // the cached mips are complete, nothing to generate on the GPU
+    texture->isRenderTarget = header->mipLevels == 1;
+
+    texture->dataLayout.resize(1);
+    texture->dataLayout[0].resize(header->mipLevels);
+    for (uint32_t mipLevel = 0; mipLevel < header->mipLevels; mipLevel++)
+    {
+        TextureSubresourceData& layout = texture->dataLayout[0][mipLevel];
+        layout.dataOffset = ptrdiff_t(mips[mipLevel].dataOffset);
+        layout.rowPitch = size_t(mips[mipLevel].rowPitch);
+        layout.depthPitch = 0;
+        layout.dataSize = size_t(mips[mipLevel].dataSize);
+    }
+
+    texture->data = blob;
+
+    ++m_DecodedCacheHits;
+    m_DecodedCacheBytesSaved += blob->size();
+
+    return true;
+}
+
+void TextureCache::StoreDecodedTexture(const std::filesystem::path& cachePath, TextureData& texture) const
+{
+    uint32_t channels;
+    bool isFloat, srgb;
+    if (texture.mipLevels != 1 || !GetDecodedFormatLayout(texture.format, channels, isFloat, srgb))
+        return;
+
+    // Mips are generated here with a box filter, so cache hits skip the GPU mip generation too
+    const uint32_t mipLevels = m_GenerateMipmaps ? GetMipLevelsNum(texture.width, texture.height) : 1;
+    const size_t bytesPerPixel = size_t(channels) * (isFloat ? 4 : 1);
+
+    std::vector<DecodedTextureFileMip> mips(mipLevels);
+    uint64_t fileSize = sizeof(DecodedTextureFileHeader) + mipLevels * sizeof(DecodedTextureFileMip);
+    for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+    {
+        fileSize = (fileSize + 15) & ~uint64_t(15);
+        mips[mipLevel].dataOffset = fileSize;
+        mips[mipLevel].rowPitch = std::max(texture.width >> mipLevel, 1u) * bytesPerPixel;
+        mips[mipLevel].dataSize = mips[mipLevel].rowPitch * std::max(texture.height >> mipLevel, 1u);
+        fileSize += mips[mipLevel].dataSize;
+    }
+
+    uint8_t* fileData = static_cast<uint8_t*>(calloc(size_t(fileSize), 1));
+    if (!fileData)
+        return;
+
+    DecodedTextureFileHeader header{};
+    header.magic = c_DecodedTextureCacheMagic;
+    header.version = c_DecodedTextureCacheVersion;
+    header.format = uint32_t(texture.format);
+    header.width = texture.width;
+    header.height = texture.height;
+    header.mipLevels = mipLevels;
+    header.originalBitsPerPixel = texture.originalBitsPerPixel;
+    memcpy(fileData, &header, sizeof(header));
+    memcpy(fileData + sizeof(header), mips.data(), mips.size() * sizeof(DecodedTextureFileMip));
+
+    const TextureSubresourceData& sourceLayout = texture.dataLayout[0][0];
+    const uint8_t* source = static_cast<const uint8_t*>(texture.data->data()) + sourceLayout.dataOffset;
+    for (uint32_t row = 0; row < texture.height; row++)
+        memcpy(fileData + mips[0].dataOffset + row * mips[0].rowPitch, source + row * sourceLayout.rowPitch, size_t(mips[0].rowPitch));
+
+    for (uint32_t mipLevel = 1; mipLevel < mipLevels; mipLevel++)
+    {
+        image::DownscaleImage(fileData + mips[mipLevel - 1].dataOffset,
+            std::max(texture.width >> (mipLevel - 1), 1u), std::max(texture.height >> (mipLevel - 1), 1u),
+            fileData + mips[mipLevel].dataOffset,
+            std::max(texture.width >> mipLevel, 1u), std::max(texture.height >> mipLevel, 1u),
+            channels, isFloat, srgb);
+    }
+
+    // Write under a temporary name and rename, so that readers never map a partial file
+    std::filesystem::path tempPath = cachePath;
+    tempPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+    if (m_DecodedCacheFS->writeFile(tempPath, fileData, size_t(fileSize)))
+    {
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+        if (error)
+            std::filesystem::remove(tempPath, error);
+        else
+            m_DecodedCacheBytesWritten += fileSize;
+    }
+    else
+        log::warning("Couldn't write decoded texture cache file '%s'", cachePath.generic_string().c_str());
+
+    // Use the generated mips for this load as well
+    texture.data = std::make_shared<Blob>(fileData, size_t(fileSize));
+    texture.mipLevels = mipLevels;
+    texture.isRenderTarget = mipLevels == 1;
+    texture.dataLayout[0].resize(mipLevels);
+    for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+    {
+        TextureSubresourceData& layout = texture.dataLayout[0][mipLevel];
+        layout.dataOffset = ptrdiff_t(mips[mipLevel].dataOffset);
+        layout.rowPitch = size_t(mips[mipLevel].rowPitch);
+        layout.depthPitch = 0;
+        layout.dataSize = size_t(mips[mipLevel].dataSize);
+    }
+}
+
 void TextureCache::FinalizeTexture(
     std::shared_ptr<TextureData> texture,
     CommonRenderPasses* passes,
@@ -357,6 +732,12 @@ void TextureCache::FinalizeTexture(
     assert(texture->data);
     assert(commandList);
 
+    if (CanStreamTexture(*texture))
+    {
+        FinalizeStreamedTexture(texture, commandList);
+        return;
+    }
+
     uint originalWidth = texture->width;
     uint originalHeight = texture->height;
 
@@ -402,6 +783,8 @@ void TextureCache::FinalizeTexture(
 
     const char* dataPointer = static_cast<const char*>(texture->data->data());
 
+    bool generateMips = m_GenerateMipmaps && texture->isRenderTarget && passes;
+
     nvrhi::TextureDesc textureDesc;
     textureDesc.format = texture->format;
     textureDesc.width = scaledWidth;
@@ -409,13 +792,33 @@ void TextureCache::FinalizeTexture(
     textureDesc.depth = texture->depth;
     textureDesc.arraySize = texture->arraySize;
     textureDesc.dimension = texture->dimension;
-    textureDesc.mipLevels = m_GenerateMipmaps && texture->isRenderTarget && passes
+    textureDesc.mipLevels = generateMips
         ? GetMipLevelsNum(textureDesc.width, textureDesc.height)
         : texture->mipLevels;
     textureDesc.debugName = texture->path;
     textureDesc.isRenderTarget = texture->isRenderTarget;
+
+    // Mips are generated with one compute dispatch for all slices where the format, or its linear alias
+    // for sRGB, supports typed UAV stores, otherwise with a blit per level of slice 0.
+    // Only textures that get their mips from that dispatch are created with UAV access.
+    bool computeMips = textureDesc.mipLevels > texture->mipLevels && !isBlockCompressed
+        && texture->dimension != nvrhi::TextureDimension::Texture3D
+        && passes->SupportsGenerateMips(texture->format);
+
+    textureDesc.isUAV = computeMips;
+    textureDesc.isTypeless = computeMips && IsSrgbFormat(texture->format);
     texture->texture = m_Device->createTexture(textureDesc);
 
+    if (!texture->texture)
+    {
+        // the device rejects dimensions and formats that it doesn't support
+        log::message(m_ErrorLogSeverity, "Couldn't create texture '%s' (%ux%u, %u array slices)",
+            texture->path.c_str(), textureDesc.width, textureDesc.height, textureDesc.arraySize);
+        texture->data.reset();
+        ++m_TexturesFinalized;
+        return;
+    }
+
     commandList->beginTrackingTextureState(texture->texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Common);
 
     if (m_DescriptorTable)
@@ -451,33 +854,31 @@ void TextureCache::FinalizeTexture(
     }
     else
     {
-        for (uint32_t arraySlice = 0; arraySlice < texture->arraySize; arraySlice++)
-        {
-            for (uint32_t mipLevel = 0; mipLevel < texture->mipLevels; mipLevel++)
-            {
-                const TextureSubresourceData& layout = texture->dataLayout[arraySlice][mipLevel];
-
-                commandList->writeTexture(texture->texture, arraySlice, mipLevel, dataPointer + layout.dataOffset,
-                    layout.rowPitch, layout.depthPitch);
-            }
-        }
+        UploadDDSTextureData(m_Device, commandList, texture->texture, *texture);
     }
 
     texture->data.reset();
 
-    for (uint mipLevel = texture->mipLevels; mipLevel < textureDesc.mipLevels; mipLevel++)
+    if (computeMips)
     {
-        nvrhi::FramebufferHandle framebuffer = m_Device->createFramebuffer(nvrhi::FramebufferDesc()
-            .addColorAttachment(nvrhi::FramebufferAttachment()
-                .setTexture(texture->texture)
-                .setArraySlice(0)
-                .setMipLevel(mipLevel)));
-        
-        BlitParameters blitParams;
-        blitParams.sourceTexture = texture->texture;
-        blitParams.sourceMip = mipLevel - 1;
-        blitParams.targetFramebuffer = framebuffer;
-        passes->BlitTexture(commandList, blitParams);
+        passes->GenerateMips(commandList, texture->texture, texture->mipLevels - 1);
+    }
+    else
+    {
+        for (uint mipLevel = texture->mipLevels; mipLevel < textureDesc.mipLevels; mipLevel++)
+        {
+            nvrhi::FramebufferHandle framebuffer = m_Device->createFramebuffer(nvrhi::FramebufferDesc()
+                .addColorAttachment(nvrhi::FramebufferAttachment()
+                    .setTexture(texture->texture)
+                    .setArraySlice(0)
+                    .setMipLevel(mipLevel)));
+
+            BlitParameters blitParams;
+            blitParams.sourceTexture = texture->texture;
+            blitParams.sourceMip = mipLevel - 1;
+            blitParams.targetFramebuffer = framebuffer;
+            passes->BlitTexture(commandList, blitParams);
+        }
     }
 
     commandList->setPermanentTextureState(texture->texture, nvrhi::ResourceStates::ShaderResource);
@@ -486,6 +887,370 @@ void TextureCache::FinalizeTexture(
     ++m_TexturesFinalized;
 }
 
+static uint64_t GetResidentBytes(const TextureData& texture, uint32_t residentMip)
+{
+    uint64_t bytes = 0;
+    for (const auto& sliceLayout : texture.dataLayout)
+        for (uint32_t mipLevel = residentMip; mipLevel < texture.mipLevels; mipLevel++)
+            bytes += sliceLayout[mipLevel].dataSize;
+
+    return bytes;
+}
+
+uint64_t TextureCache::GetUploadBytes(const TextureData& texture)
+{
+    // streamed textures only upload their resident mips
+    if (texture.isStreamed)
+        return texture.residentBytes;
+
+    uint64_t bytes = 0;
+    for (const auto& sliceLayout : texture.dataLayout)
+        for (const auto& mipLayout : sliceLayout)
+            bytes += mipLayout.dataSize;
+
+    return bytes;
+}
+
+bool TextureCache::ReadTextureHeader(const std::filesystem::path& path, TextureData& textureInfo, uint64_t& memoryBytes)
+{
+    memoryBytes = 0;
+
+    std::string extension = path.extension().generic_string();
+    if (extension != ".dds" && extension != ".DDS")
+        return false;
+
+    // Magic number and DDS_HEADER, followed by DDS_HEADER_DXT10 in newer files.
+    // Tiny legacy files can be shorter than both headers together.
+    constexpr size_t c_DDSHeaderSize = 4 + 124;
+    constexpr size_t c_DDSHeaderDX10Size = 20;
+
+    std::shared_ptr<IBlob> header = m_fs->readFileRange(path, 0, c_DDSHeaderSize + c_DDSHeaderDX10Size);
+    if (!header)
+        header = m_fs->readFileRange(path, 0, c_DDSHeaderSize);
+    if (!header)
+        return false;
+
+    size_t fileSize = ReadDDSHeader(header->data(), header->size(), textureInfo);
+    if (fileSize == 0)
+        return false;
+
+    memoryBytes = fileSize - textureInfo.dataLayout[0][0].dataOffset;
+    return true;
+}
+
+bool TextureCache::CanStreamTexture(const TextureData& texture) const
+{
+    if (m_StreamingBudget == 0 || texture.isRenderTarget || texture.mipLevels < 2)
+        return false;
+
+    if (texture.dimension != nvrhi::TextureDimension::Texture2D &&
+        texture.dimension != nvrhi::TextureDimension::Texture2DArray &&
+        texture.dimension != nvrhi::TextureDimension::TextureCube &&
+        texture.dimension != nvrhi::TextureDimension::TextureCubeArray)
+        return false;
+
+    // Block compressed textures need block aligned dimensions on the top resident mip
+    if (nvrhi::getFormatInfo(texture.format).blockSize > 1 && ((texture.width | texture.height) & 3) != 0)
+        return false;
+
+    return GetStreamingTailMip(texture) > 0;
+}
+
+uint32_t TextureCache::GetStreamingTailMip(const TextureData& texture) const
+{
+    uint32_t tailMip = 0;
+    while (tailMip + 1 < texture.mipLevels && std::max(texture.width, texture.height) >> tailMip > m_StreamingTailSize)
+        ++tailMip;
+
+    if (nvrhi::getFormatInfo(texture.format).blockSize > 1)
+    {
+        while (tailMip > 0 && (((texture.width >> tailMip) | (texture.height >> tailMip)) & 3) != 0)
+            --tailMip;
+    }
+
+    return tailMip;
+}
+
+void TextureCache::FinalizeStreamedTexture(std::shared_ptr<TextureData> texture, nvrhi::ICommandList* commandList)
+{
+    // Only the tail mips become resident, and the data is kept to stream in the rest on request
+    uint32_t tailMip = GetStreamingTailMip(*texture);
+
+    texture->isStreamed = true;
+    texture->residentMip = texture->mipLevels;
+    texture->requestedMip = tailMip;
+    texture->lastRequestFrame = 0;
+    ChangeTextureResidency(*texture, tailMip, commandList);
+
+    std::lock_guard<std::mutex> guard(m_StreamingMutex);
+    m_StreamedTextures.push_back(texture);
+    m_StreamingStats.streamedTextures = uint32_t(m_StreamedTextures.size());
+    m_StreamingStats.residentBytes += texture->residentBytes;
+
+    ++m_TexturesFinalized;
+}
+
+uint64_t TextureCache::ChangeTextureResidency(TextureData& texture, uint32_t residentMip, nvrhi::ICommandList* commandList)
+{
+    // Textures can't change their mip count, so a new texture is created with the new resident mips,
+    // and the mips that are already resident are copied from the old one.
+    nvrhi::TextureDesc textureDesc;
+    textureDesc.format = texture.format;
+    textureDesc.width = std::max(texture.width >> residentMip, 1u);
+    textureDesc.height = std::max(texture.height >> residentMip, 1u);
+    textureDesc.depth = texture.depth;
+    textureDesc.arraySize = texture.arraySize;
+    textureDesc.dimension = texture.dimension;
+    textureDesc.mipLevels = texture.mipLevels - residentMip;
+    textureDesc.debugName = texture.path;
+    textureDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    textureDesc.keepInitialState = true;
+
+    nvrhi::TextureHandle newTexture = m_Device->createTexture(textureDesc);
+    if (!newTexture)
+        return 0;
+
+    // Mips that are not resident yet are uploaded from the data, the rest is copied from the old texture
+    uint32_t uploadMipCount = texture.texture ? std::max(texture.residentMip, residentMip) - residentMip : textureDesc.mipLevels;
+    uint64_t uploadBytes = 0;
+
+    if (uploadMipCount > 0)
+        uploadBytes = UploadDDSTextureData(m_Device, commandList, newTexture, texture, residentMip, uploadMipCount);
+
+    if (texture.texture)
+    {
+        for (uint32_t arraySlice = 0; arraySlice < texture.arraySize; arraySlice++)
+        {
+            for (uint32_t mipLevel = residentMip + uploadMipCount; mipLevel < texture.mipLevels; mipLevel++)
+            {
+                commandList->copyTexture(
+                    newTexture, nvrhi::TextureSlice().setArraySlice(arraySlice).setMipLevel(mipLevel - residentMip),
+                    texture.texture, nvrhi::TextureSlice().setArraySlice(arraySlice).setMipLevel(mipLevel - texture.residentMip));
+            }
+        }
+    }
+
+    texture.texture = newTexture;
+    texture.residentMip = residentMip;
+    texture.residentBytes = GetResidentBytes(texture, residentMip);
+
+    if (m_DescriptorTable)
+    {
+        // Keep the bindless index so that materials referencing it don't need to be updated.
+        // The table rewrites the slot once the frames in flight are done with it, and keeps
+        // the old texture alive until then, see DescriptorTableManager::UpdateDescriptor.
+        nvrhi::BindingSetItem descriptor = nvrhi::BindingSetItem::Texture_SRV(0, newTexture);
+        if (texture.bindlessDescriptor.IsValid())
+            m_DescriptorTable->UpdateDescriptor(texture.bindlessDescriptor.Get(), descriptor);
+        else
+            texture.bindlessDescriptor = m_DescriptorTable->CreateDescriptorHandle(descriptor);
+    }
+
+    return uploadBytes;
+}
+
+void TextureCache::SetStreamingBudget(uint64_t budgetBytes, uint32_t tailSize)
+{
+    std::lock_guard<std::mutex> guard(m_StreamingMutex);
+
+    m_StreamingBudget = budgetBytes;
+    m_StreamingTailSize = std::max(tailSize, 1u);
+}
+
+void TextureCache::RequestTextureMip(const std::shared_ptr<LoadedTexture>& _texture, uint32_t mipLevel)
+{
+    TextureData* texture = static_cast<TextureData*>(_texture.get());
+    if (!texture || !texture->isStreamed)
+        return;
+
+    std::lock_guard<std::mutex> guard(m_StreamingMutex);
+
+    if (texture->lastRequestFrame != m_StreamingFrame)
+    {
+        texture->lastRequestFrame = m_StreamingFrame;
+        texture->requestedMip = mipLevel;
+    }
+    else
+        texture->requestedMip = std::min(texture->requestedMip, mipLevel);
+}
+
+void TextureCache::RequestTextureSize(const std::shared_ptr<LoadedTexture>& _texture, float projectedPixels)
+{
+    TextureData* texture = static_cast<TextureData*>(_texture.get());
+    if (!texture || !texture->isStreamed)
+        return;
+
+    float textureSize = float(std::max(texture->width, texture->height));
+    uint32_t mipLevel = 0;
+    if (projectedPixels <= 0.f)
+        mipLevel = texture->mipLevels;
+    else if (projectedPixels < textureSize)
+        mipLevel = uint32_t(floorf(std::log2(textureSize / projectedPixels)));
+
+    RequestTextureMip(_texture, mipLevel);
+}
+
+void TextureCache::RequestMipsForMeshInstances(const std::vector<std::shared_ptr<MeshInstance>>& instances, const IView& view)
+{
+    if (m_StreamingBudget == 0)
+        return;
+
+    const float4x4 projection = view.GetProjectionMatrix(false);
+    const nvrhi::Rect viewExtent = view.GetViewExtent();
+    const float pixelsPerUnit = projection[1][1] * float(viewExtent.height()) * 0.5f;
+    const float3 viewOrigin = view.GetViewOrigin();
+    const bool orthographic = view.IsOrthographicProjection();
+
+    for (const auto& instance : instances)
+    {
+        const SceneGraphNode* node = instance->GetNode();
+        const auto& mesh = instance->GetMesh();
+        if (!node || !mesh)
+            continue;
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            if (!geometry->material)
+                continue;
+
+            // Assume that the texture space covers the geometry, and project its bounding box size
+            box3 bounds = geometry->objectSpaceBounds * node->GetLocalToWorldTransformFloat();
+            if (!view.IsBoxVisible(bounds))
+                continue;
+
+            float size = length(bounds.diagonal());
+            float distance = orthographic ? 1.f : std::max(length(bounds.clamp(viewOrigin) - viewOrigin), 1e-3f);
+            float projectedPixels = size * pixelsPerUnit / distance;
+
+            const Material& material = *geometry->material;
+            RequestTextureSize(material.baseOrDiffuseTexture, projectedPixels);
+            RequestTextureSize(material.metalRoughOrSpecularTexture, projectedPixels);
+            RequestTextureSize(material.normalTexture, projectedPixels);
+            RequestTextureSize(material.emissiveTexture, projectedPixels);
+            RequestTextureSize(material.occlusionTexture, projectedPixels);
+            RequestTextureSize(material.transmissionTexture, projectedPixels);
+        }
+    }
+}
+
+void TextureCache::ApplyMipFeedback(const uint32_t* minMipPerDescriptor, size_t count)
+{
+    std::vector<std::pair<std::shared_ptr<TextureData>, uint32_t>> requests;
+
+    {
+        std::lock_guard<std::mutex> guard(m_StreamingMutex);
+
+        for (const auto& texture : m_StreamedTextures)
+        {
+            if (!texture->bindlessDescriptor.IsValid())
+                continue;
+
+            size_t index = size_t(texture->bindlessDescriptor.Get());
+            if (index < count && minMipPerDescriptor[index] != ~0u)
+                requests.push_back(std::make_pair(texture, minMipPerDescriptor[index]));
+        }
+    }
+
+    for (const auto& [texture, mipLevel] : requests)
+        RequestTextureMip(texture, mipLevel);
+}
+
+bool TextureCache::UpdateStreaming(nvrhi::ICommandList* commandList)
+{
+    std::lock_guard<std::mutex> guard(m_StreamingMutex);
+
+    const uint64_t frame = m_StreamingFrame++;
+
+    m_StreamingStats.texturesStreamedIn = 0;
+    m_StreamingStats.texturesEvicted = 0;
+    m_StreamingStats.uploadBytes = 0;
+    m_StreamingStats.budgetBytes = m_StreamingBudget;
+
+    if (m_StreamedTextures.empty())
+        return false;
+
+    uint64_t residentBytes = 0;
+    for (const auto& texture : m_StreamedTextures)
+        residentBytes += texture->residentBytes;
+
+    // Least recently requested textures first
+    std::vector<TextureData*> evictionOrder;
+    for (const auto& texture : m_StreamedTextures)
+    {
+        if (texture->lastRequestFrame != frame && texture->residentMip < GetStreamingTailMip(*texture))
+            evictionOrder.push_back(texture.get());
+    }
+    std::sort(evictionOrder.begin(), evictionOrder.end(), [](const TextureData* a, const TextureData* b)
+        { return a->lastRequestFrame < b->lastRequestFrame; });
+    size_t nextEviction = 0;
+
+    bool changed = false;
+
+    // Evicts unused mips until 'requiredBytes' more fit into the budget
+    auto evict = [this, commandList, &residentBytes, &evictionOrder, &nextEviction, &changed](uint64_t requiredBytes)
+    {
+        while (residentBytes + requiredBytes > m_StreamingBudget && nextEviction < evictionOrder.size())
+        {
+            TextureData* texture = evictionOrder[nextEviction++];
+
+            residentBytes -= texture->residentBytes;
+            ChangeTextureResidency(*texture, GetStreamingTailMip(*texture), commandList);
+            residentBytes += texture->residentBytes;
+
+            m_StreamingStats.texturesEvicted += 1;
+            changed = true;
+        }
+
+        return residentBytes + requiredBytes <= m_StreamingBudget;
+    };
+
+    evict(0);
+
+    // Stream in the textures with the largest difference between the requested and resident mips first
+    std::vector<TextureData*> streamingOrder;
+    for (const auto& texture : m_StreamedTextures)
+    {
+        if (texture->lastRequestFrame == frame && texture->requestedMip < texture->residentMip)
+            streamingOrder.push_back(texture.get());
+    }
+    std::sort(streamingOrder.begin(), streamingOrder.end(), [](const TextureData* a, const TextureData* b)
+        { return a->residentMip - a->requestedMip > b->residentMip - b->requestedMip; });
+
+    for (TextureData* texture : streamingOrder)
+    {
+        uint64_t requestedBytes = GetResidentBytes(*texture, texture->requestedMip) - texture->residentBytes;
+        if (m_StreamingStats.uploadBytes > 0 && m_StreamingStats.uploadBytes + requestedBytes > m_StreamingUploadLimit)
+            break;
+
+        // Settle for a less detailed mip when the requested one doesn't fit into the budget
+        uint32_t targetMip = texture->requestedMip;
+        while (targetMip < texture->residentMip && !evict(GetResidentBytes(*texture, targetMip) - texture->residentBytes))
+            ++targetMip;
+
+        if (targetMip >= texture->residentMip)
+            continue;
+
+        residentBytes -= texture->residentBytes;
+        m_StreamingStats.uploadBytes += ChangeTextureResidency(*texture, targetMip, commandList);
+        residentBytes += texture->residentBytes;
+
+        m_StreamingStats.texturesStreamedIn += 1;
+        changed = true;
+    }
+
+    m_StreamingStats.streamedTextures = uint32_t(m_StreamedTextures.size());
+    m_StreamingStats.residentBytes = residentBytes;
+
+    if (changed)
+    {
+        log::message(m_InfoLogSeverity, "Texture streaming: %u textures streamed in (%.2f MB), %u evicted, %.2f MB resident",
+            m_StreamingStats.texturesStreamedIn, double(m_StreamingStats.uploadBytes) / (1024.0 * 1024.0),
+            m_StreamingStats.texturesEvicted, double(residentBytes) / (1024.0 * 1024.0));
+    }
+
+    return changed;
+}
+
 void TextureCache::TextureLoaded(std::shared_ptr<TextureData> texture)
 {
     std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
@@ -506,12 +1271,9 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFile(
 {
     std::shared_ptr<TextureData> texture;
 
-    if (FindTextureInCache(path, texture))
+    if (FindTextureInCache(path, sRGB, texture))
         return texture;
 
-    texture->forceSRGB = sRGB;
-    texture->path = path.generic_string();
-
     auto fileData = ReadTextureFile(path);
     if (fileData)
     {
@@ -534,12 +1296,9 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFileDeferred(
 {
     std::shared_ptr<TextureData> texture;
 
-    if (FindTextureInCache(path, texture))
+    if (FindTextureInCache(path, sRGB, texture))
         return texture;
 
-    texture->forceSRGB = sRGB;
-    texture->path = path.generic_string();
-
     auto fileData = ReadTextureFile(path);
     if (fileData)
     {
@@ -547,9 +1306,7 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFileDeferred(
         {
             TextureLoaded(texture);
 
-            std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-            m_TexturesToFinalize.push(texture);
+            PushLoadRequest(m_TexturesToFinalize, texture);
         }
     }
 
@@ -558,7 +1315,116 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFileDeferred(
     return texture;
 }
 
+void TextureCache::PushLoadRequest(std::vector<TextureLoadRequest>& queue, std::shared_ptr<TextureData> texture, std::shared_ptr<IBlob> fileData)
+{
+    std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
+
+    TextureLoadRequest request;
+    request.priority = texture->priority;
+    request.sequence = m_LoadRequestSequence++;
+    request.texture = std::move(texture);
+    request.fileData = std::move(fileData);
+
+    queue.push_back(std::move(request));
+    std::push_heap(queue.begin(), queue.end());
+}
+
+bool TextureCache::PopLoadRequest(std::vector<TextureLoadRequest>& queue, TextureLoadRequest& request)
+{
+    std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
+
+    if (queue.empty())
+        return false;
+
+    std::pop_heap(queue.begin(), queue.end());
+    request = std::move(queue.back());
+    queue.pop_back();
+
+    return true;
+}
+
+void TextureCache::DecodeNextTexture()
+{
+    TextureLoadRequest request;
+    if (!PopLoadRequest(m_TexturesToDecode, request))
+        return;
+
+    const std::shared_ptr<TextureData>& texture = request.texture;
+    if (FillTextureData(request.fileData, texture, std::filesystem::path(texture->path).extension().generic_string(), ""))
+    {
+        TextureLoaded(texture);
+
+        PushLoadRequest(m_TexturesToFinalize, texture);
+    }
+
+    ++m_TexturesLoaded;
+}
+
+void TextureCache::SetTexturePriority(const std::shared_ptr<LoadedTexture>& _texture, int priority)
+{
+    TextureData* texture = static_cast<TextureData*>(_texture.get());
+    if (!texture)
+        return;
+
+    std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
+
+    if (texture->priority == priority)
+        return;
+
+    texture->priority = priority;
+
+    // Priorities change rarely, so the pending requests are updated in place and the heaps rebuilt
+    for (auto* queue : { &m_TexturesToDecode, &m_TexturesToFinalize })
+    {
+        bool found = false;
+        for (auto& request : *queue)
+        {
+            if (request.texture.get() == texture)
+            {
+                request.priority = priority;
+                found = true;
+            }
+        }
+
+        if (found)
+            std::make_heap(queue->begin(), queue->end());
+    }
+}
+
+void TextureCache::PrioritizeMaterialTextures(const Material& material, int priority)
+{
+    for (const auto* texture : { &material.baseOrDiffuseTexture, &material.metalRoughOrSpecularTexture,
+        &material.normalTexture, &material.emissiveTexture, &material.occlusionTexture, &material.transmissionTexture })
+    {
+        if (!*texture)
+            continue;
+
+        int currentPriority;
+        {
+            std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
+            currentPriority = static_cast<TextureData*>(texture->get())->priority;
+        }
+
+        if (currentPriority < priority)
+            SetTexturePriority(*texture, priority);
+    }
+}
+
 #ifdef DONUT_WITH_TASKFLOW
+void TextureCache::WaitForAsyncLoads(tf::Executor& executor)
+{
+    // finish the tasks that may request more textures, such as model loading
+    executor.wait_for_all();
+
+    // the reads complete outside of the executor and schedule the decoding when they do
+    {
+        std::unique_lock<std::mutex> lock(m_PendingFileReadsMutex);
+        m_PendingFileReadsCondition.wait(lock, [this]() { return m_PendingFileReads == 0; });
+    }
+
+    executor.wait_for_all();
+}
+
 std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFileAsync(
     const std::filesystem::path& path,
     bool sRGB,
@@ -566,28 +1432,41 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFileAsync(
 {
     std::shared_ptr<TextureData> texture;
 
-    if (FindTextureInCache(path, texture))
+    if (FindTextureInCache(path, sRGB, texture))
         return texture;
 
-    texture->forceSRGB = sRGB;
-    texture->path = path.generic_string();
+    {
+        std::lock_guard<std::mutex> guard(m_PendingFileReadsMutex);
+        ++m_PendingFileReads;
+    }
 
-    executor.async([this, texture, path]()
+    // Submit the read from a worker thread, because some file systems resolve the file or even read it
+    // synchronously, and decode on a worker when the data arrives. With a truly asynchronous file system,
+    // no worker thread is blocked waiting for I/O.
+    executor.silent_async([this, texture, path, &executor]()
     {
-        auto fileData = ReadTextureFile(path);
-        if (fileData)
+        m_fs->readFileAsync(path, [this, texture, path, &executor](std::shared_ptr<IBlob> fileData)
         {
-            if (FillTextureData(fileData, texture, path.extension().generic_string(), ""))
+            if (fileData)
             {
-                TextureLoaded(texture);
-
-                std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-                m_TexturesToFinalize.push(texture);
+                // Each task decodes the pending texture with the highest priority, not necessarily this one
+                PushLoadRequest(m_TexturesToDecode, texture, fileData);
+                executor.silent_async([this]()
+                {
+                    image::SerialScope serialScope;
+                    DecodeNextTexture();
+                });
+            }
+            else
+            {
+                log::message(m_ErrorLogSeverity, "Couldn't read texture file '%s'", path.generic_string().c_str());
+                ++m_TexturesLoaded;
             }
-        }
 
-        ++m_TexturesLoaded;
+            std::lock_guard<std::mutex> guard(m_PendingFileReadsMutex);
+            if (--m_PendingFileReads == 0)
+                m_PendingFileReadsCondition.notify_all();
+        });
     });
 
     return texture;
@@ -608,13 +1487,13 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromMemoryAsync(
 
     executor.async([this, texture, data, mimeType]()
         {
+            image::SerialScope serialScope;
+
             if (FillTextureData(data, texture, "", mimeType))
             {
                 TextureLoaded(texture);
 
-                std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-                m_TexturesToFinalize.push(texture);
+                PushLoadRequest(m_TexturesToFinalize, texture);
             }
 
             ++m_TexturesLoaded;
@@ -666,9 +1545,7 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromMemoryDeferred(
     {
         TextureLoaded(texture);
 
-        std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-        m_TexturesToFinalize.push(texture);
+        PushLoadRequest(m_TexturesToFinalize, texture);
     }
     
     ++m_TexturesLoaded;
@@ -679,8 +1556,7 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromMemoryDeferred(
 
 std::shared_ptr<TextureData> TextureCache::GetLoadedTexture(std::filesystem::path const& path)
 {
-	std::lock_guard<std::shared_mutex> guard(m_LoadedTexturesMutex);
-	return m_LoadedTextures[path.generic_string()];
+	return m_LoadedTextures.find(path.generic_string());
 }
 
 bool TextureCache::ProcessRenderingThreadCommands(CommonRenderPasses& passes, float timeLimitMilliseconds)
@@ -689,6 +1565,25 @@ bool TextureCache::ProcessRenderingThreadCommands(CommonRenderPasses& passes, fl
 
     time_point<high_resolution_clock> startTime = high_resolution_clock::now();
 
+    TextureFinalizationStats stats;
+    TextureUploadBatch batch;
+    batch.maxBytes = m_MaxFinalizationBatchBytes;
+    bool commandListOpen = false;
+
+    auto submitBatch = [this, &stats, &batch, &commandListOpen]()
+    {
+        m_CommandList->close();
+        m_Device->executeCommandList(m_CommandList);
+        commandListOpen = false;
+
+        log::message(m_InfoLogSeverity, "Uploaded %u textures (%.2f MB) in one command list", batch.textures,
+            double(batch.bytes) / (1024.0 * 1024.0));
+
+        stats.commandListsSubmitted += 1;
+        stats.largestBatchBytes = std::max(stats.largestBatchBytes, batch.bytes);
+        batch.Clear();
+    };
+
     uint commandsExecuted = 0;
     while (true)
     {
@@ -702,17 +1597,13 @@ bool TextureCache::ProcessRenderingThreadCommands(CommonRenderPasses& passes, fl
                 break;
         }
 
-        {
-            std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-            if (m_TexturesToFinalize.empty())
-                break;
+        TextureLoadRequest request;
+        if (!PopLoadRequest(m_TexturesToFinalize, request))
+            break;
 
-            pTexture = m_TexturesToFinalize.front();
-            m_TexturesToFinalize.pop();
-        }
+        pTexture = std::move(request.texture);
 
-        if (pTexture->data)
+        if (pTexture->data && !pTexture->texture)
         {
             commandsExecuted += 1;
 
@@ -721,16 +1612,38 @@ bool TextureCache::ProcessRenderingThreadCommands(CommonRenderPasses& passes, fl
                 m_CommandList = m_Device->createCommandList();
             }
 
-            m_CommandList->open();
+            if (!commandListOpen)
+            {
+                m_CommandList->open();
+                commandListOpen = true;
+            }
 
             FinalizeTexture(pTexture, &passes, m_CommandList);
 
-            m_CommandList->close();
-            m_Device->executeCommandList(m_CommandList);
-            m_Device->runGarbageCollection();
+            uint64_t textureBytes = GetUploadBytes(*pTexture);
+            stats.uploadBytes += textureBytes;
+            stats.texturesFinalized += 1;
+
+            if (batch.Add(textureBytes))
+                submitBatch();
         }
     }
 
+    if (commandListOpen)
+        submitBatch();
+
+    if (commandsExecuted > 0)
+    {
+        // release the resources of the previous batches once per call instead of once per texture
+        m_Device->runGarbageCollection();
+
+        m_LastFinalizationStats = stats;
+        m_TotalFinalizationStats.texturesFinalized += stats.texturesFinalized;
+        m_TotalFinalizationStats.commandListsSubmitted += stats.commandListsSubmitted;
+        m_TotalFinalizationStats.uploadBytes += stats.uploadBytes;
+        m_TotalFinalizationStats.largestBatchBytes = std::max(m_TotalFinalizationStats.largestBatchBytes, stats.largestBatchBytes);
+    }
+
     return (commandsExecuted > 0);
 }
 
@@ -842,7 +1755,8 @@ namespace donut::engine
     {
         TextureData* texture = static_cast<TextureData*>(_texture.get());
 
-        return texture && texture->data;
+        // streamed textures keep their data after finalization
+        return texture && texture->data && !texture->texture;
     }
 
     bool TextureCache::IsTextureFinalized(const std::shared_ptr<LoadedTexture>& texture)
@@ -852,12 +1766,12 @@ namespace donut::engine
 
     bool TextureCache::UnloadTexture(const std::shared_ptr<LoadedTexture>& texture)
     {
-        const auto& it = m_LoadedTextures.find(texture->path);
-
-        if (it == m_LoadedTextures.end())
+        std::shared_ptr<TextureData> textureData;
+        if (!m_LoadedTextures.erase(texture->path, &textureData))
             return false;
 
-        m_LoadedTextures.erase(it);
+        std::lock_guard<std::mutex> guard(m_StreamingMutex);
+        m_StreamedTextures.erase(std::remove(m_StreamedTextures.begin(), m_StreamedTextures.end(), textureData), m_StreamedTextures.end());
 
         return true;
     }
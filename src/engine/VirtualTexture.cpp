@@ -0,0 +1,716 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <donut/engine/VirtualTexture.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/log.h>
+#include <donut/core/math/math.h>
+#include <nvrhi/utils.h>
+#include "ImageProcessing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <unordered_set>
+
+using namespace donut::math;
+#include <donut/shaders/virtual_texture_cb.h>
+
+using namespace donut::vfs;
+using namespace donut::engine;
+
+static bool IsPowerOfTwo(uint32_t value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static uint32_t GetPageCount(uint32_t size, uint32_t pageSize, uint32_t mipLevel)
+{
+    return std::max((size / pageSize) >> mipLevel, 1u);
+}
+
+static uint32_t GetVirtualTextureMipLevels(uint32_t width, uint32_t height, uint32_t pageSize)
+{
+    uint32_t pages = std::max(width, height) / pageSize;
+    uint32_t mipLevels = 1;
+    while (pages > 1)
+    {
+        pages >>= 1;
+        ++mipLevels;
+    }
+    return mipLevels;
+}
+
+std::shared_ptr<IBlob> donut::engine::BuildVirtualTextureFile(const void* rgba8, uint32_t width, uint32_t height, bool sRGB,
+    uint32_t pageSize, uint32_t pageBorder)
+{
+    if (!rgba8 || !IsPowerOfTwo(pageSize) || !IsPowerOfTwo(width) || !IsPowerOfTwo(height) ||
+        width < pageSize || height < pageSize || pageBorder > pageSize)
+        return nullptr;
+
+    // The feedback entries can address 1024 pages along each axis
+    if (width / pageSize > (1u << VIRTUAL_TEXTURE_FEEDBACK_PAGE_BITS) || height / pageSize > (1u << VIRTUAL_TEXTURE_FEEDBACK_PAGE_BITS))
+        return nullptr;
+
+    VirtualTextureFileHeader header;
+    header.width = width;
+    header.height = height;
+    header.pageSize = pageSize;
+    header.pageBorder = pageBorder;
+    header.mipLevels = GetVirtualTextureMipLevels(width, height, pageSize);
+    header.sRGB = sRGB ? 1 : 0;
+
+    uint32_t totalPages = 0;
+    for (uint32_t mipLevel = 0; mipLevel < header.mipLevels; mipLevel++)
+        totalPages += GetPageCount(width, pageSize, mipLevel) * GetPageCount(height, pageSize, mipLevel);
+
+    const uint32_t paddedPageSize = pageSize + pageBorder * 2;
+    const size_t pageBytes = size_t(paddedPageSize) * paddedPageSize * 4;
+    const size_t pageTableOffset = sizeof(VirtualTextureFileHeader);
+    const size_t payloadOffset = pageTableOffset + sizeof(VirtualTexturePageEntry) * totalPages;
+    const size_t fileSize = payloadOffset + pageBytes * totalPages;
+
+    uint8_t* fileData = static_cast<uint8_t*>(malloc(fileSize));
+    if (!fileData)
+        return nullptr;
+
+    memcpy(fileData, &header, sizeof(header));
+    auto* pageTable = reinterpret_cast<VirtualTexturePageEntry*>(fileData + pageTableOffset);
+
+    std::vector<uint8_t> mipImage;
+    std::vector<uint8_t> nextMipImage;
+    const uint8_t* mipData = static_cast<const uint8_t*>(rgba8);
+    uint32_t mipWidth = width;
+    uint32_t mipHeight = height;
+    uint32_t pageIndex = 0;
+
+    for (uint32_t mipLevel = 0; mipLevel < header.mipLevels; mipLevel++)
+    {
+        if (mipLevel > 0)
+        {
+            uint32_t nextWidth = std::max(mipWidth >> 1, 1u);
+            uint32_t nextHeight = std::max(mipHeight >> 1, 1u);
+            nextMipImage.resize(size_t(nextWidth) * nextHeight * 4);
+            image::DownscaleImage(mipData, mipWidth, mipHeight, nextMipImage.data(), nextWidth, nextHeight, 4, false, sRGB);
+            std::swap(mipImage, nextMipImage);
+            mipData = mipImage.data();
+            mipWidth = nextWidth;
+            mipHeight = nextHeight;
+        }
+
+        const uint32_t pagesX = GetPageCount(width, pageSize, mipLevel);
+        const uint32_t pagesY = GetPageCount(height, pageSize, mipLevel);
+        const uint32_t firstPage = pageIndex;
+
+        // Copy the pages with their borders, clamping at the image edges. Pages of the mip levels
+        // that are smaller than a page contain the image in their top-left corner.
+        image::ParallelFor(pagesY, 1, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t pageY = begin; pageY < end; pageY++)
+            {
+                for (uint32_t pageX = 0; pageX < pagesX; pageX++)
+                {
+                    uint8_t* page = fileData + payloadOffset + pageBytes * (firstPage + pageY * pagesX + pageX);
+
+                    for (uint32_t row = 0; row < paddedPageSize; row++)
+                    {
+                        int sourceY = std::clamp(int(pageY * pageSize + row) - int(pageBorder), 0, int(mipHeight) - 1);
+                        const uint8_t* sourceRow = mipData + size_t(sourceY) * mipWidth * 4;
+                        uint8_t* destRow = page + size_t(row) * paddedPageSize * 4;
+
+                        for (uint32_t column = 0; column < paddedPageSize; column++)
+                        {
+                            int sourceX = std::clamp(int(pageX * pageSize + column) - int(pageBorder), 0, int(mipWidth) - 1);
+                            memcpy(destRow + column * 4, sourceRow + sourceX * 4, 4);
+                        }
+                    }
+                }
+            }
+        });
+
+        for (uint32_t page = 0; page < pagesX * pagesY; page++)
+        {
+            VirtualTexturePageEntry& entry = pageTable[pageIndex];
+            entry = VirtualTexturePageEntry();
+            entry.offset = payloadOffset + pageBytes * pageIndex;
+            entry.size = uint32_t(pageBytes);
+            ++pageIndex;
+        }
+    }
+
+    return std::make_shared<Blob>(fileData, fileSize);
+}
+
+uint32_t VirtualTexture::GetPageCountX(uint32_t mipLevel) const
+{
+    return GetPageCount(m_Width, m_PageSize, mipLevel);
+}
+
+uint32_t VirtualTexture::GetPageCountY(uint32_t mipLevel) const
+{
+    return GetPageCount(m_Height, m_PageSize, mipLevel);
+}
+
+VirtualTextureSystem::VirtualTextureSystem(nvrhi::IDevice* device, std::shared_ptr<IFileSystem> fs, const VirtualTextureSystemDesc& desc)
+    : m_Device(device)
+    , m_FS(std::move(fs))
+    , m_Desc(desc)
+{
+    assert(m_Desc.atlasPages > 0 && m_Desc.atlasPages <= (1u << VIRTUAL_TEXTURE_INDIRECTION_PAGE_BITS));
+
+    const uint32_t atlasSize = m_Desc.atlasPages * GetPaddedPageSize();
+
+    for (uint32_t layer = 0; layer < 2; layer++)
+    {
+        nvrhi::TextureDesc textureDesc;
+        textureDesc.width = atlasSize;
+        textureDesc.height = atlasSize;
+        textureDesc.format = layer == 0 ? nvrhi::Format::SRGBA8_UNORM : nvrhi::Format::RGBA8_UNORM;
+        textureDesc.debugName = layer == 0 ? "VirtualTextureAtlas0" : "VirtualTextureAtlas1";
+        textureDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        textureDesc.keepInitialState = true;
+        m_AtlasTextures[layer] = m_Device->createTexture(textureDesc);
+
+        textureDesc.width = GetPaddedPageSize();
+        textureDesc.height = GetPaddedPageSize();
+        textureDesc.debugName = "VirtualTexturePageUpload";
+        m_PageUploadTextures[layer] = m_Device->createTexture(textureDesc);
+    }
+
+    m_Slots.resize(m_Desc.atlasPages * m_Desc.atlasPages);
+    m_FreeSlots.reserve(m_Slots.size());
+    for (int slot = int(m_Slots.size()) - 1; slot >= 0; slot--)
+        m_FreeSlots.push_back(slot);
+
+    // The atlas has no mip levels; anisotropic filtering stays within the page borders.
+    auto samplerDesc = nvrhi::SamplerDesc()
+        .setAllAddressModes(nvrhi::SamplerAddressMode::Clamp)
+        .setAllFilters(true)
+        .setMaxAnisotropy(float(std::max(m_Desc.pageBorder, 1u)));
+    m_Sampler = m_Device->createSampler(samplerDesc);
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = VIRTUAL_TEXTURE_FEEDBACK_ENTRIES * sizeof(uint32_t);
+    bufferDesc.structStride = sizeof(uint32_t);
+    bufferDesc.canHaveUAVs = true;
+    bufferDesc.debugName = "VirtualTextureFeedback";
+    bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    bufferDesc.keepInitialState = true;
+    m_FeedbackBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.structStride = 0;
+    bufferDesc.canHaveUAVs = false;
+    bufferDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+    bufferDesc.debugName = "VirtualTextureFeedbackReadback";
+    bufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
+    for (auto& buffer : m_ReadbackBuffers)
+        buffer = m_Device->createBuffer(bufferDesc);
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Pixel;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::ConstantBuffer(4),
+        nvrhi::BindingLayoutItem::Texture_SRV(20),
+        nvrhi::BindingLayoutItem::Texture_SRV(21),
+        nvrhi::BindingLayoutItem::Texture_SRV(22),
+        nvrhi::BindingLayoutItem::Sampler(4),
+        nvrhi::BindingLayoutItem::StructuredBuffer_UAV(7)
+    };
+    m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+    m_Stats.atlasPages = uint32_t(m_Slots.size());
+}
+
+bool VirtualTextureSystem::ReadLayerHeader(const std::filesystem::path& path, VirtualTextureFileHeader& header, std::vector<VirtualTexturePageEntry>& pageTable)
+{
+    std::shared_ptr<IBlob> headerBlob = m_FS->readFileRange(path, 0, sizeof(VirtualTextureFileHeader));
+    if (!headerBlob)
+    {
+        log::error("Couldn't read virtual texture file '%s'", path.generic_string().c_str());
+        return false;
+    }
+
+    memcpy(&header, headerBlob->data(), sizeof(header));
+
+    if (header.magic != c_VirtualTextureFileMagic || header.version != c_VirtualTextureFileVersion)
+    {
+        log::error("'%s' is not a virtual texture file or has an unsupported version", path.generic_string().c_str());
+        return false;
+    }
+
+    if (header.pageSize != m_Desc.pageSize || header.pageBorder != m_Desc.pageBorder ||
+        !IsPowerOfTwo(header.width) || !IsPowerOfTwo(header.height) ||
+        header.width < header.pageSize || header.height < header.pageSize ||
+        header.mipLevels != GetVirtualTextureMipLevels(header.width, header.height, header.pageSize))
+    {
+        log::error("Virtual texture file '%s' has a page layout that doesn't match the virtual texture system", path.generic_string().c_str());
+        return false;
+    }
+
+    uint32_t totalPages = 0;
+    for (uint32_t mipLevel = 0; mipLevel < header.mipLevels; mipLevel++)
+        totalPages += GetPageCount(header.width, header.pageSize, mipLevel) * GetPageCount(header.height, header.pageSize, mipLevel);
+
+    std::shared_ptr<IBlob> pageTableBlob = m_FS->readFileRange(path, sizeof(VirtualTextureFileHeader), sizeof(VirtualTexturePageEntry) * totalPages);
+    if (!pageTableBlob)
+    {
+        log::error("Virtual texture file '%s' is truncated", path.generic_string().c_str());
+        return false;
+    }
+
+    pageTable.resize(totalPages);
+    memcpy(pageTable.data(), pageTableBlob->data(), pageTableBlob->size());
+
+    return true;
+}
+
+std::shared_ptr<VirtualTexture> VirtualTextureSystem::LoadVirtualTexture(nvrhi::ICommandList* commandList, const std::vector<std::filesystem::path>& layerFiles)
+{
+    if (layerFiles.empty() || layerFiles.size() > 2)
+    {
+        log::error("Virtual textures must have one or two layers");
+        return nullptr;
+    }
+
+    auto texture = std::make_shared<VirtualTexture>();
+    texture->m_PageSize = m_Desc.pageSize;
+
+    for (size_t layerIndex = 0; layerIndex < layerFiles.size(); layerIndex++)
+    {
+        VirtualTexture::Layer layer;
+        layer.path = layerFiles[layerIndex];
+
+        VirtualTextureFileHeader header;
+        if (!ReadLayerHeader(layer.path, header, layer.pageTable))
+            return nullptr;
+
+        if (layerIndex == 0)
+        {
+            texture->m_Width = header.width;
+            texture->m_Height = header.height;
+            texture->m_MipLevels = header.mipLevels;
+        }
+        else if (header.width != texture->m_Width || header.height != texture->m_Height)
+        {
+            log::error("Virtual texture file '%s' doesn't match the dimensions of the other layers", layer.path.generic_string().c_str());
+            return nullptr;
+        }
+
+        if ((header.sRGB != 0) != (layerIndex == 0))
+        {
+            log::warning("Virtual texture file '%s' uses the wrong color space for layer %d", layer.path.generic_string().c_str(), int(layerIndex));
+        }
+
+        texture->m_Layers.push_back(std::move(layer));
+    }
+
+    uint32_t pageOffset = 0;
+    for (uint32_t mipLevel = 0; mipLevel < texture->m_MipLevels; mipLevel++)
+    {
+        const uint32_t pageCount = texture->GetPageCountX(mipLevel) * texture->GetPageCountY(mipLevel);
+        texture->m_MipPageOffsets.push_back(pageOffset);
+        texture->m_PageSlots.push_back(std::vector<int>(pageCount, -1));
+        texture->m_Indirection.push_back(std::vector<uint32_t>(pageCount, 0));
+        pageOffset += pageCount;
+    }
+
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    ReleaseExpiredTextures();
+
+    auto freeID = std::find_if(m_Textures.begin(), m_Textures.end(), [](const std::weak_ptr<VirtualTexture>& entry) { return entry.expired(); });
+    if (freeID != m_Textures.end())
+    {
+        texture->m_ID = uint32_t(freeID - m_Textures.begin());
+        *freeID = texture;
+    }
+    else if (m_Textures.size() < (1u << (32 - VIRTUAL_TEXTURE_FEEDBACK_ID_SHIFT)))
+    {
+        texture->m_ID = uint32_t(m_Textures.size());
+        m_Textures.push_back(texture);
+    }
+    else
+    {
+        log::error("Too many virtual textures");
+        return nullptr;
+    }
+
+    nvrhi::TextureDesc textureDesc;
+    textureDesc.width = texture->GetPageCountX(0);
+    textureDesc.height = texture->GetPageCountY(0);
+    textureDesc.mipLevels = texture->m_MipLevels;
+    textureDesc.format = nvrhi::Format::R32_UINT;
+    textureDesc.debugName = "VirtualTextureIndirection";
+    textureDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    textureDesc.keepInitialState = true;
+    texture->m_IndirectionTexture = m_Device->createTexture(textureDesc);
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = sizeof(VirtualTextureConstants);
+    bufferDesc.debugName = "VirtualTextureConstants";
+    bufferDesc.isConstantBuffer = true;
+    bufferDesc.initialState = nvrhi::ResourceStates::ConstantBuffer;
+    bufferDesc.keepInitialState = true;
+    texture->m_ConstantBuffer = m_Device->createBuffer(bufferDesc);
+
+    VirtualTextureConstants constants = {};
+    constants.virtualSize = float2(float(texture->m_Width), float(texture->m_Height));
+    constants.invAtlasSize = float2(1.f / float(m_Desc.atlasPages * GetPaddedPageSize()));
+    constants.pageCounts = uint2(texture->GetPageCountX(0), texture->GetPageCountY(0));
+    constants.pageSize = m_Desc.pageSize;
+    constants.pageBorder = m_Desc.pageBorder;
+    constants.mipLevels = texture->m_MipLevels;
+    constants.textureID = texture->m_ID;
+    constants.layerCount = texture->GetLayerCount();
+    commandList->writeBuffer(texture->m_ConstantBuffer, &constants, sizeof(constants));
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(4, texture->m_ConstantBuffer),
+        nvrhi::BindingSetItem::Texture_SRV(20, texture->m_IndirectionTexture),
+        nvrhi::BindingSetItem::Texture_SRV(21, m_AtlasTextures[0]),
+        nvrhi::BindingSetItem::Texture_SRV(22, m_AtlasTextures[1]),
+        nvrhi::BindingSetItem::Sampler(4, m_Sampler),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(7, m_FeedbackBuffer)
+    };
+    texture->m_BindingSet = m_Device->createBindingSet(bindingSetDesc, m_BindingLayout);
+
+    // The coarsest mip level is the fallback for all other pages and never gets evicted
+    const uint32_t coarsestMip = texture->m_MipLevels - 1;
+    for (uint32_t pageY = 0; pageY < texture->GetPageCountY(coarsestMip); pageY++)
+    {
+        for (uint32_t pageX = 0; pageX < texture->GetPageCountX(coarsestMip); pageX++)
+        {
+            if (!LoadPage(commandList, *texture, coarsestMip, pageX, pageY, true))
+            {
+                log::error("Couldn't load the coarsest mip level of virtual texture '%s'", layerFiles[0].generic_string().c_str());
+                return nullptr;
+            }
+        }
+    }
+
+    texture->m_DirtyMipLevels = texture->m_MipLevels;
+    UpdateIndirection(commandList, *texture);
+
+    return texture;
+}
+
+void VirtualTextureSystem::ReleaseExpiredTextures()
+{
+    for (size_t slotIndex = 0; slotIndex < m_Slots.size(); slotIndex++)
+    {
+        AtlasSlot& slot = m_Slots[slotIndex];
+        if (slot.textureID >= 0 && m_Textures[slot.textureID].expired())
+        {
+            slot = AtlasSlot();
+            m_FreeSlots.push_back(int(slotIndex));
+        }
+    }
+}
+
+int VirtualTextureSystem::AllocateSlot()
+{
+    if (!m_FreeSlots.empty())
+    {
+        int slot = m_FreeSlots.back();
+        m_FreeSlots.pop_back();
+        return slot;
+    }
+
+    // Evict the least recently requested page, but never the pages requested by the current frame
+    int victim = -1;
+    for (int slotIndex = 0; slotIndex < int(m_Slots.size()); slotIndex++)
+    {
+        const AtlasSlot& slot = m_Slots[slotIndex];
+        if (slot.pinned || slot.lastUsedFrame >= m_FrameIndex)
+            continue;
+
+        if (victim < 0 || slot.lastUsedFrame < m_Slots[victim].lastUsedFrame)
+            victim = slotIndex;
+    }
+
+    if (victim < 0)
+        return -1;
+
+    AtlasSlot& slot = m_Slots[victim];
+    if (std::shared_ptr<VirtualTexture> owner = m_Textures[slot.textureID].lock())
+    {
+        owner->m_PageSlots[slot.mipLevel][slot.pageY * owner->GetPageCountX(slot.mipLevel) + slot.pageX] = -1;
+        owner->m_DirtyMipLevels = std::max(owner->m_DirtyMipLevels, slot.mipLevel + 1);
+    }
+
+    slot = AtlasSlot();
+    ++m_Stats.pagesEvicted;
+
+    return victim;
+}
+
+bool VirtualTextureSystem::LoadPage(nvrhi::ICommandList* commandList, VirtualTexture& texture, uint32_t mipLevel, uint32_t pageX, uint32_t pageY, bool pinned)
+{
+    const uint32_t pageIndex = pageY * texture.GetPageCountX(mipLevel) + pageX;
+    assert(texture.m_PageSlots[mipLevel][pageIndex] < 0);
+
+    const int slotIndex = AllocateSlot();
+    if (slotIndex < 0)
+        return false;
+
+    const uint32_t paddedPageSize = GetPaddedPageSize();
+    const size_t pageBytes = size_t(paddedPageSize) * paddedPageSize * 4;
+
+    std::shared_ptr<IBlob> pageData[2];
+    for (size_t layerIndex = 0; layerIndex < texture.m_Layers.size(); layerIndex++)
+    {
+        const VirtualTexture::Layer& layer = texture.m_Layers[layerIndex];
+        const VirtualTexturePageEntry& entry = layer.pageTable[texture.m_MipPageOffsets[mipLevel] + pageIndex];
+
+        if (entry.size == pageBytes)
+            pageData[layerIndex] = m_FS->readFileRange(layer.path, entry.offset, entry.size);
+
+        if (!pageData[layerIndex])
+        {
+            if (!texture.m_LoadFailureReported)
+            {
+                log::warning("Couldn't read page (%u, %u) of mip %u from virtual texture file '%s'",
+                    pageX, pageY, mipLevel, layer.path.generic_string().c_str());
+                texture.m_LoadFailureReported = true;
+            }
+
+            m_FreeSlots.push_back(slotIndex);
+            ++m_Stats.failedLoads;
+            return false;
+        }
+    }
+
+    const uint32_t atlasX = (uint32_t(slotIndex) % m_Desc.atlasPages) * paddedPageSize;
+    const uint32_t atlasY = (uint32_t(slotIndex) / m_Desc.atlasPages) * paddedPageSize;
+
+    for (size_t layerIndex = 0; layerIndex < texture.m_Layers.size(); layerIndex++)
+    {
+        commandList->writeTexture(m_PageUploadTextures[layerIndex], 0, 0, pageData[layerIndex]->data(), paddedPageSize * 4);
+        commandList->copyTexture(
+            m_AtlasTextures[layerIndex], nvrhi::TextureSlice().setOrigin(atlasX, atlasY).setWidth(paddedPageSize).setHeight(paddedPageSize),
+            m_PageUploadTextures[layerIndex], nvrhi::TextureSlice());
+    }
+
+    AtlasSlot& slot = m_Slots[slotIndex];
+    slot.textureID = int(texture.m_ID);
+    slot.mipLevel = mipLevel;
+    slot.pageX = pageX;
+    slot.pageY = pageY;
+    slot.lastUsedFrame = m_FrameIndex;
+    slot.pinned = pinned;
+
+    texture.m_PageSlots[mipLevel][pageIndex] = slotIndex;
+    texture.m_DirtyMipLevels = std::max(texture.m_DirtyMipLevels, mipLevel + 1);
+    ++m_Stats.pagesLoaded;
+
+    return true;
+}
+
+void VirtualTextureSystem::UpdateIndirection(nvrhi::ICommandList* commandList, VirtualTexture& texture)
+{
+    // Every page that isn't resident points to the closest resident page of a coarser mip level.
+    // The coarsest level is always resident, so the levels are rebuilt from coarse to fine.
+    for (int mipLevel = int(texture.m_DirtyMipLevels) - 1; mipLevel >= 0; mipLevel--)
+    {
+        const uint32_t pagesX = texture.GetPageCountX(mipLevel);
+        const uint32_t pagesY = texture.GetPageCountY(mipLevel);
+        const std::vector<int>& slots = texture.m_PageSlots[mipLevel];
+        std::vector<uint32_t>& indirection = texture.m_Indirection[mipLevel];
+
+        for (uint32_t pageY = 0; pageY < pagesY; pageY++)
+        {
+            for (uint32_t pageX = 0; pageX < pagesX; pageX++)
+            {
+                const uint32_t pageIndex = pageY * pagesX + pageX;
+                const int slot = slots[pageIndex];
+
+                if (slot >= 0)
+                {
+                    indirection[pageIndex] = (uint32_t(slot) % m_Desc.atlasPages)
+                        | ((uint32_t(slot) / m_Desc.atlasPages) << VIRTUAL_TEXTURE_INDIRECTION_PAGE_BITS)
+                        | (uint32_t(mipLevel) << VIRTUAL_TEXTURE_INDIRECTION_MIP_SHIFT);
+                }
+                else
+                {
+                    assert(uint32_t(mipLevel) + 1 < texture.m_MipLevels);
+                    const uint32_t parentPagesX = texture.GetPageCountX(mipLevel + 1);
+                    const uint32_t parentPagesY = texture.GetPageCountY(mipLevel + 1);
+                    const uint32_t parentX = std::min(pageX >> 1, parentPagesX - 1);
+                    const uint32_t parentY = std::min(pageY >> 1, parentPagesY - 1);
+                    indirection[pageIndex] = texture.m_Indirection[mipLevel + 1][parentY * parentPagesX + parentX];
+                }
+            }
+        }
+
+        commandList->writeTexture(texture.m_IndirectionTexture, 0, mipLevel, indirection.data(), pagesX * sizeof(uint32_t));
+    }
+
+    texture.m_DirtyMipLevels = 0;
+}
+
+void VirtualTextureSystem::CollectFeedback(std::vector<PageRequest>& loads)
+{
+    // The readback buffer written two frames ago
+    const uint32_t readbackIndex = uint32_t((m_FrameIndex + 1) % c_ReadbackLatency);
+    if (m_ReadbackFrames[readbackIndex] == 0)
+        return;
+
+    m_ReadbackFrames[readbackIndex] = 0;
+
+    std::unordered_set<uint32_t> requests;
+    const uint32_t* feedback = static_cast<const uint32_t*>(m_Device->mapBuffer(m_ReadbackBuffers[readbackIndex], nvrhi::CpuAccessMode::Read));
+    if (!feedback)
+        return;
+
+    for (uint32_t entry = 0; entry < VIRTUAL_TEXTURE_FEEDBACK_ENTRIES; entry++)
+    {
+        if (feedback[entry] != VIRTUAL_TEXTURE_FEEDBACK_EMPTY)
+            requests.insert(feedback[entry]);
+    }
+
+    m_Device->unmapBuffer(m_ReadbackBuffers[readbackIndex]);
+
+    m_Stats.requestedPages = uint32_t(requests.size());
+
+    const uint32_t pageMask = (1u << VIRTUAL_TEXTURE_FEEDBACK_PAGE_BITS) - 1;
+    std::unordered_set<uint64_t> missingPages;
+
+    for (uint32_t request : requests)
+    {
+        const uint32_t textureID = request >> VIRTUAL_TEXTURE_FEEDBACK_ID_SHIFT;
+        const uint32_t requestedMip = (request >> VIRTUAL_TEXTURE_FEEDBACK_MIP_SHIFT) & 0xf;
+        const uint32_t requestedX = request & pageMask;
+        const uint32_t requestedY = (request >> VIRTUAL_TEXTURE_FEEDBACK_PAGE_BITS) & pageMask;
+
+        if (textureID >= m_Textures.size())
+            continue;
+
+        std::shared_ptr<VirtualTexture> texture = m_Textures[textureID].lock();
+        if (!texture || requestedMip >= texture->m_MipLevels ||
+            requestedX >= texture->GetPageCountX(requestedMip) || requestedY >= texture->GetPageCountY(requestedMip))
+            continue;
+
+        // Request the whole chain of coarser pages, so that the indirection can fall back to them
+        for (uint32_t mipLevel = requestedMip; mipLevel < texture->m_MipLevels; mipLevel++)
+        {
+            const uint32_t shift = mipLevel - requestedMip;
+            const uint32_t pageX = std::min(requestedX >> shift, texture->GetPageCountX(mipLevel) - 1);
+            const uint32_t pageY = std::min(requestedY >> shift, texture->GetPageCountY(mipLevel) - 1);
+            const int slot = texture->m_PageSlots[mipLevel][pageY * texture->GetPageCountX(mipLevel) + pageX];
+
+            if (slot >= 0)
+                m_Slots[slot].lastUsedFrame = m_FrameIndex;
+            else
+                missingPages.insert((uint64_t(textureID) << 40) | (uint64_t(mipLevel) << 32) | (uint64_t(pageY) << 16) | pageX);
+        }
+    }
+
+    loads.reserve(missingPages.size());
+    for (uint64_t page : missingPages)
+    {
+        PageRequest load;
+        load.textureID = uint32_t(page >> 40);
+        load.mipLevel = uint32_t(page >> 32) & 0xff;
+        load.pageY = uint32_t(page >> 16) & 0xffff;
+        load.pageX = uint32_t(page) & 0xffff;
+        loads.push_back(load);
+    }
+
+    // Coarse pages first: they cover more of the screen and the finer pages depend on them
+    std::sort(loads.begin(), loads.end(), [](const PageRequest& a, const PageRequest& b)
+    {
+        if (a.mipLevel != b.mipLevel)
+            return a.mipLevel > b.mipLevel;
+        if (a.textureID != b.textureID)
+            return a.textureID < b.textureID;
+        return a.pageY != b.pageY ? a.pageY < b.pageY : a.pageX < b.pageX;
+    });
+}
+
+void VirtualTextureSystem::BeginFrame(nvrhi::ICommandList* commandList)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    ++m_FrameIndex;
+    m_Stats.requestedPages = 0;
+    m_Stats.pagesLoaded = 0;
+    m_Stats.pagesEvicted = 0;
+    m_Stats.failedLoads = 0;
+
+    ReleaseExpiredTextures();
+
+    std::vector<PageRequest> loads;
+    CollectFeedback(loads);
+
+    uint32_t uploads = 0;
+    for (const PageRequest& load : loads)
+    {
+        if (uploads >= m_Desc.maxPageUploadsPerFrame)
+            break;
+
+        std::shared_ptr<VirtualTexture> texture = m_Textures[load.textureID].lock();
+        if (!texture)
+            continue;
+
+        if (!LoadPage(commandList, *texture, load.mipLevel, load.pageX, load.pageY, false))
+        {
+            // Stop when the atlas is full of pages used by this frame; read errors just skip the page
+            if (m_FreeSlots.empty())
+                break;
+            continue;
+        }
+
+        ++uploads;
+    }
+
+    for (const auto& weakTexture : m_Textures)
+    {
+        std::shared_ptr<VirtualTexture> texture = weakTexture.lock();
+        if (texture && texture->m_DirtyMipLevels)
+            UpdateIndirection(commandList, *texture);
+    }
+
+    commandList->clearBufferUInt(m_FeedbackBuffer, VIRTUAL_TEXTURE_FEEDBACK_EMPTY);
+}
+
+void VirtualTextureSystem::EndFrame(nvrhi::ICommandList* commandList)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    const uint32_t readbackIndex = uint32_t(m_FrameIndex % c_ReadbackLatency);
+    commandList->copyBuffer(m_ReadbackBuffers[readbackIndex], 0, m_FeedbackBuffer, 0, VIRTUAL_TEXTURE_FEEDBACK_ENTRIES * sizeof(uint32_t));
+    m_ReadbackFrames[readbackIndex] = m_FrameIndex;
+}
+
+VirtualTextureStats VirtualTextureSystem::GetStats()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    VirtualTextureStats stats = m_Stats;
+    stats.residentPages = uint32_t(m_Slots.size() - m_FreeSlots.size());
+    stats.virtualTextures = uint32_t(std::count_if(m_Textures.begin(), m_Textures.end(),
+        [](const std::weak_ptr<VirtualTexture>& texture) { return !texture.expired(); }));
+
+    return stats;
+}
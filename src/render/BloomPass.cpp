@@ -25,6 +25,7 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/Profiler.h>
 #include <utility>
 
 #if DONUT_WITH_STATIC_SHADERS
@@ -168,6 +169,7 @@ void BloomPass::Render(
     float effectiveSigma = clamp(sigmaInPixels * 0.25f, 1.f, 100.f);
 
     commandList->beginMarker("Bloom");
+    DONUT_PROFILE_GPU(commandList, "Bloom");
 
     nvrhi::DrawArguments fullscreenquadargs;
     fullscreenquadargs.instanceCount = 1;
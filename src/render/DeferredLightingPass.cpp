@@ -23,13 +23,16 @@
 #include <donut/render/DeferredLightingPass.h>
 #include <donut/render/DrawStrategy.h>
 #include <donut/render/GBuffer.h>
+#include <donut/render/LightClusteringPass.h>
 #include <donut/engine/FramebufferFactory.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/ShadowMap.h>
 #include <donut/engine/SceneTypes.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/Profiler.h>
 #include <donut/core/log.h>
+#include <algorithm>
 #include <utility>
 
 #if DONUT_WITH_STATIC_SHADERS
@@ -117,12 +120,63 @@ void donut::render::DeferredLightingPass::Init(const std::shared_ptr<engine::Sha
         pipelineDesc.bindingLayouts = { m_BindingLayout };
         
         m_Pso = m_Device->createComputePipeline(pipelineDesc);
+
+        layoutDesc.bindings.push_back(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(4));
+        layoutDesc.bindings.push_back(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(5));
+        layoutDesc.bindings.push_back(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(6));
+        m_ClusteredBindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+        pipelineDesc.CS = CreateClusteredComputeShader(*shaderFactory);
+        pipelineDesc.bindingLayouts = { m_ClusteredBindingLayout };
+
+        m_ClusteredPso = m_Device->createComputePipeline(pipelineDesc);
+
+        layoutDesc.bindings.resize(layoutDesc.bindings.size() - 2);
+        m_TiledBindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+        pipelineDesc.CS = CreateTiledComputeShader(*shaderFactory);
+        pipelineDesc.bindingLayouts = { m_TiledBindingLayout };
+
+        m_TiledPso = m_Device->createComputePipeline(pipelineDesc);
     }
+
+    CreateTiledLightBuffer(64);
+}
+
+void DeferredLightingPass::CreateTiledLightBuffer(uint32_t capacity)
+{
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = sizeof(LightConstants) * capacity;
+    bufferDesc.structStride = sizeof(LightConstants);
+    bufferDesc.debugName = "DeferredTiledLights";
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+    m_TiledLightBuffer = m_Device->createBuffer(bufferDesc);
+    m_TiledLightBufferCapacity = capacity;
+
+    // The cached binding sets reference the previous buffer
+    m_BindingSets.Clear();
 }
 
 nvrhi::ShaderHandle DeferredLightingPass::CreateComputeShader(ShaderFactory& shaderFactory)
 {
-    return shaderFactory.CreateAutoShader("donut/passes/deferred_lighting_cs.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_deferred_lighting_cs), nullptr, nvrhi::ShaderType::Compute);
+    std::vector<ShaderMacro> macros = { ShaderMacro("LIGHT_CLUSTERING", "0"), ShaderMacro("TILED_LIGHTING", "0") };
+
+    return shaderFactory.CreateAutoShader("donut/passes/deferred_lighting_cs.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_deferred_lighting_cs), &macros, nvrhi::ShaderType::Compute);
+}
+
+nvrhi::ShaderHandle DeferredLightingPass::CreateClusteredComputeShader(ShaderFactory& shaderFactory)
+{
+    std::vector<ShaderMacro> macros = { ShaderMacro("LIGHT_CLUSTERING", "1"), ShaderMacro("TILED_LIGHTING", "0") };
+
+    return shaderFactory.CreateAutoShader("donut/passes/deferred_lighting_cs.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_deferred_lighting_cs), &macros, nvrhi::ShaderType::Compute);
+}
+
+nvrhi::ShaderHandle DeferredLightingPass::CreateTiledComputeShader(ShaderFactory& shaderFactory)
+{
+    std::vector<ShaderMacro> macros = { ShaderMacro("LIGHT_CLUSTERING", "0"), ShaderMacro("TILED_LIGHTING", "1") };
+
+    return shaderFactory.CreateAutoShader("donut/passes/deferred_lighting_cs.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_deferred_lighting_cs), &macros, nvrhi::ShaderType::Compute);
 }
 
 void DeferredLightingPass::Render(
@@ -139,6 +193,7 @@ void DeferredLightingPass::Render(
     assert(inputs.output);
 
     commandList->beginMarker("DeferredLighting");
+    DONUT_PROFILE_GPU(commandList, "DeferredLighting");
 
     DeferredLightingConstants deferredConstants = {};
     deferredConstants.randomOffset = randomOffset;
@@ -156,10 +211,29 @@ void DeferredLightingPass::Render(
 
     int numShadows = 0;
 
+    const bool tiledLighting = inputs.tiledLighting && !inputs.lightClusters;
+    std::vector<LightConstants> tiledLights;
+
+    if (inputs.lightClusters)
+        inputs.lightClusters->FillClusterConstants(deferredConstants.clusters);
+
     if (inputs.lights)
     {
         for (const auto& light : *inputs.lights)
         {
+            // The clustered lights are shaded from the cluster light lists
+            if (inputs.lightClusters && LightClusteringPass::IsClusteredLight(*light))
+                continue;
+
+            // The lights without shadows are culled per tile from the tiled light buffer
+            if (tiledLighting && !light->shadowMap && light->shadowChannel < 0)
+            {
+                LightConstants& lightConstants = tiledLights.emplace_back();
+                lightConstants = {};
+                light->FillLightConstants(lightConstants);
+                continue;
+            }
+
             if (light->shadowMap)
             {
                 if (!shadowMapTexture)
@@ -214,6 +288,19 @@ void DeferredLightingPass::Render(
         }
     }
 
+    if (tiledLighting)
+    {
+        if (tiledLights.size() > m_TiledLightBufferCapacity)
+            CreateTiledLightBuffer(std::max(uint32_t(tiledLights.size()), m_TiledLightBufferCapacity * 2));
+
+        if (!tiledLights.empty())
+            commandList->writeBuffer(m_TiledLightBuffer, tiledLights.data(), tiledLights.size() * sizeof(LightConstants));
+
+        deferredConstants.numTiledLights = uint32_t(tiledLights.size());
+        deferredConstants.enableTileHeatmap = inputs.tileHeatmap;
+        deferredConstants.tileHeatmapMaxLights = inputs.tileHeatmapMaxLights;
+    }
+
     nvrhi::ITexture* lightProbeDiffuse = nullptr;
     nvrhi::ITexture* lightProbeSpecular = nullptr;
     nvrhi::ITexture* lightProbeEnvironmentBrdf = nullptr;
@@ -283,20 +370,38 @@ void DeferredLightingPass::Render(
             nvrhi::BindingSetItem::Sampler(3, m_CommonPasses->m_LinearClampSampler)
         };
 
-        nvrhi::BindingSetHandle bindingSet = m_BindingSets.GetOrCreateBindingSet(bindingSetDesc, m_BindingLayout);
+        nvrhi::IBindingLayout* bindingLayout = m_BindingLayout;
+        nvrhi::IComputePipeline* pipeline = m_Pso;
+
+        if (inputs.lightClusters)
+        {
+            bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, inputs.lightClusters->GetLightBuffer()));
+            bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(5, inputs.lightClusters->GetClusterGridBuffer()));
+            bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(6, inputs.lightClusters->GetLightIndexBuffer()));
+            bindingLayout = m_ClusteredBindingLayout;
+            pipeline = m_ClusteredPso;
+        }
+        else if (tiledLighting)
+        {
+            bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_TiledLightBuffer));
+            bindingLayout = m_TiledBindingLayout;
+            pipeline = m_TiledPso;
+        }
+
+        nvrhi::BindingSetHandle bindingSet = m_BindingSets.GetOrCreateBindingSet(bindingSetDesc, bindingLayout);
     
         view->FillPlanarViewConstants(deferredConstants.view);
         commandList->writeBuffer(m_DeferredLightingCB, &deferredConstants, sizeof(deferredConstants));
 
         nvrhi::ComputeState state;
-        state.pipeline = m_Pso;
+        state.pipeline = pipeline;
         state.bindings = { bindingSet };
         commandList->setComputeState(state);
 
         auto viewExtent = view->GetViewExtent();
         commandList->dispatch(
-            dm::div_ceil(viewExtent.width(), 16),
-            dm::div_ceil(viewExtent.height(), 16));
+            dm::div_ceil(viewExtent.width(), DEFERRED_TILE_SIZE),
+            dm::div_ceil(viewExtent.height(), DEFERRED_TILE_SIZE));
     }
 
     commandList->endMarker();
@@ -22,12 +22,14 @@
 
 #include <donut/render/DepthPass.h>
 #include <donut/render/DrawStrategy.h>
+#include <donut/engine/SceneGraph.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/SceneTypes.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
 #include <donut/engine/MaterialBindingCache.h>
 #include <nvrhi/utils.h>
+#include <algorithm>
 #include <utility>
 
 #if DONUT_WITH_STATIC_SHADERS
@@ -209,19 +211,20 @@ bool DepthPass::SetupMaterial(GeometryPassContext& abstractContext, const engine
         return false;
     }
 
-    nvrhi::GraphicsPipelineHandle& pipeline = m_Pipelines[key.value];
-
-    if (!pipeline)
+    nvrhi::GraphicsPipelineHandle pipeline;
     {
         std::lock_guard<std::mutex> lockGuard(m_Mutex);
 
-        if (!pipeline)
-            pipeline = CreateGraphicsPipeline(key, state.framebuffer);
+        nvrhi::GraphicsPipelineHandle& cachedPipeline = m_Pipelines[key.value];
+        if (!cachedPipeline)
+            cachedPipeline = CreateGraphicsPipeline(key, state.framebuffer);
 
-        if (!pipeline)
-            return false;
+        pipeline = cachedPipeline;
     }
 
+    if (!pipeline)
+        return false;
+
     assert(pipeline->getFramebufferInfo() == state.framebuffer->getFramebufferInfo());
 
     state.pipeline = pipeline;
@@ -238,3 +241,69 @@ void DepthPass::SetupInputBuffers(GeometryPassContext& context, const engine::Bu
 
     state.indexBuffer = { buffers->indexBuffer, nvrhi::Format::R32_UINT, 0 };
 }
+
+void DepthPass::GetPipelineKeys(const SceneGraph& scene, const IView& view, std::vector<PipelineKey>& keys) const
+{
+    PipelineKey keyTemplate;
+    keyTemplate.value = 0;
+    keyTemplate.bits.frontCounterClockwise = view.IsMirrored();
+    keyTemplate.bits.reverseDepth = view.IsReverseDepth();
+
+    for (const auto& material : scene.GetMaterials())
+    {
+        // Same domain selection as SetupMaterial
+        bool alphaTested = material->domain == MaterialDomain::AlphaTested && material->baseOrDiffuseTexture && material->baseOrDiffuseTexture->texture;
+        if (!alphaTested && material->domain != MaterialDomain::Opaque)
+            continue;
+
+        for (nvrhi::RasterCullMode cullMode : GetMaterialCullModes(*material))
+        {
+            PipelineKey key = keyTemplate;
+            key.bits.cullMode = cullMode;
+            key.bits.alphaTested = alphaTested;
+
+            if (std::none_of(keys.begin(), keys.end(), [key](PipelineKey other) { return other.value == key.value; }))
+                keys.push_back(key);
+        }
+    }
+}
+
+void DepthPass::PrecompilePipelines(const std::vector<PipelineKey>& keys, nvrhi::IFramebuffer* framebuffer, tf::Executor* executor)
+{
+    std::vector<uint32_t> keyValues;
+    for (const PipelineKey& key : keys)
+    {
+        keyValues.push_back(key.value);
+    }
+
+    PrecompileGeometryPipelines(keyValues, m_Pipelines, PipelineKey::Count, m_Mutex,
+        [this, framebuffer](uint32_t value)
+        {
+            PipelineKey key;
+            key.value = value;
+            return CreateGraphicsPipeline(key, framebuffer);
+        }, executor);
+}
+
+bool DepthPass::SavePipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    return SaveGeometryPipelineKeys(fs, path, "DepthPass", m_Pipelines, PipelineKey::Count);
+}
+
+bool DepthPass::LoadPipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path, std::vector<PipelineKey>& keys) const
+{
+    std::vector<uint32_t> keyValues;
+    if (!LoadGeometryPipelineKeys(fs, path, "DepthPass", PipelineKey::Count, keyValues))
+        return false;
+
+    for (uint32_t value : keyValues)
+    {
+        PipelineKey key;
+        key.value = value;
+        keys.push_back(key);
+    }
+
+    return true;
+}
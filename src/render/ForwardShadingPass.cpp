@@ -22,14 +22,19 @@
 
 #include <donut/render/ForwardShadingPass.h>
 #include <donut/render/DrawStrategy.h>
+#include <donut/render/LightClusteringPass.h>
 #include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/Scene.h>
+#include <donut/engine/SceneGraph.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/ShadowMap.h>
 #include <donut/engine/SceneTypes.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/MaterialBindingCache.h>
+#include <donut/engine/VirtualTexture.h>
 #include <donut/core/log.h>
 #include <nvrhi/utils.h>
+#include <algorithm>
 #include <utility>
 
 #if DONUT_WITH_STATIC_SHADERS
@@ -70,6 +75,19 @@ void ForwardShadingPass::Init(ShaderFactory& shaderFactory, const CreateParamete
     m_SupportedViewTypes = ViewType::PLANAR;
     if (params.singlePassCubemap)
         m_SupportedViewTypes = ViewType::CUBEMAP;
+
+    m_LightClusters = params.lightClusters;
+
+    if (params.bindlessScene)
+    {
+        if (BindlessMaterialBindings::IsSupported(params.bindlessScene.get(), params.bindlessLayout))
+        {
+            m_BindlessMaterials = std::make_shared<BindlessMaterialBindings>(m_Device, params.bindlessScene,
+                params.bindlessLayout, m_CommonPasses->m_AnisotropicWrapSampler, params.trackLiveness);
+        }
+        else
+            log::warning("ForwardShadingPass: the bindless material path needs a scene with a descriptor table and its layout");
+    }
     
     m_VertexShader = CreateVertexShader(shaderFactory, params);
     m_InputLayout = CreateInputLayout(m_VertexShader, params);
@@ -77,6 +95,19 @@ void ForwardShadingPass::Init(ShaderFactory& shaderFactory, const CreateParamete
     m_PixelShader = CreatePixelShader(shaderFactory, params, false);
     m_PixelShaderTransmissive = CreatePixelShader(shaderFactory, params, true);
 
+    if (params.virtualTextures)
+    {
+        // The virtual texture bindings use the same Vulkan descriptor set as the bindless descriptor table
+        if (m_BindlessMaterials)
+            log::error("ForwardShadingPass: virtual textures are not supported together with bindless materials, they are ignored");
+        else
+        {
+            m_VirtualTextures = params.virtualTextures;
+            m_PixelShaderVirtualTexture = CreateVirtualTexturePixelShader(shaderFactory, params, false);
+            m_PixelShaderVirtualTextureTransmissive = CreateVirtualTexturePixelShader(shaderFactory, params, true);
+        }
+    }
+
     if (params.materialBindings)
         m_MaterialBindings = params.materialBindings;
     else
@@ -128,6 +159,20 @@ nvrhi::ShaderHandle ForwardShadingPass::CreatePixelShader(ShaderFactory& shaderF
 {
     std::vector<ShaderMacro> Macros;
     Macros.push_back(ShaderMacro("TRANSMISSIVE_MATERIAL", transmissiveMaterial ? "1" : "0"));
+    Macros.push_back(ShaderMacro("VIRTUAL_TEXTURING", "0"));
+    Macros.push_back(ShaderMacro("LIGHT_CLUSTERING", params.lightClusters ? "1" : "0"));
+    Macros.push_back(ShaderMacro("BINDLESS_MATERIALS", m_BindlessMaterials ? "1" : "0"));
+
+    return shaderFactory.CreateAutoShader("donut/passes/forward_ps.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_forward_ps), &Macros, nvrhi::ShaderType::Pixel);
+}
+
+nvrhi::ShaderHandle ForwardShadingPass::CreateVirtualTexturePixelShader(ShaderFactory& shaderFactory, const CreateParameters& params, bool transmissiveMaterial)
+{
+    std::vector<ShaderMacro> Macros;
+    Macros.push_back(ShaderMacro("TRANSMISSIVE_MATERIAL", transmissiveMaterial ? "1" : "0"));
+    Macros.push_back(ShaderMacro("VIRTUAL_TEXTURING", "1"));
+    Macros.push_back(ShaderMacro("LIGHT_CLUSTERING", params.lightClusters ? "1" : "0"));
+    Macros.push_back(ShaderMacro("BINDLESS_MATERIALS", "0"));
 
     return shaderFactory.CreateAutoShader("donut/passes/forward_ps.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_forward_ps), &Macros, nvrhi::ShaderType::Pixel);
 }
@@ -187,6 +232,13 @@ nvrhi::BindingLayoutHandle ForwardShadingPass::CreateLightBindingLayout()
         nvrhi::BindingLayoutItem::Sampler(3)
     };
 
+    if (m_LightClusters)
+    {
+        lightProbeBindingDesc.bindings.push_back(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(14));
+        lightProbeBindingDesc.bindings.push_back(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(15));
+        lightProbeBindingDesc.bindings.push_back(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(16));
+    }
+
     return m_Device->createBindingLayout(lightProbeBindingDesc);
 }
 
@@ -202,6 +254,14 @@ nvrhi::BindingSetHandle ForwardShadingPass::CreateLightBindingSet(nvrhi::ITextur
         nvrhi::BindingSetItem::Sampler(2, m_CommonPasses->m_LinearWrapSampler),
         nvrhi::BindingSetItem::Sampler(3, m_CommonPasses->m_LinearClampSampler)
     };
+
+    if (m_LightClusters)
+    {
+        bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(14, m_LightClusters->GetLightBuffer()));
+        bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(15, m_LightClusters->GetClusterGridBuffer()));
+        bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(16, m_LightClusters->GetLightIndexBuffer()));
+    }
+
     bindingSetDesc.trackLiveness = m_TrackLiveness;
 
     return m_Device->createBindingSet(bindingSetDesc, m_LightBindingLayout);
@@ -216,7 +276,15 @@ nvrhi::GraphicsPipelineHandle ForwardShadingPass::CreateGraphicsPipeline(Pipelin
     pipelineDesc.renderState.rasterState.frontCounterClockwise = key.bits.frontCounterClockwise;
     pipelineDesc.renderState.rasterState.setCullMode(key.bits.cullMode);
     pipelineDesc.renderState.blendState.alphaToCoverageEnable = false;
-    pipelineDesc.bindingLayouts = { m_MaterialBindings->GetLayout(), m_ViewBindingLayout, m_LightBindingLayout };
+    if (m_BindlessMaterials)
+        pipelineDesc.bindingLayouts = { m_BindlessMaterials->GetLayout(), m_ViewBindingLayout, m_LightBindingLayout, m_BindlessMaterials->GetDescriptorTableLayout() };
+    else
+        pipelineDesc.bindingLayouts = { m_MaterialBindings->GetLayout(), m_ViewBindingLayout, m_LightBindingLayout };
+    if (key.bits.virtualTexture)
+        pipelineDesc.bindingLayouts.push_back(m_VirtualTextures->GetBindingLayout());
+
+    nvrhi::IShader* pixelShader = key.bits.virtualTexture ? m_PixelShaderVirtualTexture : m_PixelShader;
+    nvrhi::IShader* pixelShaderTransmissive = key.bits.virtualTexture ? m_PixelShaderVirtualTextureTransmissive : m_PixelShaderTransmissive;
 
     pipelineDesc.renderState.depthStencilState
         .setDepthFunc(key.bits.reverseDepth
@@ -226,16 +294,16 @@ nvrhi::GraphicsPipelineHandle ForwardShadingPass::CreateGraphicsPipeline(Pipelin
     switch (key.bits.domain)  // NOLINT(clang-diagnostic-switch-enum)
     {
     case MaterialDomain::Opaque:
-        pipelineDesc.PS = m_PixelShader;
+        pipelineDesc.PS = pixelShader;
         break;
 
     case MaterialDomain::AlphaTested:
-        pipelineDesc.PS = m_PixelShader;
+        pipelineDesc.PS = pixelShader;
         pipelineDesc.renderState.blendState.alphaToCoverageEnable = true;
         break;
 
     case MaterialDomain::AlphaBlended: {
-        pipelineDesc.PS = m_PixelShader;
+        pipelineDesc.PS = pixelShader;
         pipelineDesc.renderState.blendState.alphaToCoverageEnable = false;
         pipelineDesc.renderState.blendState.targets[0]
             .enableBlend()
@@ -251,7 +319,7 @@ nvrhi::GraphicsPipelineHandle ForwardShadingPass::CreateGraphicsPipeline(Pipelin
     case MaterialDomain::Transmissive:
     case MaterialDomain::TransmissiveAlphaTested:
     case MaterialDomain::TransmissiveAlphaBlended: {
-        pipelineDesc.PS = m_PixelShaderTransmissive;
+        pipelineDesc.PS = pixelShaderTransmissive;
         pipelineDesc.renderState.blendState.alphaToCoverageEnable = false;
         pipelineDesc.renderState.blendState.targets[0]
             .enableBlend()
@@ -307,6 +375,9 @@ void ForwardShadingPass::SetupView(
 
     context.keyTemplate.bits.frontCounterClockwise = view->IsMirrored();
     context.keyTemplate.bits.reverseDepth = view->IsReverseDepth();
+
+    if (m_BindlessMaterials)
+        context.bindlessBindingSet = m_BindlessMaterials->GetBindingSet();
 }
 
 void ForwardShadingPass::PrepareLights(
@@ -375,9 +446,17 @@ void ForwardShadingPass::PrepareLights(
 
     int numShadows = 0;
 
-    for (int nLight = 0; nLight < std::min(static_cast<int>(lights.size()), FORWARD_MAX_LIGHTS); nLight++)
+    if (m_LightClusters)
+        m_LightClusters->FillClusterConstants(constants.clusters);
+
+    for (const auto& light : lights)
     {
-        const auto& light = lights[nLight];
+        // The clustered lights are shaded from the cluster light lists
+        if (m_LightClusters && LightClusteringPass::IsClusteredLight(*light))
+            continue;
+
+        if (constants.numLights >= FORWARD_MAX_LIGHTS)
+            break;
 
         LightConstants& lightConstants = constants.lights[constants.numLights];
         light->FillLightConstants(lightConstants);
@@ -433,46 +512,97 @@ ViewType::Enum ForwardShadingPass::GetSupportedViewTypes() const
     return m_SupportedViewTypes;
 }
 
+bool ForwardShadingPass::FillPipelineKey(const Context& context, const Material* material, nvrhi::RasterCullMode cullMode, PipelineKey& key) const
+{
+    if (material->domain >= MaterialDomain::Count || cullMode > nvrhi::RasterCullMode::None)
+    {
+        assert(false);
+        return false;
+    }
+
+    key = context.keyTemplate;
+    key.bits.cullMode = cullMode;
+    key.bits.domain = material->domain;
+    key.bits.virtualTexture = material->virtualTexture && m_PixelShaderVirtualTexture;
+
+    return true;
+}
+
 bool ForwardShadingPass::SetupMaterial(GeometryPassContext& abstractContext, const Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state)
 {
     auto& context = static_cast<Context&>(abstractContext);
 
-    nvrhi::IBindingSet* materialBindingSet = m_MaterialBindings->GetMaterialBindingSet(material);
+    nvrhi::IBindingSet* materialBindingSet = m_BindlessMaterials
+        ? context.bindlessBindingSet.Get()
+        : m_MaterialBindings->GetMaterialBindingSet(material);
 
     if (!materialBindingSet)
         return false;
 
-    if (material->domain >= MaterialDomain::Count || cullMode > nvrhi::RasterCullMode::None)
-    {
-        assert(false);
+    PipelineKey key;
+    if (!FillPipelineKey(context, material, cullMode, key))
         return false;
-    }
 
-    PipelineKey key = context.keyTemplate;
-    key.bits.cullMode = cullMode;
-    key.bits.domain = material->domain;
+    nvrhi::IBindingSet* virtualTextureBindingSet = nullptr;
+    if (key.bits.virtualTexture)
+        virtualTextureBindingSet = material->virtualTexture->GetBindingSet();
 
-    nvrhi::GraphicsPipelineHandle& pipeline = m_Pipelines[key.value];
-    
-    if (!pipeline)
+    nvrhi::GraphicsPipelineHandle pipeline;
     {
         std::lock_guard<std::mutex> lockGuard(m_Mutex);
 
-        if (!pipeline)
-            pipeline = CreateGraphicsPipeline(key, state.framebuffer);
+        nvrhi::GraphicsPipelineHandle& cachedPipeline = m_Pipelines[key.value];
+        if (!cachedPipeline)
+            cachedPipeline = CreateGraphicsPipeline(key, state.framebuffer);
 
-        if (!pipeline)
-            return false;
+        pipeline = cachedPipeline;
     }
 
+    if (!pipeline)
+        return false;
+
     assert(pipeline->getFramebufferInfo() == state.framebuffer->getFramebufferInfo());
 
     state.pipeline = pipeline;
     state.bindings = { materialBindingSet, m_ViewBindingSet, context.lightBindingSet };
+    if (m_BindlessMaterials)
+        state.bindings.push_back(m_BindlessMaterials->GetDescriptorTable());
+    if (virtualTextureBindingSet)
+        state.bindings.push_back(virtualTextureBindingSet);
+
+    return true;
+}
+
+void ForwardShadingPass::SetPushConstants(GeometryPassContext& abstractContext, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args)
+{
+    auto& context = static_cast<Context&>(abstractContext);
+
+    if (m_BindlessMaterials)
+        BindlessMaterialBindings::SetDrawConstants(commandList, context.geometryIndex);
+}
+
+bool ForwardShadingPass::GetMaterialPipelineKey(GeometryPassContext& abstractContext, const Material* material, nvrhi::RasterCullMode cullMode, uint32_t& key)
+{
+    if (!m_BindlessMaterials)
+        return false;
 
+    auto& context = static_cast<Context&>(abstractContext);
+
+    PipelineKey pipelineKey;
+    if (!FillPipelineKey(context, material, cullMode, pipelineKey))
+        return false;
+
+    key = pipelineKey.value;
     return true;
 }
 
+void ForwardShadingPass::SetupGeometry(GeometryPassContext& abstractContext, const MeshGeometry* geometry)
+{
+    auto& context = static_cast<Context&>(abstractContext);
+
+    context.geometryIndex = uint32_t(geometry->globalGeometryIndex);
+}
+
 void ForwardShadingPass::SetupInputBuffers(GeometryPassContext& abstractContext, const BufferGroup* buffers, nvrhi::GraphicsState& state)
 {
     state.vertexBuffers = {
@@ -486,3 +616,72 @@ void ForwardShadingPass::SetupInputBuffers(GeometryPassContext& abstractContext,
 
     state.indexBuffer = { buffers->indexBuffer, nvrhi::Format::R32_UINT, 0 };
 }
+
+void ForwardShadingPass::GetPipelineKeys(const SceneGraph& scene, const IView& view, std::vector<PipelineKey>& keys) const
+{
+    PipelineKey keyTemplate;
+    keyTemplate.value = 0;
+    keyTemplate.bits.frontCounterClockwise = view.IsMirrored();
+    keyTemplate.bits.reverseDepth = view.IsReverseDepth();
+
+    for (const auto& material : scene.GetMaterials())
+    {
+        if (material->domain >= MaterialDomain::Count)
+            continue;
+
+        for (nvrhi::RasterCullMode cullMode : GetMaterialCullModes(*material))
+        {
+            PipelineKey key = keyTemplate;
+            key.bits.domain = material->domain;
+            key.bits.cullMode = cullMode;
+            key.bits.virtualTexture = material->virtualTexture && m_PixelShaderVirtualTexture;
+
+            if (std::none_of(keys.begin(), keys.end(), [key](PipelineKey other) { return other.value == key.value; }))
+                keys.push_back(key);
+        }
+    }
+}
+
+void ForwardShadingPass::PrecompilePipelines(const std::vector<PipelineKey>& keys, nvrhi::IFramebuffer* framebuffer, tf::Executor* executor)
+{
+    std::vector<uint32_t> keyValues;
+    for (const PipelineKey& key : keys)
+    {
+        // Keys loaded from a previous run may need virtual textures that are not enabled now
+        if (key.bits.virtualTexture && !m_PixelShaderVirtualTexture)
+            continue;
+
+        keyValues.push_back(key.value);
+    }
+
+    PrecompileGeometryPipelines(keyValues, m_Pipelines, PipelineKey::Count, m_Mutex,
+        [this, framebuffer](uint32_t value)
+        {
+            PipelineKey key;
+            key.value = value;
+            return CreateGraphicsPipeline(key, framebuffer);
+        }, executor);
+}
+
+bool ForwardShadingPass::SavePipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    return SaveGeometryPipelineKeys(fs, path, "ForwardShadingPass", m_Pipelines, PipelineKey::Count);
+}
+
+bool ForwardShadingPass::LoadPipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path, std::vector<PipelineKey>& keys) const
+{
+    std::vector<uint32_t> keyValues;
+    if (!LoadGeometryPipelineKeys(fs, path, "ForwardShadingPass", PipelineKey::Count, keyValues))
+        return false;
+
+    for (uint32_t value : keyValues)
+    {
+        PipelineKey key;
+        key.value = value;
+        keys.push_back(key);
+    }
+
+    return true;
+}
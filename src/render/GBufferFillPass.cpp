@@ -23,13 +23,17 @@
 #include <donut/render/GBufferFillPass.h>
 #include <donut/render/DrawStrategy.h>
 #include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/Scene.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/ShadowMap.h>
 #include <donut/engine/SceneTypes.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/MaterialBindingCache.h>
+#include <donut/engine/VirtualTexture.h>
 #include <donut/core/log.h>
 #include <nvrhi/utils.h>
+#include <algorithm>
 #include <utility>
 
 #if DONUT_WITH_STATIC_SHADERS
@@ -71,6 +75,17 @@ void GBufferFillPass::Init(ShaderFactory& shaderFactory, const CreateParameters&
     m_SupportedViewTypes = ViewType::PLANAR;
     if (params.enableSinglePassCubemap)
         m_SupportedViewTypes = ViewType::Enum(m_SupportedViewTypes | ViewType::CUBEMAP);
+
+    if (params.bindlessScene)
+    {
+        if (BindlessMaterialBindings::IsSupported(params.bindlessScene.get(), params.bindlessLayout))
+        {
+            m_BindlessMaterials = std::make_shared<BindlessMaterialBindings>(m_Device, params.bindlessScene,
+                params.bindlessLayout, m_CommonPasses->m_AnisotropicWrapSampler, params.trackLiveness);
+        }
+        else
+            log::warning("GBufferFillPass: the bindless material path needs a scene with a descriptor table and its layout");
+    }
     
     m_VertexShader = CreateVertexShader(shaderFactory, params);
     m_InputLayout = CreateInputLayout(m_VertexShader, params);
@@ -78,6 +93,19 @@ void GBufferFillPass::Init(ShaderFactory& shaderFactory, const CreateParameters&
     m_PixelShader = CreatePixelShader(shaderFactory, params, false);
     m_PixelShaderAlphaTested = CreatePixelShader(shaderFactory, params, true);
 
+    if (params.virtualTextures)
+    {
+        // The virtual texture bindings use the same Vulkan descriptor set as the bindless descriptor table
+        if (m_BindlessMaterials)
+            log::error("GBufferFillPass: virtual textures are not supported together with bindless materials, they are ignored");
+        else
+        {
+            m_VirtualTextures = params.virtualTextures;
+            m_PixelShaderVirtualTexture = CreateVirtualTexturePixelShader(shaderFactory, params, false);
+            m_PixelShaderVirtualTextureAlphaTested = CreateVirtualTexturePixelShader(shaderFactory, params, true);
+        }
+    }
+
     if (params.materialBindings)
         m_MaterialBindings = params.materialBindings;
     else
@@ -136,6 +164,19 @@ nvrhi::ShaderHandle GBufferFillPass::CreatePixelShader(ShaderFactory& shaderFact
     std::vector<ShaderMacro> PixelShaderMacros;
     PixelShaderMacros.push_back(ShaderMacro("MOTION_VECTORS", params.enableMotionVectors ? "1" : "0"));
     PixelShaderMacros.push_back(ShaderMacro("ALPHA_TESTED", alphaTested ? "1" : "0"));
+    PixelShaderMacros.push_back(ShaderMacro("VIRTUAL_TEXTURING", "0"));
+    PixelShaderMacros.push_back(ShaderMacro("BINDLESS_MATERIALS", m_BindlessMaterials ? "1" : "0"));
+
+    return shaderFactory.CreateAutoShader("donut/passes/gbuffer_ps.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_gbuffer_ps), &PixelShaderMacros, nvrhi::ShaderType::Pixel);
+}
+
+nvrhi::ShaderHandle GBufferFillPass::CreateVirtualTexturePixelShader(ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested)
+{
+    std::vector<ShaderMacro> PixelShaderMacros;
+    PixelShaderMacros.push_back(ShaderMacro("MOTION_VECTORS", params.enableMotionVectors ? "1" : "0"));
+    PixelShaderMacros.push_back(ShaderMacro("ALPHA_TESTED", alphaTested ? "1" : "0"));
+    PixelShaderMacros.push_back(ShaderMacro("VIRTUAL_TEXTURING", "1"));
+    PixelShaderMacros.push_back(ShaderMacro("BINDLESS_MATERIALS", "0"));
 
     return shaderFactory.CreateAutoShader("donut/passes/gbuffer_ps.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_gbuffer_ps), &PixelShaderMacros, nvrhi::ShaderType::Pixel);
 }
@@ -181,7 +222,12 @@ nvrhi::GraphicsPipelineHandle GBufferFillPass::CreateGraphicsPipeline(PipelineKe
         .setFrontCounterClockwise(key.bits.frontCounterClockwise)
         .setCullMode(key.bits.cullMode);
     pipelineDesc.renderState.blendState.disableAlphaToCoverage();
-    pipelineDesc.bindingLayouts = { m_MaterialBindings->GetLayout(), m_ViewBindingLayout };
+    if (m_BindlessMaterials)
+        pipelineDesc.bindingLayouts = { m_BindlessMaterials->GetLayout(), m_ViewBindingLayout, m_BindlessMaterials->GetDescriptorTableLayout() };
+    else
+        pipelineDesc.bindingLayouts = { m_MaterialBindings->GetLayout(), m_ViewBindingLayout };
+    if (key.bits.virtualTexture)
+        pipelineDesc.bindingLayouts.push_back(m_VirtualTextures->GetBindingLayout());
 
     pipelineDesc.renderState.depthStencilState
         .setDepthWriteEnable(m_EnableDepthWrite)
@@ -200,23 +246,26 @@ nvrhi::GraphicsPipelineHandle GBufferFillPass::CreateGraphicsPipeline(PipelineKe
             .setBackFaceStencil(nvrhi::DepthStencilState::StencilOpDesc().setPassOp(nvrhi::StencilOp::Replace));
     }
 
+    nvrhi::IShader* pixelShader = key.bits.virtualTexture ? m_PixelShaderVirtualTexture : m_PixelShader;
+    nvrhi::IShader* pixelShaderAlphaTested = key.bits.virtualTexture ? m_PixelShaderVirtualTextureAlphaTested : m_PixelShaderAlphaTested;
+
     if (key.bits.alphaTested)
     {
         pipelineDesc.renderState.rasterState.setCullNone();
 
-        if (m_PixelShaderAlphaTested)
+        if (pixelShaderAlphaTested)
         {
-            pipelineDesc.PS = m_PixelShaderAlphaTested;
+            pipelineDesc.PS = pixelShaderAlphaTested;
         }
         else
         {
-            pipelineDesc.PS = m_PixelShader;
+            pipelineDesc.PS = pixelShader;
             pipelineDesc.renderState.blendState.alphaToCoverageEnable = true;
         }
     }
     else
     {
-        pipelineDesc.PS = m_PixelShader;
+        pipelineDesc.PS = pixelShader;
     }
 
     return m_Device->createGraphicsPipeline(pipelineDesc, sampleFramebuffer);
@@ -261,13 +310,14 @@ void GBufferFillPass::SetupView(GeometryPassContext& abstractContext, nvrhi::ICo
 
     context.keyTemplate.bits.frontCounterClockwise = view->IsMirrored();
     context.keyTemplate.bits.reverseDepth = view->IsReverseDepth();
+
+    if (m_BindlessMaterials)
+        context.bindlessBindingSet = m_BindlessMaterials->GetBindingSet();
 }
 
-bool GBufferFillPass::SetupMaterial(GeometryPassContext& abstractContext, const engine::Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state)
+bool GBufferFillPass::FillPipelineKey(const Context& context, const engine::Material* material, nvrhi::RasterCullMode cullMode, PipelineKey& key) const
 {
-    auto& context = static_cast<Context&>(abstractContext);
-    
-    PipelineKey key = context.keyTemplate;
+    key = context.keyTemplate;
     key.bits.cullMode = cullMode;
 
     switch (material->domain)
@@ -286,32 +336,87 @@ bool GBufferFillPass::SetupMaterial(GeometryPassContext& abstractContext, const
         return false;
     }
 
-    nvrhi::IBindingSet* materialBindingSet = m_MaterialBindings->GetMaterialBindingSet(material);
+    key.bits.virtualTexture = material->virtualTexture && m_PixelShaderVirtualTexture;
+
+    return true;
+}
+
+bool GBufferFillPass::SetupMaterial(GeometryPassContext& abstractContext, const engine::Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state)
+{
+    auto& context = static_cast<Context&>(abstractContext);
+
+    PipelineKey key;
+    if (!FillPipelineKey(context, material, cullMode, key))
+        return false;
+
+    nvrhi::IBindingSet* materialBindingSet = m_BindlessMaterials
+        ? context.bindlessBindingSet.Get()
+        : m_MaterialBindings->GetMaterialBindingSet(material);
 
     if (!materialBindingSet)
         return false;
 
-    nvrhi::GraphicsPipelineHandle& pipeline = m_Pipelines[key.value];
+    nvrhi::IBindingSet* virtualTextureBindingSet = nullptr;
+    if (key.bits.virtualTexture)
+        virtualTextureBindingSet = material->virtualTexture->GetBindingSet();
 
-    if (!pipeline)
+    // Copy the handle under the lock, passes may record from several threads at once
+    nvrhi::GraphicsPipelineHandle pipeline;
     {
         std::lock_guard<std::mutex> lockGuard(m_Mutex);
 
-        if (!pipeline)
-            pipeline = CreateGraphicsPipeline(key, state.framebuffer);
+        nvrhi::GraphicsPipelineHandle& cachedPipeline = m_Pipelines[key.value];
+        if (!cachedPipeline)
+            cachedPipeline = CreateGraphicsPipeline(key, state.framebuffer);
 
-        if (!pipeline)
-            return false;
+        pipeline = cachedPipeline;
     }
 
+    if (!pipeline)
+        return false;
+
     assert(pipeline->getFramebufferInfo() == state.framebuffer->getFramebufferInfo());
 
     state.pipeline = pipeline;
     state.bindings = { materialBindingSet, m_ViewBindings };
+    if (m_BindlessMaterials)
+        state.bindings.push_back(m_BindlessMaterials->GetDescriptorTable());
+    if (virtualTextureBindingSet)
+        state.bindings.push_back(virtualTextureBindingSet);
+
+    return true;
+}
+
+void GBufferFillPass::SetPushConstants(GeometryPassContext& abstractContext, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args)
+{
+    auto& context = static_cast<Context&>(abstractContext);
+
+    if (m_BindlessMaterials)
+        BindlessMaterialBindings::SetDrawConstants(commandList, context.geometryIndex);
+}
+
+bool GBufferFillPass::GetMaterialPipelineKey(GeometryPassContext& abstractContext, const engine::Material* material, nvrhi::RasterCullMode cullMode, uint32_t& key)
+{
+    if (!m_BindlessMaterials)
+        return false;
+
+    auto& context = static_cast<Context&>(abstractContext);
 
+    PipelineKey pipelineKey;
+    if (!FillPipelineKey(context, material, cullMode, pipelineKey))
+        return false;
+
+    key = pipelineKey.value;
     return true;
 }
 
+void GBufferFillPass::SetupGeometry(GeometryPassContext& abstractContext, const engine::MeshGeometry* geometry)
+{
+    auto& context = static_cast<Context&>(abstractContext);
+
+    context.geometryIndex = uint32_t(geometry->globalGeometryIndex);
+}
+
 void GBufferFillPass::SetupInputBuffers(GeometryPassContext& context, const engine::BufferGroup* buffers, nvrhi::GraphicsState& state)
 {
     state.vertexBuffers = {
@@ -326,6 +431,14 @@ void GBufferFillPass::SetupInputBuffers(GeometryPassContext& context, const engi
     state.indexBuffer = { buffers->indexBuffer, nvrhi::Format::R32_UINT, 0 };
 }
 
+void MaterialIDPass::Init(engine::ShaderFactory& shaderFactory, const CreateParameters& params)
+{
+    CreateParameters materialIdParams = params;
+    materialIdParams.bindlessScene = nullptr;
+
+    GBufferFillPass::Init(shaderFactory, materialIdParams);
+}
+
 nvrhi::ShaderHandle MaterialIDPass::CreatePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested)
 {
     std::vector<ShaderMacro> PixelShaderMacros;
@@ -334,6 +447,12 @@ nvrhi::ShaderHandle MaterialIDPass::CreatePixelShader(engine::ShaderFactory& sha
     return shaderFactory.CreateAutoShader("donut/passes/material_id_ps.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_material_id_ps), &PixelShaderMacros, nvrhi::ShaderType::Pixel);
 }
 
+nvrhi::ShaderHandle MaterialIDPass::CreateVirtualTexturePixelShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested)
+{
+    // Material IDs don't depend on the textures, except for alpha testing which uses the regular base color texture
+    return nullptr;
+}
+
 void MaterialIDPass::CreateViewBindings(nvrhi::BindingLayoutHandle& layout, nvrhi::BindingSetHandle& set, const CreateParameters& params)
 {
     nvrhi::BindingSetDesc bindingSetDesc;
@@ -351,3 +470,72 @@ void MaterialIDPass::SetPushConstants(GeometryPassContext& context, nvrhi::IComm
 {
     commandList->setPushConstants(&args.startInstanceLocation, sizeof(uint32_t));
 }
+
+void GBufferFillPass::GetPipelineKeys(const SceneGraph& scene, const IView& view, std::vector<PipelineKey>& keys) const
+{
+    PipelineKey keyTemplate;
+    keyTemplate.value = 0;
+    keyTemplate.bits.frontCounterClockwise = view.IsMirrored();
+    keyTemplate.bits.reverseDepth = view.IsReverseDepth();
+
+    for (const auto& material : scene.GetMaterials())
+    {
+        if (material->domain >= MaterialDomain::Count)
+            continue;
+
+        for (nvrhi::RasterCullMode cullMode : GetMaterialCullModes(*material))
+        {
+            PipelineKey key = keyTemplate;
+            key.bits.cullMode = cullMode;
+            key.bits.alphaTested = material->domain == MaterialDomain::AlphaTested;
+            key.bits.virtualTexture = material->virtualTexture && m_PixelShaderVirtualTexture;
+
+            if (std::none_of(keys.begin(), keys.end(), [key](PipelineKey other) { return other.value == key.value; }))
+                keys.push_back(key);
+        }
+    }
+}
+
+void GBufferFillPass::PrecompilePipelines(const std::vector<PipelineKey>& keys, nvrhi::IFramebuffer* framebuffer, tf::Executor* executor)
+{
+    std::vector<uint32_t> keyValues;
+    for (const PipelineKey& key : keys)
+    {
+        // Keys loaded from a previous run may need virtual textures that are not enabled now
+        if (key.bits.virtualTexture && !m_PixelShaderVirtualTexture)
+            continue;
+
+        keyValues.push_back(key.value);
+    }
+
+    PrecompileGeometryPipelines(keyValues, m_Pipelines, PipelineKey::Count, m_Mutex,
+        [this, framebuffer](uint32_t value)
+        {
+            PipelineKey key;
+            key.value = value;
+            return CreateGraphicsPipeline(key, framebuffer);
+        }, executor);
+}
+
+bool GBufferFillPass::SavePipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    return SaveGeometryPipelineKeys(fs, path, "GBufferFillPass", m_Pipelines, PipelineKey::Count);
+}
+
+bool GBufferFillPass::LoadPipelineKeys(vfs::IFileSystem& fs, const std::filesystem::path& path, std::vector<PipelineKey>& keys) const
+{
+    std::vector<uint32_t> keyValues;
+    if (!LoadGeometryPipelineKeys(fs, path, "GBufferFillPass", PipelineKey::Count, keyValues))
+        return false;
+
+    for (uint32_t value : keyValues)
+    {
+        PipelineKey key;
+        key.value = value;
+        keys.push_back(key);
+    }
+
+    return true;
+}
@@ -21,11 +21,23 @@
 */
 
 #include <donut/render/GeometryPasses.h>
+#include <donut/engine/Scene.h>
 #include <donut/engine/SceneGraph.h>
 #include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/Profiler.h>
 #include <donut/render/DrawStrategy.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cstring>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
 
 using namespace donut::math;
+#include <donut/shaders/bindless.h>
+
 using namespace donut::engine;
 using namespace donut::render;
 
@@ -39,6 +51,8 @@ void donut::render::RenderView(
     GeometryPassContext& passContext,
     bool materialEvents)
 {
+    DONUT_PROFILE_CPU("RenderView");
+
     pass.SetupView(passContext, commandList, view, viewPrev);
 
     const Material* lastMaterial = nullptr;
@@ -55,10 +69,14 @@ void donut::render::RenderView(
     graphicsState.viewport = view->GetViewportState();
     graphicsState.shadingRateState = view->GetVariableRateShadingState();
 
+    uint32_t lastMaterialKey = 0;
+    bool lastMaterialKeyValid = false;
+
     nvrhi::DrawArguments currentDraw;
     currentDraw.instanceCount = 0;
+    const MeshGeometry* currentGeometry = nullptr;
 
-    auto flushDraw = [commandList, materialEvents, &graphicsState, &currentDraw, &eventMaterial, &pass, &passContext](const Material* material)
+    auto flushDraw = [commandList, materialEvents, &graphicsState, &currentDraw, &currentGeometry, &eventMaterial, &pass, &passContext](const Material* material)
     {
         if (currentDraw.instanceCount == 0)
             return;
@@ -79,6 +97,7 @@ void donut::render::RenderView(
             }
         }
 
+        pass.SetupGeometry(passContext, currentGeometry);
         pass.SetPushConstants(passContext, commandList, graphicsState, currentDraw);
 
         commandList->drawIndexed(currentDraw);
@@ -109,11 +128,20 @@ void donut::render::RenderView(
 
         if (newMaterial)
         {
-            drawMaterial = pass.SetupMaterial(passContext, item->material, item->cullMode, graphicsState);
+            uint32_t materialKey = 0;
+            bool mergeable = pass.GetMaterialPipelineKey(passContext, item->material, item->cullMode, materialKey);
+
+            // Materials with the same pipeline key share the graphics state
+            if (!mergeable || !lastMaterialKeyValid || materialKey != lastMaterialKey)
+            {
+                drawMaterial = pass.SetupMaterial(passContext, item->material, item->cullMode, graphicsState);
+                stateValid = false;
+            }
 
             lastMaterial = item->material;
             lastCullMode = item->cullMode;
-            stateValid = false;
+            lastMaterialKey = materialKey;
+            lastMaterialKeyValid = mergeable && drawMaterial;
         }
 
         if (drawMaterial)
@@ -142,6 +170,7 @@ void donut::render::RenderView(
                 flushDraw(item->material);
 
                 currentDraw = args;
+                currentGeometry = item->geometry;
             }
         }
     }
@@ -167,6 +196,8 @@ void donut::render::RenderCompositeView(
     if (passEvent)
         commandList->beginMarker(passEvent);
 
+    DONUT_PROFILE_GPU(commandList, passEvent ? passEvent : "RenderCompositeView");
+
     ViewType::Enum supportedViewTypes = pass.GetSupportedViewTypes();
 
     if (compositeViewPrev)
@@ -192,3 +223,403 @@ void donut::render::RenderCompositeView(
     if (passEvent)
         commandList->endMarker();
 }
+
+ParallelGeometryRenderer::ParallelGeometryRenderer(nvrhi::IDevice* device, tf::Executor* executor, uint32_t maxTasksPerView, uint32_t minItemsPerTask)
+    : m_Device(device)
+    , m_Executor(executor)
+    , m_MaxTasksPerView(std::max(maxTasksPerView, 1u))
+    , m_MinItemsPerTask(std::max(minItemsPerTask, 1u))
+    // D3D11 only supports immediate command lists, which map to the immediate context and cannot be recorded concurrently
+    , m_ParallelRecording(device->getGraphicsAPI() != nvrhi::GraphicsAPI::D3D11)
+{
+}
+
+nvrhi::ICommandList* ParallelGeometryRenderer::GetCommandList(uint32_t index)
+{
+    while (m_CommandLists.size() <= index)
+    {
+        nvrhi::CommandListParameters params;
+        params.enableImmediateExecution = false;
+        nvrhi::CommandListHandle commandList = m_Device->createCommandList(params);
+        if (!commandList)
+            return nullptr;
+
+        m_CommandLists.push_back(commandList);
+    }
+
+    return m_CommandLists[index];
+}
+
+void ParallelGeometryRenderer::RenderCompositeView(
+    nvrhi::ICommandList* commandList,
+    const ICompositeView* compositeView,
+    const ICompositeView* compositeViewPrev,
+    FramebufferFactory& framebufferFactory,
+    const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+    IDrawStrategy& drawStrategy,
+    IGeometryPass& pass,
+    const ContextFactory& createContext,
+    const char* passEvent,
+    bool materialEvents)
+{
+    ViewType::Enum supportedViewTypes = pass.GetSupportedViewTypes();
+    const uint32_t numViews = compositeView->GetNumChildViews(supportedViewTypes);
+
+    if (compositeViewPrev)
+    {
+        // the views must have the same topology
+        assert(numViews == compositeViewPrev->GetNumChildViews(supportedViewTypes));
+    }
+
+    if (m_ViewItems.size() < numViews)
+        m_ViewItems.resize(numViews);
+
+    std::vector<nvrhi::IFramebuffer*> framebuffers(numViews);
+    std::vector<Task> tasks;
+
+    // The draw strategies and the framebuffer factory are not thread-safe, so the draw items are collected here.
+    // The items are copied because the strategies may reuse the storage behind the returned pointers.
+    for (uint32_t viewIndex = 0; viewIndex < numViews; viewIndex++)
+    {
+        const IView* view = compositeView->GetChildView(supportedViewTypes, viewIndex);
+        assert(view != nullptr);
+
+        drawStrategy.PrepareForView(rootNode, *view);
+        framebuffers[viewIndex] = framebufferFactory.GetFramebuffer(*view);
+
+        std::vector<DrawItem>& items = m_ViewItems[viewIndex];
+        items.clear();
+        while (const DrawItem* item = drawStrategy.GetNextItem())
+            items.push_back(*item);
+
+        if (items.empty())
+            continue;
+
+        const uint32_t numItems = uint32_t(items.size());
+        const uint32_t numTasks = std::clamp(numItems / m_MinItemsPerTask, 1u, m_MaxTasksPerView);
+        const uint32_t itemsPerTask = (numItems + numTasks - 1) / numTasks;
+
+        for (uint32_t firstItem = 0; firstItem < numItems; firstItem += itemsPerTask)
+        {
+            Task task;
+            task.viewIndex = viewIndex;
+            task.firstItem = firstItem;
+            task.numItems = std::min(itemsPerTask, numItems - firstItem);
+            task.commandListIndex = m_NumRecordedCommandLists + uint32_t(tasks.size());
+            tasks.push_back(task);
+        }
+    }
+
+    // Command lists are created on this thread, recording only touches the lists that belong to the task
+    bool haveCommandLists = m_ParallelRecording;
+    for (size_t taskIndex = 0; haveCommandLists && taskIndex < tasks.size(); taskIndex++)
+        haveCommandLists = GetCommandList(tasks[taskIndex].commandListIndex) != nullptr;
+
+    if (!haveCommandLists)
+    {
+        // Record the collected items into the caller's command list, like the serial RenderCompositeView
+        std::unique_ptr<GeometryPassContext> passContext = createContext(commandList);
+        if (!passContext)
+            return;
+
+        if (passEvent)
+            commandList->beginMarker(passEvent);
+
+        {
+            DONUT_PROFILE_GPU(commandList, passEvent ? passEvent : "RenderCompositeView");
+
+            for (uint32_t viewIndex = 0; viewIndex < numViews; viewIndex++)
+            {
+                const IView* view = compositeView->GetChildView(supportedViewTypes, viewIndex);
+                const IView* viewPrev = compositeViewPrev ? compositeViewPrev->GetChildView(supportedViewTypes, viewIndex) : nullptr;
+
+                PassthroughDrawStrategy viewStrategy;
+                viewStrategy.SetData(m_ViewItems[viewIndex].data(), m_ViewItems[viewIndex].size());
+
+                RenderView(commandList, view, viewPrev, framebuffers[viewIndex], viewStrategy, pass, *passContext, materialEvents);
+            }
+        }
+
+        if (passEvent)
+            commandList->endMarker();
+
+        return;
+    }
+
+    m_NumRecordedCommandLists += uint32_t(tasks.size());
+
+    auto recordTask = [&](const Task& task)
+    {
+        nvrhi::ICommandList* taskCommandList = m_CommandLists[task.commandListIndex];
+        taskCommandList->open();
+
+        if (passEvent)
+            taskCommandList->beginMarker(passEvent);
+
+        {
+            // The GPU time of all chunks adds up in the same zone
+            DONUT_PROFILE_GPU(taskCommandList, passEvent ? passEvent : "RenderCompositeView");
+
+            const IView* view = compositeView->GetChildView(supportedViewTypes, task.viewIndex);
+            const IView* viewPrev = compositeViewPrev ? compositeViewPrev->GetChildView(supportedViewTypes, task.viewIndex) : nullptr;
+
+            PassthroughDrawStrategy chunkStrategy;
+            chunkStrategy.SetData(m_ViewItems[task.viewIndex].data() + task.firstItem, task.numItems);
+
+            std::unique_ptr<GeometryPassContext> passContext = createContext(taskCommandList);
+            if (passContext)
+                RenderView(taskCommandList, view, viewPrev, framebuffers[task.viewIndex], chunkStrategy, pass, *passContext, materialEvents);
+        }
+
+        if (passEvent)
+            taskCommandList->endMarker();
+
+        taskCommandList->close();
+    };
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (m_Executor && tasks.size() > 1)
+    {
+        tf::Taskflow taskflow;
+        for (const Task& task : tasks)
+            taskflow.emplace([&recordTask, &task]() { recordTask(task); });
+
+        m_Executor->run(taskflow).wait();
+        return;
+    }
+#endif
+
+    for (const Task& task : tasks)
+        recordTask(task);
+}
+
+void ParallelGeometryRenderer::Execute()
+{
+    if (m_NumRecordedCommandLists == 0)
+        return;
+
+    std::vector<nvrhi::ICommandList*> commandLists;
+    commandLists.reserve(m_NumRecordedCommandLists);
+    for (uint32_t index = 0; index < m_NumRecordedCommandLists; index++)
+        commandLists.push_back(m_CommandLists[index]);
+
+    m_Device->executeCommandLists(commandLists.data(), commandLists.size());
+    m_NumRecordedCommandLists = 0;
+}
+
+BindlessMaterialBindings::BindlessMaterialBindings(
+    nvrhi::IDevice* device,
+    std::shared_ptr<Scene> scene,
+    nvrhi::IBindingLayout* descriptorTableLayout,
+    nvrhi::ISampler* sampler,
+    bool trackLiveness)
+    : m_Device(device)
+    , m_Scene(std::move(scene))
+    , m_DescriptorTableLayout(descriptorTableLayout)
+    , m_Sampler(sampler)
+    , m_TrackLiveness(trackLiveness)
+{
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Pixel;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::RawBuffer_SRV(0),
+        nvrhi::BindingLayoutItem::RawBuffer_SRV(1),
+        nvrhi::BindingLayoutItem::Sampler(0),
+        nvrhi::BindingLayoutItem::PushConstants(3, sizeof(BindlessDrawConstants))
+    };
+
+    m_Layout = m_Device->createBindingLayout(layoutDesc);
+}
+
+bool BindlessMaterialBindings::IsSupported(const Scene* scene, nvrhi::IBindingLayout* descriptorTableLayout)
+{
+    return scene && descriptorTableLayout && scene->GetDescriptorTable();
+}
+
+nvrhi::IDescriptorTable* BindlessMaterialBindings::GetDescriptorTable() const
+{
+    return m_Scene->GetDescriptorTable();
+}
+
+nvrhi::BindingSetHandle BindlessMaterialBindings::GetBindingSet()
+{
+    nvrhi::IBuffer* materialBuffer = m_Scene->GetMaterialBuffer();
+    nvrhi::IBuffer* geometryBuffer = m_Scene->GetGeometryBuffer();
+
+    if (!materialBuffer || !geometryBuffer)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (!m_BindingSet || materialBuffer != m_MaterialBuffer || geometryBuffer != m_GeometryBuffer)
+    {
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::RawBuffer_SRV(0, materialBuffer),
+            nvrhi::BindingSetItem::RawBuffer_SRV(1, geometryBuffer),
+            nvrhi::BindingSetItem::Sampler(0, m_Sampler),
+            nvrhi::BindingSetItem::PushConstants(3, sizeof(BindlessDrawConstants))
+        };
+        bindingSetDesc.trackLiveness = m_TrackLiveness;
+
+        m_BindingSet = m_Device->createBindingSet(bindingSetDesc, m_Layout);
+        m_MaterialBuffer = materialBuffer;
+        m_GeometryBuffer = geometryBuffer;
+    }
+
+    return m_BindingSet;
+}
+
+void BindlessMaterialBindings::SetDrawConstants(nvrhi::ICommandList* commandList, uint32_t geometryIndex)
+{
+    BindlessDrawConstants constants;
+    constants.geometryIndex = geometryIndex;
+    commandList->setPushConstants(&constants, sizeof(constants));
+}
+
+std::vector<nvrhi::RasterCullMode> donut::render::GetMaterialCullModes(const Material& material)
+{
+    if (!material.doubleSided)
+        return { nvrhi::RasterCullMode::Back };
+
+    if (material.domain == MaterialDomain::Opaque || material.domain == MaterialDomain::AlphaTested)
+        return { nvrhi::RasterCullMode::None };
+
+    return { nvrhi::RasterCullMode::None, nvrhi::RasterCullMode::Front, nvrhi::RasterCullMode::Back };
+}
+
+void donut::render::PrecompileGeometryPipelines(
+    const std::vector<uint32_t>& keys,
+    nvrhi::GraphicsPipelineHandle* pipelines,
+    size_t pipelineCount,
+    std::mutex& mutex,
+    const std::function<nvrhi::GraphicsPipelineHandle(uint32_t key)>& createPipeline,
+    tf::Executor* executor)
+{
+    std::vector<uint32_t> missingKeys;
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex);
+
+        for (uint32_t key : keys)
+        {
+            if (key < pipelineCount && !pipelines[key] && std::find(missingKeys.begin(), missingKeys.end(), key) == missingKeys.end())
+                missingKeys.push_back(key);
+        }
+    }
+
+    // The pipelines are created without holding the mutex, which only guards the stores
+    auto createAndStore = [&](uint32_t key)
+    {
+        nvrhi::GraphicsPipelineHandle pipeline = createPipeline(key);
+        if (!pipeline)
+            return;
+
+        std::lock_guard<std::mutex> lockGuard(mutex);
+        if (!pipelines[key])
+            pipelines[key] = pipeline;
+    };
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && missingKeys.size() > 1)
+    {
+        tf::Taskflow taskflow;
+        for (uint32_t key : missingKeys)
+            taskflow.emplace([&createAndStore, key]() { createAndStore(key); });
+
+        executor->run(taskflow).wait();
+        return;
+    }
+#endif
+
+    for (uint32_t key : missingKeys)
+        createAndStore(key);
+}
+
+namespace
+{
+    constexpr uint32_t c_PipelineKeysMagic = 0x4b504744; // 'DGPK'
+    constexpr uint32_t c_PipelineKeysVersion = 1;
+
+    struct PipelineKeysHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t pipelineCount;
+        uint32_t numKeys;
+        char passName[48];
+    };
+}
+
+bool donut::render::SaveGeometryPipelineKeys(
+    vfs::IFileSystem& fs,
+    const std::filesystem::path& path,
+    const char* passName,
+    const nvrhi::GraphicsPipelineHandle* pipelines,
+    size_t pipelineCount)
+{
+    PipelineKeysHeader header = {};
+    header.magic = c_PipelineKeysMagic;
+    header.version = c_PipelineKeysVersion;
+    header.pipelineCount = uint32_t(pipelineCount);
+    strncpy(header.passName, passName, sizeof(header.passName) - 1);
+
+    std::vector<uint8_t> data(sizeof(header));
+    for (uint32_t key = 0; key < uint32_t(pipelineCount); key++)
+    {
+        if (!pipelines[key])
+            continue;
+
+        size_t offset = data.size();
+        data.resize(offset + sizeof(key));
+        memcpy(data.data() + offset, &key, sizeof(key));
+        ++header.numKeys;
+    }
+
+    memcpy(data.data(), &header, sizeof(header));
+
+    if (!fs.writeFile(path, data.data(), data.size()))
+    {
+        log::warning("Couldn't write the pipeline keys of %s to '%s'", passName, path.generic_string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool donut::render::LoadGeometryPipelineKeys(
+    vfs::IFileSystem& fs,
+    const std::filesystem::path& path,
+    const char* passName,
+    size_t pipelineCount,
+    std::vector<uint32_t>& keys)
+{
+    std::shared_ptr<vfs::IBlob> blob = fs.readFile(path);
+    if (!blob || blob->size() < sizeof(PipelineKeysHeader))
+        return false;
+
+    PipelineKeysHeader header;
+    memcpy(&header, blob->data(), sizeof(header));
+    header.passName[sizeof(header.passName) - 1] = 0;
+
+    if (header.magic != c_PipelineKeysMagic
+        || header.version != c_PipelineKeysVersion
+        || header.pipelineCount != uint32_t(pipelineCount)
+        || strcmp(header.passName, passName) != 0
+        || blob->size() < sizeof(header) + size_t(header.numKeys) * sizeof(uint32_t))
+    {
+        log::warning("Ignoring the incompatible pipeline keys file '%s'", path.generic_string().c_str());
+        return false;
+    }
+
+    const uint8_t* keyData = static_cast<const uint8_t*>(blob->data()) + sizeof(header);
+    for (uint32_t index = 0; index < header.numKeys; index++)
+    {
+        uint32_t key;
+        memcpy(&key, keyData + index * sizeof(key), sizeof(key));
+
+        if (key < pipelineCount)
+            keys.push_back(key);
+    }
+
+    return true;
+}
@@ -0,0 +1,334 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/LightClusteringPass.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/engine/Profiler.h>
+#include <donut/core/log.h>
+#include <nvrhi/utils.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if DONUT_WITH_STATIC_SHADERS
+#if DONUT_WITH_DX11
+#include "compiled_shaders/passes/light_clustering_cs.dxbc.h"
+#endif
+#if DONUT_WITH_DX12
+#include "compiled_shaders/passes/light_clustering_cs.dxil.h"
+#endif
+#if DONUT_WITH_VULKAN
+#include "compiled_shaders/passes/light_clustering_cs.spirv.h"
+#endif
+#endif
+
+using namespace donut::math;
+#include <donut/shaders/light_cb.h>
+#include <donut/shaders/light_clustering_cb.h>
+
+using namespace donut::engine;
+using namespace donut::render;
+
+// Depth slices start at this view depth at least, which matters for orthographic views
+static constexpr float c_MinClusterDepth = 0.01f;
+
+// Far bound of the last depth slice, standing in for infinity
+static constexpr float c_FarSliceDepth = 1e8f;
+
+LightClusteringPass::LightClusteringPass(nvrhi::IDevice* device)
+    : m_Device(device)
+{
+}
+
+void LightClusteringPass::Init(ShaderFactory& shaderFactory, const CreateParameters& params)
+{
+    m_Params = params;
+    m_Params.tileSize = std::max(m_Params.tileSize, 1u);
+    m_Params.depthSlices = std::max(m_Params.depthSlices, 1u);
+    m_Params.maxClusters = std::max(m_Params.maxClusters, m_Params.depthSlices);
+    m_Params.maxLights = std::max(m_Params.maxLights, 1u);
+    m_Params.maxLightIndices = std::max(m_Params.maxLightIndices, 1u);
+
+    m_ConstantBuffer = m_Device->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(
+        sizeof(LightClusteringConstants), "LightClusteringConstants", c_MaxRenderPassConstantBufferVersions));
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = sizeof(LightConstants) * m_Params.maxLights;
+    bufferDesc.structStride = sizeof(LightConstants);
+    bufferDesc.debugName = "ClusteredLights";
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+    m_LightBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(float4) * m_Params.maxLights;
+    bufferDesc.structStride = sizeof(float4);
+    bufferDesc.debugName = "ClusteredLightBounds";
+    m_LightBoundsBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(uint2) * m_Params.maxClusters;
+    bufferDesc.structStride = sizeof(uint2);
+    bufferDesc.debugName = "LightClusterGrid";
+    bufferDesc.canHaveUAVs = true;
+    m_ClusterGridBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(uint32_t) * m_Params.maxLightIndices;
+    bufferDesc.structStride = sizeof(uint32_t);
+    bufferDesc.debugName = "LightClusterIndices";
+    m_LightIndexBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(uint32_t);
+    bufferDesc.debugName = "LightClusterIndexCounter";
+    bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    m_LightIndexCounterBuffer = m_Device->createBuffer(bufferDesc);
+
+    if (m_Params.binOnCPU)
+        return;
+
+    m_ComputeShader = CreateComputeShader(shaderFactory);
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Compute;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_UAV(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_UAV(1),
+        nvrhi::BindingLayoutItem::StructuredBuffer_UAV(2)
+    };
+    m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_LightBoundsBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(0, m_ClusterGridBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_LightIndexBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_LightIndexCounterBuffer)
+    };
+    m_BindingSet = m_Device->createBindingSet(bindingSetDesc, m_BindingLayout);
+
+    nvrhi::ComputePipelineDesc pipelineDesc;
+    pipelineDesc.CS = m_ComputeShader;
+    pipelineDesc.bindingLayouts = { m_BindingLayout };
+    m_Pipeline = m_Device->createComputePipeline(pipelineDesc);
+}
+
+nvrhi::ShaderHandle LightClusteringPass::CreateComputeShader(ShaderFactory& shaderFactory)
+{
+    return shaderFactory.CreateAutoShader("donut/passes/light_clustering_cs.hlsl", "main", DONUT_MAKE_PLATFORM_SHADER(g_light_clustering_cs), nullptr, nvrhi::ShaderType::Compute);
+}
+
+bool LightClusteringPass::IsClusteredLight(const Light& light)
+{
+    return !light.shadowMap && light.shadowChannel < 0;
+}
+
+// View space bounding sphere of the light's influence, infinite for directional lights and unlimited range
+static float4 GetLightViewBounds(const LightConstants& light, const affine3& worldToView)
+{
+    float3 center = worldToView.transformPoint(light.position);
+
+    if (light.lightType == LightType_Directional || light.angularSizeOrInvRange <= 0.f)
+        return float4(center, std::numeric_limits<float>::max());
+
+    return float4(center, 1.f / light.angularSizeOrInvRange);
+}
+
+void LightClusteringPass::Render(
+    nvrhi::ICommandList* commandList,
+    const IView& view,
+    const std::vector<std::shared_ptr<Light>>& lights)
+{
+    commandList->beginMarker("LightClustering");
+    DONUT_PROFILE_GPU(commandList, "LightClustering");
+
+    const affine3 worldToView = view.GetViewMatrix();
+
+    std::vector<LightConstants> lightConstants;
+    std::vector<float4> lightBounds;
+    lightConstants.reserve(std::min(lights.size(), size_t(m_Params.maxLights)));
+    lightBounds.reserve(lightConstants.capacity());
+
+    for (const auto& light : lights)
+    {
+        if (!IsClusteredLight(*light))
+            continue;
+
+        if (lightConstants.size() >= m_Params.maxLights)
+        {
+            log::warning("Maximum number of clustered lights (%d) exceeded in LightClusteringPass", m_Params.maxLights);
+            break;
+        }
+
+        LightConstants& constants = lightConstants.emplace_back();
+        constants = {};
+        light->FillLightConstants(constants);
+        lightBounds.push_back(GetLightViewBounds(constants, worldToView));
+    }
+
+    m_NumLights = uint32_t(lightConstants.size());
+
+    // Grow the tiles until the grid fits into the cluster buffer
+    const nvrhi::Rect viewExtent = view.GetViewExtent();
+    const uint32_t viewWidth = uint32_t(std::max(viewExtent.width(), 1));
+    const uint32_t viewHeight = uint32_t(std::max(viewExtent.height(), 1));
+
+    m_ClusterTileSize = m_Params.tileSize;
+    while (true)
+    {
+        m_GridSize.x = (viewWidth + m_ClusterTileSize - 1) / m_ClusterTileSize;
+        m_GridSize.y = (viewHeight + m_ClusterTileSize - 1) / m_ClusterTileSize;
+        m_GridSize.z = m_Params.depthSlices;
+
+        if (m_GridSize.x * m_GridSize.y * m_GridSize.z <= m_Params.maxClusters)
+            break;
+
+        m_ClusterTileSize *= 2;
+    }
+
+    // Exponential depth slices between the near plane and maxDistance
+    float4 nearPoint = float4(0.f, 0.f, view.IsReverseDepth() ? 1.f : 0.f, 1.f) * view.GetInverseProjectionMatrix(false);
+    float nearDepth = std::max(nearPoint.z / nearPoint.w, c_MinClusterDepth);
+    float farDepth = std::max(m_Params.maxDistance, nearDepth * 2.f);
+
+    m_DepthScale = float(m_GridSize.z) / logf(farDepth / nearDepth);
+    m_DepthBias = -logf(nearDepth) * m_DepthScale;
+
+    LightClusteringConstants constants = {};
+    view.FillPlanarViewConstants(constants.view);
+    FillClusterConstants(constants.clusters);
+    constants.maxLightIndices = m_Params.maxLightIndices;
+    constants.farSliceDepth = c_FarSliceDepth;
+
+    if (m_NumLights > 0)
+    {
+        commandList->writeBuffer(m_LightBuffer, lightConstants.data(), lightConstants.size() * sizeof(LightConstants));
+        commandList->writeBuffer(m_LightBoundsBuffer, lightBounds.data(), lightBounds.size() * sizeof(float4));
+    }
+
+    if (m_Params.binOnCPU)
+    {
+        BinLightsOnCPU(constants, lightBounds);
+
+        commandList->writeBuffer(m_ClusterGridBuffer, m_CpuClusterGrid.data(), m_CpuClusterGrid.size() * sizeof(uint2));
+        if (!m_CpuLightIndices.empty())
+            commandList->writeBuffer(m_LightIndexBuffer, m_CpuLightIndices.data(), m_CpuLightIndices.size() * sizeof(uint32_t));
+    }
+    else
+    {
+        commandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
+        commandList->clearBufferUInt(m_LightIndexCounterBuffer, 0);
+
+        nvrhi::ComputeState state;
+        state.pipeline = m_Pipeline;
+        state.bindings = { m_BindingSet };
+        commandList->setComputeState(state);
+        commandList->dispatch(m_GridSize.x, m_GridSize.y, m_GridSize.z);
+    }
+
+    commandList->endMarker();
+}
+
+void LightClusteringPass::FillClusterConstants(LightClusterConstants& constants) const
+{
+    constants.gridSize = m_GridSize;
+    constants.tileSize = m_ClusterTileSize;
+    constants.depthScale = m_DepthScale;
+    constants.depthBias = m_DepthBias;
+    constants.numLights = m_NumLights;
+}
+
+// Same view space point reconstruction as GetViewPositionAtDepth in light_clustering_cs.hlsl
+static float3 GetViewPositionAtDepth(const PlanarViewConstants& view, float2 windowPosition, float viewDepth)
+{
+    float2 clipXY = windowPosition * view.windowToClipScale + view.windowToClipBias;
+
+    float4 nearPoint = float4(clipXY, 0.25f, 1.f) * view.matClipToView;
+    float4 farPoint = float4(clipXY, 0.75f, 1.f) * view.matClipToView;
+    float3 nearPosition = nearPoint.xyz() / nearPoint.w;
+    float3 farPosition = farPoint.xyz() / farPoint.w;
+
+    float3 direction = farPosition - nearPosition;
+    return nearPosition + direction * ((viewDepth - nearPosition.z) / direction.z);
+}
+
+void LightClusteringPass::BinLightsOnCPU(const LightClusteringConstants& constants, const std::vector<float4>& lightBounds)
+{
+    const LightClusterConstants& clusters = constants.clusters;
+
+    m_CpuClusterGrid.resize(size_t(clusters.gridSize.x) * clusters.gridSize.y * clusters.gridSize.z);
+    m_CpuLightIndices.clear();
+
+    std::vector<uint32_t> clusterLights;
+
+    for (uint32_t z = 0; z < clusters.gridSize.z; z++)
+    {
+        float sliceNear = (z == 0) ? 0.f : expf((float(z) - clusters.depthBias) / clusters.depthScale);
+        float sliceFar = (z == clusters.gridSize.z - 1) ? constants.farSliceDepth : expf((float(z + 1) - clusters.depthBias) / clusters.depthScale);
+
+        for (uint32_t y = 0; y < clusters.gridSize.y; y++)
+        {
+            for (uint32_t x = 0; x < clusters.gridSize.x; x++)
+            {
+                float2 tileMin = constants.view.viewportOrigin + float2(float(x * clusters.tileSize), float(y * clusters.tileSize));
+                float2 tileMax = min(tileMin + float(clusters.tileSize), constants.view.viewportOrigin + constants.view.viewportSize);
+
+                float3 boxMin = float3(GetViewPositionAtDepth(constants.view, tileMin, sliceNear).xy(), sliceNear);
+                float3 boxMax = boxMin;
+
+                for (uint32_t corner = 0; corner < 8; corner++)
+                {
+                    float2 windowPosition = float2((corner & 1) ? tileMax.x : tileMin.x, (corner & 2) ? tileMax.y : tileMin.y);
+                    float3 position = GetViewPositionAtDepth(constants.view, windowPosition, (corner & 4) ? sliceFar : sliceNear);
+                    boxMin = min(boxMin, position);
+                    boxMax = max(boxMax, position);
+                }
+
+                clusterLights.clear();
+
+                for (uint32_t lightIndex = 0; lightIndex < clusters.numLights; lightIndex++)
+                {
+                    const float4& sphere = lightBounds[lightIndex];
+                    float3 offset = clamp(sphere.xyz(), boxMin, boxMax) - sphere.xyz();
+
+                    if (dot(offset, offset) <= sphere.w * sphere.w && clusterLights.size() < LIGHT_CLUSTERING_MAX_LIGHTS_PER_CLUSTER)
+                        clusterLights.push_back(lightIndex);
+                }
+
+                uint2& range = m_CpuClusterGrid[(size_t(z) * clusters.gridSize.y + y) * clusters.gridSize.x + x];
+                range = uint2(uint32_t(m_CpuLightIndices.size()), uint32_t(clusterLights.size()));
+
+                // The index buffer is full, leave the cluster unlit like the GPU path does
+                if (m_CpuLightIndices.size() + clusterLights.size() > constants.maxLightIndices)
+                {
+                    range.y = 0;
+                    continue;
+                }
+
+                m_CpuLightIndices.insert(m_CpuLightIndices.end(), clusterLights.begin(), clusterLights.end());
+            }
+        }
+    }
+}
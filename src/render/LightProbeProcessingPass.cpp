@@ -67,6 +67,7 @@ LightProbeProcessingPass::LightProbeProcessingPass(
     : m_Device(device)
     , m_IntermediateTextureSize(intermediateTextureSize)
     , m_CommonPasses(commonPasses)
+    , m_BindingSetCache(device)
 {
     m_GeometryShader = shaderFactory->CreateAutoShader("donut/passes/light_probe.hlsl", "cubemap_gs", DONUT_MAKE_PLATFORM_SHADER(g_light_probe_cubemap_gs), nullptr, nvrhi::ShaderType::Geometry);
     m_MipPixelShader = shaderFactory->CreateAutoShader("donut/passes/light_probe.hlsl", "mip_ps", DONUT_MAKE_PLATFORM_SHADER(g_light_probe_mip_ps), nullptr, nvrhi::ShaderType::Pixel);
@@ -142,24 +143,14 @@ nvrhi::FramebufferHandle LightProbeProcessingPass::GetCachedFramebuffer(nvrhi::I
 
 nvrhi::BindingSetHandle LightProbeProcessingPass::GetCachedBindingSet(nvrhi::ITexture* texture, nvrhi::TextureSubresourceSet subresources)
 {
-    TextureSubresourcesKey key;
-    key.texture = texture;
-    key.subresources = subresources;
-
-    nvrhi::BindingSetHandle& bindingSet = m_BindingSetCache[key];
-    if (!bindingSet)
-    {
-        nvrhi::BindingSetDesc bindingSetDesc;
-        bindingSetDesc.bindings = {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_LightProbeCB),
-            nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearWrapSampler),
-            nvrhi::BindingSetItem::Texture_SRV(0, texture, nvrhi::Format::UNKNOWN, subresources),
-        };
-
-        bindingSet = m_Device->createBindingSet(bindingSetDesc, m_BindingLayout);
-    }
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_LightProbeCB),
+        nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearWrapSampler),
+        nvrhi::BindingSetItem::Texture_SRV(0, texture, nvrhi::Format::UNKNOWN, subresources),
+    };
 
-    return bindingSet;
+    return m_BindingSetCache.GetOrCreateBindingSet(bindingSetDesc, m_BindingLayout);
 }
 
 void LightProbeProcessingPass::BlitCubemap(nvrhi::ICommandList* commandList, nvrhi::ITexture* inCubeMap, uint32_t inBaseArraySlice, uint32_t inMipLevel, nvrhi::ITexture* outCubeMap, uint32_t outBaseArraySlice, uint32_t outMipLevel)
@@ -394,5 +385,18 @@ void LightProbeProcessingPass::ResetCaches()
     m_BlitPsoCache.clear();
     m_DiffusePsoCache.clear();
     m_FramebufferCache.clear();
-    m_BindingSetCache.clear();
+    m_BindingSetCache.Clear();
+}
+
+void LightProbeProcessingPass::InvalidateTexture(nvrhi::ITexture* texture)
+{
+    for (auto it = m_FramebufferCache.begin(); it != m_FramebufferCache.end(); )
+    {
+        if (it->first.texture == texture)
+            it = m_FramebufferCache.erase(it);
+        else
+            ++it;
+    }
+
+    m_BindingSetCache.Invalidate(texture);
 }
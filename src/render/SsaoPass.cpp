@@ -27,6 +27,7 @@
 #include <donut/engine/ShadowMap.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/Profiler.h>
 #include <nvrhi/utils.h>
 
 #if DONUT_WITH_STATIC_SHADERS
@@ -229,6 +230,7 @@ void SsaoPass::Render(
     assert(m_Blur.BindingSets[bindingSetIndex]);
 
     commandList->beginMarker("SSAO");
+    DONUT_PROFILE_GPU(commandList, "SSAO");
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
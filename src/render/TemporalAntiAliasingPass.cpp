@@ -25,6 +25,7 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/Profiler.h>
 
 #if DONUT_WITH_STATIC_SHADERS
 #if DONUT_WITH_DX11
@@ -199,6 +200,7 @@ void TemporalAntiAliasingPass::RenderMotionVectors(
     assert(m_MotionVectorsPso);
 
     commandList->beginMarker("MotionVectors");
+    DONUT_PROFILE_GPU(commandList, "MotionVectors");
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -246,6 +248,7 @@ void TemporalAntiAliasingPass::TemporalResolve(
     assert(compositeViewInput.GetNumChildViews(ViewType::PLANAR) == compositeViewOutput.GetNumChildViews(ViewType::PLANAR));
     
     commandList->beginMarker("TemporalAA");
+    DONUT_PROFILE_GPU(commandList, "TemporalAA");
 
     for (uint viewIndex = 0; viewIndex < compositeViewInput.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -24,6 +24,7 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/Profiler.h>
 #include <sstream>
 #include <assert.h>
 #include <donut/engine/FramebufferFactory.h>
@@ -64,6 +65,7 @@ ToneMappingPass::ToneMappingPass(
     , m_HistogramBins(params.histogramBins)
     , m_CommonPasses(commonPasses)
     , m_FramebufferFactory(framebufferFactory)
+    , m_BindingCache(device, 0, c_BindingSetMaxAge)
 {
     assert(params.histogramBins <= 256);
 
@@ -203,19 +205,15 @@ void ToneMappingPass::Render(
     const ICompositeView& compositeView,
     nvrhi::ITexture* sourceTexture)
 {
-    nvrhi::BindingSetHandle& bindingSet = m_RenderBindingSets[sourceTexture];
-    if (!bindingSet)
-    {
-        nvrhi::BindingSetDesc bindingSetDesc;
-        bindingSetDesc.bindings = {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_ToneMappingCB),
-            nvrhi::BindingSetItem::Texture_SRV(0, sourceTexture),
-            nvrhi::BindingSetItem::TypedBuffer_SRV(1, m_ExposureBuffer),
-            nvrhi::BindingSetItem::Texture_SRV(2, m_ColorLUT),
-            nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearClampSampler)
-        };
-        bindingSet = m_Device->createBindingSet(bindingSetDesc, m_RenderBindingLayout);
-    }
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_ToneMappingCB),
+        nvrhi::BindingSetItem::Texture_SRV(0, sourceTexture),
+        nvrhi::BindingSetItem::TypedBuffer_SRV(1, m_ExposureBuffer),
+        nvrhi::BindingSetItem::Texture_SRV(2, m_ColorLUT),
+        nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearClampSampler)
+    };
+    nvrhi::BindingSetHandle bindingSet = m_BindingCache.GetOrCreateBindingSet(bindingSetDesc, m_RenderBindingLayout);
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -255,6 +253,7 @@ void ToneMappingPass::SimpleRender(
     ::ITexture* sourceTexture)
 {
     commandList->beginMarker("ToneMapping");
+    DONUT_PROFILE_GPU(commandList, "ToneMapping");
     ResetHistogram(commandList);
     AddFrameToHistogram(commandList, compositeView, sourceTexture);
     ComputeExposure(commandList, params);
@@ -270,6 +269,12 @@ nvrhi::BufferHandle ToneMappingPass::GetExposureBuffer()
 void ToneMappingPass::AdvanceFrame(float frameTime)
 {
     m_FrameTime = frameTime;
+    m_BindingCache.AdvanceFrame();
+}
+
+void ToneMappingPass::InvalidateTexture(nvrhi::ITexture* texture)
+{
+    m_BindingCache.Invalidate(texture);
 }
 
 void ToneMappingPass::ResetExposure(nvrhi::ICommandList* commandList, float initialExposure)
@@ -288,18 +293,13 @@ static const float g_maxLogLuminamce = 4;
 
 void ToneMappingPass::AddFrameToHistogram(nvrhi::ICommandList* commandList, const ICompositeView& compositeView, nvrhi::ITexture* sourceTexture)
 {
-    nvrhi::BindingSetHandle& bindingSet = m_HistogramBindingSets[sourceTexture];
-    if (!bindingSet)
-    {
-        nvrhi::BindingSetDesc bindingSetDesc;
-        bindingSetDesc.bindings = {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_ToneMappingCB),
-            nvrhi::BindingSetItem::Texture_SRV(0, sourceTexture),
-            nvrhi::BindingSetItem::TypedBuffer_UAV(0, m_HistogramBuffer)
-        };
-
-        bindingSet = m_Device->createBindingSet(bindingSetDesc, m_HistogramBindingLayout);
-    }
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_ToneMappingCB),
+        nvrhi::BindingSetItem::Texture_SRV(0, sourceTexture),
+        nvrhi::BindingSetItem::TypedBuffer_UAV(0, m_HistogramBuffer)
+    };
+    nvrhi::BindingSetHandle bindingSet = m_BindingCache.GetOrCreateBindingSet(bindingSetDesc, m_HistogramBindingLayout);
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
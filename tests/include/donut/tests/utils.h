@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <cstdlib>
 #include <stdexcept>
 #include <string>
 
@@ -34,5 +35,9 @@
 #define CHECK(condition) \
 	if (!(condition)) { throw std::runtime_error(std::string(__FILE__) + ':' + std::to_string(__LINE__) + ':' + __PRETTY_FUNCTION__); }
 
-
-
+// Timing measurements are skipped unless the DONUT_TEST_BENCHMARKS environment variable is set,
+// so that regular test runs stay fast and silent.
+inline bool benchmarks_enabled()
+{
+	return getenv("DONUT_TEST_BENCHMARKS") != nullptr;
+}
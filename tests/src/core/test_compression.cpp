@@ -0,0 +1,411 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/vfs/Compression.h>
+
+#include <donut/core/vfs/TarFile.h>
+
+#include <donut/tests/utils.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <map>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+#ifdef DONUT_WITH_ZSTD
+#include <zdict.h>
+#endif
+
+using namespace donut;
+
+std::filesystem::path rpath(DONUT_TEST_SOURCE_DIR);
+
+// Generates moderately compressible data: runs of repeated words mixed with noise.
+static std::vector<uint8_t> generate_test_data(size_t size)
+{
+	std::vector<uint8_t> data(size);
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < size; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		data[i] = ((seed >> 24) < 32) ? uint8_t(seed >> 16) : uint8_t("donut::vfs "[i % 11]);
+	}
+	return data;
+}
+
+// A minimal writable file system that keeps the files in memory.
+class MemoryFileSystem : public vfs::IFileSystem
+{
+public:
+	std::map<std::string, std::vector<uint8_t>> files;
+
+	size_t totalSize() const
+	{
+		size_t size = 0;
+		for (const auto& [name, data] : files)
+			size += data.size();
+		return size;
+	}
+
+	bool folderExists(const std::filesystem::path&) override { return false; }
+	bool fileExists(const std::filesystem::path& name) override { return files.find(name.generic_string()) != files.end(); }
+
+	std::shared_ptr<vfs::IBlob> readFile(const std::filesystem::path& name) override
+	{
+		auto it = files.find(name.generic_string());
+		if (it == files.end())
+			return nullptr;
+
+		void* data = malloc(std::max(it->second.size(), size_t(1)));
+		memcpy(data, it->second.data(), it->second.size());
+		return std::make_shared<vfs::Blob>(data, it->second.size());
+	}
+
+	bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override
+	{
+		files[name.generic_string()].assign((const uint8_t*)data, (const uint8_t*)data + size);
+		return true;
+	}
+
+	int enumerateFiles(const std::filesystem::path&, const std::vector<std::string>&, vfs::enumerate_callback_t, bool) override { return vfs::status::NotImplemented; }
+	int enumerateDirectories(const std::filesystem::path&, vfs::enumerate_callback_t, bool) override { return vfs::status::NotImplemented; }
+};
+
+static void collect_files(vfs::IFileSystem& fs, const std::filesystem::path& path, std::vector<std::vector<uint8_t>>& contents)
+{
+	std::vector<std::string> files;
+	fs.enumerateFiles(path, {}, vfs::enumerate_to_vector(files));
+	for (const auto& file : files)
+	{
+		std::shared_ptr<vfs::IBlob> blob = fs.readFile(path / file);
+		if (!vfs::IBlob::isEmpty(blob.get()))
+			contents.emplace_back((const uint8_t*)blob->data(), (const uint8_t*)blob->data() + blob->size());
+	}
+
+	std::vector<std::string> directories;
+	fs.enumerateDirectories(path, vfs::enumerate_to_vector(directories));
+	for (const auto& directory : directories)
+		collect_files(fs, path / directory, contents);
+}
+
+#ifdef DONUT_WITH_LZ4
+
+static double measure_read(vfs::IFileSystem& fs, const std::filesystem::path& name, std::vector<uint8_t> const& expected)
+{
+	const int iterations = benchmarks_enabled() ? 4 : 1;
+	double seconds = 0.0;
+
+	for (int i = 0; i < iterations; i++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		std::shared_ptr<vfs::IBlob> blob = fs.readFile(name);
+		auto end = std::chrono::high_resolution_clock::now();
+		seconds += std::chrono::duration<double>(end - start).count();
+
+		CHECK(blob);
+		CHECK(blob->size() == expected.size());
+		CHECK(memcmp(blob->data(), expected.data(), expected.size()) == 0);
+	}
+
+	return double(expected.size()) * iterations / seconds * 1e-9;
+}
+
+void test_compression_layer()
+{
+	// the default 64 KB blocks give a few dozen blocks for the parallel path even with the small data set
+	auto memoryFS = std::make_shared<MemoryFileSystem>();
+	std::vector<uint8_t> data = generate_test_data(benchmarks_enabled() ? 32 * 1024 * 1024 : 2 * 1024 * 1024);
+
+	// write the same data in linked and independent block modes
+	{
+		vfs::CompressionLayer layer(memoryFS);
+		layer.setCompressionLevel(1);
+		CHECK(layer.writeFile("linked.bin.lz4", data.data(), data.size()));
+
+		layer.setIndependentBlocks(true);
+		CHECK(layer.writeFile("independent.bin.lz4", data.data(), data.size()));
+
+		const char* text = "***HELLO WORLD***";
+		CHECK(layer.writeFile("plain.txt", text, strlen(text)));
+	}
+
+	// negative lookup cache
+	{
+		vfs::CompressionLayer layer(memoryFS);
+
+		std::shared_ptr<vfs::IBlob> blob = layer.readFile("plain.txt");
+		CHECK(blob && blob->size() == 17);
+		blob = layer.readFile("plain.txt");
+		CHECK(blob && blob->size() == 17);
+		CHECK(layer.readFile("missing.txt") == nullptr);
+
+		// writing a compressed version must invalidate the cached lookup
+		CHECK(layer.writeFile("plain.txt.lz4", "compressed", 10));
+		blob = layer.readFile("plain.txt");
+		CHECK(blob && blob->size() == 10);
+		CHECK(memcmp(blob->data(), "compressed", 10) == 0);
+	}
+
+	// sequential decompression
+	vfs::CompressionLayer sequentialLayer(memoryFS);
+	double linkedRate = measure_read(sequentialLayer, "linked.bin", data);
+	double sequentialRate = measure_read(sequentialLayer, "independent.bin", data);
+
+	if (benchmarks_enabled())
+	{
+		printf("LZ4 sequential decompression, linked blocks: %.2f GB/s\n", linkedRate);
+		printf("LZ4 sequential decompression, independent blocks: %.2f GB/s\n", sequentialRate);
+	}
+
+#ifdef DONUT_WITH_TASKFLOW
+	// block-parallel decompression
+	{
+		tf::Executor executor;
+		vfs::CompressionLayer parallelLayer(memoryFS);
+		parallelLayer.setParallelDecompression(&executor);
+
+		double parallelRate = measure_read(parallelLayer, "independent.bin", data);
+		if (benchmarks_enabled())
+			printf("LZ4 parallel decompression, independent blocks, %d workers: %.2f GB/s\n", int(executor.num_workers()), parallelRate);
+
+		// linked frames must still decode through the sequential path
+		measure_read(parallelLayer, "linked.bin", data);
+
+		// asynchronous reads are decompressed on the executor
+		std::shared_ptr<vfs::IBlob> blob = parallelLayer.readFileFuture("independent.bin").get();
+		CHECK(blob && blob->size() == data.size());
+		CHECK(memcmp(blob->data(), data.data(), data.size()) == 0);
+	}
+#endif
+
+	// asynchronous reads of compressed and uncompressed files
+	{
+		vfs::CompressionLayer layer(memoryFS);
+
+		std::shared_ptr<vfs::IBlob> blob = layer.readFileFuture("linked.bin").get();
+		CHECK(blob && blob->size() == data.size());
+		CHECK(memcmp(blob->data(), data.data(), data.size()) == 0);
+
+		blob = layer.readFileFuture("plain.txt").get();
+		CHECK(blob && blob->size() == 10);
+		CHECK(layer.readFileFuture("missing.txt").get() == nullptr);
+	}
+}
+
+#endif // DONUT_WITH_LZ4
+
+#ifdef DONUT_WITH_ZSTD
+
+void test_zstd()
+{
+	auto memoryFS = std::make_shared<MemoryFileSystem>();
+	std::vector<uint8_t> data = generate_test_data(4 * 1024 * 1024);
+
+	// round trip
+	{
+		vfs::CompressionLayer layer(memoryFS);
+		layer.setZstdCompressionLevel(3);
+		CHECK(layer.writeFile("data.bin.zst", data.data(), data.size()));
+		CHECK(memoryFS->files["data.bin.zst"].size() < data.size());
+
+		std::shared_ptr<vfs::IBlob> blob = layer.readFile("data.bin");
+		CHECK(blob && blob->size() == data.size());
+		CHECK(memcmp(blob->data(), data.data(), data.size()) == 0);
+	}
+
+	// concatenated frames
+	{
+		vfs::CompressionLayer layer(memoryFS);
+		size_t half = data.size() / 2;
+		CHECK(layer.writeFile("first.bin.zst", data.data(), half));
+		CHECK(layer.writeFile("second.bin.zst", data.data() + half, data.size() - half));
+
+		std::vector<uint8_t>& frames = memoryFS->files["frames.bin.zst"];
+		frames = memoryFS->files["first.bin.zst"];
+		frames.insert(frames.end(), memoryFS->files["second.bin.zst"].begin(), memoryFS->files["second.bin.zst"].end());
+
+		std::shared_ptr<vfs::IBlob> blob = layer.readFile("frames.bin");
+		CHECK(blob && blob->size() == data.size());
+		CHECK(memcmp(blob->data(), data.data(), data.size()) == 0);
+	}
+
+	// the lookup cache follows the last write in both directions
+	{
+		vfs::CompressionLayer layer(memoryFS);
+		CHECK(layer.writeFile("cached.txt.zst", "compressed", 10));
+		std::shared_ptr<vfs::IBlob> blob = layer.readFile("cached.txt");
+		CHECK(blob && blob->size() == 10 && memcmp(blob->data(), "compressed", 10) == 0);
+
+		CHECK(layer.writeFile("cached.txt", "plain", 5));
+		blob = layer.readFile("cached.txt");
+		CHECK(blob && blob->size() == 5 && memcmp(blob->data(), "plain", 5) == 0);
+
+		CHECK(layer.writeFile("cached.txt.zst", "compressed again", 16));
+		blob = layer.readFile("cached.txt");
+		CHECK(blob && blob->size() == 16 && memcmp(blob->data(), "compressed again", 16) == 0);
+	}
+
+	// dictionary
+	{
+		std::vector<uint8_t> samples;
+		std::vector<size_t> sampleSizes;
+		for (size_t i = 0; i < 256; i++)
+		{
+			size_t offset = (i * 7919) % (data.size() - 4096);
+			samples.insert(samples.end(), data.begin() + offset, data.begin() + offset + 1024);
+			sampleSizes.push_back(1024);
+		}
+
+		std::vector<uint8_t> dictionary(16 * 1024);
+		size_t dictionarySize = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(),
+			samples.data(), sampleSizes.data(), unsigned(sampleSizes.size()));
+		CHECK(!ZDICT_isError(dictionarySize));
+
+		vfs::CompressionLayer writer(memoryFS);
+		CHECK(!writer.addZstdDictionary(samples.data(), 1024));
+		CHECK(writer.addZstdDictionary(dictionary.data(), dictionarySize, true));
+		CHECK(writer.writeFile("small.bin.zst", data.data() + 512, 1024));
+
+		// a layer without the dictionary cannot decode the file
+		vfs::CompressionLayer reader(memoryFS);
+		CHECK(reader.readFile("small.bin") == nullptr);
+
+		CHECK(reader.addZstdDictionary(dictionary.data(), dictionarySize));
+		std::shared_ptr<vfs::IBlob> blob = reader.readFile("small.bin");
+		CHECK(blob && blob->size() == 1024);
+		CHECK(memcmp(blob->data(), data.data() + 512, 1024) == 0);
+	}
+}
+
+// Compares the compression ratio and decoding speed of LZ4 and Zstandard.
+// The asset set is a tar archive produced by scripts/lz4_tar.py, specified through the
+// DONUT_COMPRESSION_BENCHMARK_ARCHIVE environment variable, or Donut's shader sources by default.
+void benchmark_compression_formats()
+{
+	std::vector<std::vector<uint8_t>> assets;
+
+	const char* archivePath = getenv("DONUT_COMPRESSION_BENCHMARK_ARCHIVE");
+	if (archivePath)
+	{
+		auto tarFile = std::make_shared<vfs::TarFile>(archivePath);
+		CHECK(tarFile->isOpen());
+
+		vfs::CompressionLayer layer(tarFile);
+		collect_files(layer, "", assets);
+	}
+	else
+	{
+		auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+		vfs::RelativeFileSystem shaderFS(nativeFS, rpath.parent_path());
+		collect_files(shaderFS, "shaders", assets);
+		collect_files(shaderFS, "include/donut/shaders", assets);
+	}
+
+	CHECK(!assets.empty());
+
+	size_t originalSize = 0;
+	std::vector<uint8_t> samples;
+	std::vector<size_t> sampleSizes;
+	for (const auto& asset : assets)
+	{
+		originalSize += asset.size();
+		samples.insert(samples.end(), asset.begin(), asset.end());
+		sampleSizes.push_back(asset.size());
+	}
+
+	std::vector<uint8_t> dictionary(64 * 1024);
+	size_t dictionarySize = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(),
+		samples.data(), sampleSizes.data(), unsigned(sampleSizes.size()));
+	bool haveDictionary = !ZDICT_isError(dictionarySize);
+
+	printf("Compression benchmark: %d files, %zu bytes\n", int(assets.size()), originalSize);
+
+	enum class Method { LZ4, Zstd, ZstdDictionary };
+	for (Method method : { Method::LZ4, Method::Zstd, Method::ZstdDictionary })
+	{
+#ifndef DONUT_WITH_LZ4
+		if (method == Method::LZ4)
+			continue;
+#endif
+		if (method == Method::ZstdDictionary && !haveDictionary)
+		{
+			printf("  zstd+dict: dictionary training failed, skipping\n");
+			continue;
+		}
+
+		auto memoryFS = std::make_shared<MemoryFileSystem>();
+		vfs::CompressionLayer layer(memoryFS);
+		layer.setCompressionLevel(9);
+		layer.setZstdCompressionLevel(19);
+		if (method == Method::ZstdDictionary)
+			layer.addZstdDictionary(dictionary.data(), dictionarySize, true);
+
+		const char* extension = (method == Method::LZ4) ? ".lz4" : ".zst";
+		for (size_t i = 0; i < assets.size(); i++)
+			CHECK(layer.writeFile(std::to_string(i) + extension, assets[i].data(), assets[i].size()));
+
+		size_t compressedSize = memoryFS->totalSize();
+
+		constexpr int iterations = 8;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (size_t i = 0; i < assets.size(); i++)
+			{
+				std::shared_ptr<vfs::IBlob> blob = layer.readFile(std::to_string(i));
+				CHECK(blob && blob->size() == assets[i].size());
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double seconds = std::chrono::duration<double>(end - start).count();
+
+		const char* methodName = (method == Method::LZ4) ? "lz4" : (method == Method::Zstd) ? "zstd" : "zstd+dict";
+		printf("  %-10s compressed %10zu bytes, ratio %.2fx, decode %.2f GB/s\n", methodName, compressedSize,
+			double(originalSize) / double(compressedSize), double(originalSize) * iterations / seconds * 1e-9);
+	}
+}
+
+#endif // DONUT_WITH_ZSTD
+
+int main(int, char** argv)
+{
+	try
+	{
+#ifdef DONUT_WITH_LZ4
+		test_compression_layer();
+#endif
+#ifdef DONUT_WITH_ZSTD
+		test_zstd();
+		if (benchmarks_enabled())
+			benchmark_compression_formats();
+#endif
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
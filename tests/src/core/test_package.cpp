@@ -0,0 +1,195 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#include <donut/core/vfs/PackageFile.h>
+
+#include <donut/core/vfs/Compression.h>
+
+#include <donut/tests/utils.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+using namespace donut;
+
+std::filesystem::path bpath(DONUT_TEST_BINARY_DIR);
+
+static std::shared_ptr<vfs::IBlob> make_blob(std::string const& contents)
+{
+	void* data = malloc(contents.size());
+	memcpy(data, contents.data(), contents.size());
+	return std::make_shared<vfs::Blob>(data, contents.size());
+}
+
+static bool blob_equals(std::shared_ptr<vfs::IBlob> const& blob, std::string const& contents)
+{
+	return blob && blob->size() == contents.size() && memcmp(blob->data(), contents.data(), contents.size()) == 0;
+}
+
+static void check_package_file(std::filesystem::path const& root)
+{
+	std::string textData = "a small text file";
+	std::string largeData;
+	for (int i = 0; i < 10000; i++)
+		largeData += "line " + std::to_string(i % 100) + "\n";
+
+	vfs::PackageWriter writer;
+	CHECK(writer.addFile("/text/a.txt", make_blob(textData)));
+	CHECK(writer.addFile("data/b.bin", make_blob(largeData)));
+	CHECK(!writer.addFile("text/../text/a.txt", make_blob(textData)));
+
+#ifdef DONUT_WITH_LZ4
+	// produce a compressed entry through the compression layer
+	{
+		auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+		vfs::CompressionLayer compressionLayer(std::make_shared<vfs::RelativeFileSystem>(nativeFS, root));
+		CHECK(compressionLayer.writeFile("compressed.txt.lz4", largeData.data(), largeData.size()));
+
+		vfs::RelativeFileSystem rootFS(nativeFS, root);
+		CHECK(writer.addFiles(rootFS, { "compressed.txt.lz4" }) == 1);
+	}
+#endif
+
+	std::filesystem::path packagePath = root / "test.dpk";
+	CHECK(writer.write(packagePath));
+
+	auto package = std::make_shared<vfs::PackageFile>(packagePath);
+	CHECK(package->isOpen());
+
+	CHECK(package->fileExists("text/a.txt"));
+	CHECK(package->fileExists("/data/b.bin"));
+	CHECK(!package->fileExists("data/c.bin"));
+	CHECK(package->folderExists("text"));
+	CHECK(!package->folderExists("text/a.txt"));
+	CHECK(blob_equals(package->readFile("/text/a.txt"), textData));
+	CHECK(blob_equals(package->readFile("data/b.bin"), largeData));
+	CHECK(blob_equals(package->readFileRange("data/b.bin", 7, 20), largeData.substr(7, 20)));
+	CHECK(!package->readFileRange("data/b.bin", largeData.size() - 10, 11));
+	CHECK(!package->readFileRange("data/c.bin", 0, 1));
+
+	const vfs::PackageEntry* entry = package->findEntry("data/b.bin");
+	CHECK(entry);
+	CHECK(entry->offset % vfs::PackageAlignment == 0);
+	CHECK(entry->size == largeData.size());
+	CHECK(entry->compression == vfs::CompressionFormat::None);
+
+	std::vector<std::string> files;
+	CHECK(package->enumerateFiles("/text", { ".txt" }, vfs::enumerate_to_vector(files)) == 1);
+	CHECK(files.size() == 1 && files[0] == "a.txt");
+
+#ifdef DONUT_WITH_LZ4
+	entry = package->findEntry("compressed.txt");
+	CHECK(entry);
+	CHECK(entry->compression == vfs::CompressionFormat::LZ4);
+	CHECK(entry->size == largeData.size());
+	CHECK(entry->storedSize < largeData.size());
+
+	// compressed entries are visible with their extension and decompressed by the compression layer
+	CHECK(package->fileExists("compressed.txt.lz4"));
+	CHECK(!package->fileExists("compressed.txt"));
+	CHECK(!package->fileExists("compressed.txt.zst"));
+
+	vfs::CompressionLayer packageCompressionLayer(package);
+	CHECK(blob_equals(packageCompressionLayer.readFile("compressed.txt"), largeData));
+	CHECK(blob_equals(packageCompressionLayer.readFile("text/a.txt"), textData));
+
+	// ranges of uncompressed files are passed through, compressed files can't be read in ranges
+	CHECK(blob_equals(packageCompressionLayer.readFileRange("text/a.txt", 2, 5), textData.substr(2, 5)));
+	CHECK(!packageCompressionLayer.readFileRange("compressed.txt", 0, 16));
+#endif
+
+	// a truncated package must be rejected
+	{
+		std::filesystem::path truncatedPath = root / "truncated.dpk";
+		std::filesystem::copy_file(packagePath, truncatedPath, std::filesystem::copy_options::overwrite_existing);
+		std::filesystem::resize_file(truncatedPath, 100);
+		vfs::PackageFile truncated(truncatedPath);
+		CHECK(!truncated.isOpen());
+		CHECK(!truncated.fileExists("text/a.txt"));
+	}
+}
+
+// The packages are closed when check_package_file returns, so their files can be removed.
+void test_package_file()
+{
+	std::filesystem::path root = bpath / "package_test_files";
+	std::filesystem::create_directories(root);
+
+	check_package_file(root);
+
+	std::filesystem::remove_all(root);
+}
+
+static void measure_package_lookup(std::filesystem::path const& root)
+{
+	constexpr int numFiles = 20000;
+
+	vfs::PackageWriter writer;
+	for (int i = 0; i < numFiles; i++)
+		writer.addFile("dir" + std::to_string(i % 64) + "/file" + std::to_string(i) + ".bin", make_blob(std::to_string(i)));
+
+	std::filesystem::path packagePath = root / "lookup.dpk";
+	CHECK(writer.write(packagePath));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	vfs::PackageFile package(packagePath);
+	auto mounted = std::chrono::high_resolution_clock::now();
+	CHECK(package.isOpen());
+
+	int found = 0;
+	for (int i = 0; i < numFiles; i++)
+	{
+		if (package.findEntry("dir" + std::to_string(i % 64) + "/file" + std::to_string(i) + ".bin"))
+			++found;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	CHECK(found == numFiles);
+
+	printf("Package with %d files: mounted in %.2f ms, %.0f ns per lookup\n", numFiles,
+		std::chrono::duration<double, std::milli>(mounted - start).count(),
+		std::chrono::duration<double, std::nano>(end - mounted).count() / numFiles);
+}
+
+void benchmark_package_lookup()
+{
+	std::filesystem::path root = bpath / "package_benchmark_files";
+	std::filesystem::create_directories(root);
+
+	measure_package_lookup(root);
+
+	std::filesystem::remove_all(root);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_package_file();
+		if (benchmarks_enabled())
+			benchmark_package_lookup();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
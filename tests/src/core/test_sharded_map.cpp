@@ -0,0 +1,164 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/sharded_map.h>
+
+#include <donut/tests/utils.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace donut;
+
+void test_sharded_map()
+{
+	core::sharded_map<std::string, int, 8> map;
+
+	CHECK(map.empty() && map.size() == 0);
+	CHECK(map.find("a") == 0 && !map.contains("a"));
+
+	auto [value, inserted] = map.find_or_insert("a", []() { return 1; });
+	CHECK(inserted && value == 1);
+
+	std::tie(value, inserted) = map.find_or_insert("a", []() { return 2; });
+	CHECK(!inserted && value == 1);
+
+	map.insert_or_assign("b", 3);
+	map.insert_or_assign("b", 4);
+	CHECK(map.size() == 2 && map.contains("b") && map.find("b") == 4);
+
+	int erased = 0;
+	CHECK(map.erase("b", &erased) && erased == 4);
+	CHECK(!map.erase("b"));
+	CHECK(map.size() == 1);
+
+	for (int i = 0; i < 100; ++i)
+		map.insert_or_assign(std::to_string(i), i);
+
+	auto entries = map.snapshot();
+	CHECK(entries.size() == 101);
+
+	int sum = 0;
+	for (auto const& entry : entries)
+		sum += entry.first == "a" ? 0 : entry.second;
+	CHECK(sum == 99 * 100 / 2);
+
+	map.clear();
+	CHECK(map.empty());
+}
+
+// Runs 'request(key)' from many threads on overlapping keys and returns the elapsed time in ms
+template<typename Request> double run_contention(int threadCount, int requestsPerThread, int keyCount, Request&& request)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			uint32_t random = 12345u + uint32_t(t) * 7919u;
+			for (int r = 0; r < requestsPerThread; ++r)
+			{
+				random = random * 1664525u + 1013904223u;
+				request(int((random >> 8) % keyCount));
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+// Many threads requesting overlapping keys, as parallel scene loading does with texture paths:
+// every key must be created exactly once, and all threads must observe the same value.
+// With benchmarks enabled, also compares against a single map behind one shared_mutex,
+// like the texture cache used before.
+void test_sharded_map_contention()
+{
+	constexpr int threadCount = 16;
+	constexpr int keyCount = 2000;
+	const int requestsPerThread = benchmarks_enabled() ? 50000 : 2000;
+
+	std::vector<std::string> keys;
+	for (int i = 0; i < keyCount; ++i)
+		keys.push_back("media/textures/texture_" + std::to_string(i) + ".png");
+
+	core::sharded_map<std::string, std::shared_ptr<int>> map;
+	std::atomic<int> created = 0;
+	std::atomic<int> mismatches = 0;
+
+	double shardedTime = run_contention(threadCount, requestsPerThread, keyCount, [&](int key)
+	{
+		auto result = map.find_or_insert(keys[key], [&created, key]()
+		{
+			++created;
+			return std::make_shared<int>(key);
+		});
+
+		if (*result.first != key)
+			++mismatches;
+	});
+
+	if (benchmarks_enabled())
+	{
+		std::unordered_map<std::string, std::shared_ptr<int>> lockedMap;
+		std::shared_mutex lockedMapMutex;
+
+		double lockedTime = run_contention(threadCount, requestsPerThread, keyCount, [&](int key)
+		{
+			std::lock_guard<std::shared_mutex> guard(lockedMapMutex);
+			auto& value = lockedMap[keys[key]];
+			if (!value)
+				value = std::make_shared<int>(key);
+		});
+
+		printf("%d threads, %d requests over %d keys: sharded_map %.1f ms, single lock %.1f ms\n",
+			threadCount, threadCount * requestsPerThread, keyCount, shardedTime, lockedTime);
+	}
+
+	CHECK(mismatches == 0);
+	CHECK(created == int(map.size()));
+	CHECK(map.size() <= size_t(keyCount));
+
+	for (auto const& entry : map.snapshot())
+		CHECK(keys[*entry.second] == entry.first);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_sharded_map();
+		test_sharded_map_contention();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
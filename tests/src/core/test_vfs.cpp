@@ -23,7 +23,11 @@
 #include <donut/core/vfs/VFS.h>
 
 #include <donut/tests/utils.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <filesystem>
+#include <map>
 
 using namespace donut;
 
@@ -71,9 +75,35 @@ void test_native_filesystem()
 		CHECK(blob.use_count()>0);
 		CHECK(blob->size() > 0);
 
-		std::string data = (char const*)blob->data();
+		std::string data((char const*)blob->data(), blob->size());
 		CHECK(data.find("***HELLO WORLD***")!=std::string::npos);
 	}
+
+	// mapFile
+	{
+		std::shared_ptr<vfs::IBlob> blob = fs.readFile(rpath / "src/core/test_vfs.cpp");
+		std::shared_ptr<vfs::IBlob> mapped = fs.mapFile(rpath / "src/core/test_vfs.cpp");
+		CHECK(mapped && mapped->size() == blob->size());
+		CHECK(memcmp(mapped->data(), blob->data(), blob->size()) == 0);
+
+		CHECK(!fs.mapFile(rpath / "src/core/nonexistent.cpp"));
+	}
+
+	// readFileRange
+	{
+		std::shared_ptr<vfs::IBlob> blob = fs.readFile(rpath / "src/core/test_vfs.cpp");
+		std::shared_ptr<vfs::IBlob> range = fs.readFileRange(rpath / "src/core/test_vfs.cpp", 16, 100);
+		CHECK(range && range->size() == 100);
+		CHECK(memcmp(range->data(), (char const*)blob->data() + 16, 100) == 0);
+
+		// the default implementation should produce the same range
+		std::shared_ptr<vfs::IBlob> fallback = fs.IFileSystem::readFileRange(rpath / "src/core/test_vfs.cpp", 16, 100);
+		CHECK(fallback && memcmp(fallback->data(), range->data(), 100) == 0);
+
+		CHECK(!fs.readFileRange(rpath / "src/core/test_vfs.cpp", blob->size() - 10, 11));
+		CHECK(!fs.IFileSystem::readFileRange(rpath / "src/core/test_vfs.cpp", blob->size() + 1, 0));
+		CHECK(!fs.readFileRange(rpath / "src/core/nonexistent.cpp", 0, 1));
+	}
 }
 
 void test_relative_filesystem()
@@ -118,7 +148,7 @@ void test_relative_filesystem()
 		CHECK(blob.use_count() > 0);
 		CHECK(blob->size() > 0);
 
-		std::string data = (char const*)blob->data();
+		std::string data((char const*)blob->data(), blob->size());
 		CHECK(data.find("***HELLO WORLD***") != std::string::npos);
 	}
 }
@@ -167,7 +197,7 @@ void test_root_filesystem()
 		CHECK(blob.use_count() > 0);
 		CHECK(blob->size() > 0);
 
-		std::string data = (char const*)blob->data();
+		std::string data((char const*)blob->data(), blob->size());
 		CHECK(data.find("***HELLO WORLD***") != std::string::npos);
 	}
 
@@ -177,6 +207,159 @@ void test_root_filesystem()
 	CHECK(rootFS.unmount("/foo") == false);
 }
 
+// A file system that records the last requested path and answers without doing any work.
+class RecordingFileSystem : public vfs::IFileSystem
+{
+public:
+	std::filesystem::path lastPath;
+	std::shared_ptr<vfs::IBlob> blob = std::make_shared<vfs::Blob>(nullptr, 0);
+
+	bool folderExists(const std::filesystem::path& name) override { lastPath = name; return true; }
+	bool fileExists(const std::filesystem::path& name) override { lastPath = name; return true; }
+	std::shared_ptr<vfs::IBlob> readFile(const std::filesystem::path& name) override { lastPath = name; return blob; }
+	bool writeFile(const std::filesystem::path& name, const void*, size_t) override { lastPath = name; return true; }
+	int enumerateFiles(const std::filesystem::path&, const std::vector<std::string>&, vfs::enumerate_callback_t, bool) override { return 0; }
+	int enumerateDirectories(const std::filesystem::path&, vfs::enumerate_callback_t, bool) override { return 0; }
+};
+
+void test_mount_points()
+{
+	vfs::RootFileSystem rootFS;
+	auto fsA = std::make_shared<RecordingFileSystem>();
+	auto fsC = std::make_shared<RecordingFileSystem>();
+	rootFS.mount("/a", fsA);
+	rootFS.mount("/b/c/", fsC);
+
+	CHECK(rootFS.fileExists("/a/x/y.txt"));
+	CHECK(fsA->lastPath == "x/y.txt");
+
+	CHECK(rootFS.fileExists("/b/c/d.txt"));
+	CHECK(fsC->lastPath == "d.txt");
+
+	CHECK(rootFS.fileExists("/a/../b/./c/e.txt"));
+	CHECK(fsC->lastPath == "e.txt");
+
+	CHECK(rootFS.folderExists("/a"));
+	CHECK(fsA->lastPath == "");
+
+	CHECK(!rootFS.fileExists("/b/d.txt"));
+	CHECK(!rootFS.fileExists("/ab/x.txt"));
+	CHECK(!rootFS.fileExists("a/x.txt"));
+
+	// nested mount points are rejected
+	auto fsNested = std::make_shared<RecordingFileSystem>();
+	rootFS.mount("/a/nested", fsNested);
+	CHECK(rootFS.fileExists("/a/nested/x.txt"));
+	CHECK(fsA->lastPath == "nested/x.txt");
+
+	// unmounting must invalidate the cached lookups
+	CHECK(rootFS.unmount("/b/c"));
+	CHECK(!rootFS.fileExists("/b/c/d.txt"));
+	CHECK(!rootFS.unmount("/b"));
+
+	rootFS.mount("/b", fsC);
+	CHECK(rootFS.fileExists("/b/c/d.txt"));
+	CHECK(fsC->lastPath == "c/d.txt");
+}
+
+void benchmark_root_filesystem_dispatch()
+{
+	vfs::RootFileSystem rootFS;
+	auto fs = std::make_shared<RecordingFileSystem>();
+	for (const char* mountPoint : { "/shaders", "/fonts", "/config", "/cache", "/native/textures", "/native/models" })
+		rootFS.mount(mountPoint, std::make_shared<RecordingFileSystem>());
+	rootFS.mount("/media", std::make_shared<vfs::RelativeFileSystem>(fs, "/data/media"));
+
+	std::vector<std::filesystem::path> paths;
+	for (int i = 0; i < 32; i++)
+		paths.push_back("/media/textures/material_" + std::to_string(i) + "/base_color.png");
+
+	constexpr int iterations = 200000;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		CHECK(rootFS.readFile(paths[i % paths.size()]));
+	auto readEnd = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		CHECK(rootFS.fileExists(paths[i % paths.size()]));
+	auto existsEnd = std::chrono::high_resolution_clock::now();
+
+	CHECK(fs->lastPath == std::filesystem::path("/data/media/textures/material_31/base_color.png"));
+
+	printf("RootFileSystem dispatch: readFile %.0f ns, fileExists %.0f ns per call\n",
+		std::chrono::duration<double, std::nano>(readEnd - start).count() / iterations,
+		std::chrono::duration<double, std::nano>(existsEnd - readEnd).count() / iterations);
+}
+
+void test_async_reads()
+{
+	// readFileFuture
+	{
+		vfs::NativeFileSystem fs;
+
+		std::shared_ptr<vfs::IBlob> blob = fs.readFileFuture(rpath / "src/core/test_vfs.cpp").get();
+		CHECK(blob);
+		CHECK(blob->size() > 0);
+
+		std::string data((char const*)blob->data(), blob->size());
+		CHECK(data.find("***HELLO WORLD***") != std::string::npos);
+
+		CHECK(fs.readFileFuture(rpath / "dummy").get() == nullptr);
+	}
+
+	// readFilesAsync through a mount point, compared with readFile
+	{
+		vfs::RootFileSystem rootFS;
+		rootFS.mount("/tests", rpath);
+
+		std::vector<std::string> names;
+		rootFS.enumerateFiles("/tests/src/core", { ".cpp" }, vfs::enumerate_to_vector(names));
+		CHECK(!names.empty());
+		names.push_back("dummy.cpp");
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::map<std::string, std::shared_ptr<vfs::IBlob>> results;
+
+		std::vector<vfs::ReadRequest> requests;
+		for (const auto& name : names)
+		{
+			requests.push_back({ "/tests/src/core/" + name, [&, name](std::shared_ptr<vfs::IBlob> blob)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				results[name] = blob;
+				condition.notify_all();
+			} });
+		}
+		requests.push_back({ "/unmounted/file.txt", [&](std::shared_ptr<vfs::IBlob> blob)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			results["unmounted"] = blob;
+			condition.notify_all();
+		} });
+
+		rootFS.readFilesAsync(std::move(requests));
+
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [&]() { return results.size() == names.size() + 1; });
+
+		CHECK(results["dummy.cpp"] == nullptr);
+		CHECK(results["unmounted"] == nullptr);
+
+		for (const auto& name : names)
+		{
+			if (name == "dummy.cpp")
+				continue;
+
+			std::shared_ptr<vfs::IBlob> expected = rootFS.readFile("/tests/src/core/" + name);
+			const std::shared_ptr<vfs::IBlob>& actual = results[name];
+			CHECK(expected && actual);
+			CHECK(actual->size() == expected->size());
+			CHECK(memcmp(actual->data(), expected->data(), expected->size()) == 0);
+		}
+	}
+}
+
 int main(int, char** argv)
 {
 	try
@@ -184,6 +367,10 @@ int main(int, char** argv)
 		test_native_filesystem();
 		test_relative_filesystem();
 		test_root_filesystem();
+		test_mount_points();
+		test_async_reads();
+		if (benchmarks_enabled())
+			benchmark_root_filesystem_dispatch();
 	}
 	catch (const std::runtime_error & err)
 	{
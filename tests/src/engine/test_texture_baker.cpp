@@ -0,0 +1,396 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/TextureBaker.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/DDSFile.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace donut;
+using namespace donut::engine;
+
+// RGBA8 pixels, rows top to bottom
+typedef std::vector<uint8_t> Image;
+
+// Encodes an uncompressed 32-bit TGA image with a top-left origin.
+static std::vector<uint8_t> make_tga(Image const& pixels, uint16_t width, uint16_t height)
+{
+	std::vector<uint8_t> file(18 + size_t(width) * height * 4);
+	file[2] = 2; // uncompressed true-color
+	file[12] = uint8_t(width);
+	file[13] = uint8_t(width >> 8);
+	file[14] = uint8_t(height);
+	file[15] = uint8_t(height >> 8);
+	file[16] = 32;
+	file[17] = 8 | 0x20; // alpha bits, top-left origin
+
+	for (size_t i = 0; i < size_t(width) * height; i++)
+	{
+		file[18 + i * 4 + 0] = pixels[i * 4 + 2];
+		file[18 + i * 4 + 1] = pixels[i * 4 + 1];
+		file[18 + i * 4 + 2] = pixels[i * 4 + 0];
+		file[18 + i * 4 + 3] = pixels[i * 4 + 3];
+	}
+	return file;
+}
+
+static uint32_t read_u32(uint8_t const* data)
+{
+	return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+}
+
+// Reads the bits of a block starting from the least significant bit of the first byte.
+struct BlockBitReader
+{
+	uint8_t const* data;
+	uint32_t position = 0;
+
+	uint32_t Read(uint32_t bits)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < bits; i++, position++)
+			value |= uint32_t((data[position >> 3] >> (position & 7)) & 1) << i;
+		return value;
+	}
+};
+
+// The reference decoders below follow the format specifications, not the encoders.
+
+static void decode_bc1(uint8_t const* block, uint8_t* pixels)
+{
+	uint16_t const color0 = uint16_t(block[0] | block[1] << 8);
+	uint16_t const color1 = uint16_t(block[2] | block[3] << 8);
+
+	int palette[4][3];
+	for (int endpoint = 0; endpoint < 2; endpoint++)
+	{
+		uint16_t const color = endpoint ? color1 : color0;
+		int const r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+		palette[endpoint][0] = r << 3 | r >> 2;
+		palette[endpoint][1] = g << 2 | g >> 4;
+		palette[endpoint][2] = b << 3 | b >> 2;
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	uint32_t const indices = read_u32(block + 4);
+	for (int i = 0; i < 16; i++)
+	{
+		uint32_t const index = (indices >> (i * 2)) & 3;
+		for (int c = 0; c < 3; c++)
+			pixels[i * 4 + c] = uint8_t(palette[index][c]);
+		pixels[i * 4 + 3] = (color0 <= color1 && index == 3) ? 0 : 255;
+	}
+}
+
+static void decode_bc4(uint8_t const* block, uint8_t* pixels, int channel)
+{
+	int const value0 = block[0], value1 = block[1];
+
+	int palette[8] = { value0, value1 };
+	if (value0 > value1)
+	{
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * value0 + (i - 1) * value1) / 7;
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+			palette[i] = ((6 - i) * value0 + (i - 1) * value1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	BlockBitReader reader{ block + 2 };
+	for (int i = 0; i < 16; i++)
+		pixels[i * 4 + channel] = uint8_t(palette[reader.Read(3)]);
+}
+
+// Decodes a BC7 block if it uses mode 6, the only mode that the baker writes.
+static bool decode_bc7_mode6(uint8_t const* block, uint8_t* pixels)
+{
+	BlockBitReader reader{ block };
+	if (reader.Read(7) != 1u << 6)
+		return false;
+
+	int endpoints[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = int(reader.Read(7));
+		endpoints[1][c] = int(reader.Read(7));
+	}
+	int const pbit0 = int(reader.Read(1));
+	int const pbit1 = int(reader.Read(1));
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = endpoints[0][c] << 1 | pbit0;
+		endpoints[1][c] = endpoints[1][c] << 1 | pbit1;
+	}
+
+	static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	for (int i = 0; i < 16; i++)
+	{
+		// the anchor index of the first pixel has an implicit zero MSB
+		int const weight = weights[reader.Read(i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; c++)
+			pixels[i * 4 + c] = uint8_t(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+	}
+
+	return reader.position == 128;
+}
+
+static float rms_error(Image const& a, Image const& b, int firstChannel, int channelCount)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < a.size() / 4; i++)
+	{
+		for (int c = firstChannel; c < firstChannel + channelCount; c++)
+		{
+			double const error = double(a[i * 4 + c]) - double(b[i * 4 + c]);
+			sum += error * error;
+		}
+	}
+	return float(std::sqrt(sum / double(a.size() / 4 * channelCount)));
+}
+
+// Bakes a 4x4 image and returns the first block of its top mip level.
+static std::vector<uint8_t> bake_block(Image const& pixels, TextureBakeSettings const& settings, nvrhi::Format expectedFormat)
+{
+	std::vector<uint8_t> const tga = make_tga(pixels, 4, 4);
+
+	nvrhi::Format format = nvrhi::Format::UNKNOWN;
+	std::shared_ptr<vfs::IBlob> baked = BakeTexture(tga.data(), tga.size(), settings, &format);
+	CHECK(baked);
+	CHECK(format == expectedFormat);
+
+	TextureData texture;
+	texture.data = baked;
+	CHECK(LoadDDSTextureFromMemory(texture));
+	CHECK(texture.format == expectedFormat);
+	CHECK(texture.mipLevels == 3);
+
+	size_t const blockSize = (format == nvrhi::Format::BC1_UNORM || format == nvrhi::Format::BC4_UNORM) ? 8 : 16;
+	size_t const offset = texture.dataLayout[0][0].dataOffset;
+	CHECK(offset + blockSize <= baked->size());
+
+	uint8_t const* data = static_cast<uint8_t const*>(baked->data());
+	return std::vector<uint8_t>(data + offset, data + offset + blockSize);
+}
+
+enum class Pattern
+{
+	Flat,
+	Gradient,
+	TwoColor
+};
+
+static Image make_block(Pattern pattern)
+{
+	Image pixels(16 * 4);
+	for (int i = 0; i < 16; i++)
+	{
+		int const x = i % 4, y = i / 4;
+		uint8_t* pixel = &pixels[i * 4];
+		switch (pattern)
+		{
+		case Pattern::Flat:
+			pixel[0] = 180; pixel[1] = 90; pixel[2] = 40; pixel[3] = 255;
+			break;
+		case Pattern::Gradient:
+			pixel[0] = uint8_t(100 + i * 3);
+			pixel[1] = uint8_t(150 - i * 2);
+			pixel[2] = uint8_t(60 + i);
+			pixel[3] = 255;
+			break;
+		case Pattern::TwoColor: {
+			uint8_t const value = ((x + y) & 1) ? 200 : 30;
+			pixel[0] = pixel[1] = pixel[2] = value;
+			pixel[3] = 255;
+			break;
+		}
+		}
+	}
+	return pixels;
+}
+
+void test_bc7_blocks()
+{
+	TextureBakeSettings settings;
+	settings.mode = TextureBakeMode::Color;
+
+	float const maxErrors[] = { 1.f, 1.f, 1.f };
+	for (Pattern pattern : { Pattern::Flat, Pattern::Gradient, Pattern::TwoColor })
+	{
+		Image const source = make_block(pattern);
+		std::vector<uint8_t> const block = bake_block(source, settings, nvrhi::Format::BC7_UNORM);
+
+		// mode 6: six zero bits followed by a one
+		CHECK((block[0] & 0x7f) == 0x40);
+
+		Image decoded(source.size());
+		CHECK(decode_bc7_mode6(block.data(), decoded.data()));
+		CHECK(rms_error(source, decoded, 0, 4) <= maxErrors[int(pattern)]);
+	}
+
+	// translucent pixels keep their alpha
+	Image source = make_block(Pattern::Gradient);
+	for (int i = 0; i < 16; i++)
+		source[i * 4 + 3] = uint8_t(i * 16);
+
+	std::vector<uint8_t> const block = bake_block(source, settings, nvrhi::Format::BC7_UNORM);
+	Image decoded(source.size());
+	CHECK(decode_bc7_mode6(block.data(), decoded.data()));
+	CHECK(rms_error(source, decoded, 3, 1) <= 2.f);
+}
+
+void test_bc1_blocks()
+{
+	TextureBakeSettings settings;
+	settings.mode = TextureBakeMode::Color;
+	settings.preferBC1 = true;
+
+	float const maxErrors[] = { 1.5f, 4.5f, 3.f };
+	for (Pattern pattern : { Pattern::Flat, Pattern::Gradient, Pattern::TwoColor })
+	{
+		Image const source = make_block(pattern);
+		std::vector<uint8_t> const block = bake_block(source, settings, nvrhi::Format::BC1_UNORM);
+
+		// Opaque blocks must use the 4-color mode, where color0 > color1, or a single color
+		// in the 3-color mode without the transparent index.
+		uint16_t const color0 = uint16_t(block[0] | block[1] << 8);
+		uint16_t const color1 = uint16_t(block[2] | block[3] << 8);
+		CHECK(color0 > color1 || (pattern == Pattern::Flat && color0 == color1));
+
+		Image decoded(source.size());
+		decode_bc1(block.data(), decoded.data());
+		for (int i = 0; i < 16; i++)
+			CHECK(decoded[i * 4 + 3] == 255);
+		CHECK(rms_error(source, decoded, 0, 3) <= maxErrors[int(pattern)]);
+	}
+}
+
+void test_bc4_bc5_blocks()
+{
+	float const maxErrors[] = { 0.5f, 2.5f, 0.5f };
+	for (Pattern pattern : { Pattern::Flat, Pattern::Gradient, Pattern::TwoColor })
+	{
+		Image const source = make_block(pattern);
+
+		TextureBakeSettings settings;
+		settings.mode = TextureBakeMode::Mask;
+		std::vector<uint8_t> block = bake_block(source, settings, nvrhi::Format::BC4_UNORM);
+
+		Image decoded(source.size());
+		decode_bc4(block.data(), decoded.data(), 0);
+		CHECK(rms_error(source, decoded, 0, 1) <= maxErrors[int(pattern)]);
+
+		settings.mode = TextureBakeMode::NormalMap;
+		block = bake_block(source, settings, nvrhi::Format::BC5_UNORM);
+
+		decode_bc4(block.data(), decoded.data(), 0);
+		decode_bc4(block.data() + 8, decoded.data(), 1);
+		CHECK(rms_error(source, decoded, 0, 2) <= maxErrors[int(pattern)]);
+	}
+}
+
+void test_baked_file()
+{
+	uint16_t const width = 16, height = 8;
+	Image pixels(size_t(width) * height * 4);
+	for (size_t i = 0; i < pixels.size(); i += 4)
+	{
+		pixels[i + 0] = 180;
+		pixels[i + 1] = 90;
+		pixels[i + 2] = 40;
+		pixels[i + 3] = 255;
+	}
+	std::vector<uint8_t> const tga = make_tga(pixels, width, height);
+
+	TextureBakeSettings settings;
+	settings.mode = TextureBakeMode::Color;
+	settings.sRGB = true;
+
+	nvrhi::Format format = nvrhi::Format::UNKNOWN;
+	std::shared_ptr<vfs::IBlob> baked = BakeTexture(tga.data(), tga.size(), settings, &format);
+	CHECK(baked);
+	CHECK(format == nvrhi::Format::BC7_UNORM_SRGB);
+
+	// magic, DDS_HEADER with a DX10 extension, then 16x8, 8x4, 4x2, 2x1 and 1x1 levels of 16-byte blocks
+	uint8_t const* data = static_cast<uint8_t const*>(baked->data());
+	CHECK(baked->size() == 4 + 124 + 20 + (8 + 2 + 1 + 1 + 1) * 16);
+	CHECK(read_u32(data) == 0x20534444); // "DDS "
+	CHECK(read_u32(data + 4) == 124);
+	CHECK(read_u32(data + 12) == height);
+	CHECK(read_u32(data + 16) == width);
+	CHECK(read_u32(data + 28) == 5);
+	CHECK(read_u32(data + 84) == 0x30315844); // "DX10"
+	CHECK(read_u32(data + 128) == 99); // DXGI_FORMAT_BC7_UNORM_SRGB
+
+	TextureData texture;
+	texture.data = baked;
+	CHECK(LoadDDSTextureFromMemory(texture));
+	CHECK(texture.width == width && texture.height == height);
+	CHECK(texture.mipLevels == 5);
+	CHECK(texture.format == nvrhi::Format::BC7_UNORM_SRGB);
+
+	// the box filter keeps a flat image flat down to the last level
+	Image decoded(16 * 4);
+	CHECK(decode_bc7_mode6(data + texture.dataLayout[0][4].dataOffset, decoded.data()));
+	CHECK(rms_error(Image(pixels.begin(), pixels.begin() + 16 * 4), decoded, 0, 4) <= 1.f);
+
+	// the image must be decodable
+	uint8_t const garbage[16] = {};
+	CHECK(!BakeTexture(garbage, sizeof(garbage), settings));
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_bc7_blocks();
+		test_bc1_blocks();
+		test_bc4_bc5_blocks();
+		test_baked_file();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
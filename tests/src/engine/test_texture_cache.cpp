@@ -0,0 +1,218 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/DDSFile.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <filesystem>
+#include <fstream>
+
+using namespace donut;
+using namespace donut::engine;
+
+std::filesystem::path bpath(DONUT_TEST_BINARY_DIR);
+
+// Writes an uncompressed 32-bit TGA image, which stb decodes straight into an RGBA8 texture.
+static void write_tga(std::filesystem::path const& path, uint16_t width, uint16_t height)
+{
+	uint8_t header[18] = {};
+	header[2] = 2; // uncompressed true-color
+	header[12] = uint8_t(width);
+	header[13] = uint8_t(width >> 8);
+	header[14] = uint8_t(height);
+	header[15] = uint8_t(height >> 8);
+	header[16] = 32;
+	header[17] = 8; // alpha bits
+
+	std::vector<uint8_t> pixels(size_t(width) * height * 4);
+	for (size_t i = 0; i < pixels.size(); i++)
+		pixels[i] = uint8_t(i * 7);
+
+	std::ofstream file(path, std::ios::binary);
+	file.write((char const*)header, sizeof(header));
+	file.write((char const*)pixels.data(), pixels.size());
+}
+
+// Decoded images are uploaded from blobs that don't report their size, so the
+// finalization batches must be measured from the texture layout to be split at all.
+static void check_upload_batching(std::filesystem::path const& root)
+{
+	// decoding doesn't use the device, only finalization does
+	TextureCache textureCache(nullptr, std::make_shared<vfs::NativeFileSystem>(), nullptr);
+
+	std::vector<uint64_t> uploadBytes;
+	for (const char* name : { "a.tga", "b.tga", "c.tga", "d.tga" })
+	{
+		write_tga(root / name, 64, 32);
+
+		auto texture = std::static_pointer_cast<TextureData>(textureCache.LoadTextureFromFileDeferred(root / name, false));
+		CHECK(texture && texture->data);
+		CHECK(texture->format == nvrhi::Format::RGBA8_UNORM);
+
+		uploadBytes.push_back(TextureCache::GetUploadBytes(*texture));
+		CHECK(uploadBytes.back() == 64 * 32 * 4);
+	}
+
+	// a limit of one and a half images closes every second batch
+	TextureUploadBatch batch;
+	batch.maxBytes = uploadBytes[0] * 3 / 2;
+
+	CHECK(!batch.Add(uploadBytes[0]));
+	CHECK(batch.Add(uploadBytes[1]));
+	CHECK(batch.textures == 2 && batch.bytes == uploadBytes[0] + uploadBytes[1]);
+
+	batch.Clear();
+	CHECK(!batch.Add(uploadBytes[2]));
+	CHECK(batch.Add(uploadBytes[3]));
+}
+
+// Texture budgets are planned from the DDS headers alone, so the payload must not be needed.
+static void check_texture_header(std::filesystem::path const& root)
+{
+	TextureCache textureCache(nullptr, std::make_shared<vfs::NativeFileSystem>(), nullptr);
+
+	nvrhi::TextureDesc desc;
+	desc.width = 16;
+	desc.height = 8;
+	desc.mipLevels = 5;
+	desc.format = nvrhi::Format::RGBA8_UNORM;
+
+	// 16x8, 8x4, 4x2, 2x1 and 1x1 levels of 4-byte pixels
+	uint64_t const payloadBytes = (128 + 32 + 8 + 2 + 1) * 4;
+	std::vector<uint8_t> payload(payloadBytes);
+	std::shared_ptr<vfs::IBlob> dds = SaveTextureDataAsDDS(desc, payload.data(), payload.size());
+	CHECK(dds);
+
+	// only the headers are on disk
+	size_t const headerSize = dds->size() - payloadBytes;
+	{
+		std::ofstream file(root / "header.dds", std::ios::binary);
+		file.write((char const*)dds->data(), headerSize);
+	}
+
+	TextureData info;
+	uint64_t memoryBytes = 0;
+	CHECK(textureCache.ReadTextureHeader(root / "header.dds", info, memoryBytes));
+	CHECK(info.width == 16 && info.height == 8);
+	CHECK(info.mipLevels == 5);
+	CHECK(info.format == nvrhi::Format::RGBA8_UNORM);
+	CHECK(info.dataLayout[0][0].dataOffset == headerSize);
+	CHECK(memoryBytes == payloadBytes);
+
+	// other formats and missing files report nothing
+	write_tga(root / "image.tga", 4, 4);
+	CHECK(!textureCache.ReadTextureHeader(root / "image.tga", info, memoryBytes));
+	CHECK(memoryBytes == 0);
+	CHECK(!textureCache.ReadTextureHeader(root / "missing.dds", info, memoryBytes));
+}
+
+void test_texture_header()
+{
+	std::filesystem::path root = bpath / "texture_header_test_files";
+	std::filesystem::create_directories(root);
+
+	check_texture_header(root);
+
+	std::filesystem::remove_all(root);
+}
+
+// Decoded cache files are uploaded straight from the mapped file, so a corrupt layout must be rejected.
+static void check_corrupt_decoded_cache(std::filesystem::path const& root)
+{
+	std::filesystem::path const cacheDirectory = root / "decoded";
+	write_tga(root / "image.tga", 64, 32);
+
+	{
+		TextureCache textureCache(nullptr, std::make_shared<vfs::NativeFileSystem>(), nullptr);
+		textureCache.SetDecodedTextureCacheDirectory(cacheDirectory);
+
+		auto texture = std::static_pointer_cast<TextureData>(textureCache.LoadTextureFromFileDeferred(root / "image.tga", false));
+		CHECK(texture && texture->data);
+		CHECK(textureCache.GetDecodedCacheStats().bytesWritten > 0);
+	}
+
+	std::filesystem::path cacheFile;
+	for (auto const& entry : std::filesystem::directory_iterator(cacheDirectory))
+	{
+		if (entry.path().extension() == ".dtex")
+			cacheFile = entry.path();
+	}
+	CHECK(!cacheFile.empty());
+
+	// The row pitch of mip 0 follows the 32-byte file header and the data offset of the mip.
+	// A pitch wider than the image would make the upload read past the end of the file.
+	{
+		std::fstream file(cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+		uint64_t const rowPitch = 1 << 20;
+		file.seekp(32 + 8);
+		file.write((char const*)&rowPitch, sizeof(rowPitch));
+	}
+
+	{
+		TextureCache textureCache(nullptr, std::make_shared<vfs::NativeFileSystem>(), nullptr);
+		textureCache.SetDecodedTextureCacheDirectory(cacheDirectory);
+
+		auto texture = std::static_pointer_cast<TextureData>(textureCache.LoadTextureFromFileDeferred(root / "image.tga", false));
+		CHECK(texture && texture->data);
+		CHECK(textureCache.GetDecodedCacheStats().hits == 0);
+		CHECK(textureCache.GetDecodedCacheStats().misses == 1);
+		CHECK(texture->dataLayout[0][0].rowPitch == 64 * 4);
+	}
+}
+
+void test_decoded_cache_validation()
+{
+	std::filesystem::path root = bpath / "decoded_cache_test_files";
+	std::filesystem::create_directories(root);
+
+	check_corrupt_decoded_cache(root);
+
+	std::filesystem::remove_all(root);
+}
+
+void test_upload_batching()
+{
+	std::filesystem::path root = bpath / "texture_cache_test_files";
+	std::filesystem::create_directories(root);
+
+	check_upload_batching(root);
+
+	std::filesystem::remove_all(root);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_upload_batching();
+		test_texture_header();
+		test_decoded_cache_validation();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
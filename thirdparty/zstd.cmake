@@ -0,0 +1,38 @@
+#
+# Copyright (c) 2014-2020, NVIDIA CORPORATION. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+
+file(GLOB zstd_src
+    "zstd/lib/common/*.c"
+    "zstd/lib/common/*.h"
+    "zstd/lib/compress/*.c"
+    "zstd/lib/compress/*.h"
+    "zstd/lib/decompress/*.c"
+    "zstd/lib/decompress/*.h"
+    "zstd/lib/dictBuilder/*.c"
+    "zstd/lib/dictBuilder/*.h"
+)
+
+add_library(zstd STATIC EXCLUDE_FROM_ALL ${zstd_src})
+target_include_directories(zstd INTERFACE zstd/lib)
+
+# the assembly version of the Huffman decoder is not part of the source list above
+target_compile_definitions(zstd PRIVATE ZSTD_DISABLE_ASM)
@@ -0,0 +1,557 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// Renders a scene into a G-buffer on a headless device for a fixed number of frames, with the camera
+// following a recorded path, and writes the CPU time of each frame stage as JSON or CSV.
+// Runs on any Vulkan implementation, including software ones like lavapipe or SwiftShader.
+//
+// Usage: donut_bench [options] <scene file>
+//   -vk, -dx12, -dx11      Graphics API, see app::GetGraphicsAPIFromCommandLine
+//   --frames <n>           Number of measured frames, 300 by default
+//   --warmup <n>           Number of frames rendered before the measured ones, 30 by default
+//   --size <w> <h>         Render target size, 1920x1080 by default
+//   --camera-path <file>   Camera path, see below. Without a path, the first scene camera is used,
+//                          or the camera orbits around the scene if there are no scene cameras
+//   --fps <n>              Animation frames per second, the scene time advances by 1/fps per frame
+//   --shaders <dir>        Directory with the compiled Donut shaders for the API
+//   --json <file>          Writes the frame timings and their summary as JSON
+//   --csv <file>           Writes the frame timings as CSV
+//   --trace <file>         Writes the profiler zones of the last frames as a Chrome trace
+//
+// The camera path is a JSON file with keyframes of the camera position and the point it looks at:
+//   { "mode": "spline", "keyframes": [ { "time": 0, "position": [0, 1, 5], "target": [0, 1, 0] }, ... ] }
+// The mode is "step", "linear" or "spline". The path is played at the animation time and loops.
+
+#include <donut/app/ApplicationBase.h>
+#include <donut/app/Camera.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/app/Timer.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/KeyframeAnimation.h>
+#include <donut/engine/Profiler.h>
+#include <donut/engine/Scene.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/View.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/render/GBuffer.h>
+#include <donut/render/GBufferFillPass.h>
+#include <donut/core/json.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <json/value.h>
+#include <nvrhi/utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace donut;
+using namespace donut::math;
+
+namespace
+{
+    struct BenchOptions
+    {
+        std::filesystem::path sceneFile;
+        std::filesystem::path cameraPathFile;
+        std::filesystem::path shaderDirectory;
+        std::filesystem::path jsonFile;
+        std::filesystem::path csvFile;
+        std::filesystem::path traceFile;
+        uint32_t frames = 300;
+        uint32_t warmupFrames = 30;
+        uint2 size = uint2(1920, 1080);
+        float fps = 60.f;
+    };
+
+    struct FrameTimings
+    {
+        double sceneRefreshMs = 0.0;
+        double cullingMs = 0.0;
+        double recordingMs = 0.0;
+        double submissionMs = 0.0;
+        double gpuWaitMs = 0.0;
+        double frameMs = 0.0;
+        size_t drawItems = 0;
+    };
+
+    // Field names and accessors, in the order of the CSV columns
+    struct TimingField
+    {
+        const char* name;
+        double FrameTimings::* value;
+    };
+
+    const TimingField c_TimingFields[] = {
+        { "sceneRefreshMs", &FrameTimings::sceneRefreshMs },
+        { "cullingMs", &FrameTimings::cullingMs },
+        { "recordingMs", &FrameTimings::recordingMs },
+        { "submissionMs", &FrameTimings::submissionMs },
+        { "gpuWaitMs", &FrameTimings::gpuWaitMs },
+        { "frameMs", &FrameTimings::frameMs },
+    };
+
+    class CameraPath
+    {
+    private:
+        engine::animation::Sequence m_Sequence;
+
+    public:
+        bool Load(vfs::IFileSystem& fs, const std::filesystem::path& fileName)
+        {
+            Json::Value root;
+            if (!json::LoadFromFile(fs, fileName, root))
+                return false;
+
+            auto position = std::make_shared<engine::animation::Sampler>();
+            auto target = std::make_shared<engine::animation::Sampler>();
+
+            engine::animation::InterpolationMode mode = engine::animation::InterpolationMode::CatmullRomSpline;
+            const std::string modeName = json::Read<std::string>(root["mode"], "spline");
+            if (modeName == "step")
+                mode = engine::animation::InterpolationMode::Step;
+            else if (modeName == "linear")
+                mode = engine::animation::InterpolationMode::Linear;
+
+            position->SetInterpolationMode(mode);
+            target->SetInterpolationMode(mode);
+
+            for (const Json::Value& keyframeNode : root["keyframes"])
+            {
+                engine::animation::Keyframe keyframe;
+                keyframe.time = json::Read<float>(keyframeNode["time"], 0.f);
+
+                keyframe.value = float4(json::Read<float3>(keyframeNode["position"], float3(0.f)), 0.f);
+                position->AddKeyframe(keyframe);
+
+                keyframe.value = float4(json::Read<float3>(keyframeNode["target"], float3(0.f, 0.f, 1.f)), 0.f);
+                target->AddKeyframe(keyframe);
+            }
+
+            if (position->GetKeyframes().empty())
+            {
+                log::error("Camera path '%s' has no keyframes", fileName.generic_string().c_str());
+                return false;
+            }
+
+            SetTracks(position, target);
+            return true;
+        }
+
+        // A circle around the scene bounds at the height of their center, one revolution in 'duration' seconds
+        void CreateOrbit(const box3& bounds, float duration)
+        {
+            auto position = std::make_shared<engine::animation::Sampler>();
+            auto target = std::make_shared<engine::animation::Sampler>();
+            position->SetInterpolationMode(engine::animation::InterpolationMode::CatmullRomSpline);
+            target->SetInterpolationMode(engine::animation::InterpolationMode::Step);
+
+            const float3 center = bounds.isempty() ? float3(0.f) : bounds.center();
+            const float radius = bounds.isempty() ? 5.f : length(bounds.diagonal()) * 0.5f;
+
+            const int steps = 16;
+            for (int step = 0; step <= steps; step++)
+            {
+                const float angle = 2.f * PI_f * float(step) / float(steps);
+
+                engine::animation::Keyframe keyframe;
+                keyframe.time = duration * float(step) / float(steps);
+                keyframe.value = float4(center + float3(cosf(angle), 0.25f, sinf(angle)) * radius, 0.f);
+                position->AddKeyframe(keyframe);
+
+                keyframe.value = float4(center, 0.f);
+                target->AddKeyframe(keyframe);
+            }
+
+            SetTracks(position, target);
+        }
+
+        void SetTracks(const std::shared_ptr<engine::animation::Sampler>& position, const std::shared_ptr<engine::animation::Sampler>& target)
+        {
+            m_Sequence.AddTrack("position", position);
+            m_Sequence.AddTrack("target", target);
+        }
+
+        void Apply(app::FirstPersonCamera& camera, float time)
+        {
+            const float duration = m_Sequence.GetDuration();
+            if (duration > 0.f)
+                time = fmodf(time, duration);
+
+            std::optional<float4> position = m_Sequence.Evaluate("position", time, true);
+            std::optional<float4> target = m_Sequence.Evaluate("target", time, true);
+
+            if (position.has_value() && target.has_value())
+                camera.LookAt(position->xyz(), target->xyz());
+        }
+    };
+}
+
+static bool ParseCommandLine(int argc, const char* const* argv, BenchOptions& options)
+{
+    for (int n = 1; n < argc; n++)
+    {
+        const char* arg = argv[n];
+
+        if (!strcmp(arg, "-vk") || !strcmp(arg, "-vulkan") || !strcmp(arg, "-dx11") || !strcmp(arg, "-d3d11") ||
+            !strcmp(arg, "-dx12") || !strcmp(arg, "-d3d12"))
+            continue; // handled by app::GetGraphicsAPIFromCommandLine
+        else if (!strcmp(arg, "--frames") && n + 1 < argc)
+            options.frames = uint32_t(std::max(atoi(argv[++n]), 1));
+        else if (!strcmp(arg, "--warmup") && n + 1 < argc)
+            options.warmupFrames = uint32_t(std::max(atoi(argv[++n]), 0));
+        else if (!strcmp(arg, "--size") && n + 2 < argc)
+        {
+            options.size.x = uint32_t(std::max(atoi(argv[++n]), 1));
+            options.size.y = uint32_t(std::max(atoi(argv[++n]), 1));
+        }
+        else if (!strcmp(arg, "--fps") && n + 1 < argc)
+            options.fps = std::max(float(atof(argv[++n])), 1.f);
+        else if (!strcmp(arg, "--camera-path") && n + 1 < argc)
+            options.cameraPathFile = argv[++n];
+        else if (!strcmp(arg, "--shaders") && n + 1 < argc)
+            options.shaderDirectory = argv[++n];
+        else if (!strcmp(arg, "--json") && n + 1 < argc)
+            options.jsonFile = argv[++n];
+        else if (!strcmp(arg, "--csv") && n + 1 < argc)
+            options.csvFile = argv[++n];
+        else if (!strcmp(arg, "--trace") && n + 1 < argc)
+            options.traceFile = argv[++n];
+        else if (arg[0] == '-')
+        {
+            log::error("Unknown option '%s'", arg);
+            return false;
+        }
+        else
+            options.sceneFile = arg;
+    }
+
+    return !options.sceneFile.empty();
+}
+
+static double Percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+        return 0.0;
+
+    const size_t index = std::min(size_t(fraction * double(values.size())), values.size() - 1);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static bool WriteJson(vfs::IFileSystem& fs, const std::filesystem::path& fileName, const BenchOptions& options,
+    const char* renderer, const std::vector<FrameTimings>& frames)
+{
+    Json::Value root;
+    root["scene"] = options.sceneFile.generic_string();
+    root["renderer"] = renderer;
+    root["width"] = options.size.x;
+    root["height"] = options.size.y;
+    root["warmupFrames"] = options.warmupFrames;
+
+    Json::Value& summary = root["summary"];
+    for (const TimingField& field : c_TimingFields)
+    {
+        std::vector<double> values;
+        values.reserve(frames.size());
+        for (const FrameTimings& frame : frames)
+            values.push_back(frame.*field.value);
+
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+
+        Json::Value& node = summary[field.name];
+        node["average"] = values.empty() ? 0.0 : sum / double(values.size());
+        node["median"] = Percentile(values, 0.5);
+        node["p95"] = Percentile(values, 0.95);
+        node["max"] = values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+    }
+
+    Json::Value& framesNode = root["frames"];
+    framesNode = Json::Value(Json::arrayValue);
+    for (const FrameTimings& frame : frames)
+    {
+        Json::Value node;
+        for (const TimingField& field : c_TimingFields)
+            node[field.name] = frame.*field.value;
+        node["drawItems"] = Json::UInt64(frame.drawItems);
+        framesNode.append(node);
+    }
+
+    const std::string text = root.toStyledString();
+    return fs.writeFile(fileName, text.data(), text.size());
+}
+
+static bool WriteCsv(vfs::IFileSystem& fs, const std::filesystem::path& fileName, const std::vector<FrameTimings>& frames)
+{
+    std::stringstream ss;
+    ss << "frame";
+    for (const TimingField& field : c_TimingFields)
+        ss << "," << field.name;
+    ss << ",drawItems\n";
+
+    for (size_t index = 0; index < frames.size(); index++)
+    {
+        ss << index;
+        for (const TimingField& field : c_TimingFields)
+            ss << "," << frames[index].*field.value;
+        ss << "," << frames[index].drawItems << "\n";
+    }
+
+    const std::string text = ss.str();
+    return fs.writeFile(fileName, text.data(), text.size());
+}
+
+static double ElapsedMilliseconds(app::HiResTimer& timer)
+{
+    timer.Stop();
+    double result = timer.Milliseconds();
+    timer.Start();
+    return result;
+}
+
+static int RunBenchmark(app::DeviceManager& deviceManager, const BenchOptions& options)
+{
+    nvrhi::IDevice* device = deviceManager.GetDevice();
+    const nvrhi::GraphicsAPI api = device->getGraphicsAPI();
+
+    auto nativeFs = std::make_shared<vfs::NativeFileSystem>();
+
+    std::filesystem::path shaderDirectory = options.shaderDirectory;
+    if (shaderDirectory.empty())
+    {
+        shaderDirectory = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(api);
+#ifdef DONUT_BENCH_SHADER_DIR
+        if (!nativeFs->folderExists(shaderDirectory))
+            shaderDirectory = std::filesystem::path(DONUT_BENCH_SHADER_DIR) / app::GetShaderTypeName(api);
+#endif
+    }
+
+    auto rootFs = std::make_shared<vfs::RootFileSystem>();
+    rootFs->mount("/shaders/donut", shaderDirectory);
+
+    auto shaderFactory = std::make_shared<engine::ShaderFactory>(device, rootFs, "/shaders");
+    auto commonPasses = std::make_shared<engine::CommonRenderPasses>(device, shaderFactory);
+    auto textureCache = std::make_shared<engine::TextureCache>(device, nativeFs, nullptr);
+
+    app::HiResTimer timer;
+    timer.Start();
+
+    auto scene = std::make_shared<engine::Scene>(device, *shaderFactory, nativeFs, textureCache, nullptr, nullptr);
+    if (!scene->Load(options.sceneFile))
+    {
+        log::error("Couldn't load scene '%s'", options.sceneFile.generic_string().c_str());
+        return 1;
+    }
+
+    textureCache->ProcessRenderingThreadCommands(*commonPasses, 0.f);
+    textureCache->LoadingFinished();
+    scene->FinishedLoading(0);
+
+    log::info("Loaded '%s' in %.1f ms", options.sceneFile.generic_string().c_str(), ElapsedMilliseconds(timer));
+
+    const std::shared_ptr<engine::SceneGraphNode>& rootNode = scene->GetSceneGraph()->GetRootNode();
+
+    app::SwitchableCamera camera;
+    CameraPath cameraPath;
+    bool useCameraPath = true;
+
+    if (!options.cameraPathFile.empty())
+    {
+        if (!cameraPath.Load(*nativeFs, options.cameraPathFile))
+            return 1;
+    }
+    else if (!scene->GetSceneGraph()->GetCameras().empty())
+    {
+        camera.SwitchToSceneCamera(scene->GetSceneGraph()->GetCameras()[0]);
+        useCameraPath = false;
+    }
+    else
+        cameraPath.CreateOrbit(rootNode->GetGlobalBoundingBox(), 10.f);
+
+    render::GBufferRenderTargets gbuffer;
+    gbuffer.Init(device, options.size, 1, false, true);
+
+    render::GBufferFillPass gbufferPass(device, commonPasses);
+    gbufferPass.Init(*shaderFactory, render::GBufferFillPass::CreateParameters());
+    render::GBufferFillPass::Context passContext;
+
+    render::InstancedOpaqueDrawStrategy drawStrategy;
+    render::PassthroughDrawStrategy passthroughStrategy;
+    std::vector<render::DrawItem> drawItems;
+
+    engine::PlanarView view;
+    engine::PlanarView viewPrevious;
+    view.SetViewport(nvrhi::Viewport(float(options.size.x), float(options.size.y)));
+
+    nvrhi::CommandListHandle commandList = device->createCommandList();
+
+    engine::Profiler profiler(device);
+    profiler.SetEnabled(!options.traceFile.empty());
+    engine::Profiler::SetActive(&profiler);
+
+    std::vector<FrameTimings> frames;
+    frames.reserve(options.frames);
+
+    const uint32_t totalFrames = options.warmupFrames + options.frames;
+    for (uint32_t frameIndex = 0; frameIndex < totalFrames; frameIndex++)
+    {
+        profiler.BeginFrame();
+
+        FrameTimings timings;
+        app::HiResTimer frameTimer;
+        frameTimer.Start();
+        timer.Start();
+
+        const float time = float(frameIndex) / options.fps;
+        for (const auto& animation : scene->GetSceneGraph()->GetAnimations())
+        {
+            const float duration = animation->GetDuration();
+            (void)animation->Apply(duration > 0.f ? fmodf(time, duration) : 0.f);
+        }
+
+        if (useCameraPath)
+            cameraPath.Apply(camera.GetFirstPersonCamera(), time);
+
+        commandList->open();
+        scene->Refresh(commandList, frameIndex + 1);
+        timings.sceneRefreshMs = ElapsedMilliseconds(timer);
+
+        float verticalFov = radians(60.f);
+        float zNear = 0.01f;
+        camera.GetSceneCameraProjectionParams(verticalFov, zNear);
+
+        view.SetMatrices(camera.GetWorldToViewMatrix(),
+            perspProjD3DStyleReverse(verticalFov, float(options.size.x) / float(options.size.y), zNear));
+        view.UpdateCache();
+        if (frameIndex == 0)
+            viewPrevious = view;
+
+        {
+            DONUT_PROFILE_CPU("Culling");
+
+            drawItems.clear();
+            drawStrategy.PrepareForView(rootNode, view);
+            while (const render::DrawItem* item = drawStrategy.GetNextItem())
+                drawItems.push_back(*item);
+        }
+        timings.cullingMs = ElapsedMilliseconds(timer);
+        timings.drawItems = drawItems.size();
+
+        gbuffer.Clear(commandList);
+        passthroughStrategy.SetData(drawItems.data(), drawItems.size());
+        render::RenderView(commandList, &view, &viewPrevious, gbuffer.GBufferFramebuffer->GetFramebuffer(view),
+            passthroughStrategy, gbufferPass, passContext);
+        commandList->close();
+        timings.recordingMs = ElapsedMilliseconds(timer);
+
+        device->executeCommandList(commandList);
+        timings.submissionMs = ElapsedMilliseconds(timer);
+
+        // Waiting every frame keeps the stages of different frames from overlapping in the measurements
+        device->waitForIdle();
+        device->runGarbageCollection();
+        timings.gpuWaitMs = ElapsedMilliseconds(timer);
+
+        frameTimer.Stop();
+        timings.frameMs = frameTimer.Milliseconds();
+
+        viewPrevious = view;
+        profiler.EndFrame();
+
+        if (frameIndex >= options.warmupFrames)
+            frames.push_back(timings);
+    }
+
+    engine::Profiler::SetActive(nullptr);
+
+    double totalMs = 0.0;
+    for (const FrameTimings& frame : frames)
+        totalMs += frame.frameMs;
+
+    log::info("%s: %u frames at %ux%u, %.3f ms per frame on average", deviceManager.GetRendererString(),
+        uint32_t(frames.size()), options.size.x, options.size.y, frames.empty() ? 0.0 : totalMs / double(frames.size()));
+
+    int result = 0;
+
+    if (!options.jsonFile.empty() && !WriteJson(*nativeFs, options.jsonFile, options, deviceManager.GetRendererString(), frames))
+    {
+        log::error("Couldn't write '%s'", options.jsonFile.generic_string().c_str());
+        result = 1;
+    }
+
+    if (!options.csvFile.empty() && !WriteCsv(*nativeFs, options.csvFile, frames))
+    {
+        log::error("Couldn't write '%s'", options.csvFile.generic_string().c_str());
+        result = 1;
+    }
+
+    if (!options.traceFile.empty() && !profiler.WriteChromeTrace(*nativeFs, options.traceFile))
+        result = 1;
+
+    return result;
+}
+
+int main(int argc, const char* const* argv)
+{
+    log::ConsoleApplicationMode();
+
+    BenchOptions options;
+    if (!ParseCommandLine(argc, argv, options))
+    {
+        log::info("Usage: donut_bench [-vk | -dx12 | -dx11] [--frames <n>] [--warmup <n>] [--size <w> <h>] [--fps <n>] "
+            "[--camera-path <file>] [--shaders <dir>] [--json <file>] [--csv <file>] [--trace <file>] <scene file>");
+        return 1;
+    }
+
+    const nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(argc, argv);
+    app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
+
+    app::DeviceCreationParameters deviceParams;
+    deviceParams.backBufferWidth = options.size.x;
+    deviceParams.backBufferHeight = options.size.y;
+#ifdef _DEBUG
+    deviceParams.enableDebugRuntime = true;
+    deviceParams.enableNvrhiValidationLayer = true;
+#endif
+
+    if (!deviceManager->CreateHeadlessDevice(deviceParams))
+    {
+        log::error("Couldn't create a headless %s device", nvrhi::utils::GraphicsAPIToString(api));
+        delete deviceManager;
+        return 1;
+    }
+
+    int result = RunBenchmark(*deviceManager, options);
+
+    deviceManager->Shutdown();
+    delete deviceManager;
+
+    return result;
+}
@@ -0,0 +1,250 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// Bakes images into block compressed DDS files with full mip chains, stored in the
+// content-addressed cache directories that TextureCache checks before decoding an image.
+//
+// Usage: donut_texture_baker [options] <image or directory>...
+//   --srgb          Only bake the variant for images loaded as sRGB (color textures)
+//   --linear        Only bake the variant for images loaded as linear data
+//   --mode <mode>   auto, color, normal or mask; see TextureBakeMode. In auto mode, the linear
+//                   variant of images with "normal" in their name is baked as a normal map.
+//   --bc1           Use BC1 instead of BC7 for opaque color images
+//   --force         Bake even if the baked file already exists
+//   --threads <n>   Number of worker threads, defaults to the number of CPU cores
+
+#include <donut/engine/TextureBaker.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace donut;
+
+namespace
+{
+    struct BakeOptions
+    {
+        bool bakeSrgb = true;
+        bool bakeLinear = true;
+        bool force = false;
+        bool preferBC1 = false;
+        engine::TextureBakeMode mode = engine::TextureBakeMode::Auto;
+        unsigned int threads = 0;
+    };
+
+    struct BakeStatistics
+    {
+        std::atomic<uint32_t> baked = 0;
+        std::atomic<uint32_t> skipped = 0;
+        std::atomic<uint32_t> failed = 0;
+        std::atomic<uint64_t> sourceBytes = 0;
+        std::atomic<uint64_t> bakedBytes = 0;
+    };
+}
+
+static const std::vector<std::string> c_ImageExtensions = { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".gif" };
+
+static bool IsImageFile(const std::filesystem::path& path)
+{
+    std::string extension = path.extension().generic_string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+    return std::find(c_ImageExtensions.begin(), c_ImageExtensions.end(), extension) != c_ImageExtensions.end();
+}
+
+static bool LooksLikeNormalMap(const std::filesystem::path& path)
+{
+    std::string name = path.filename().generic_string();
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) { return char(tolower(c)); });
+    return name.find("normal") != std::string::npos;
+}
+
+static void BakeVariant(vfs::IFileSystem& fs, const std::filesystem::path& path, const vfs::IBlob& sourceData,
+    bool sRGB, const BakeOptions& options, BakeStatistics& stats)
+{
+    std::filesystem::path bakedPath = engine::GetBakedTexturePath(path, sourceData.data(), sourceData.size(), sRGB);
+
+    if (!options.force && fs.fileExists(bakedPath))
+    {
+        ++stats.skipped;
+        return;
+    }
+
+    engine::TextureBakeSettings settings;
+    settings.mode = options.mode;
+    settings.sRGB = sRGB;
+    settings.preferBC1 = options.preferBC1;
+
+    if (settings.mode == engine::TextureBakeMode::Auto && !sRGB && LooksLikeNormalMap(path))
+        settings.mode = engine::TextureBakeMode::NormalMap;
+
+    std::shared_ptr<vfs::IBlob> baked = engine::BakeTexture(sourceData.data(), sourceData.size(), settings);
+    if (!baked)
+    {
+        log::warning("Couldn't bake '%s'", path.generic_string().c_str());
+        ++stats.failed;
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(bakedPath.parent_path(), error);
+
+    if (!fs.writeFile(bakedPath, baked->data(), baked->size()))
+    {
+        log::warning("Couldn't write '%s'", bakedPath.generic_string().c_str());
+        ++stats.failed;
+        return;
+    }
+
+    log::info("%s -> %s", path.generic_string().c_str(), bakedPath.filename().generic_string().c_str());
+
+    ++stats.baked;
+    stats.sourceBytes += sourceData.size();
+    stats.bakedBytes += baked->size();
+}
+
+static bool ParseCommandLine(int argc, const char* const* argv, BakeOptions& options, std::vector<std::filesystem::path>& inputs)
+{
+    for (int n = 1; n < argc; n++)
+    {
+        const char* arg = argv[n];
+
+        if (!strcmp(arg, "--srgb"))
+            options.bakeLinear = false;
+        else if (!strcmp(arg, "--linear"))
+            options.bakeSrgb = false;
+        else if (!strcmp(arg, "--bc1"))
+            options.preferBC1 = true;
+        else if (!strcmp(arg, "--force"))
+            options.force = true;
+        else if (!strcmp(arg, "--threads") && n + 1 < argc)
+            options.threads = unsigned(std::max(atoi(argv[++n]), 1));
+        else if (!strcmp(arg, "--mode") && n + 1 < argc)
+        {
+            const char* mode = argv[++n];
+            if (!strcmp(mode, "auto"))
+                options.mode = engine::TextureBakeMode::Auto;
+            else if (!strcmp(mode, "color"))
+                options.mode = engine::TextureBakeMode::Color;
+            else if (!strcmp(mode, "normal"))
+                options.mode = engine::TextureBakeMode::NormalMap;
+            else if (!strcmp(mode, "mask"))
+                options.mode = engine::TextureBakeMode::Mask;
+            else
+            {
+                log::error("Unknown bake mode '%s'", mode);
+                return false;
+            }
+        }
+        else if (arg[0] == '-')
+        {
+            log::error("Unknown option '%s'", arg);
+            return false;
+        }
+        else
+            inputs.push_back(arg);
+    }
+
+    if (!options.bakeSrgb && !options.bakeLinear)
+    {
+        log::error("--srgb and --linear are mutually exclusive");
+        return false;
+    }
+
+    return !inputs.empty();
+}
+
+int main(int argc, const char* const* argv)
+{
+    log::ConsoleApplicationMode();
+
+    BakeOptions options;
+    std::vector<std::filesystem::path> inputs;
+
+    if (!ParseCommandLine(argc, argv, options, inputs))
+    {
+        log::info("Usage: donut_texture_baker [--srgb | --linear] [--mode auto|color|normal|mask] [--bc1] [--force] [--threads <n>] <image or directory>...");
+        return 1;
+    }
+
+    std::vector<std::filesystem::path> files;
+    for (const std::filesystem::path& input : inputs)
+    {
+        std::error_code error;
+        if (std::filesystem::is_directory(input, error))
+        {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(input, error))
+            {
+                // Don't descend into the caches made by earlier runs
+                if (entry.is_regular_file() && IsImageFile(entry.path()) && entry.path().parent_path().filename() != ".baked")
+                    files.push_back(entry.path());
+            }
+        }
+        else if (std::filesystem::is_regular_file(input, error))
+            files.push_back(input);
+        else
+            log::warning("'%s' is not a file or directory", input.generic_string().c_str());
+    }
+
+    vfs::NativeFileSystem fs;
+    BakeStatistics stats;
+    std::atomic<size_t> nextFile = 0;
+
+    auto worker = [&]()
+    {
+        for (size_t index = nextFile++; index < files.size(); index = nextFile++)
+        {
+            const std::filesystem::path& path = files[index];
+
+            std::shared_ptr<vfs::IBlob> sourceData = fs.readFile(path);
+            if (!sourceData)
+            {
+                log::warning("Couldn't read '%s'", path.generic_string().c_str());
+                ++stats.failed;
+                continue;
+            }
+
+            if (options.bakeSrgb)
+                BakeVariant(fs, path, *sourceData, true, options, stats);
+            if (options.bakeLinear)
+                BakeVariant(fs, path, *sourceData, false, options, stats);
+        }
+    };
+
+    unsigned int threadCount = options.threads ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadCount; i++)
+        threads.emplace_back(worker);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    log::info("Baked %u, up to date %u, failed %u. %.1f MB of images baked into %.1f MB",
+        stats.baked.load(), stats.skipped.load(), stats.failed.load(),
+        double(stats.sourceBytes.load()) / (1024.0 * 1024.0), double(stats.bakedBytes.load()) / (1024.0 * 1024.0));
+
+    return stats.failed > 0 ? 1 : 0;
+}